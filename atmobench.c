@@ -0,0 +1,687 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the standalone benchmark of the DFAtmo image analyze, color filter and color output engine.
+ * It runs synthetic and recorded (PNM or record file) frames through every stage of the engine using
+ * the "null" output driver and reports the time spent per pixel and per channel.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+#include "atmoreplay.h"
+
+#define NUM_VARIANTS        4       /* Number of different frames per frame kind */
+#define MIN_RUN_TIME        2000000 /* Minimum duration of one measuring run [ns] */
+#define DEFAULT_RUNS        7       /* Default number of measuring runs per stage */
+#define MAX_FRAME_KINDS     16
+
+
+typedef struct {
+  const char *name;
+  int top, bottom, left, right, center, top_left, top_right, bottom_left, bottom_right;
+} bench_layout_t;
+
+static const bench_layout_t bench_layouts[] = {
+  { "4ch",      1,   1,   1,   1, 0, 0, 0, 0, 0 },
+  { "classic",  1,   1,   1,   1, 1, 0, 0, 0, 0 },
+  { "16ch",     5,   5,   3,   3, 0, 0, 0, 0, 0 },
+  { "42ch",    12,  12,   7,   7, 0, 1, 1, 1, 1 },
+  { "128ch",   40,  40,  22,  22, 0, 1, 1, 1, 1 },
+  { "max",     MAX_BORDER_CHANNELS, MAX_BORDER_CHANNELS, MAX_BORDER_CHANNELS, MAX_BORDER_CHANNELS, 1, 1, 1, 1, 1 },
+  { NULL }
+};
+
+typedef struct {
+  const char *name;
+  int hue_win_size, sat_win_size;
+} bench_window_t;
+
+static const bench_window_t bench_windows[] = {
+  { "win0", 0, 0 },
+  { "win3", 3, 3 },
+  { "win5", 5, 5 },
+  { NULL }
+};
+
+typedef struct {
+  const char *name;
+  int filter, filter_delay, gamma, wc, fine_colors;
+} bench_filter_t;
+
+static const bench_filter_t bench_filters[] = {
+  { "off",        FILTER_NONE,       0, 10, 255, 0 },
+  { "percent",    FILTER_PERCENTAGE, 0, 10, 255, 0 },
+  { "combined",   FILTER_COMBINED,   0, 10, 255, 0 },
+  { "comb+delay", FILTER_COMBINED, 200, 10, 255, 0 },
+  { "comb+gamma", FILTER_COMBINED,   0, 25, 200, 0 },
+  { "comb+fine",  FILTER_COMBINED, 200, 25, 200, 1 },
+  { NULL }
+};
+
+enum { ST_HSV, ST_WEIGHT, ST_HUE_HIST, ST_W_HUE_HIST, ST_MOST_USED_HUE, ST_SAT_HIST, ST_W_SAT_HIST, ST_MOST_USED_SAT,
+       ST_AVG_BRIGHT, ST_UNIFORM_BRIGHT, ST_RGB_VALUES, ST_FILTERS, ST_DELAY_FILTER, ST_GAMMA, ST_WHITE_CAL, ST_OUTPUT, NUM_STAGES };
+
+enum { PER_PIXEL, PER_CHANNEL };
+
+static const struct { const char *name; int unit; } stage_desc[NUM_STAGES] = {
+  { "rgb_to_hsv",                     PER_PIXEL },
+  { "calc_weight",                    PER_PIXEL },
+  { "calc_hue_hist",                  PER_PIXEL },
+  { "calc_windowed_hue_hist",         PER_CHANNEL },
+  { "calc_most_used_hue",             PER_CHANNEL },
+  { "calc_sat_hist",                  PER_PIXEL },
+  { "calc_windowed_sat_hist",         PER_CHANNEL },
+  { "calc_most_used_sat",             PER_CHANNEL },
+  { "calc_average_brightness",        PER_PIXEL },
+  { "calc_uniform_average_brightness",PER_PIXEL },
+  { "calc_rgb_values",                PER_CHANNEL },
+  { "apply_filters",                  PER_CHANNEL },
+  { "apply_delay_filter",             PER_CHANNEL },
+  { "apply_gamma_correction",         PER_CHANNEL },
+  { "apply_white_calibration",        PER_CHANNEL },
+  { "send_output_colors",             PER_CHANNEL },
+};
+
+typedef struct {
+  char name[64];
+  int width, height;
+  uint8_t *rgb;             /* Packed RGB pixel data as grabbed by xine and VDR */
+} bench_frame_t;
+
+typedef struct {
+  int width, height;        /* Source size of recorded frame */
+  uint8_t *rgb;
+} bench_picture_t;
+
+typedef struct {
+  char name[64];
+  int num_pictures;         /* One picture of a PNM file or frames spread over a recording */
+  bench_picture_t pictures[NUM_VARIANTS];
+} bench_source_t;
+
+typedef struct {
+  atmo_driver_t ad;
+  int num_runs;
+  int csv;
+  int num_sources;
+  bench_source_t sources[MAX_FRAME_KINDS];
+  bench_frame_t frames[NUM_VARIANTS];
+  rgb_color_t *output_variants[2];
+} bench_t;
+
+
+/*
+ * Recorded frames are read from binary PNM (P6) files as written by the VDR grab function.
+ */
+static int pnm_read_int(FILE *fd) {
+  int c, v = 0;
+
+  do {
+    c = fgetc(fd);
+    if (c == '#') {
+      while (c != '\n' && c != EOF)
+        c = fgetc(fd);
+    }
+  } while (c != EOF && isspace(c));
+
+  if (c == EOF || !isdigit(c))
+    return -1;
+
+  while (c != EOF && isdigit(c)) {
+    v = v * 10 + c - '0';
+    c = fgetc(fd);
+  }
+  return v;
+}
+
+static int load_pnm(bench_picture_t *pic, FILE *fd, const char *filename) {
+  int maxval, size;
+
+  pic->width = pnm_read_int(fd);
+  pic->height = pnm_read_int(fd);
+  maxval = pnm_read_int(fd);
+  if (pic->width < 8 || pic->height < 8 || maxval != 255) {
+    fprintf(stderr, "frame file '%s' has unsupported size or depth\n", filename);
+    return 1;
+  }
+
+  size = pic->width * pic->height * 3;
+  pic->rgb = (uint8_t *) malloc(size);
+  if (pic->rgb == NULL || fread(pic->rgb, 1, size, fd) != (size_t)size) {
+    fprintf(stderr, "reading frame file '%s' failed\n", filename);
+    return 1;
+  }
+  return 0;
+}
+
+
+  /* Convert crop window of recorded frame to packed RGB, deeper formats are reduced to 8 bit */
+static int load_recorded_frame(bench_picture_t *pic, const rec_frame_header_t *fh) {
+  const int pixel_len = rec_pixel_len[fh->format];
+  const int pitch = fh->width * pixel_len;
+  const uint8_t *img = (const uint8_t *) (fh + 1) + fh->crop_top * pitch + fh->crop_left * pixel_len;
+  uint8_t *d;
+  int h;
+
+  pic->width = fh->crop_width;
+  pic->height = fh->crop_height;
+  pic->rgb = d = (uint8_t *) malloc(pic->width * pic->height * 3);
+  if (d == NULL)
+    return 1;
+
+  for (h = fh->crop_height; h--; img += pitch) {
+    const uint8_t *i = img;
+    int w = fh->crop_width;
+    for (; w--; i += pixel_len, d += 3) {
+      const uint16_t *c = (const uint16_t *) i;
+      uint32_t color;
+      switch (fh->format) {
+      case REC_FMT_RGB24:
+      case REC_FMT_RGBA32:
+        d[0] = i[0]; d[1] = i[1]; d[2] = i[2];
+        break;
+      case REC_FMT_BGRA32:
+        d[0] = i[2]; d[1] = i[1]; d[2] = i[0];
+        break;
+      case REC_FMT_XRGB32:
+        color = *((const uint32_t *) i);
+        d[0] = color >> 16; d[1] = color >> 8; d[2] = color;
+        break;
+      case REC_FMT_RGB48:
+        d[0] = c[0] >> 8; d[1] = c[1] >> 8; d[2] = c[2] >> 8;
+        break;
+      case REC_FMT_XRGB2101010:
+        color = *((const uint32_t *) i);
+        d[0] = color >> 22; d[1] = color >> 12; d[2] = color >> 2;
+        break;
+      }
+    }
+  }
+  return 0;
+}
+
+
+  /* Frames of a recording are taken evenly spread over the whole recording */
+static int load_recording(bench_source_t *src, const char *filename) {
+  rec_reader_t r;
+  const rec_frame_header_t *fh;
+  int num_frames = 0, n = 0, rc = 0;
+
+  if (open_recording(&r, filename))
+    return 1;
+  while (next_recorded_frame(&r) != NULL)
+    ++num_frames;
+  if (!num_frames) {
+    fprintf(stderr, "record file '%s' contains no frames\n", filename);
+    close_recording(&r);
+    return 1;
+  }
+
+  rewind_recording(&r);
+  while (!rc && src->num_pictures < NUM_VARIANTS && (fh = next_recorded_frame(&r)) != NULL) {
+    if (n++ == (src->num_pictures * num_frames) / NUM_VARIANTS)
+      rc = load_recorded_frame(&src->pictures[src->num_pictures++], fh);
+  }
+  close_recording(&r);
+  if (rc)
+    fprintf(stderr, "reading record file '%s' failed\n", filename);
+  return rc;
+}
+
+
+  /* Frame files are binary PNM (P6) files or recordings of parameter "record_file" */
+static int load_source(bench_source_t *src, const char *filename) {
+  FILE *fd = fopen(filename, "rb");
+  const char *s;
+  int rc;
+
+  if (fd == NULL) {
+    fprintf(stderr, "can't open frame file '%s'\n", filename);
+    return 1;
+  }
+
+  if (fgetc(fd) == 'P' && fgetc(fd) == '6') {
+    src->num_pictures = 1;
+    rc = load_pnm(&src->pictures[0], fd, filename);
+    fclose(fd);
+  } else {
+    fclose(fd);
+    rc = load_recording(src, filename);
+  }
+  if (rc)
+    return 1;
+
+  s = strrchr(filename, '/');
+  snprintf(src->name, sizeof(src->name), "%s", s ? s + 1: filename);
+  return 0;
+}
+
+
+  /* Nearest neighbour scaling of recorded frame to analyze size */
+static void scale_source(bench_picture_t *pic, uint8_t *dst, int w, int h) {
+  int x, y;
+  for (y = 0; y < h; ++y) {
+    const uint8_t *row = pic->rgb + ((y * pic->height) / h) * pic->width * 3;
+    for (x = 0; x < w; ++x) {
+      const uint8_t *s = row + ((x * pic->width) / w) * 3;
+      dst[0] = s[0];
+      dst[1] = s[1];
+      dst[2] = s[2];
+      dst += 3;
+    }
+  }
+}
+
+
+static void run_stage(bench_t *b, int stage, bench_frame_t *f, int iter) {
+  atmo_driver_t *ad = &b->ad;
+
+  switch (stage) {
+  case ST_HSV:
+    calc_hsv_image_from_rgb(ad->hsv_img, f->rgb, f->width * f->height);
+    break;
+  case ST_WEIGHT:
+    ad->analyze_width = 0;
+    configure_analyze_size(ad, f->width, f->height);
+    break;
+  case ST_HUE_HIST:
+    calc_hue_hist(ad);
+    break;
+  case ST_W_HUE_HIST:
+    calc_windowed_hue_hist(ad);
+    break;
+  case ST_MOST_USED_HUE:
+    calc_most_used_hue(ad);
+    break;
+  case ST_SAT_HIST:
+    calc_sat_hist(ad);
+    break;
+  case ST_W_SAT_HIST:
+    calc_windowed_sat_hist(ad);
+    break;
+  case ST_MOST_USED_SAT:
+    calc_most_used_sat(ad);
+    break;
+  case ST_AVG_BRIGHT:
+    calc_average_brightness(ad);
+    break;
+  case ST_UNIFORM_BRIGHT:
+    calc_uniform_average_brightness(ad);
+    break;
+  case ST_RGB_VALUES:
+    calc_rgb_values(ad);
+    break;
+  case ST_FILTERS:
+    apply_filters(ad);
+    break;
+  case ST_DELAY_FILTER:
+    apply_delay_filter(ad);
+    break;
+  case ST_GAMMA:
+      /* Corrections work in place, so restart from the same colors on every iteration */
+    memcpy(ad->filtered_output_colors, ad->filtered_colors, ad->sum_channels * sizeof(rgb_color_t));
+    memcpy(ad->filtered_output_fine, ad->filtered_fine, ad->sum_channels * sizeof(rgb16_color_t));
+    apply_gamma_correction(ad);
+    break;
+  case ST_WHITE_CAL:
+    memcpy(ad->filtered_output_colors, ad->filtered_colors, ad->sum_channels * sizeof(rgb_color_t));
+    memcpy(ad->filtered_output_fine, ad->filtered_fine, ad->sum_channels * sizeof(rgb16_color_t));
+    apply_white_calibration(ad);
+    break;
+  case ST_OUTPUT:
+    send_output_colors(ad, b->output_variants[iter & 1], 0);
+    break;
+  }
+}
+
+
+  /* Prepare engine state of all frame variants so that every stage could be run in isolation */
+static void prepare_frame(bench_t *b, bench_frame_t *f) {
+  atmo_driver_t *ad = &b->ad;
+  configure_analyze_size(ad, f->width, f->height);
+  calc_hsv_image_from_rgb(ad->hsv_img, f->rgb, f->width * f->height);
+  run_analysis(ad);
+}
+
+
+static int compare_double(const void *a, const void *b) {
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da < db) ? -1: (da > db) ? 1: 0;
+}
+
+
+typedef struct { double median, min, mad; } bench_stat_t;
+
+  /* Measure one stage: calibrate iteration count, then do several runs over all frame variants */
+static void measure_stage(bench_t *b, int stage, bench_stat_t *st) {
+  double runs[64], dev[64];
+  int num_runs = b->num_runs;
+  int iters = 1;
+  int r, v, i;
+
+    /* Calibrate number of iterations so that one run lasts at least MIN_RUN_TIME */
+  for (;;) {
+    uint64_t t = 0;
+    for (v = 0; v < NUM_VARIANTS; ++v) {
+      uint64_t t0;
+      prepare_frame(b, &b->frames[v]);
+      t0 = now_ns();
+      for (i = 0; i < iters; ++i)
+        run_stage(b, stage, &b->frames[v], i);
+      t += now_ns() - t0;
+    }
+    if (t >= MIN_RUN_TIME || iters >= (1 << 20))
+      break;
+    iters *= 2;
+  }
+
+  for (r = 0; r < num_runs; ++r) {
+    uint64_t sum = 0;
+    for (v = 0; v < NUM_VARIANTS; ++v) {
+      uint64_t t0;
+      prepare_frame(b, &b->frames[v]);
+      t0 = now_ns();
+      for (i = 0; i < iters; ++i)
+        run_stage(b, stage, &b->frames[v], i);
+      sum += now_ns() - t0;
+    }
+    runs[r] = (double)sum / (double)(iters * NUM_VARIANTS);
+  }
+
+  qsort(runs, num_runs, sizeof(double), compare_double);
+  st->min = runs[0];
+  st->median = runs[num_runs / 2];
+  for (r = 0; r < num_runs; ++r)
+    dev[r] = fabs(runs[r] - st->median);
+  qsort(dev, num_runs, sizeof(double), compare_double);
+  st->mad = dev[num_runs / 2];
+}
+
+
+static void print_header(bench_t *b, const char *section) {
+  if (b->csv)
+    printf("section,frame,size,layout,config,stage,median_ns,min_ns,mad_pct,ns_per_pixel,ns_per_channel\n");
+  else {
+    printf("\n--- %s\n", section);
+    printf("%-10s %-8s %-8s %-10s %-32s %12s %12s %6s %10s %10s\n", "frame", "size", "layout", "config", "stage", "median[ns]", "min[ns]", "mad%", "ns/pixel", "ns/chan");
+  }
+}
+
+
+static void print_result(bench_t *b, const char *section, const char *frame, const char *layout, const char *config, const char *stage, int unit, bench_stat_t *st) {
+  const atmo_driver_t *ad = &b->ad;
+  const int pixels = ad->analyze_width * ad->analyze_height;
+  const double mad_pct = st->median > 0.0 ? 100.0 * st->mad / st->median: 0.0;
+  char size[16], px[16], ch[16];
+
+  snprintf(size, sizeof(size), "%dx%d", ad->analyze_width, ad->analyze_height);
+  if (unit == PER_PIXEL)
+    snprintf(px, sizeof(px), "%.3f", st->median / pixels);
+  else
+    strcpy(px, "-");
+  snprintf(ch, sizeof(ch), "%.2f", st->median / ad->sum_channels);
+
+  if (b->csv)
+    printf("%s,%s,%s,%s,%s,%s,%.1f,%.1f,%.2f,%s,%s\n", section, frame, size, layout, config, stage, st->median, st->min, mad_pct, px, ch);
+  else
+    printf("%-10s %-8s %-8s %-10s %-32s %12.1f %12.1f %6.2f %10s %10s\n", frame, size, layout, config, stage, st->median, st->min, mad_pct, px, ch);
+  fflush(stdout);
+}
+
+
+static int configure_layout(bench_t *b, const bench_layout_t *l) {
+  atmo_driver_t *ad = &b->ad;
+  int i;
+
+  free_channels(ad);
+  ad->parm.top = l->top;
+  ad->parm.bottom = l->bottom;
+  ad->parm.left = l->left;
+  ad->parm.right = l->right;
+  ad->parm.center = l->center;
+  ad->parm.top_left = l->top_left;
+  ad->parm.top_right = l->top_right;
+  ad->parm.bottom_left = l->bottom_left;
+  ad->parm.bottom_right = l->bottom_right;
+  if (config_channels(ad))
+    return 1;
+  ad->active_parm = ad->parm;
+  ad->analyze_width = 0;
+  reset_filters(ad);
+
+  for (i = 0; i < 2; ++i) {
+    int c;
+    free(b->output_variants[i]);
+    b->output_variants[i] = (rgb_color_t *) calloc(ad->sum_channels, sizeof(rgb_color_t));
+    if (b->output_variants[i] == NULL)
+      return 1;
+    for (c = 0; c < ad->sum_channels; ++c) {
+      b->output_variants[i][c].r = (uint8_t)(c * 7 + i);
+      b->output_variants[i][c].g = (uint8_t)(c * 3);
+      b->output_variants[i][c].b = (uint8_t)(255 - c);
+    }
+  }
+  return 0;
+}
+
+
+static int generate_frames(bench_t *b, int kind, int analyze_size) {
+  const int w = (analyze_size + 1) * 64;
+  const int h = (w * 9) / 16;
+  int v;
+
+  for (v = 0; v < NUM_VARIANTS; ++v) {
+    bench_frame_t *f = &b->frames[v];
+    free(f->rgb);
+    f->width = w;
+    f->height = h;
+    f->rgb = (uint8_t *) malloc(w * h * 3);
+    if (f->rgb == NULL)
+      return 1;
+    if (kind < b->num_sources) {
+        /* Variants of a single picture are the same picture shifted by some pixels */
+      bench_source_t *src = &b->sources[kind];
+      scale_source(&src->pictures[v % src->num_pictures], f->rgb, w, h);
+      if (v && src->num_pictures == 1)
+        memmove(f->rgb, f->rgb + v * 3, (w * h - v) * 3);
+      snprintf(f->name, sizeof(f->name), "%s", src->name);
+    } else {
+      kind -= b->num_sources;
+      (*generators[kind].gen)(f->rgb, w, h, v);
+      snprintf(f->name, sizeof(f->name), "%s", generators[kind].name);
+    }
+  }
+  return 0;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] [frame.pnm|recording ...]\n"
+                  "  -s <size>     analyze size 0 ... 3 (default: all)\n"
+                  "  -l <layout>   channel layout (4ch, classic, 16ch, 42ch, 128ch, max; default: all)\n"
+                  "  -w <window>   hue/saturation window (win0, win3, win5; default: all)\n"
+                  "  -f <filter>   filter setting (off, percent, combined, comb+delay, comb+gamma, comb+fine; default: all)\n"
+                  "  -k <frame>    synthetic frame kind (gradient, bars, noise, dark; default: all)\n"
+                  "  -r <runs>     number of measuring runs per stage (default: %d)\n"
+                  "  -a            measure analyze stages only\n"
+                  "  -o            measure filter and output stages only\n"
+                  "  -c            CSV output\n"
+                  "  -v            verbose engine logging\n", prog, DEFAULT_RUNS);
+}
+
+
+int main(int argc, char *argv[]) {
+  static bench_t bench;
+  bench_t *b = &bench;
+  atmo_driver_t *ad = &b->ad;
+  const char *sel_layout = NULL, *sel_window = NULL, *sel_filter = NULL, *sel_kind = NULL;
+  int sel_size = -1;
+  int do_analyze = 1, do_output = 1;
+  int num_kinds, kind, size, c;
+  const bench_layout_t *l;
+  const bench_window_t *w;
+  const bench_filter_t *f;
+
+  b->num_runs = DEFAULT_RUNS;
+
+  while ((c = getopt(argc, argv, "s:l:w:f:k:r:aocvh")) != -1) {
+    switch (c) {
+    case 's':
+      sel_size = atoi(optarg);
+      if (sel_size < 0 || sel_size > 3) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'l':
+      sel_layout = optarg;
+      break;
+    case 'w':
+      sel_window = optarg;
+      break;
+    case 'f':
+      sel_filter = optarg;
+      break;
+    case 'k':
+      sel_kind = optarg;
+      break;
+    case 'r':
+      b->num_runs = atoi(optarg);
+      if (b->num_runs < 1 || b->num_runs > 64) {
+        usage(argv[0]);
+        return 1;
+      }
+      break;
+    case 'a':
+      do_output = 0;
+      break;
+    case 'o':
+      do_analyze = 0;
+      break;
+    case 'c':
+      b->csv = 1;
+      break;
+    case 'v':
+      act_log_level = DFLOG_DEBUG;
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  for (; optind < argc && b->num_sources < MAX_FRAME_KINDS; ++optind) {
+    if (load_source(&b->sources[b->num_sources], argv[optind]))
+      return 1;
+    ++b->num_sources;
+  }
+
+  init_configuration(ad);
+  reset_filters(ad);
+  if (load_output_driver(ad) || open_output_driver(ad))
+    return 1;
+
+  for (num_kinds = 0; generators[num_kinds].name; ++num_kinds)
+    ;
+  num_kinds += b->num_sources;
+
+  if (do_analyze) {
+    print_header(b, "analyze");
+    for (kind = 0; kind < num_kinds; ++kind) {
+      if (sel_kind && kind >= b->num_sources && strcmp(sel_kind, generators[kind - b->num_sources].name))
+        continue;
+      for (size = 0; size < 4; ++size) {
+        if (sel_size >= 0 && size != sel_size)
+          continue;
+        if (generate_frames(b, kind, size))
+          return 1;
+        for (l = bench_layouts; l->name; ++l) {
+          if (sel_layout && strcmp(sel_layout, l->name))
+            continue;
+          if (configure_layout(b, l))
+            return 1;
+          for (w = bench_windows; w->name; ++w) {
+            bench_stat_t st, total;
+            int stage;
+            if (sel_window && strcmp(sel_window, w->name))
+              continue;
+            ad->active_parm.hue_win_size = w->hue_win_size;
+            ad->active_parm.sat_win_size = w->sat_win_size;
+            memset(&total, 0, sizeof(total));
+            for (stage = ST_HSV; stage <= ST_RGB_VALUES; ++stage) {
+              if ((stage == ST_W_HUE_HIST && !w->hue_win_size) || (stage == ST_W_SAT_HIST && !w->sat_win_size))
+                continue;
+              measure_stage(b, stage, &st);
+              print_result(b, "analyze", b->frames[0].name, l->name, w->name, stage_desc[stage].name, stage_desc[stage].unit, &st);
+                /* Weight table is calculated only on size change, uniform brightness is an alternative */
+              if (stage != ST_WEIGHT && stage != ST_UNIFORM_BRIGHT) {
+                total.median += st.median;
+                total.min += st.min;
+                total.mad += st.mad;
+              }
+            }
+            print_result(b, "analyze", b->frames[0].name, l->name, w->name, "total per frame", PER_PIXEL, &total);
+          }
+        }
+      }
+    }
+  }
+
+  if (do_output) {
+    print_header(b, "filter and output");
+    if (generate_frames(b, num_kinds - 1, 1))
+      return 1;
+    for (l = bench_layouts; l->name; ++l) {
+      if (sel_layout && strcmp(sel_layout, l->name))
+        continue;
+      if (configure_layout(b, l))
+        return 1;
+      for (f = bench_filters; f->name; ++f) {
+        bench_stat_t st;
+        int stage;
+        if (sel_filter && strcmp(sel_filter, f->name))
+          continue;
+        ad->active_parm.filter = f->filter;
+        ad->active_parm.filter_delay = f->filter_delay;
+        ad->active_parm.gamma = f->gamma;
+        ad->active_parm.wc_red = f->wc;
+        ad->active_parm.wc_green = f->wc;
+        ad->active_parm.wc_blue = f->wc;
+        ad->active_parm.fine_colors = f->fine_colors;
+        reset_filters(ad);
+        for (stage = ST_FILTERS; stage < NUM_STAGES; ++stage) {
+          measure_stage(b, stage, &st);
+          print_result(b, "output", b->frames[0].name, l->name, f->name, stage_desc[stage].name, stage_desc[stage].unit, &st);
+        }
+      }
+    }
+  }
+
+  close_output_driver(ad);
+  unload_output_driver(ad);
+  free_channels(ad);
+  free_analyze_images(ad);
+  return 0;
+}
@@ -0,0 +1,380 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the check and benchmark of the boblight output driver against a fake boblight server.
+ * The server runs in a thread on localhost and reports one light per DFAtmo channel with a scan
+ * region following the area layout of the analyze engine. The lights are listed in reverse order, so
+ * the driver has to map them by their scan region. Every received light value is checked and at the
+ * end the values of all lights must be equal to the last frame and black after the driver is closed.
+ * Optionally the server drops the connection after every n frames to check the reconnect.
+ *
+ * Every channel color of a frame encodes its channel number and the frame number:
+ * red = channel & 0xFF, green = frame number & 0xFF, blue = channel >> 8
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+
+#define DEFAULT_LAYOUT          "top=32 bottom=32 left=18 right=18 center=1 top_left=1 top_right=1 bottom_left=1 bottom_right=1"
+#define DEFAULT_FRAMES          5000
+#define RX_BUFFER_SIZE          (256 * 1024)
+#define SETTLE_TIMEOUT          1000    /* [ms] */
+
+typedef struct {
+  int listen_sock;
+  int num_lights;
+  float vscan[MAX_OUTPUT_CHANNELS][2], hscan[MAX_OUTPUT_CHANNELS][2];
+  int drop_interval;            // Drop connection after this number of frames
+  volatile int stop;
+  pthread_mutex_t lock;
+  rgb_color_t values[MAX_OUTPUT_CHANNELS];
+  int green;                    // Green value of current frame
+  uint32_t frames, connections, errors;
+  uint64_t bytes;
+} fake_server_t;
+
+
+  /* Scan regions of lights follow the area layout of the analyze engine */
+static void build_lights(fake_server_t *s, const atmo_parameters_t *p) {
+  const float sum_top = p->top + p->top_left + p->top_right, sum_bottom = p->bottom + p->bottom_left + p->bottom_right;
+  const float sum_left = p->left + p->top_left + p->bottom_left, sum_right = p->right + p->top_right + p->bottom_right;
+  int n = 0, i;
+
+#define SET_LIGHT(v0, v1, h0, h1) do { s->vscan[n][0] = (v0); s->vscan[n][1] = (v1); s->hscan[n][0] = (h0); s->hscan[n][1] = (h1); ++n; } while (0)
+  for (i = 0; i < p->top; ++i)
+    SET_LIGHT(0, 15, (i + p->top_left) * 100 / sum_top, (i + p->top_left + 1) * 100 / sum_top);
+  for (i = 0; i < p->bottom; ++i)
+    SET_LIGHT(85, 100, (i + p->bottom_left) * 100 / sum_bottom, (i + p->bottom_left + 1) * 100 / sum_bottom);
+  for (i = 0; i < p->left; ++i)
+    SET_LIGHT((i + p->top_left) * 100 / sum_left, (i + p->top_left + 1) * 100 / sum_left, 0, 15);
+  for (i = 0; i < p->right; ++i)
+    SET_LIGHT((i + p->top_right) * 100 / sum_right, (i + p->top_right + 1) * 100 / sum_right, 85, 100);
+  if (p->center)
+    SET_LIGHT(25, 75, 25, 75);
+  if (p->top_left)
+    SET_LIGHT(0, 100 / sum_left, 0, 100 / sum_top);
+  if (p->top_right)
+    SET_LIGHT(0, 100 / sum_right, 100 - 100 / sum_top, 100);
+  if (p->bottom_left)
+    SET_LIGHT(100 - 100 / sum_left, 100, 0, 100 / sum_bottom);
+  if (p->bottom_right)
+    SET_LIGHT(100 - 100 / sum_right, 100, 100 - 100 / sum_bottom, 100);
+#undef SET_LIGHT
+  s->num_lights = n;
+}
+
+
+static int to_byte(float v) {
+  return (int)(v * 255.0f + 0.5f);
+}
+
+
+  /* Process one command line of the client. Returns 1 if connection should be dropped */
+static int process_line(fake_server_t *s, int sock, char *line) {
+  char reply[128], name[64];
+  float r, g, b;
+  int i;
+
+  if (!strcmp(line, "hello")) {
+    send(sock, "hello\n", 6, MSG_NOSIGNAL);
+  } else if (!strcmp(line, "get version")) {
+    send(sock, "version 5\n", 10, MSG_NOSIGNAL);
+  } else if (!strcmp(line, "get lights")) {
+    snprintf(reply, sizeof(reply), "lights %d\n", s->num_lights);
+    send(sock, reply, strlen(reply), MSG_NOSIGNAL);
+    for (i = s->num_lights; i--;) {
+      snprintf(reply, sizeof(reply), "light ch%d scan %f %f %f %f\n", i + 1, s->vscan[i][0], s->vscan[i][1], s->hscan[i][0], s->hscan[i][1]);
+      send(sock, reply, strlen(reply), MSG_NOSIGNAL);
+    }
+  } else if (!strncmp(line, "set priority ", 13)) {
+    ;
+  } else if (sscanf(line, "set light %63s rgb %f %f %f", name, &r, &g, &b) == 4) {
+    const int ch = atoi(name + 2) - 1;
+    rgb_color_t c;
+    c.r = to_byte(r);
+    c.g = to_byte(g);
+    c.b = to_byte(b);
+    if (strncmp(name, "ch", 2) || ch < 0 || ch >= s->num_lights) {
+      if (s->errors++ < 10)
+        printf("unknown light '%s'\n", name);
+      return 0;
+    }
+    if ((c.r || c.g || c.b) && (c.r != (ch & 0xFF) || c.b != (ch >> 8) || (s->green >= 0 && c.g != s->green))) {
+      if (s->errors++ < 10)
+        printf("light %s is %d,%d,%d expected %d,%d,%d\n", name, c.r, c.g, c.b, ch & 0xFF, (s->green >= 0) ? s->green: c.g, ch >> 8);
+    }
+    if (c.r || c.g || c.b)
+      s->green = c.g;
+    pthread_mutex_lock(&s->lock);
+    s->values[ch] = c;
+    pthread_mutex_unlock(&s->lock);
+  } else if (!strcmp(line, "sync")) {
+    s->green = -1;
+    ++s->frames;
+    if (s->drop_interval && !(s->frames % s->drop_interval))
+      return 1;
+  } else {
+    if (s->errors++ < 10)
+      printf("unknown command '%s'\n", line);
+  }
+  return 0;
+}
+
+
+static void *server_thread(void *arg) {
+  fake_server_t *s = (fake_server_t *) arg;
+  char *buf = (char *) malloc(RX_BUFFER_SIZE + 1);
+  int sock = -1, len = 0;
+
+  while (!s->stop && buf != NULL) {
+    struct pollfd pfd;
+    int n;
+
+    if (sock < 0) {
+      pfd.fd = s->listen_sock;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, 50) > 0) {
+        sock = accept(s->listen_sock, NULL, NULL);
+        len = 0;
+        s->green = -1;
+        ++s->connections;
+      }
+      continue;
+    }
+
+    pfd.fd = sock;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 50) <= 0)
+      continue;
+    n = recv(sock, buf + len, RX_BUFFER_SIZE - len, 0);
+    if (n <= 0) {
+      close(sock);
+      sock = -1;
+    } else {
+      char *line = buf, *end;
+      s->bytes += n;
+      len += n;
+      buf[len] = 0;
+      while ((end = strchr(line, '\n')) != NULL) {
+        *end = 0;
+        if (process_line(s, sock, line)) {
+          close(sock);
+          sock = -1;
+          break;
+        }
+        line = end + 1;
+      }
+      len -= line - buf;
+      memmove(buf, line, len);
+    }
+  }
+  if (sock >= 0)
+    close(sock);
+  free(buf);
+  return NULL;
+}
+
+
+  /* Compare light values with colors, wait a while for the server to receive them */
+static int compare_lights(fake_server_t *s, rgb_color_t *colors, int report) {
+  uint64_t end = now_ns() + (uint64_t)SETTLE_TIMEOUT * 1000000;
+  int mismatch, i;
+
+  do {
+    mismatch = 0;
+    pthread_mutex_lock(&s->lock);
+    for (i = 0; i < s->num_lights; ++i) {
+      if (memcmp(&s->values[i], &colors[i], sizeof(rgb_color_t))) {
+        if (report && mismatch < 10)
+          printf("light ch%d is %d,%d,%d expected %d,%d,%d\n", i + 1, s->values[i].r, s->values[i].g, s->values[i].b, colors[i].r, colors[i].g, colors[i].b);
+        ++mismatch;
+      }
+    }
+    pthread_mutex_unlock(&s->lock);
+    if (mismatch && !report) {
+      struct timespec ts = { 0, 10000000 };
+      nanosleep(&ts, NULL);
+    }
+  } while (mismatch && !report && now_ns() < end);
+  return mismatch;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] [parameter=value ...]\n"
+                  "  -d <path>     path of boblight output driver (default: .)\n"
+                  "  -n <frames>   number of frames (default: %d)\n"
+                  "  -r <ms>       output rate, 0 is as fast as possible (default: 0)\n"
+                  "  -k <n>        server drops connection after every n frames (default: 0)\n"
+                  "  -v <level>    log level 0 ... 3\n"
+                  "Parameters override the default layout: %s\n", prog, DEFAULT_FRAMES, DEFAULT_LAYOUT);
+}
+
+
+int main(int argc, char *argv[]) {
+  static atmo_driver_t atmo_driver;
+  static fake_server_t server;
+  atmo_driver_t *ad = &atmo_driver;
+  fake_server_t *s = &server;
+  const char *driver_path = ".";
+  char layout[1024], parms[SIZE_DRIVER_PATH + 256];
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  pthread_t thread;
+  uint64_t start, next, worst = 0, elapsed;
+  int frames = DEFAULT_FRAMES, rate = 0, rc = 0, errors = 0, frame, c, i;
+  rgb_color_t last_frame[MAX_OUTPUT_CHANNELS];
+
+  while ((c = getopt(argc, argv, "d:n:r:k:v:h")) != -1) {
+    switch (c) {
+    case 'd':
+      driver_path = optarg;
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 'k':
+      s->drop_interval = atoi(optarg);
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (frames < 1 || rate < 0 || s->drop_interval < 0) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  strcpy(layout, DEFAULT_LAYOUT);
+  for (; optind < argc; ++optind) {
+    if (strlen(layout) + strlen(argv[optind]) + 2 > sizeof(layout)) {
+      usage(argv[0]);
+      return 1;
+    }
+    strcat(layout, " ");
+    strcat(layout, argv[optind]);
+  }
+
+  init_configuration(ad);
+  if (set_parm_list(&ad->parm, layout) || config_channels(ad))
+    return 1;
+  build_lights(s, &ad->parm);
+
+    /* Fake boblight server on localhost with ephemeral port */
+  s->listen_sock = socket(AF_INET, SOCK_STREAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (s->listen_sock < 0 || bind(s->listen_sock, (struct sockaddr *) &addr, sizeof(addr)) || listen(s->listen_sock, 1) ||
+      getsockname(s->listen_sock, (struct sockaddr *) &addr, &addr_len)) {
+    printf("opening server socket failed\n");
+    free_channels(ad);
+    return 1;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+  s->green = -1;
+  pthread_create(&thread, NULL, server_thread, s);
+
+  snprintf(parms, sizeof(parms), "driver=boblight driver_path=%s output_rate=%d driver_param=127.0.0.1:%d",
+            driver_path, rate ? rate: 20, ntohs(addr.sin_port));
+  if (set_parm_list(&ad->parm, parms) || open_output_driver(ad)) {
+    rc = 1;
+    goto cleanup;
+  }
+  ad->active_parm = ad->parm;
+  if (turn_lights_off(ad)) {
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    rc = 1;
+    goto cleanup;
+  }
+
+  start = now_ns();
+  next = start;
+  for (frame = 1; frame <= frames; ++frame) {
+    uint64_t t;
+    for (i = 0; i < ad->sum_channels; ++i) {
+      ad->output_colors[i].r = i & 0xFF;
+      ad->output_colors[i].g = frame & 0xFF;
+      ad->output_colors[i].b = i >> 8;
+    }
+    t = now_ns();
+    if ((rc = send_output_colors(ad, ad->output_colors, 0)))
+      break;
+    t = now_ns() - t;
+    if (t > worst)
+      worst = t;
+    if (rate) {
+      next += (uint64_t)rate * 1000000;
+      while ((t = now_ns()) < next)
+        ad->output_driver->poll_colors(ad->output_driver, (next - t) / 1000000);
+    }
+  }
+  ad->output_driver->poll_colors(ad->output_driver, SETTLE_TIMEOUT);
+  elapsed = now_ns() - start;
+  memcpy(last_frame, ad->output_colors, ad->sum_channels * sizeof(rgb_color_t));
+
+  if (frame <= frames)
+    printf("output failed at frame %d\n", frame);
+  else if (compare_lights(s, last_frame, 0)) {
+      /* Connection may have been dropped after the last frame */
+    send_output_colors(ad, ad->output_colors, 1);
+    ad->output_driver->poll_colors(ad->output_driver, 2 * SETTLE_TIMEOUT);
+    errors += compare_lights(s, last_frame, 0) && compare_lights(s, last_frame, 1);
+  }
+
+  close_output_driver(ad);
+  unload_output_driver(ad);
+  memset(last_frame, 0, sizeof(last_frame));
+  if (!rc && compare_lights(s, last_frame, 0)) {
+    printf("lights are not turned off after close\n");
+    ++errors;
+  }
+
+  errors += s->errors;
+  printf("%d lights, %d frames in %.3f s, %.1f frames/s submitted, %u frames received, %.1f bytes per frame, %u connections, worst submit %.1f us: %s\n",
+          s->num_lights, frames, elapsed / 1000000000.0, frames * 1000000000.0 / elapsed, s->frames, s->frames ? (double)s->bytes / s->frames: 0.0,
+          s->connections, worst / 1000.0, (rc || errors) ? "FAILED": "PASSED");
+
+cleanup:
+  s->stop = 1;
+  pthread_join(thread, NULL);
+  close(s->listen_sock);
+  free_channels(ad);
+  return (rc || errors);
+}
@@ -0,0 +1,446 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the regression check of the DFAtmo image analyze, color filter and color output engine.
+ * A corpus of synthetic frames (and optional recordings) is run through the engine for a set of
+ * parameter settings. The analyzed, filtered and output colors of every frame are compared against
+ * a golden file. Any difference is a failure unless a tolerance is given.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+#include "atmoreplay.h"
+
+#define DEFAULT_GOLDEN_FILE     "atmocheck.golden"
+#define NUM_SYNTH_FRAMES        16      /* Length of synthetic frame sequence per parameter setting */
+#define MAX_RECORDED_FRAMES     64      /* Maximum number of frames used from a recording */
+#define MAX_RECORDINGS          8
+#define MAX_REPORTED_DIFFS      20
+
+
+typedef struct {
+  const char *name;
+  const char *parm;
+  int format;                   /* Pixel format of synthetic frames */
+} check_setting_t;
+
+  /* Parameters not given here have the default values of init_configuration() */
+static const check_setting_t check_settings[] = {
+  { "classic",        "top=1 bottom=1 left=1 right=1 center=1" },
+  { "classic-raw",    "top=1 bottom=1 left=1 right=1 center=1 filter=0 hue_win_size=0 sat_win_size=0" },
+  { "16ch-small",     "top=5 bottom=5 left=3 right=3 analyze_size=0 overscan=30" },
+  { "16ch-win5",      "top=5 bottom=5 left=3 right=3 analyze_size=3 hue_win_size=5 sat_win_size=5" },
+  { "42ch-corners",   "top=12 bottom=12 left=7 right=7 top_left=1 top_right=1 bottom_left=1 bottom_right=1 analyze_size=2" },
+  { "uniform",        "top=3 bottom=3 left=2 right=2 uniform_brightness=80 brightness=150" },
+  { "percent",        "top=3 bottom=3 left=2 right=2 filter=1 filter_smoothness=30" },
+  { "combined",       "top=3 bottom=3 left=2 right=2 filter=2 filter_length=300 filter_threshold=10 filter_smoothness=90" },
+  { "delay",          "top=3 bottom=3 left=2 right=2 filter_delay=100" },
+  { "gamma-wc",       "top=3 bottom=3 left=2 right=2 gamma=22 wc_red=200 wc_green=230 wc_blue=180" },
+  { "edge-low",       "top=3 bottom=3 left=2 right=2 edge_weighting=10 weight_limit=0 darkness_limit=0 hue_threshold=50" },
+  { "edge-high",      "top=3 bottom=3 left=2 right=2 edge_weighting=200 weight_limit=100 darkness_limit=30 hue_threshold=100" },
+  { "deadband",       "top=3 bottom=3 left=2 right=2 filter=2 filter_length=2000 filter_threshold=100 filter_smoothness=50 output_deadband=6" },
+  { "deadband-perc",  "top=3 bottom=3 left=2 right=2 filter=2 filter_length=2000 filter_threshold=100 filter_smoothness=50 gamma=22 output_deadband=6 output_deadband_mode=1" },
+  { "fine",           "top=3 bottom=3 left=2 right=2 fine_colors=1 filter=2 filter_length=2000 filter_threshold=100 filter_smoothness=50 gamma=22 wc_red=200" },
+  { "fine-percent",   "top=3 bottom=3 left=2 right=2 fine_colors=1 filter=1 filter_smoothness=80 filter_delay=100 output_deadband=6" },
+  { "rgb48",          "top=3 bottom=3 left=2 right=2", REC_FMT_RGB48 },
+  { "fine-rgb48",     "top=3 bottom=3 left=2 right=2 fine_colors=1 filter=0 overscan=30", REC_FMT_RGB48 },
+  { "fine-rgb30",     "top=3 bottom=3 left=2 right=2 fine_colors=1 uniform_brightness=80 brightness=150", REC_FMT_XRGB2101010 },
+  { NULL, NULL }
+};
+
+
+typedef struct {
+  char *data;
+  size_t size, alloc_size;
+} text_buf_t;
+
+typedef struct {
+  char name[64];
+  int num_frames;
+  const rec_frame_header_t *frames[MAX_RECORDED_FRAMES];
+} check_corpus_t;
+
+typedef struct {
+  int tolerance;
+  int num_diffs, num_lines, num_values;
+  int max_diff;
+} check_result_t;
+
+
+static int buf_printf(text_buf_t *b, const char *fmt, ...) {
+  va_list ap;
+  int n;
+
+  for (;;) {
+    va_start(ap, fmt);
+    n = vsnprintf(b->data + b->size, b->alloc_size - b->size, fmt, ap);
+    va_end(ap);
+    if (n < 0)
+      return 1;
+    if (b->size + n < b->alloc_size)
+      break;
+    b->alloc_size = (b->alloc_size + n + 1) * 2;
+    b->data = (char *) realloc(b->data, b->alloc_size);
+    if (b->data == NULL)
+      return 1;
+  }
+  b->size += n;
+  return 0;
+}
+
+
+static void print_colors(text_buf_t *b, const char *prefix, const rgb_color_t *c, int n) {
+  buf_printf(b, "%s", prefix);
+  while (n--) {
+    buf_printf(b, " %02x%02x%02x", c->r, c->g, c->b);
+    ++c;
+  }
+  buf_printf(b, "\n");
+}
+
+
+  /*
+   * Build synthetic frame as grabbed by the grab threads including crop window of overscan.
+   * Frames with more than 8 bit per color get a pattern below the 8 bit resolution.
+   */
+static rec_frame_header_t *build_synth_frame(int kind, int variant, int analyze_size, int overscan, int format) {
+  const int w = (analyze_size + 1) * 64;
+  const int h = (w * 9) / 16;
+  rec_frame_header_t *fh = (rec_frame_header_t *) malloc(sizeof(rec_frame_header_t) + w * h * rec_pixel_len[format]);
+  int crop_w, crop_h;
+
+  if (fh == NULL)
+    return NULL;
+  crop_w = (w * overscan + 500) / 1000;
+  crop_h = (h * overscan + 500) / 1000;
+  memset(fh, 0, sizeof(*fh));
+  fh->width = w;
+  fh->height = h;
+  fh->format = format;
+  fh->crop_left = crop_w;
+  fh->crop_top = crop_h;
+  fh->crop_width = w - 2 * crop_w;
+  fh->crop_height = h - 2 * crop_h;
+  (*generators[kind].gen)((uint8_t *) (fh + 1), w, h, variant);
+
+  if (format != REC_FMT_RGB24) {
+    const uint8_t *src = (const uint8_t *) (fh + 1) + w * h * 3;
+    int i = w * h;
+      /* Expand in place from the end */
+    while (i--) {
+      const int fraction = ((i % w) * 3 + (i / w) * 5) & 0xFF;
+      int c[3], k;
+      src -= 3;
+      for (k = 0; k < 3; ++k)
+        c[k] = src[k] ? ((src[k] << 8) | fraction): 0;
+      if (format == REC_FMT_RGB48) {
+        uint16_t *p = (uint16_t *) (fh + 1) + i * 3;
+        for (k = 0; k < 3; ++k)
+          p[k] = c[k];
+      } else
+        ((uint32_t *) (fh + 1))[i] = ((c[0] >> 6) << 20) | ((c[1] >> 6) << 10) | (c[2] >> 6);
+    }
+  }
+  return fh;
+}
+
+
+static int run_setting(atmo_driver_t *ad, const check_setting_t *s, check_corpus_t *corpus, text_buf_t *out) {
+  int i;
+
+  init_configuration(ad);
+  if (set_parm_list(&ad->parm, s->parm))
+    return 1;
+  if (config_channels(ad))
+    return 1;
+  ad->active_parm = ad->parm;
+  reset_filters(ad);
+  if (load_output_driver(ad) || open_output_driver(ad))
+    return 1;
+
+  for (i = 0; i < (corpus ? corpus->num_frames: NUM_SYNTH_FRAMES); ++i) {
+    const rec_frame_header_t *fh;
+    rec_frame_header_t *synth = NULL;
+    char prefix[128];
+    int rc;
+
+    if (corpus) {
+      fh = corpus->frames[i];
+      snprintf(prefix, sizeof(prefix), "%s %s %d", s->name, corpus->name, i);
+    } else {
+      const int kind = i % 4, variant = i / 4;
+      fh = synth = build_synth_frame(kind, variant, ad->active_parm.analyze_size, ad->active_parm.overscan, s->format);
+      if (synth == NULL)
+        return 1;
+      snprintf(prefix, sizeof(prefix), "%s %s%d %d", s->name, generators[kind].name, variant, i);
+    }
+
+    rc = analyze_recorded_frame(ad, fh);
+    free(synth);
+    if (rc)
+      return 1;
+
+    apply_filters(ad);
+    if (apply_delay_filter(ad))
+      return 1;
+    apply_gamma_correction(ad);
+    apply_white_calibration(ad);
+    if (send_output_colors(ad, ad->filtered_output_colors, 0))
+      return 1;
+
+    buf_printf(out, "%s A", prefix);
+    print_colors(out, "", ad->analyzed_colors, ad->sum_channels);
+    buf_printf(out, "%s F", prefix);
+    print_colors(out, "", ad->filtered_colors, ad->sum_channels);
+    buf_printf(out, "%s O", prefix);
+    print_colors(out, "", ad->filtered_output_colors, ad->sum_channels);
+    if (ad->active_parm.output_deadband) {
+      buf_printf(out, "%s S", prefix);
+      print_colors(out, "", ad->last_output_colors, ad->sum_channels);
+    }
+  }
+
+  close_output_driver(ad);
+  unload_output_driver(ad);
+  free_channels(ad);
+  free_analyze_images(ad);
+  return 0;
+}
+
+
+static const char *next_line(const char *p, const char *end, int *len) {
+  const char *e;
+  while (p < end && (*p == '#' || *p == '\n')) {
+    e = memchr(p, '\n', end - p);
+    p = e ? e + 1: end;
+  }
+  if (p >= end)
+    return NULL;
+  e = memchr(p, '\n', end - p);
+  *len = e ? e - p: end - p;
+  return p;
+}
+
+
+  /* Compare one result line against golden line. Returns number of differing values. */
+static int compare_line(const char *act, int act_len, const char *gold, int gold_len, check_result_t *res) {
+  const char *a = memchr(act, ' ', act_len), *g;
+  int key_len, n = 0;
+
+  if (!a)
+    return 1;
+  a = memchr(a + 1, ' ', act_len - (a + 1 - act));
+  if (!a)
+    return 1;
+  a = memchr(a + 1, ' ', act_len - (a + 1 - act));
+  if (!a)
+    return 1;
+  a = memchr(a + 1, ' ', act_len - (a + 1 - act));
+  key_len = a ? a - act: act_len;
+  if (gold_len < key_len || memcmp(act, gold, key_len) || (gold_len > key_len && gold[key_len] != ' '))
+    return -1;
+
+  if (act_len == gold_len && !memcmp(act, gold, act_len)) {
+    res->num_values += ((act_len - key_len) / 7) * 3;
+    return 0;
+  }
+  if (!res->tolerance || act_len != gold_len)
+    return 1;
+
+  a = act + key_len;
+  g = gold + key_len;
+  while (a < act + act_len) {
+    unsigned int av, gv;
+    int i;
+    if (sscanf(a, " %6x", &av) != 1 || sscanf(g, " %6x", &gv) != 1)
+      return n + 1;
+    for (i = 0; i < 3; ++i) {
+      int d = abs((int)((av >> (i * 8)) & 0xFF) - (int)((gv >> (i * 8)) & 0xFF));
+      if (d > res->max_diff)
+        res->max_diff = d;
+      if (d > res->tolerance)
+        ++n;
+      ++res->num_values;
+    }
+    a += 7;
+    g += 7;
+  }
+  return n;
+}
+
+
+static int compare_results(text_buf_t *act, const char *golden_file, check_result_t *res) {
+  FILE *fd = fopen(golden_file, "rb");
+  const char *ap = act->data, *aend = act->data + act->size;
+  const char *gp, *gend;
+  char *golden;
+  long size;
+  int alen = 0, glen = 0;
+
+  if (fd == NULL) {
+    fprintf(stderr, "can't open golden file '%s'\n", golden_file);
+    return 1;
+  }
+  fseek(fd, 0, SEEK_END);
+  size = ftell(fd);
+  fseek(fd, 0, SEEK_SET);
+  golden = (char *) malloc(size + 1);
+  if (golden == NULL || fread(golden, 1, size, fd) != (size_t)size) {
+    fprintf(stderr, "reading golden file '%s' failed\n", golden_file);
+    fclose(fd);
+    return 1;
+  }
+  fclose(fd);
+  gp = golden;
+  gend = golden + size;
+
+  for (;;) {
+    int n;
+    ap = next_line(ap, aend, &alen);
+    gp = next_line(gp, gend, &glen);
+    if (ap == NULL || gp == NULL)
+      break;
+    ++res->num_lines;
+    n = compare_line(ap, alen, gp, glen, res);
+    if (n < 0) {
+      fprintf(stderr, "golden file does not match check setup at:\n  %.*s\n  %.*s\n", (alen > 60) ? 60: alen, ap, (glen > 60) ? 60: glen, gp);
+      free(golden);
+      return 1;
+    }
+    if (n) {
+      if (res->num_diffs < MAX_REPORTED_DIFFS)
+        fprintf(stderr, "DIFF: %.*s\n  expected: %.*s\n", alen, ap, glen, gp);
+      ++res->num_diffs;
+    }
+    ap += alen;
+    gp += glen;
+  }
+  free(golden);
+
+  if (ap != NULL || gp != NULL) {
+    fprintf(stderr, "number of results differ from golden file\n");
+    return 1;
+  }
+  return 0;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] [file.rec ...]\n"
+                  "  -g <file>     golden file (default: %s)\n"
+                  "  -u            update golden file with actual results\n"
+                  "  -a <n>        approximate mode: allow color differences up to n\n"
+                  "  -v <level>    log level 0 ... 3\n", prog, DEFAULT_GOLDEN_FILE);
+}
+
+
+int main(int argc, char *argv[]) {
+  static atmo_driver_t atmo_driver;
+  static check_corpus_t corpus[MAX_RECORDINGS];
+  static rec_reader_t readers[MAX_RECORDINGS];
+  const char *golden_file = DEFAULT_GOLDEN_FILE;
+  const check_setting_t *s;
+  check_result_t res;
+  text_buf_t out;
+  int update = 0, num_corpus = 0, c, i;
+
+  memset(&res, 0, sizeof(res));
+  memset(&out, 0, sizeof(out));
+
+  while ((c = getopt(argc, argv, "g:ua:v:h")) != -1) {
+    switch (c) {
+    case 'g':
+      golden_file = optarg;
+      break;
+    case 'u':
+      update = 1;
+      break;
+    case 'a':
+      res.tolerance = atoi(optarg);
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  for (; optind < argc && num_corpus < MAX_RECORDINGS; ++optind) {
+    check_corpus_t *cp = &corpus[num_corpus];
+    const rec_frame_header_t *fh;
+    const char *n = strrchr(argv[optind], '/');
+
+    if (open_recording(&readers[num_corpus], argv[optind]))
+      return 1;
+    snprintf(cp->name, sizeof(cp->name), "%s", n ? n + 1: argv[optind]);
+    while (cp->num_frames < MAX_RECORDED_FRAMES && (fh = next_recorded_frame(&readers[num_corpus])) != NULL)
+      cp->frames[cp->num_frames++] = fh;
+    ++num_corpus;
+  }
+
+  buf_printf(&out, "# DFAtmo engine golden results: setting frame index A(nalyzed)|F(iltered)|O(utput) colors...\n");
+  buf_printf(&out, "# Update with 'make check CHECKARGS=-u' only if the change of results is intended!\n");
+  for (s = check_settings; s->name; ++s) {
+    if (run_setting(&atmo_driver, s, NULL, &out))
+      return 1;
+    for (i = 0; i < num_corpus; ++i) {
+      if (run_setting(&atmo_driver, s, &corpus[i], &out))
+        return 1;
+    }
+  }
+
+  for (i = 0; i < num_corpus; ++i)
+    close_recording(&readers[i]);
+
+  if (update) {
+    FILE *fd = fopen(golden_file, "wb");
+    if (fd == NULL || fwrite(out.data, out.size, 1, fd) != 1 || fclose(fd)) {
+      fprintf(stderr, "writing golden file '%s' failed\n", golden_file);
+      return 1;
+    }
+    printf("golden file '%s' updated\n", golden_file);
+    return 0;
+  }
+
+  if (compare_results(&out, golden_file, &res))
+    return 1;
+
+  if (res.num_diffs) {
+    printf("FAILED: %d of %d result lines differ from golden file", res.num_diffs, res.num_lines);
+    if (res.tolerance)
+      printf(" (tolerance %d, max. difference %d)", res.tolerance, res.max_diff);
+    printf("\n");
+    return 1;
+  }
+
+  printf("PASSED: %d result lines with %d color values", res.num_lines, res.num_values);
+  if (res.tolerance)
+    printf(" (tolerance %d, max. difference %d)", res.tolerance, res.max_diff);
+  printf("\n");
+  free(out.data);
+  return 0;
+}
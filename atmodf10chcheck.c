@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the throughput check of the DF10CH output driver with emulated controllers (df10chemu.c).
+ * Frames are submitted to the driver with the output rate or as fast as possible. At the end the brightness
+ * values of all emulated controllers are compared with the colors of the last frame. Brightness updates are
+ * reported per submitted frame, without output rate most frames are replaced by newer ones before sending.
+ *
+ * Every channel color of a frame depends on the channel number and the frame number. A channel changes
+ * only every third frame, so the driver gets partial updates by the changed channel mask.
+ *
+ * With timed output frames are submitted with a presentation time and the submits could be delayed randomly.
+ * The spread of the time between brightness updates of the first controller shows how well the driver absorbs
+ * the delays.
+ *
+ * With dithering a last frame with fractional colors of the percent filter is held. The time weighted mean brightness
+ * of every channel of the emulated controllers must match the gamma value interpolated between the 8 bit steps.
+ * With fine colors but without dithering the brightness must be the interpolated value rounded to a PWM step.
+ *
+ * At the end the driver is closed and reopened twice, the second time after the emulated controllers are
+ * re-enumerated with new device addresses. The open times show the speed-up by the controller data cached
+ * over reopen, after every reopen a frame must be output correctly.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <getopt.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+
+#define DEFAULT_CONTROLLERS     8
+#define DEFAULT_FRAMES          200
+#define DEFAULT_RATE            20      /* Output rate of engine [ms] */
+#define EMU_LEDS                10      /* RGB LEDs of an emulated controller */
+#define EMU_PWM_RES             4095    /* PWM resolution and white calibration of emulated controllers */
+#define DRAIN_TIMEOUT           1000    /* [ms] */
+#define DITHER_TIME             500     /* Time the dithered frame is measured [ms] */
+#define DITHER_TOLERANCE        0.25    /* Maximum error of mean dithered brightness [PWM steps] */
+#define FINE_TOLERANCE          0.51    /* Maximum error of fine brightness without dithering, half a step plus rounding [PWM steps] */
+
+typedef int (*emu_controllers_t)(void);
+typedef int (*emu_brightness_t)(int ctrl, int channel);
+typedef uint32_t (*emu_brightness_requests_t)(int ctrl);
+typedef uint32_t (*emu_apply_interval_t)(int ctrl, double *mean, double *deviation);
+typedef uint64_t (*emu_mean_brightness_t)(int ctrl, double *mean);
+typedef void (*emu_reenumerate_t)(void);
+
+
+static void gen_frame(atmo_driver_t *ad, int frame) {
+  int i;
+  for (i = 0; i < ad->sum_channels; ++i) {
+    const int f = frame - (frame + i) % 3;
+    ad->output_colors[i].r = (i + f) & 0xFF;
+    ad->output_colors[i].g = (i * 3 + f) & 0xFF;
+    ad->output_colors[i].b = (i * 7 + f * 5) & 0xFF;
+  }
+}
+
+
+  /* Engine channel of LED of controller. Controllers are assigned round robin to top, bottom, left and right */
+static int engine_channel(atmo_driver_t *ad, int ctrl, int led) {
+  const atmo_parameters_t *p = &ad->active_parm;
+  const int area_start[4] = { 0, p->top, p->top + p->bottom, p->top + p->bottom + p->left };
+  return area_start[ctrl % 4] + (ctrl / 4) * EMU_LEDS + led;
+}
+
+
+  /* Compare brightness of all channels of emulated controllers with colors */
+static int check_brightness(atmo_driver_t *ad, int num_ctrls, emu_brightness_t brightness, int report) {
+  int errors = 0, k, i;
+
+  for (k = 0; k < num_ctrls; ++k) {
+    for (i = 0; i < EMU_LEDS * 3; ++i) {
+      const rgb_color_t *c = &ad->output_colors[engine_channel(ad, k, i / 3)];
+      const int v = (i % 3 == 0) ? c->r: ((i % 3 == 1) ? c->g: c->b);
+      const int expected = (int)(pow(v / 255.0, 1.0) * EMU_PWM_RES + 0.5);
+      const int b = brightness(k, i);
+      if (b != expected) {
+        if (report && errors < 10)
+          printf("controller %d channel %d: brightness %d expected %d\n", k, i, b, expected);
+        ++errors;
+      }
+    }
+  }
+  return errors;
+}
+
+
+  /* Hold frame with fractional colors of the percent filter and compare mean brightness of controllers with interpolated gamma values */
+static int check_dithering(atmo_driver_t *ad, int frame, int num_ctrls, emu_mean_brightness_t mean_brightness, double tolerance, double *max_error) {
+  double mean[EMU_LEDS * 3];
+  struct timespec ts = { 0, 100000000 };
+  int errors = 0, fractions = 0, k, i;
+
+  ad->active_parm.filter = FILTER_PERCENTAGE;
+  ad->active_parm.filter_smoothness = 70;
+  reset_filters(ad);
+  gen_frame(ad, frame);
+  memcpy(ad->analyzed_colors, ad->output_colors, ad->sum_channels * sizeof(rgb_color_t));
+  apply_filters(ad);
+  gen_frame(ad, frame + 1);
+  memcpy(ad->analyzed_colors, ad->output_colors, ad->sum_channels * sizeof(rgb_color_t));
+  apply_filters(ad);
+  if (apply_delay_filter(ad) || send_output_colors(ad, ad->filtered_output_colors, 0))
+    return -1;
+
+    /* Start measuring when the frame is send */
+  nanosleep(&ts, NULL);
+  for (k = 0; k < num_ctrls; ++k)
+    mean_brightness(k, mean);
+  ts.tv_sec = DITHER_TIME / 1000;
+  ts.tv_nsec = (DITHER_TIME % 1000) * 1000000;
+  nanosleep(&ts, NULL);
+
+  *max_error = 0.0;
+  for (k = 0; k < num_ctrls; ++k) {
+    mean_brightness(k, mean);
+    for (i = 0; i < EMU_LEDS * 3; ++i) {
+      const rgb16_color_t *c = &ad->filtered_output_fine[engine_channel(ad, k, i / 3)];
+      const int v = (i % 3 == 0) ? c->r: ((i % 3 == 1) ? c->g: c->b), n = v >> 8, f = v & 0xFF;
+      const int b0 = (int)(n / 255.0 * EMU_PWM_RES + 0.5), b1 = (int)(MIN(n + 1, 255) / 255.0 * EMU_PWM_RES + 0.5);
+      const double expected = b0 + (b1 - b0) * f / 256.0, e = fabs(mean[i] - expected);
+      if (((b1 - b0) * f) & 0xFF)
+        ++fractions;
+      if (e > *max_error)
+        *max_error = e;
+      if (e > tolerance) {
+        if (errors < 10)
+          printf("controller %d channel %d: mean brightness %.3f expected %.3f\n", k, i, mean[i], expected);
+        ++errors;
+      }
+    }
+  }
+  if (!fractions) {
+    printf("dithered frame has no fractional brightness\n");
+    ++errors;
+  }
+  return errors;
+}
+
+
+  /* Close and reopen driver and output a frame. Returns the open time [ns] or 0 on failure */
+static uint64_t reopen_driver(atmo_driver_t *ad, int frame, int num_ctrls, emu_brightness_t brightness, int errors) {
+  uint64_t t;
+  int tries;
+
+  ad->output_driver->poll_colors(ad->output_driver, DRAIN_TIMEOUT);
+  ad->driver_opened = 0;
+  if (ad->output_driver->close(ad->output_driver) && !errors) {
+    printf("closing output driver failed: %s\n", ad->output_driver->errmsg);
+    return 0;
+  }
+  t = now_ns();
+  if (open_output_driver(ad))
+    return 0;
+  t = now_ns() - t;
+
+  gen_frame(ad, frame);
+  if (send_output_colors(ad, ad->output_colors, 1))
+    return 0;
+  for (tries = 0; tries < 5; ++tries) {
+    ad->output_driver->poll_colors(ad->output_driver, DRAIN_TIMEOUT);
+    if (!check_brightness(ad, num_ctrls, brightness, 0) || !errors || send_output_colors(ad, ad->output_colors, 1))
+      break;
+  }
+  if (check_brightness(ad, num_ctrls, brightness, 1)) {
+    printf("output after reopen failed\n");
+    return 0;
+  }
+  return t ? t: 1;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options]\n"
+                  "  -d <path>     path of DF10CH emulator driver (default: .)\n"
+                  "  -c <n>        number of emulated controllers (default: %d, maximum: 48)\n"
+                  "  -l <us>       latency of a request (default: 1000)\n"
+                  "  -j <us>       jitter of a request (default: 0)\n"
+                  "  -e <n>        every n-th brightness request fails (default: 0)\n"
+                  "  -n <frames>   number of frames (default: %d)\n"
+                  "  -r <ms>       output rate, 0 is as fast as possible (default: %d)\n"
+                  "  -t <ms>       timed output with this presentation lead (default: 0, untimed)\n"
+                  "  -J <us>       maximum random delay of a submit with output rate (default: 0)\n"
+                  "  -D <n>        dither cycles per output, check dithering of held fractional colors (default: 0)\n"
+                  "  -F            fine colors, check held fractional colors without dithering if -D is not given\n"
+                  "  -v <level>    log level 0 ... 3\n", prog, DEFAULT_CONTROLLERS, DEFAULT_FRAMES, DEFAULT_RATE);
+}
+
+
+int main(int argc, char *argv[]) {
+  static atmo_driver_t atmo_driver;
+  atmo_driver_t *ad = &atmo_driver;
+  const char *driver_path = ".";
+  int num_ctrls = DEFAULT_CONTROLLERS, latency = 1000, jitter = 0, errors = 0, frames = DEFAULT_FRAMES, rate = DEFAULT_RATE, lead = 0, submit_jitter = 0, dither = 0, fine = 0;
+  char emu_cfg[128], parms[SIZE_DRIVER_PATH + 128];
+  emu_controllers_t emu_controllers;
+  emu_brightness_t emu_brightness;
+  emu_brightness_requests_t emu_brightness_requests;
+  emu_apply_interval_t emu_apply_interval;
+  emu_mean_brightness_t emu_mean_brightness;
+  emu_reenumerate_t emu_reenumerate;
+  double interval = 0.0, deviation = 0.0, dither_error = 0.0;
+  uint32_t seed = 4711;
+  uint64_t start, next, worst = 0, elapsed, open_time, reopen_time = 0, reenum_time = 0;
+  uint32_t updates = 0;
+  int frame, mismatch, k, rc, c;
+
+  while ((c = getopt(argc, argv, "d:c:l:j:e:n:r:t:J:D:Fv:h")) != -1) {
+    switch (c) {
+    case 'd':
+      driver_path = optarg;
+      break;
+    case 'c':
+      num_ctrls = atoi(optarg);
+      break;
+    case 'l':
+      latency = atoi(optarg);
+      break;
+    case 'j':
+      jitter = atoi(optarg);
+      break;
+    case 'e':
+      errors = atoi(optarg);
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 't':
+      lead = atoi(optarg);
+      break;
+    case 'J':
+      submit_jitter = atoi(optarg);
+      break;
+    case 'D':
+      dither = atoi(optarg);
+      break;
+    case 'F':
+      fine = 1;
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (num_ctrls < 1 || num_ctrls > 48 || frames < 1 || rate < 0 || latency < 0 || jitter < 0 || errors < 0 || lead < 0 || lead > 500 || submit_jitter < 0 || dither < 0 || dither > 16) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  snprintf(emu_cfg, sizeof(emu_cfg), "controllers:%d&latency:%d&jitter:%d&errors:%d", num_ctrls, latency, jitter, errors);
+  setenv("DF10CH_EMU", emu_cfg, 1);
+
+  init_configuration(ad);
+  snprintf(parms, sizeof(parms), "driver=df10chemu driver_path=%s output_rate=%d output_lead=%d output_dither=%d fine_colors=%d", driver_path, rate ? rate: DEFAULT_RATE, lead, dither, fine);
+  if (set_parm_list(&ad->parm, parms) || load_output_driver(ad))
+    return 1;
+  open_time = now_ns();
+  if (open_output_driver(ad)) {
+    unload_output_driver(ad);
+    return 1;
+  }
+  open_time = now_ns() - open_time;
+  emu_controllers = (emu_controllers_t) GET_LIB_PROC(ad->output_driver_lib, "df10chemu_controllers");
+  emu_brightness = (emu_brightness_t) GET_LIB_PROC(ad->output_driver_lib, "df10chemu_brightness");
+  emu_brightness_requests = (emu_brightness_requests_t) GET_LIB_PROC(ad->output_driver_lib, "df10chemu_brightness_requests");
+  emu_apply_interval = (emu_apply_interval_t) GET_LIB_PROC(ad->output_driver_lib, "df10chemu_apply_interval");
+  emu_mean_brightness = (emu_mean_brightness_t) GET_LIB_PROC(ad->output_driver_lib, "df10chemu_mean_brightness");
+  emu_reenumerate = (emu_reenumerate_t) GET_LIB_PROC(ad->output_driver_lib, "df10chemu_reenumerate");
+  if (emu_controllers == NULL || emu_brightness == NULL || emu_brightness_requests == NULL || emu_apply_interval == NULL || emu_mean_brightness == NULL ||
+        emu_reenumerate == NULL || emu_controllers() != num_ctrls) {
+    printf("output driver is not the DF10CH emulator\n");
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    return 1;
+  }
+
+    /* Channel layout is defined by the controllers */
+  if (config_channels(ad)) {
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    return 1;
+  }
+  ad->active_parm = ad->parm;
+  if (turn_lights_off(ad)) {
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    free_channels(ad);
+    return 1;
+  }
+  ad->output_driver->poll_colors(ad->output_driver, DRAIN_TIMEOUT);
+  for (k = 0; k < num_ctrls; ++k)
+    updates -= emu_brightness_requests(k);
+  emu_apply_interval(0, &interval, &deviation);
+
+  rc = 0;
+  start = now_ns();
+  next = start;
+  for (frame = 1; frame <= frames; ++frame) {
+    uint64_t t;
+    gen_frame(ad, frame);
+    if (rate && submit_jitter) {
+      struct timespec ts = { 0, 0 };
+      seed = seed * 1664525U + 1013904223U;
+      ts.tv_nsec = ((seed >> 8) % (submit_jitter + 1)) * 1000;
+      nanosleep(&ts, NULL);
+    }
+    t = now_ns();
+    if ((rc = send_output_colors(ad, ad->output_colors, 0)))
+      break;
+    t = now_ns() - t;
+    if (t > worst)
+      worst = t;
+    if (rate) {
+      next += (uint64_t)rate * 1000000;
+      while ((t = now_ns()) < next)
+        ad->output_driver->poll_colors(ad->output_driver, (next - t) / 1000000);
+    }
+  }
+  if (rate)
+    emu_apply_interval(0, &interval, &deviation);
+
+    /* Wait until last frame is send, failed transfers are send again with next output. Without injected errors the partial updates must be complete */
+  mismatch = 0;
+  if (!rc) {
+    int tries;
+    for (tries = 0; tries < 5; ++tries) {
+      ad->output_driver->poll_colors(ad->output_driver, DRAIN_TIMEOUT);
+      if (!check_brightness(ad, num_ctrls, emu_brightness, 0) || !errors || (rc = send_output_colors(ad, ad->output_colors, 1)))
+        break;
+    }
+    if (!rc)
+      mismatch = check_brightness(ad, num_ctrls, emu_brightness, 1);
+    if (!rc && !mismatch && (dither || fine) &&
+          (mismatch = check_dithering(ad, frame, num_ctrls, emu_mean_brightness, dither ? DITHER_TOLERANCE: FINE_TOLERANCE, &dither_error)) < 0)
+      rc = 1;
+  }
+  elapsed = now_ns() - start;
+  for (k = 0; k < num_ctrls; ++k)
+    updates += emu_brightness_requests(k);
+
+    /* Reopen with cached controller data, second time after re-enumeration with new device addresses */
+  if (!rc && !mismatch) {
+    reopen_time = reopen_driver(ad, frame + 2, num_ctrls, emu_brightness, errors);
+    emu_reenumerate();
+    if (reopen_time)
+      reenum_time = reopen_driver(ad, frame + 4, num_ctrls, emu_brightness, errors);
+    if (!reenum_time)
+      rc = 1;
+  }
+
+    /* Close reports transfer errors that are expected with error injection */
+  ad->output_driver->poll_colors(ad->output_driver, DRAIN_TIMEOUT);
+  ad->driver_opened = 0;
+  if (ad->output_driver->close(ad->output_driver) && !errors) {
+    printf("closing output driver failed: %s\n", ad->output_driver->errmsg);
+    rc = 1;
+  }
+  unload_output_driver(ad);
+
+  if (frame <= frames)
+    printf("output failed at frame %d\n", frame);
+  printf("%d controllers with %d channels, %d frames in %.3f s, %.2f brightness updates per frame and %.1f updates/s per controller, worst submit %.1f us",
+          num_ctrls, num_ctrls * EMU_LEDS * 3, frames, elapsed / 1000000000.0, (double) updates / num_ctrls / frames,
+          updates * 1000000000.0 / elapsed / num_ctrls, worst / 1000.0);
+  if (rate)
+    printf(", update interval %.1f us, deviation %.1f us", interval, deviation);
+  if (dither || fine)
+    printf(", maximum %s error %.3f", dither ? "dither": "fine", dither_error);
+  printf(", open %.1f ms, reopen %.1f ms, after re-enumeration %.1f ms", open_time / 1000000.0, reopen_time / 1000000.0, reenum_time / 1000000.0);
+  printf(": %s\n", (rc || mismatch) ? "FAILED": "PASSED");
+  free_channels(ad);
+  return (rc || mismatch);
+}
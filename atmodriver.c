@@ -28,17 +28,40 @@
 #define DFATMO_DRIVER_VERSION   1
 
 /* supported pixel image formats */
-#define IMG_FMT_RGBA    0
-#define IMG_FMT_BGRA    1
+#define IMG_FMT_RGBA            0
+#define IMG_FMT_BGRA            1
+#define IMG_FMT_RGB48           2       /* Three native uint16_t per pixel */
+#define IMG_FMT_XRGB2101010     3       /* Native uint32_t per pixel with 10 bit red in bits 20-29 */
+
+/* engine color arrays exported as read only memoryview */
+#define VIEW_ANALYZED           0
+#define VIEW_FILTERED           1
+#define VIEW_FILTERED_OUTPUT    2
+#define NUM_VIEWS               3
+
+#ifndef Py_TPFLAGS_HAVE_NEWBUFFER
+#define Py_TPFLAGS_HAVE_NEWBUFFER       0       /* Always supported by Python 3 */
+#endif
 
 typedef struct {
   PyObject_HEAD
 
   atmo_driver_t ad;
   int configured;
+  PyObject *owner[NUM_VIEWS];
+  PyObject *view[NUM_VIEWS];
 
 } py_atmo_driver_t;
 
+  /* Owner of an exported engine color array, frees it when the last view is released */
+typedef struct {
+  PyObject_HEAD
+
+  rgb_color_t *colors;
+  Py_ssize_t size;
+
+} py_colors_t;
+
 static PyObject *atmo_error_exception;
 static PyObject *log_cb;
 
@@ -112,38 +135,161 @@ static void calc_hsv_image_from_bgra(hsv_color_t *hsv, uint8_t *img, int pitch,
 }
 
 
+static void calc_hsv_image_from_rgb48(hsv_color_t *hsv, uint16_t *fine_v, uint8_t *img, int pitch, int width, int height) {
+  pitch *= 6;
+  while (height--) {
+    uint16_t *i = (uint16_t *) img;
+    int w = width;
+    while (w--) {
+      rgb16_to_hsv(hsv, fine_v, i[0], i[1], i[2]);
+      ++hsv;
+      ++fine_v;
+      i += 3;
+    }
+    img += pitch;
+  }
+}
+
+
+static void calc_hsv_image_from_xrgb2101010(hsv_color_t *hsv, uint16_t *fine_v, uint8_t *img, int pitch, int width, int height) {
+  pitch *= 4;
+  while (height--) {
+    uint32_t *i = (uint32_t *) img;
+    int w = width;
+    while (w--) {
+      const uint32_t color = *i;
+      rgb16_to_hsv(hsv, fine_v, RGB10_TO_16((color >> 20) & 0x3FF), RGB10_TO_16((color >> 10) & 0x3FF), RGB10_TO_16(color & 0x3FF));
+      ++hsv;
+      ++fine_v;
+      ++i;
+    }
+    img += pitch;
+  }
+}
+
+
+  /* Contiguous buffer of any object supporting the buffer protocol */
+static int get_buffer(PyObject *obj, Py_buffer *buf, Py_ssize_t min_len, const char *errmsg) {
+  if (PyObject_GetBuffer(obj, buf, PyBUF_SIMPLE))
+    return -1;
+  if (buf->len < min_len) {
+    PyBuffer_Release(buf);
+    PyErr_SetString(atmo_error_exception, errmsg);
+    return -1;
+  }
+  return 0;
+}
+
+
+static PyTypeObject colors_type = { PyObject_HEAD_INIT(NULL) };
+static PyBufferProcs colors_buffer_procs;
+
+
+static int colors_getbuffer(py_colors_t *this, Py_buffer *view, int flags) {
+  return PyBuffer_FillInfo(view, (PyObject *)this, this->colors, this->size, 1, flags);
+}
+
+
+static void colors_dealloc(py_colors_t *this) {
+  free(this->colors);
+  Py_TYPE(this)->tp_free((PyObject*)this);
+}
+
+
+static rgb_color_t **view_colors(atmo_driver_t *ad, int i) {
+  switch (i) {
+  case VIEW_ANALYZED:
+    return &ad->analyzed_colors;
+  case VIEW_FILTERED:
+    return &ad->filtered_colors;
+  }
+  return &ad->filtered_output_colors;
+}
+
+
+  /* True if the caller has released the view, e.g. with a 'with' statement */
+static int view_released(PyObject *view) {
+  Py_buffer buf;
+  if (PyObject_GetBuffer(view, &buf, PyBUF_SIMPLE)) {
+    PyErr_Clear();
+    return 1;
+  }
+  PyBuffer_Release(&buf);
+  return 0;
+}
+
+
+  /*
+   * Persistent read only view of engine colors, it is overwritten by the next call that returns this view.
+   * The array is owned by the exporter of the view, so views held by the caller stay valid after the
+   * channels are reconfigured or the driver is released. Only a view released by the caller is recreated.
+   */
+static PyObject *get_view(py_atmo_driver_t *this, int i) {
+  if (this->owner[i] == NULL) {
+    py_colors_t *owner = PyObject_New(py_colors_t, &colors_type);
+    if (owner == NULL)
+      return NULL;
+    owner->colors = *view_colors(&this->ad, i);
+    owner->size = this->ad.sum_channels * sizeof(rgb_color_t);
+    this->owner[i] = (PyObject *)owner;
+  }
+  if (this->view[i] != NULL && view_released(this->view[i]))
+    Py_CLEAR(this->view[i]);
+  if (this->view[i] == NULL) {
+    this->view[i] = PyMemoryView_FromObject(this->owner[i]);
+    if (this->view[i] == NULL)
+      return NULL;
+  }
+  Py_INCREF(this->view[i]);
+  return this->view[i];
+}
+
+
+  /* Hand exported arrays over to their views, must be called before free_channels() */
+static void release_views(py_atmo_driver_t *this) {
+  int i;
+  for (i = 0; i < NUM_VIEWS; ++i) {
+    if (this->owner[i] != NULL) {
+      *view_colors(&this->ad, i) = NULL;
+      Py_CLEAR(this->view[i]);
+      Py_CLEAR(this->owner[i]);
+    }
+  }
+}
+
+
 static PyObject *analyze_image (py_atmo_driver_t *this, PyObject *args) {
   atmo_driver_t *ad = &this->ad;
   int img_width, img_height, img_format;
-  PyObject *ba_img;
+  PyObject *img_obj;
+  Py_buffer img_buf;
   int pixel_len;
   int img_size;
   int crop_width, crop_height, analyze_width, analyze_height;
   int overscan;
   uint8_t *img;
-  Py_ssize_t colors_size;
+  static const int rec_fmt[] = { REC_FMT_RGBA32, REC_FMT_BGRA32, REC_FMT_RGB48, REC_FMT_XRGB2101010 };
 
   CHECK_CONFIGURED(this);
 
-  if (!PyArg_ParseTuple(args, "iiiO!", &img_width, &img_height, &img_format, &PyByteArray_Type, &ba_img))
+  if (!PyArg_ParseTuple(args, "iiiO", &img_width, &img_height, &img_format, &img_obj))
     return NULL;
 
   switch (img_format) {
   case IMG_FMT_RGBA:
   case IMG_FMT_BGRA:
+  case IMG_FMT_XRGB2101010:
     pixel_len = 4;
     break;
+  case IMG_FMT_RGB48:
+    pixel_len = 6;
+    break;
   default:
     PyErr_SetString(atmo_error_exception, "unknown image format");
     return NULL;
   }
 
   img_size = img_width * img_height;
-  if (PyByteArray_Size(ba_img) < (img_size * pixel_len)) {
-    PyErr_SetString(atmo_error_exception, "pixel buffer to small for image size");
-    return NULL;
-  }
-
     /* calculate size of analyze (sub) window */
   overscan = ad->active_parm.overscan;
   if (overscan) {
@@ -167,8 +313,17 @@ static PyObject *analyze_image (py_atmo_driver_t *this, PyObject *args) {
   if (configure_analyze_size(ad, analyze_width, analyze_height))
     return PyErr_NoMemory();
 
+    /* Image is used in place, the export locks it against resizing */
+  if (get_buffer(img_obj, &img_buf, (Py_ssize_t)img_width * img_height * pixel_len, "pixel buffer to small for image size"))
+    return NULL;
+
+  Py_BEGIN_ALLOW_THREADS
+
+  img = (uint8_t *)img_buf.buf;
+  record_frame(&ad->recorder, ad->active_parm.record_file, rec_fmt[img_format], img, img_width, img_height, (img_width * pixel_len),
+                crop_width, crop_height, analyze_width, analyze_height);
+
     /* convert to hsv image */
-  img = (uint8_t *)PyByteArray_AsString(ba_img);
   img += (crop_height * img_width + crop_width) * pixel_len;
   switch (img_format) {
   case IMG_FMT_RGBA:
@@ -176,10 +331,16 @@ static PyObject *analyze_image (py_atmo_driver_t *this, PyObject *args) {
     break;
   case IMG_FMT_BGRA:
     calc_hsv_image_from_bgra(ad->hsv_img, img, img_width, analyze_width, analyze_height);
+    break;
+  case IMG_FMT_RGB48:
+    calc_hsv_image_from_rgb48(ad->hsv_img, ad->fine_v_img, img, img_width, analyze_width, analyze_height);
+    ad->fine_img = 1;
+    break;
+  case IMG_FMT_XRGB2101010:
+    calc_hsv_image_from_xrgb2101010(ad->hsv_img, ad->fine_v_img, img, img_width, analyze_width, analyze_height);
+    ad->fine_img = 1;
   }
 
-  Py_BEGIN_ALLOW_THREADS
-
   calc_hue_hist(ad);
   if (ad->active_parm.hue_win_size)
     calc_windowed_hue_hist(ad);
@@ -192,12 +353,14 @@ static PyObject *analyze_image (py_atmo_driver_t *this, PyObject *args) {
     calc_uniform_average_brightness(ad);
   else
     calc_average_brightness(ad);
-  calc_rgb_values(ad);
 
   Py_END_ALLOW_THREADS
 
-  colors_size = ad->sum_channels * sizeof(rgb_color_t);
-  return PyByteArray_FromStringAndSize((const char *)ad->analyzed_colors, colors_size);
+    /* Colors are written with the GIL held, so other threads never see a partly updated view */
+  calc_rgb_values(ad);
+
+  PyBuffer_Release(&img_buf);
+  return get_view(this, VIEW_ANALYZED);
 }
 
 
@@ -215,45 +378,50 @@ static PyObject *reset_filters_wrapper (py_atmo_driver_t *this, PyObject *args)
 
 static PyObject *filter_analyzed_colors (py_atmo_driver_t *this, PyObject *args) {
   atmo_driver_t *ad = &this->ad;
-  PyObject *ba_analyzed_colors;
+  PyObject *colors_obj;
+  Py_buffer colors_buf;
   int colors_size;
 
   CHECK_CONFIGURED(this);
 
-  if (!PyArg_ParseTuple(args, "O!", &PyByteArray_Type, &ba_analyzed_colors))
+  if (!PyArg_ParseTuple(args, "O", &colors_obj))
     return NULL;
 
   colors_size = ad->sum_channels * sizeof(rgb_color_t);
-  if (PyByteArray_Size(ba_analyzed_colors) < colors_size) {
-    PyErr_SetString(atmo_error_exception, "color buffer to small for configured number of channels");
+  if (get_buffer(colors_obj, &colors_buf, colors_size, "color buffer to small for configured number of channels"))
     return NULL;
-  }
 
-  memcpy(ad->analyzed_colors, (rgb_color_t *)PyByteArray_AsString(ba_analyzed_colors), colors_size);
+    /* Fraction of analysis is kept for unchanged colors, e.g. the view returned by analyzeImage() */
+  if (colors_buf.buf != ad->analyzed_colors && memcmp(ad->analyzed_colors, colors_buf.buf, colors_size)) {
+    memcpy(ad->analyzed_colors, colors_buf.buf, colors_size);
+    ad->analyzed_fine_valid = 0;
+  }
+  PyBuffer_Release(&colors_buf);
 
   apply_filters(ad);
 
-  return PyByteArray_FromStringAndSize((const char *)ad->filtered_colors, colors_size);
+  return get_view(this, VIEW_FILTERED);
 }
 
 
 static PyObject *filter_output_colors (py_atmo_driver_t *this, PyObject *args) {
   atmo_driver_t *ad = &this->ad;
-  PyObject *ba_output_colors;
+  PyObject *colors_obj;
+  Py_buffer colors_buf;
   int colors_size;
 
   CHECK_CONFIGURED(this);
 
-  if (!PyArg_ParseTuple(args, "O!", &PyByteArray_Type, &ba_output_colors))
+  if (!PyArg_ParseTuple(args, "O", &colors_obj))
     return NULL;
 
   colors_size = ad->sum_channels * sizeof(rgb_color_t);
-  if (PyByteArray_Size(ba_output_colors) < colors_size) {
-    PyErr_SetString(atmo_error_exception, "color buffer to small for configured number of channels");
+  if (get_buffer(colors_obj, &colors_buf, colors_size, "color buffer to small for configured number of channels"))
     return NULL;
-  }
 
-  memcpy(ad->filtered_colors, (rgb_color_t *)PyByteArray_AsString(ba_output_colors), colors_size);
+  if (colors_buf.buf != ad->filtered_colors)
+    memcpy(ad->filtered_colors, colors_buf.buf, colors_size);
+  PyBuffer_Release(&colors_buf);
 
   if (apply_delay_filter(ad))
     return PyErr_NoMemory();
@@ -263,36 +431,35 @@ static PyObject *filter_output_colors (py_atmo_driver_t *this, PyObject *args) {
   apply_white_calibration(ad);
   Py_END_ALLOW_THREADS
 
-  return PyByteArray_FromStringAndSize((const char *)ad->filtered_output_colors, colors_size);
+  return get_view(this, VIEW_FILTERED_OUTPUT);
 }
 
 
 static PyObject *output_colors_wrapper (py_atmo_driver_t *this, PyObject *args) {
   atmo_driver_t *ad = &this->ad;
-  PyObject *ba_output_colors;
-  int colors_size;
+  PyObject *colors_obj;
+  Py_buffer colors_buf;
+  int colors_size, rc;
 
   CHECK_CONFIGURED(this);
   CHECK_DRIVER_OPENED(ad);
 
-  if (!PyArg_ParseTuple(args, "O!", &PyByteArray_Type, &ba_output_colors))
+  if (!PyArg_ParseTuple(args, "O", &colors_obj))
     return NULL;
 
   colors_size = ad->sum_channels * sizeof(rgb_color_t);
-  if (PyByteArray_Size(ba_output_colors) < colors_size) {
-    PyErr_SetString(atmo_error_exception, "color buffer to small for configured number of channels");
+  if (get_buffer(colors_obj, &colors_buf, colors_size, "color buffer to small for configured number of channels"))
     return NULL;
-  }
-
-  memcpy(ad->output_colors, (rgb_color_t *)PyByteArray_AsString(ba_output_colors), colors_size);
 
+    /* Colors are send in place, fraction of fine colors is kept for the view returned by filterOutputColors() */
   Py_BEGIN_ALLOW_THREADS
-  if (send_output_colors(ad, ad->output_colors, 0)) {
-    Py_BLOCK_THREADS
-    return output_driver_error(ad);
-  }
+  rc = send_output_colors(ad, (rgb_color_t *)colors_buf.buf, 0);
   Py_END_ALLOW_THREADS
 
+  PyBuffer_Release(&colors_buf);
+  if (rc)
+    return output_driver_error(ad);
+
   Py_INCREF(Py_None);
   return Py_None;
 }
@@ -331,6 +498,7 @@ static PyObject *configure (py_atmo_driver_t *this, PyObject *args) {
                   ad->active_parm.top_right != ad->parm.top_right ||
                   ad->active_parm.bottom_left != ad->parm.bottom_left ||
                   ad->active_parm.bottom_right != ad->parm.bottom_right) {
+    release_views(this);
     free_channels(ad);
     if (config_channels(ad))
       return PyErr_NoMemory();
@@ -536,6 +704,7 @@ static void atmo_driver_dealloc(py_atmo_driver_t *this)
 
   close_output_driver(ad);
   unload_output_driver(ad);
+  release_views(this);
   free_channels(ad);
   free_analyze_images(ad);
 
@@ -544,10 +713,10 @@ static void atmo_driver_dealloc(py_atmo_driver_t *this)
 
 
 static PyMethodDef atmo_driver_methods[] = {
-  {"analyzeImage", (PyCFunction)analyze_image, METH_VARARGS, "analyzeImage(width,height,imgFormat,img) -- Analyze captured image"},
+  {"analyzeImage", (PyCFunction)analyze_image, METH_VARARGS, "analyzeImage(width,height,imgFormat,img) -- Analyze captured image of any buffer object, returns read only view of colors that changes with the next call."},
   {"resetFilters", (PyCFunction)reset_filters_wrapper, METH_VARARGS, "resetFilters() -- Reset all filters."},
-  {"filterAnalyzedColors", (PyCFunction)filter_analyzed_colors, METH_VARARGS, "filterAnalyzedColors(analyzedColors) -- Apply percent/mean filters."},
-  {"filterOutputColors", (PyCFunction)filter_output_colors, METH_VARARGS, "filterOutputColors(outputColors) -- Apply delay/white/gamma filters."},
+  {"filterAnalyzedColors", (PyCFunction)filter_analyzed_colors, METH_VARARGS, "filterAnalyzedColors(analyzedColors) -- Apply percent/mean filters, returns read only view of colors that changes with the next call."},
+  {"filterOutputColors", (PyCFunction)filter_output_colors, METH_VARARGS, "filterOutputColors(outputColors) -- Apply delay/white/gamma filters, returns read only view of colors that changes with the next call."},
   {"outputColors", (PyCFunction)output_colors_wrapper, METH_VARARGS, "outputColors(outputColors) -- Output colors to controller devices."},
   {"configure", (PyCFunction)configure, METH_VARARGS, "configure() -- Configure driver with applied attributes." },
   {"instantConfigure", (PyCFunction)instant_configure_wrapper, METH_VARARGS, "instantConfigure() -- Configure only the instant attributes of driver"},
@@ -618,6 +787,16 @@ PyMODINIT_FUNC initatmodriver(void)
   if (PyType_Ready(&atmo_driver_type) < 0)
       return;
 
+  colors_buffer_procs.bf_getbuffer = (getbufferproc)colors_getbuffer;
+  colors_type.tp_name = "atmodriver.Colors";
+  colors_type.tp_basicsize = sizeof(py_colors_t);
+  colors_type.tp_dealloc = (destructor)colors_dealloc;
+  colors_type.tp_as_buffer = &colors_buffer_procs;
+  colors_type.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER;
+  colors_type.tp_doc = "Engine colors exported by read only views.";
+  if (PyType_Ready(&colors_type) < 0)
+      return;
+
   m = Py_InitModule3("atmodriver", atmo_methods, "Native Atmolight driver.");
   if (m == NULL)
     return;
@@ -630,6 +809,8 @@ PyMODINIT_FUNC initatmodriver(void)
 
   PyModule_AddIntConstant(m, "IMAGE_FORMAT_RGBA", IMG_FMT_RGBA);
   PyModule_AddIntConstant(m, "IMAGE_FORMAT_BGRA", IMG_FMT_BGRA);
+  PyModule_AddIntConstant(m, "IMAGE_FORMAT_RGB48", IMG_FMT_RGB48);
+  PyModule_AddIntConstant(m, "IMAGE_FORMAT_XRGB2101010", IMG_FMT_XRGB2101010);
 
   PyModule_AddIntConstant(m, "FILTER_NONE", FILTER_NONE);
   PyModule_AddIntConstant(m, "FILTER_PERCENTAGE", FILTER_PERCENTAGE);
@@ -37,6 +37,7 @@
 #include <windows.h>
 
 #define inline __inline
+#define UNUSED_SYM
 typedef HINSTANCE lib_handle_t;
 typedef DWORD lib_error_t;
 
@@ -64,12 +65,16 @@ typedef const char* lib_error_t;
 #define CLEAR_LIB_ERROR()       dlerror()
 #define GET_LIB_ERROR()         dlerror()
 #define IS_LIB_ERROR(err)       (err != NULL)
-#define GET_LIB_ERR_MSG(err,buf) { if (err != NULL) strncpy(buf, err, sizeof(buf)); else buf[0] = 0; }
+#define GET_LIB_ERR_MSG(err,buf) { if (err != NULL) snprintf(buf, sizeof(buf), "%s", err); else buf[0] = 0; }
 #define LIB_NAME_TEMPLATE       "%.*s/dfatmo-%s.so"
 #define LIB_SEARCH_PATH_SEP     ':'
+#define UNUSED_SYM              __attribute__ ((unused))
 #endif
 
 #include "dfatmo.h"
+#include "dfatmo_thread.h"
+#include "dfatmo_timed.h"
+#include "atmorecorder.h"
 
 /* accuracy of color calculation */
 #define h_MAX   255
@@ -81,7 +86,18 @@ typedef const char* lib_error_t;
 #define MAX(X, Y)  ((X) > (Y) ? (X) : (Y))
 #define POS_DIV(a, b)  ( (a)/(b) + ( ((a)%(b) >= (b)/2 ) ? 1 : 0) )
 
+#define OUTPUT_DRAIN_TIMEOUT    1000    /* Maximum time waiting for output of last colors when closing output driver [ms] */
+#define DEADBAND_SETTLE_OUTPUTS 8       /* Number of outputs a moving channel uses the narrow dead-band */
+
+  /* Driver supports output of changed channels (fields since version 5 exist only in version 5 drivers) */
+#define HAS_SUBMIT_CHANGED(d)   ((d)->version >= 5 && (d)->submit_changed_colors != NULL)
+
+  /* Driver supports output of colors with presentation time (fields since version 6 exist only in version 6 drivers) */
+#define HAS_SUBMIT_TIMED(d)     ((d)->version >= 6 && (d)->submit_timed_colors != NULL)
+#define HAS_SUBMIT_FINE(d)      ((d)->version >= 7 && (d)->submit_fine_colors != NULL)
+
 enum { FILTER_NONE = 0, FILTER_PERCENTAGE, FILTER_COMBINED, NUM_FILTERS };
+enum { DEADBAND_LINEAR = 0, DEADBAND_PERCEPTUAL, NUM_DEADBAND_MODES };
 
 typedef struct { uint8_t h, s, v; } hsv_color_t;
 typedef struct { int r, g, b; } rgb_color_sum_t;
@@ -103,6 +119,11 @@ typedef struct {
   int img_size, alloc_img_size;
   int edge_weighting, weight_limit;
   hsv_color_t *hsv_img;
+  uint16_t *fine_v_img;                 // Brightness of hsv image with fraction (8.8) for images with more than 8 bit
+  int fine_img;                         // fine_v_img is set by conversion of actual image
+  uint64_t *avg_bright_fine;
+  rgb16_color_t *analyzed_fine;         // Analyzed colors with fraction if parameter 'fine_colors' is set
+  int analyzed_fine_valid;
   int weight_tab_size;
   weight_tab_t *weight_tab, *weight_tab_end;
 
@@ -111,6 +132,9 @@ typedef struct {
   rgb_color_t *mean_filter_values;
   rgb_color_sum_t *mean_filter_sum_values;
   int old_mean_length;
+  rgb16_color_t *filtered_fine;         // Filtered colors with fraction if fine colors are filtered
+  rgb16_color_t *mean_filter_fine_values;
+  int filter_fine;
 
     /* delay filter related */
   rgb_color_t *filtered_output_colors;
@@ -118,13 +142,28 @@ typedef struct {
   int delay_filter_queue_length, delay_filter_queue_pos;
   int filter_delay;
   int output_rate;
+  rgb16_color_t *filtered_output_fine, *delay_filter_fine_queue;
+  int delay_filter_fine;
 
     /* output related */
   lib_handle_t output_driver_lib;
   output_driver_t *output_driver;
   int driver_opened;
   rgb_color_t *output_colors, *last_output_colors;
+  uint32_t *changed_channels;
+  rgb16_color_t *output_fine, *last_output_fine;
   int elapsed_time_last_output;
+  uint64_t present_time;
+  uint32_t sent_outputs, suppressed_outputs, unchanged_outputs;
+
+    /* output dead-band related */
+  rgb_color_t *deadband_colors;
+  uint8_t *deadband_hold;
+  int deadband_mode;
+  uint8_t deadband_tab[256];
+
+    /* grab frame recording */
+  frame_recorder_t recorder;
 
 } atmo_driver_t;
 
@@ -171,6 +210,45 @@ static inline void rgb_to_hsv(hsv_color_t *hsv, int r, int g, int b) {
 }
 
 
+  /* Like rgb_to_hsv for 16 bit components. Brightness is set with fraction (8.8) too */
+static inline void rgb16_to_hsv(hsv_color_t *hsv, uint16_t *fine_v, int r, int g, int b) {
+  const int min_v = MIN(MIN(r, g), b);
+  const int max_v = MAX(MAX(r, g), b);
+  const int delta_v = max_v - min_v;
+  int h = 0;
+
+  *fine_v = (uint16_t) (((uint32_t)max_v * (v_MAX << 8) + 32767) / 65535);
+  hsv->v = (uint8_t) ((*fine_v + 128) >> 8);
+
+  if (delta_v == 0) {
+    hsv->s = 0;
+  } else {
+    const int dr = (max_v - r) + 3 * delta_v;
+    const int dg = (max_v - g) + 3 * delta_v;
+    const int db = (max_v - b) + 3 * delta_v;
+    const int divisor = 6 * delta_v;
+
+    hsv->s = (uint8_t) POS_DIV((delta_v * s_MAX), max_v);
+
+    if (r == max_v)
+      h = POS_DIV(((db - dg) * h_MAX), divisor);
+    else if (g == max_v)
+      h = POS_DIV(((dr - db) * h_MAX), divisor) + (h_MAX/3);
+    else
+      h = POS_DIV(((dg - dr) * h_MAX), divisor) + (h_MAX/3) * 2;
+
+    if (h < 0)
+      h += h_MAX;
+    if (h > h_MAX)
+      h -= h_MAX;
+  }
+  hsv->h = (uint8_t) h;
+}
+
+  /* Scale 10 bit component to 16 bit */
+#define RGB10_TO_16(c)  (((c) << 6) | ((c) >> 4))
+
+
 #define insert_weight(_c_, _w_) { tmpw = (_w_); if (tmpw >= weight_limit) { wt->pos = pos; wt->channel = (_c_); wt->weight = tmpw; ++wt; }}
 
 static void calc_weight(atmo_driver_t *self) {
@@ -455,19 +533,35 @@ static void calc_average_brightness(atmo_driver_t *self) {
   const int darkness_limit = self->active_parm.darkness_limit;
   const uint64_t bright = self->active_parm.brightness;
   uint64_t * const avg_bright = self->avg_bright;
+  uint64_t * const avg_bright_fine = self->avg_bright_fine;
+  const int fine = self->active_parm.fine_colors;
   int * const avg_cnt = self->avg_cnt;
   int c;
 
   memset(avg_bright, 0, (n * sizeof(uint64_t)));
   memset(avg_cnt, 0, (n * sizeof(int)));
 
-  while (wt < wte) {
-    hsv_color_t *hsv = hsv_img + wt->pos;
-    if (hsv->v >= darkness_limit) {
-      avg_bright[wt->channel] += hsv->v * wt->weight;
-      avg_cnt[wt->channel] += wt->weight;
+  if (fine) {
+    const uint16_t * const fine_v_img = self->fine_img ? self->fine_v_img: NULL;
+    memset(avg_bright_fine, 0, (n * sizeof(uint64_t)));
+    while (wt < wte) {
+      hsv_color_t *hsv = hsv_img + wt->pos;
+      if (hsv->v >= darkness_limit) {
+        avg_bright[wt->channel] += hsv->v * wt->weight;
+        avg_bright_fine[wt->channel] += (fine_v_img ? fine_v_img[wt->pos]: (hsv->v << 8)) * wt->weight;
+        avg_cnt[wt->channel] += wt->weight;
+      }
+      ++wt;
+    }
+  } else {
+    while (wt < wte) {
+      hsv_color_t *hsv = hsv_img + wt->pos;
+      if (hsv->v >= darkness_limit) {
+        avg_bright[wt->channel] += hsv->v * wt->weight;
+        avg_cnt[wt->channel] += wt->weight;
+      }
+      ++wt;
     }
-    ++wt;
   }
 
   for (c = 0; c < n; ++c) {
@@ -475,6 +569,11 @@ static void calc_average_brightness(atmo_driver_t *self) {
       avg_bright[c] = (avg_bright[c] * bright) / (avg_cnt[c] * ((uint64_t)100));
       if (avg_bright[c] > v_MAX)
         avg_bright[c] = v_MAX;
+      if (fine) {
+        avg_bright_fine[c] = (avg_bright_fine[c] * bright) / (avg_cnt[c] * ((uint64_t)100));
+        if (avg_bright_fine[c] > (v_MAX << 8))
+          avg_bright_fine[c] = (v_MAX << 8);
+      }
     }
   }
 }
@@ -482,9 +581,10 @@ static void calc_average_brightness(atmo_driver_t *self) {
 
 static void calc_uniform_average_brightness(atmo_driver_t *self) {
   hsv_color_t *hsv = self->hsv_img;
+  const uint16_t *fine_v = (self->fine_img && self->active_parm.fine_colors) ? self->fine_v_img: NULL;
   int img_size = self->img_size;
   const int darkness_limit = self->active_parm.darkness_limit * self->active_parm.uniform_brightness;
-  uint64_t avg = 0;
+  uint64_t avg = 0, avg_fine = 0;
   int cnt = 0;
   uint64_t * const avg_bright = self->avg_bright;
   int c = self->sum_channels;
@@ -493,89 +593,118 @@ static void calc_uniform_average_brightness(atmo_driver_t *self) {
     const int v = hsv->v;
     if (v >= darkness_limit) {
       avg += v;
+      if (fine_v)
+        avg_fine += *fine_v;
       ++cnt;
     }
     ++hsv;
+    if (fine_v)
+      ++fine_v;
   }
 
-  if (cnt)
+  if (!(self->fine_img && self->active_parm.fine_colors))
+    avg_fine = avg << 8;
+  if (cnt) {
     avg /= cnt;
-  else
+    avg_fine /= cnt;
+  } else {
     avg = darkness_limit;
+    avg_fine = darkness_limit << 8;
+  }
 
   avg = (avg * self->active_parm.brightness) / 100;
   if (avg > v_MAX)
     avg = v_MAX;
+  avg_fine = (avg_fine * self->active_parm.brightness) / 100;
+  if (avg_fine > (v_MAX << 8))
+    avg_fine = (v_MAX << 8);
 
-  while (c)
+  while (c) {
     avg_bright[--c] = avg;
+    self->avg_bright_fine[c] = avg_fine;
+  }
 }
 
 
-static void hsv_to_rgb(rgb_color_t *rgb, double h, double s, double v) {
-  int i;
-  double f, p, q, t;
+  // 8 bit colors of fine colors are truncated
+static void fine_to_colors(rgb_color_t *dst, const rgb16_color_t *fine, int n) {
+  while (n--) {
+    dst->r = fine->r >> 8;
+    dst->g = fine->g >> 8;
+    dst->b = fine->b >> 8;
+    ++dst;
+    ++fine;
+  }
+}
 
-  rgb->r = rgb->g = rgb->b = 0;
 
-  h /= h_MAX;
-  s /= s_MAX;
-  v /= v_MAX;
+  /* Fixed point conversion for brightness with fraction (8.8). Resulting colors are truncated to 8.8 */
+static void hsv_to_rgb(rgb16_color_t *rgb, int h, int s, int v) {
+  const int h6 = h * 6, i = h6 / h_MAX, f = h6 % h_MAX;
+  const uint32_t p = ((uint32_t)v * (s_MAX - s)) / s_MAX;
+  const uint32_t q = ((uint32_t)v * (h_MAX * s_MAX - s * f)) / (h_MAX * s_MAX);
+  const uint32_t t = ((uint32_t)v * (h_MAX * s_MAX - s * (h_MAX - f))) / (h_MAX * s_MAX);
 
-  if (s == 0.0) {
-    rgb->r = (uint8_t) (v * 255.0 + 0.5);
-    rgb->g = rgb->r;
-    rgb->b = rgb->r;
-  } else {
-    h = h * 6.0;
-    if (h == 6.0)
-      h = 0.0;
-    i = (int) h;
-
-    f = h - i;
-    p = v * (1.0 - s);
-    q = v * (1.0 - (s * f));
-    t = v * (1.0 - (s * (1.0 - f)));
-
-    if (i == 0) {
-      rgb->r = (uint8_t) (v * 255.0 + 0.5);
-      rgb->g = (uint8_t) (t * 255.0 + 0.5);
-      rgb->b = (uint8_t) (p * 255.0 + 0.5);
-    } else if (i == 1) {
-      rgb->r = (uint8_t) (q * 255.0 + 0.5);
-      rgb->g = (uint8_t) (v * 255.0 + 0.5);
-      rgb->b = (uint8_t) (p * 255.0 + 0.5);
-    } else if (i == 2) {
-      rgb->r = (uint8_t) (p * 255.0 + 0.5);
-      rgb->g = (uint8_t) (v * 255.0 + 0.5);
-      rgb->b = (uint8_t) (t * 255.0 + 0.5);
-    } else if (i == 3) {
-      rgb->r = (uint8_t) (p * 255.0 + 0.5);
-      rgb->g = (uint8_t) (q * 255.0 + 0.5);
-      rgb->b = (uint8_t) (v * 255.0 + 0.5);
-    } else if (i == 4) {
-      rgb->r = (uint8_t) (t * 255.0 + 0.5);
-      rgb->g = (uint8_t) (p * 255.0 + 0.5);
-      rgb->b = (uint8_t) (v * 255.0 + 0.5);
-    } else {
-      rgb->r = (uint8_t) (v * 255.0 + 0.5);
-      rgb->g = (uint8_t) (p * 255.0 + 0.5);
-      rgb->b = (uint8_t) (q * 255.0 + 0.5);
-    }
+  switch (i) {
+  case 1:
+    rgb->r = q;
+    rgb->g = v;
+    rgb->b = p;
+    break;
+  case 2:
+    rgb->r = p;
+    rgb->g = v;
+    rgb->b = t;
+    break;
+  case 3:
+    rgb->r = p;
+    rgb->g = q;
+    rgb->b = v;
+    break;
+  case 4:
+    rgb->r = t;
+    rgb->g = p;
+    rgb->b = v;
+    break;
+  case 5:
+    rgb->r = v;
+    rgb->g = p;
+    rgb->b = q;
+    break;
+  default:      /* hue of h_MAX is the same as 0 */
+    rgb->r = v;
+    rgb->g = t;
+    rgb->b = p;
   }
 }
 
 
 static void calc_rgb_values(atmo_driver_t *self) {
   const int n = self->sum_channels;
+  rgb_color_t *rgb = self->analyzed_colors;
   int c;
 
-  for (c = 0; c < n; ++c)
-    hsv_to_rgb(&self->analyzed_colors[c], (double)self->most_used_hue[c], (double)self->most_used_sat[c], (double)self->avg_bright[c]);
+  if (self->active_parm.fine_colors) {
+    rgb16_color_t *fine = self->analyzed_fine;
+    for (c = 0; c < n; ++c)
+      hsv_to_rgb(&fine[c], self->most_used_hue[c], self->most_used_sat[c], (int)self->avg_bright_fine[c]);
+    fine_to_colors(rgb, fine, n);
+    self->analyzed_fine_valid = 1;
+  } else {
+      /* 8 bit colors are rounded */
+    for (c = 0; c < n; ++c, ++rgb) {
+      rgb16_color_t fine;
+      hsv_to_rgb(&fine, self->most_used_hue[c], self->most_used_sat[c], (int)self->avg_bright[c] << 8);
+      rgb->r = (fine.r + 128) >> 8;
+      rgb->g = (fine.g + 128) >> 8;
+      rgb->b = (fine.b + 128) >> 8;
+    }
+    self->analyzed_fine_valid = 0;
+  }
 }
 
 
-static int configure_analyze_size(atmo_driver_t *self, int width, int height) {
+static inline int configure_analyze_size(atmo_driver_t *self, int width, int height) {
   int size = width * height;
   int edge_weighting = self->active_parm.edge_weighting;
   int weight_limit = self->active_parm.weight_limit;
@@ -583,12 +712,14 @@ static int configure_analyze_size(atmo_driver_t *self, int width, int height) {
     /* allocate hsv and weight images */
   if (size > self->alloc_img_size) {
     free(self->hsv_img);
+    free(self->fine_v_img);
     free(self->weight_tab);
     self->alloc_img_size = 0;
     self->hsv_img = (hsv_color_t *) malloc(size * sizeof(hsv_color_t));
+    self->fine_v_img = (uint16_t *) malloc(size * sizeof(uint16_t));
     self->weight_tab_size = size;
     self->weight_tab = (weight_tab_t *) malloc(size * sizeof(weight_tab_t));
-    if (self->hsv_img == NULL || self->weight_tab == NULL) {
+    if (self->hsv_img == NULL || self->fine_v_img == NULL || self->weight_tab == NULL) {
       DFATMO_LOG(DFLOG_ERROR, "allocating image memory failed!");
       return 1;
     }
@@ -599,6 +730,7 @@ static int configure_analyze_size(atmo_driver_t *self, int width, int height) {
     self->weight_limit = 0;
   }
   self->img_size = size;
+  self->fine_img = 0;
 
     /* calculate weight image */
   if (width != self->analyze_width || height != self->analyze_height || edge_weighting != self->edge_weighting || weight_limit != self->weight_limit) {
@@ -614,19 +746,48 @@ static int configure_analyze_size(atmo_driver_t *self, int width, int height) {
 }
 
 
-static void free_analyze_images (atmo_driver_t *self) {
+static inline void free_analyze_images (atmo_driver_t *self) {
+  close_recorder(&self->recorder);
   free(self->hsv_img);
+  free(self->fine_v_img);
   free(self->weight_tab);
   free(self->delay_filter_queue);
+  free(self->delay_filter_fine_queue);
 }
 
 
-static void reset_filters (atmo_driver_t *self) {
+static inline void reset_filters (atmo_driver_t *self) {
   self->old_mean_length = 0;
   self->filter_delay = -1;
 }
 
 
+  // Output driver gets the colors with fraction (8.8 fixed point)
+static int is_fine_output(atmo_driver_t *self) {
+  return (self->active_parm.fine_colors || self->active_parm.output_dither) && self->driver_opened && HAS_SUBMIT_FINE(self->output_driver);
+}
+
+
+  // Filters keep the fraction of colors if parameter 'fine_colors' is set or the output driver dithers them
+static int is_fine_filtering(atmo_driver_t *self) {
+  return self->active_parm.fine_colors || is_fine_output(self);
+}
+
+
+  // Combine colors with fraction of fine colors. Colors could be replaced by the caller after filtering, so only the fraction is taken
+static void merge_fine_colors(rgb16_color_t *dst, const rgb_color_t *colors, const rgb16_color_t *fine, int n) {
+  while (n--) {
+    dst->r = (colors->r << 8) | (fine ? (fine->r & 0xFF): 0);
+    dst->g = (colors->g << 8) | (fine ? (fine->g & 0xFF): 0);
+    dst->b = (colors->b << 8) | (fine ? (fine->b & 0xFF): 0);
+    ++dst;
+    ++colors;
+    if (fine)
+      ++fine;
+  }
+}
+
+
 static void percent_filter(atmo_driver_t *self, rgb_color_t *act) {
   rgb_color_t *out = self->filtered_colors;
   const int old_p = self->active_parm.filter_smoothness;
@@ -723,7 +884,119 @@ static void mean_filter(atmo_driver_t *self, rgb_color_t *act) {
 }
 
 
-static void apply_filters(atmo_driver_t *self) {
+static void percent_filter_fine(atmo_driver_t *self, const rgb16_color_t *act) {
+  rgb16_color_t *fine = self->filtered_fine;
+  const int old_p = self->active_parm.filter_smoothness;
+  const int new_p = 100 - old_p;
+  const int n = self->sum_channels;
+  int c;
+
+  if (self->old_mean_length) {
+    for (c = 0; c < n; ++c, ++act, ++fine) {
+      fine->r = (act->r * new_p + fine->r * old_p) / 100;
+      fine->g = (act->g * new_p + fine->g * old_p) / 100;
+      fine->b = (act->b * new_p + fine->b * old_p) / 100;
+    }
+  } else {
+    self->old_mean_length = -1;
+    memcpy(fine, act, n * sizeof(rgb16_color_t));
+  }
+  fine_to_colors(self->filtered_colors, self->filtered_fine, n);
+}
+
+
+  // Same as mean_filter but mean values and sums keep the fraction
+static void mean_filter_fine(atmo_driver_t *self, const rgb16_color_t *act) {
+  rgb16_color_t *fine = self->filtered_fine;
+  rgb16_color_t *mean_values = self->mean_filter_fine_values;
+  rgb_color_sum_t *mean_sums = self->mean_filter_sum_values;
+  const double mean_threshold = self->active_parm.filter_threshold * 4.4167 * 256.0;
+  const int old_p = self->active_parm.filter_smoothness;
+  const int new_p = 100 - old_p;
+  const int filter_length = self->active_parm.filter_length;
+  const int output_rate = self->active_parm.output_rate;
+  const int mean_length = (output_rate <= 0 || filter_length <= output_rate) ? 1: filter_length / output_rate;
+  const int max_sum = mean_length * 0xFF00;
+  const int reinitialize = (mean_length != self->old_mean_length);
+  int n = self->sum_channels;
+  double dr, dg, db;
+
+  self->old_mean_length = mean_length;
+
+  while (n--) {
+    mean_sums->r += (act->r - mean_values->r);
+    if (mean_sums->r < 0)
+      mean_sums->r = 0;
+    else if (mean_sums->r > max_sum)
+      mean_sums->r = max_sum;
+    mean_values->r = mean_sums->r / mean_length;
+
+    mean_sums->g += (act->g - mean_values->g);
+    if (mean_sums->g < 0)
+      mean_sums->g = 0;
+    else if (mean_sums->g > max_sum)
+      mean_sums->g = max_sum;
+    mean_values->g = mean_sums->g / mean_length;
+
+    mean_sums->b += (act->b - mean_values->b);
+    if (mean_sums->b < 0)
+      mean_sums->b = 0;
+    else if (mean_sums->b > max_sum)
+      mean_sums->b = max_sum;
+    mean_values->b = mean_sums->b / mean_length;
+
+    dr = (act->r - mean_values->r);
+    dg = (act->g - mean_values->g);
+    db = (act->b - mean_values->b);
+    if (sqrt(dr * dr + dg * dg + db * db) > mean_threshold || reinitialize) {
+      *fine = *act;
+      *mean_values = *act;
+      mean_sums->r = act->r * mean_length;
+      mean_sums->g = act->g * mean_length;
+      mean_sums->b = act->b * mean_length;
+    } else {
+      fine->r = (mean_values->r * new_p + fine->r * old_p) / 100;
+      fine->g = (mean_values->g * new_p + fine->g * old_p) / 100;
+      fine->b = (mean_values->b * new_p + fine->b * old_p) / 100;
+    }
+
+    ++act;
+    ++fine;
+    ++mean_sums;
+    ++mean_values;
+  }
+  fine_to_colors(self->filtered_colors, self->filtered_fine, self->sum_channels);
+}
+
+
+static inline void apply_filters(atmo_driver_t *self) {
+  const int fine = is_fine_filtering(self);
+
+    /* Filters restart if fine colors are switched */
+  if (fine != self->filter_fine) {
+    self->filter_fine = fine;
+    self->old_mean_length = 0;
+  }
+
+  if (fine) {
+      /* Colors not set by analysis have no fraction */
+    if (!self->analyzed_fine_valid)
+      merge_fine_colors(self->analyzed_fine, self->analyzed_colors, NULL, self->sum_channels);
+
+    switch (self->active_parm.filter) {
+    case FILTER_PERCENTAGE:
+      percent_filter_fine(self, self->analyzed_fine);
+      break;
+    case FILTER_COMBINED:
+      mean_filter_fine(self, self->analyzed_fine);
+      break;
+    default:
+      memcpy(self->filtered_fine, self->analyzed_fine, self->sum_channels * sizeof(rgb16_color_t));
+      fine_to_colors(self->filtered_colors, self->filtered_fine, self->sum_channels);
+    }
+    return;
+  }
+
     /* Transfer analyzed colors into filtered colors */
   switch (self->active_parm.filter) {
   case FILTER_PERCENTAGE:
@@ -739,7 +1012,7 @@ static void apply_filters(atmo_driver_t *self) {
 }
 
 
-static void apply_white_calibration(atmo_driver_t *self) {
+static inline void apply_white_calibration(atmo_driver_t *self) {
   const int wc_red = self->active_parm.wc_red;
   const int wc_green = self->active_parm.wc_green;
   const int wc_blue = self->active_parm.wc_blue;
@@ -747,47 +1020,79 @@ static void apply_white_calibration(atmo_driver_t *self) {
   if (wc_red < 255 || wc_green < 255 || wc_blue < 255) {
     rgb_color_t *out = self->filtered_output_colors;
     int n = self->sum_channels;
-    while (n--) {
-      out->r = (out->r * wc_red) / 255;
-      out->g = (out->g * wc_green) / 255;
-      out->b = (out->b * wc_blue) / 255;
-      ++out;
+    if (self->filter_fine) {
+      rgb16_color_t *fine = self->filtered_output_fine;
+      while (n--) {
+        fine->r = (fine->r * wc_red) / 255;
+        fine->g = (fine->g * wc_green) / 255;
+        fine->b = (fine->b * wc_blue) / 255;
+        out->r = fine->r >> 8;
+        out->g = fine->g >> 8;
+        out->b = fine->b >> 8;
+        ++out;
+        ++fine;
+      }
+    } else {
+      while (n--) {
+        out->r = (out->r * wc_red) / 255;
+        out->g = (out->g * wc_green) / 255;
+        out->b = (out->b * wc_blue) / 255;
+        ++out;
+      }
     }
   }
 }
 
 
-static void apply_gamma_correction(atmo_driver_t *self) {
+static inline void apply_gamma_correction(atmo_driver_t *self) {
   const int igamma = self->active_parm.gamma;
   if (igamma > 10)
   {
     const double gamma = igamma / 10.0;
     rgb_color_t *out = self->filtered_output_colors;
     int n = self->sum_channels;
-    while (n--) {
-      out->r = (uint8_t)(pow((out->r / 255.0), gamma) * 255.0);
-      out->g = (uint8_t)(pow((out->g / 255.0), gamma) * 255.0);
-      out->b = (uint8_t)(pow((out->b / 255.0), gamma) * 255.0);
-      ++out;
+    if (self->filter_fine) {
+      rgb16_color_t *fine = self->filtered_output_fine;
+      while (n--) {
+        fine->r = (uint16_t)(pow((MIN(fine->r, 0xFF00) / 65280.0), gamma) * 65280.0);
+        fine->g = (uint16_t)(pow((MIN(fine->g, 0xFF00) / 65280.0), gamma) * 65280.0);
+        fine->b = (uint16_t)(pow((MIN(fine->b, 0xFF00) / 65280.0), gamma) * 65280.0);
+        out->r = fine->r >> 8;
+        out->g = fine->g >> 8;
+        out->b = fine->b >> 8;
+        ++out;
+        ++fine;
+      }
+    } else {
+      while (n--) {
+        out->r = (uint8_t)(pow((out->r / 255.0), gamma) * 255.0);
+        out->g = (uint8_t)(pow((out->g / 255.0), gamma) * 255.0);
+        out->b = (uint8_t)(pow((out->b / 255.0), gamma) * 255.0);
+        ++out;
+      }
     }
   }
 }
 
 
-static int apply_delay_filter (atmo_driver_t *self) {
+static inline int apply_delay_filter (atmo_driver_t *self) {
   int filter_delay = self->active_parm.filter_delay;
   int output_rate = self->active_parm.output_rate;
   int colors_size = self->sum_channels * sizeof(rgb_color_t);
+  const int fine = self->filter_fine;
   int outp;
 
     /* Initialize delay filter queue */
-  if (self->filter_delay != filter_delay || self->output_rate != output_rate) {
+  if (self->filter_delay != filter_delay || self->output_rate != output_rate || self->delay_filter_fine != fine) {
     free(self->delay_filter_queue);
+    FREE_AND_SET_NULL(self->delay_filter_fine_queue);
     self->filter_delay = -1;
     self->delay_filter_queue_length = ((filter_delay >= output_rate) ? filter_delay / output_rate + 1: 0) * self->sum_channels;
     if (self->delay_filter_queue_length) {
       self->delay_filter_queue = (rgb_color_t *) calloc(self->delay_filter_queue_length, sizeof(rgb_color_t));
-      if (self->delay_filter_queue == NULL) {
+      if (fine)
+        self->delay_filter_fine_queue = (rgb16_color_t *) calloc(self->delay_filter_queue_length, sizeof(rgb16_color_t));
+      if (self->delay_filter_queue == NULL || (fine && self->delay_filter_fine_queue == NULL)) {
         DFATMO_LOG(DFLOG_ERROR, "allocating delay filter queue failed!");
         return 1;
       }
@@ -797,6 +1102,7 @@ static int apply_delay_filter (atmo_driver_t *self) {
 
     self->filter_delay = filter_delay;
     self->output_rate = output_rate;
+    self->delay_filter_fine = fine;
     self->delay_filter_queue_pos = 0;
   }
 
@@ -808,32 +1114,170 @@ static int apply_delay_filter (atmo_driver_t *self) {
 
     memcpy(&self->delay_filter_queue[self->delay_filter_queue_pos], self->filtered_colors, colors_size);
     memcpy(self->filtered_output_colors, &self->delay_filter_queue[outp], colors_size);
+    if (fine) {
+      merge_fine_colors(&self->delay_filter_fine_queue[self->delay_filter_queue_pos], self->filtered_colors, self->filtered_fine, self->sum_channels);
+      memcpy(self->filtered_output_fine, &self->delay_filter_fine_queue[outp], self->sum_channels * sizeof(rgb16_color_t));
+    }
 
     self->delay_filter_queue_pos = outp;
-  } else
+  } else {
     memcpy(self->filtered_output_colors, self->filtered_colors, colors_size);
+    if (fine)
+      merge_fine_colors(self->filtered_output_fine, self->filtered_colors, self->filtered_fine, self->sum_channels);
+  }
 
   return 0;
 }
 
 
+  // Set bit of every channel that differs from last send colors. Fine colors are compared if given
+static void calc_changed_channels(atmo_driver_t *self, rgb_color_t *output_colors, rgb16_color_t *fine) {
+  uint32_t *mask = self->changed_channels;
+  const rgb_color_t *n = output_colors, *l = self->last_output_colors;
+  int c;
+
+  memset(mask, 0, CHANNEL_MASK_WORDS(self->sum_channels) * sizeof(uint32_t));
+  if (fine) {
+    const rgb16_color_t *fl = self->last_output_fine;
+    for (c = 0; c < self->sum_channels; ++c, ++fine, ++fl) {
+      if (fine->r != fl->r || fine->g != fl->g || fine->b != fl->b)
+        mask[c / 32] |= 1U << (c % 32);
+    }
+    return;
+  }
+  for (c = 0; c < self->sum_channels; ++c, ++n, ++l) {
+    if (n->r != l->r || n->g != l->g || n->b != l->b)
+      mask[c / 32] |= 1U << (c % 32);
+  }
+}
+
+
+  // Map output values to the space the dead-band is applied in: linear or CIE lightness L* of linear intensity
+static void init_deadband_tab(atmo_driver_t *self, int mode) {
+  int v;
+
+  for (v = 0; v < 256; ++v) {
+    double y = v / 255.0, l = v;
+    if (mode == DEADBAND_PERCEPTUAL)
+      l = ((y > 0.008856) ? 116.0 * pow(y, 1.0 / 3.0) - 16.0: 903.3 * y) * 2.55;
+    self->deadband_tab[v] = (uint8_t)(l + 0.5);
+  }
+  self->deadband_mode = mode;
+}
+
+
+  /*
+   * Channels that differ from the last send colors by not more than the dead-band keep their last send color.
+   * A channel that exceeded the dead-band uses half of the dead-band until it did not move for some outputs,
+   * so fades are followed smoothly but flicker of resting colors is suppressed. Switching a channel off is always send.
+   * Held channels of fine colors keep their last send fraction too.
+   */
+static rgb_color_t *apply_output_deadband(atmo_driver_t *self, rgb_color_t *output_colors, rgb16_color_t *fine) {
+  const int deadband = self->active_parm.output_deadband;
+  const uint8_t *tab = self->deadband_tab;
+  const rgb_color_t *n = output_colors, *l = self->last_output_colors;
+  rgb_color_t *out = self->deadband_colors;
+  uint8_t *hold = self->deadband_hold;
+  int c;
+
+  if (self->deadband_mode != self->active_parm.output_deadband_mode)
+    init_deadband_tab(self, self->active_parm.output_deadband_mode);
+
+  for (c = 0; c < self->sum_channels; ++c, ++n, ++l, ++out, ++hold) {
+    const int dr = abs(tab[n->r] - tab[l->r]), dg = abs(tab[n->g] - tab[l->g]), db = abs(tab[n->b] - tab[l->b]);
+    const int d = MAX(dr, MAX(dg, db));
+    if (d > (*hold ? deadband / 2: deadband) || (!(n->r | n->g | n->b) && (l->r | l->g | l->b))) {
+      *out = *n;
+      *hold = DEADBAND_SETTLE_OUTPUTS;
+    } else {
+      *out = *l;
+      if (fine)
+        fine[c] = self->last_output_fine[c];
+      if (*hold)
+        --*hold;
+    }
+  }
+  return self->deadband_colors;
+}
+
+
+  /*
+   * Presentation time of next output for timed output. Times follow a fixed grid of the output rate so wake up jitter of
+   * the output thread is absorbed by the driver. The grid slowly follows the drift of the output thread and is set again
+   * if the output thread is off by more than one output period.
+   */
+static uint64_t calc_present_time(atmo_driver_t *self) {
+  const uint64_t target = dfatmo_clock_us() + self->active_parm.output_lead * 1000;
+  const int64_t period = self->active_parm.output_rate * 1000;
+  uint64_t t = self->present_time + period;
+  const int64_t err = (int64_t)(target - t);
+
+  if (!self->present_time || err > period || err < -period)
+    t = target;
+  else
+    t += err / 8;
+  self->present_time = t;
+  return t;
+}
+
+
 static int send_output_colors (atmo_driver_t *self, rgb_color_t *output_colors, int initial) {
   int colors_size = self->sum_channels * sizeof(rgb_color_t);
-  int rc = 0;
+  const int timed = (self->active_parm.output_lead && HAS_SUBMIT_TIMED(self->output_driver));
+  const uint64_t present_time = timed ? calc_present_time(self): 0;
+  rgb16_color_t *fine = NULL;
+  int rc = 0, changed;
+
+    // Fraction of colors is only known for the colors of the filter chain
+  if (is_fine_output(self)) {
+    fine = self->output_fine;
+    merge_fine_colors(fine, output_colors, (output_colors == self->filtered_output_colors && self->filter_fine) ? self->filtered_output_fine: NULL, self->sum_channels);
+  }
 
-  if (!initial) {
+    // Send all colors at least every keep alive interval to trigger idle watchdog of controllers
+  if (!initial && self->active_parm.output_keepalive) {
     self->elapsed_time_last_output += self->active_parm.output_rate;
-    if (self->elapsed_time_last_output > 500)   // FIXME: Should be a configurable parameter [ms]!
+    if (self->elapsed_time_last_output > self->active_parm.output_keepalive)
       initial = 1;
   }
 
-  if (initial || memcmp(output_colors, self->last_output_colors, colors_size)) {
+  changed = initial || (fine ? memcmp(fine, self->last_output_fine, self->sum_channels * sizeof(rgb16_color_t)): memcmp(output_colors, self->last_output_colors, colors_size));
+  if (changed && !initial && self->active_parm.output_deadband) {
+    output_colors = apply_output_deadband(self, output_colors, fine);
+    changed = fine ? memcmp(fine, self->last_output_fine, self->sum_channels * sizeof(rgb16_color_t)): memcmp(output_colors, self->last_output_colors, colors_size);
+    if (!changed)
+      ++self->suppressed_outputs;
+  } else if (!changed)
+    ++self->unchanged_outputs;
+
+  if (changed) {
+    ++self->sent_outputs;
     self->elapsed_time_last_output = 0;
-    rc = self->output_driver->output_colors(self->output_driver, output_colors, initial ? NULL: self->last_output_colors);
+    if (fine || timed || HAS_SUBMIT_CHANGED(self->output_driver)) {
+      if (!initial)
+        calc_changed_channels(self, output_colors, fine);
+      if (fine)
+        rc = self->output_driver->submit_fine_colors(self->output_driver, fine, initial ? NULL: self->changed_channels, present_time);
+      else if (timed)
+        rc = self->output_driver->submit_timed_colors(self->output_driver, output_colors, initial ? NULL: self->changed_channels, present_time);
+      else
+        rc = self->output_driver->submit_changed_colors(self->output_driver, output_colors, initial ? NULL: self->changed_channels);
+    } else
+      rc = self->output_driver->submit_colors(self->output_driver, output_colors, initial ? NULL: self->last_output_colors);
     if (rc)
       DFATMO_LOG(DFLOG_ERROR, "output driver error: %s", self->output_driver->errmsg);
-    else
+    else {
       memcpy(self->last_output_colors, output_colors, colors_size);
+      if (fine)
+        memcpy(self->last_output_fine, fine, self->sum_channels * sizeof(rgb16_color_t));
+    }
+  } else {
+      // Give driver the chance to send colors that are deferred because device was busy
+    rc = self->output_driver->poll_colors(self->output_driver, 0);
+    if (rc < 0)
+      DFATMO_LOG(DFLOG_ERROR, "output driver error: %s", self->output_driver->errmsg);
+    else
+      rc = 0;
   }
 
   return rc;
@@ -869,14 +1313,25 @@ static int config_channels(atmo_driver_t *self) {
 
   self->avg_cnt = (int *) calloc(n, sizeof(int));
   self->avg_bright = (uint64_t *) calloc(n, sizeof(uint64_t));
+  self->avg_bright_fine = (uint64_t *) calloc(n, sizeof(uint64_t));
 
   self->analyzed_colors = (rgb_color_t *) calloc(n, sizeof(rgb_color_t));
+  self->analyzed_fine = (rgb16_color_t *) calloc(n, sizeof(rgb16_color_t));
   self->filtered_colors = (rgb_color_t *) calloc(n, sizeof(rgb_color_t));
   self->filtered_output_colors = (rgb_color_t *) calloc(n, sizeof(rgb_color_t));
+  self->filtered_fine = (rgb16_color_t *) calloc(n, sizeof(rgb16_color_t));
+  self->filtered_output_fine = (rgb16_color_t *) calloc(n, sizeof(rgb16_color_t));
+  self->output_fine = (rgb16_color_t *) calloc(n, sizeof(rgb16_color_t));
+  self->last_output_fine = (rgb16_color_t *) calloc(n, sizeof(rgb16_color_t));
   self->output_colors = (rgb_color_t *) calloc(n, sizeof(rgb_color_t));
   self->last_output_colors = (rgb_color_t *) calloc(n, sizeof(rgb_color_t));
+  self->changed_channels = (uint32_t *) calloc(CHANNEL_MASK_WORDS(n), sizeof(uint32_t));
+  self->deadband_colors = (rgb_color_t *) calloc(n, sizeof(rgb_color_t));
+  self->deadband_hold = (uint8_t *) calloc(n, sizeof(uint8_t));
+  self->deadband_mode = -1;
   self->mean_filter_values = (rgb_color_t *) calloc(n, sizeof(rgb_color_t));
   self->mean_filter_sum_values = (rgb_color_sum_t *) calloc(n, sizeof(rgb_color_sum_t));
+  self->mean_filter_fine_values = (rgb16_color_t *) calloc(n, sizeof(rgb16_color_t));
 
   if (!(self->hue_hist &&
       self->w_hue_hist &&
@@ -887,13 +1342,23 @@ static int config_channels(atmo_driver_t *self) {
       self->most_used_sat &&
       self->avg_cnt &&
       self->avg_bright &&
+      self->avg_bright_fine &&
       self->analyzed_colors &&
+      self->analyzed_fine &&
       self->filtered_colors &&
       self->filtered_output_colors &&
+      self->filtered_fine &&
+      self->filtered_output_fine &&
+      self->output_fine &&
+      self->last_output_fine &&
       self->output_colors &&
       self->last_output_colors &&
+      self->changed_channels &&
+      self->deadband_colors &&
+      self->deadband_hold &&
       self->mean_filter_values &&
-      self->mean_filter_sum_values)) {
+      self->mean_filter_sum_values &&
+      self->mean_filter_fine_values)) {
     DFATMO_LOG(DFLOG_ERROR, "channel configuration fails!");
     return 1;
   }
@@ -916,14 +1381,24 @@ static void free_channels(atmo_driver_t *self) {
 
     FREE_AND_SET_NULL(self->avg_cnt);
     FREE_AND_SET_NULL(self->avg_bright);
+    FREE_AND_SET_NULL(self->avg_bright_fine);
 
     FREE_AND_SET_NULL(self->analyzed_colors);
+    FREE_AND_SET_NULL(self->analyzed_fine);
     FREE_AND_SET_NULL(self->filtered_colors);
     FREE_AND_SET_NULL(self->filtered_output_colors);
+    FREE_AND_SET_NULL(self->filtered_fine);
+    FREE_AND_SET_NULL(self->filtered_output_fine);
+    FREE_AND_SET_NULL(self->output_fine);
+    FREE_AND_SET_NULL(self->last_output_fine);
     FREE_AND_SET_NULL(self->output_colors);
     FREE_AND_SET_NULL(self->last_output_colors);
+    FREE_AND_SET_NULL(self->changed_channels);
+    FREE_AND_SET_NULL(self->deadband_colors);
+    FREE_AND_SET_NULL(self->deadband_hold);
     FREE_AND_SET_NULL(self->mean_filter_values);
     FREE_AND_SET_NULL(self->mean_filter_sum_values);
+    FREE_AND_SET_NULL(self->mean_filter_fine_values);
 
     self->sum_channels = 0;
   }
@@ -950,62 +1425,366 @@ static int null_driver_output_colors(output_driver_t *self_gen, rgb_color_t *col
   return 0;
 }
 
+static int null_driver_poll_colors(output_driver_t *self_gen, int timeout_ms) {
+  return 0;
+}
 
-static void unload_output_driver(atmo_driver_t *self) {
-  if (self->output_driver) {
-    self->output_driver->dispose(self->output_driver);
-    self->output_driver = NULL;
+
+/*
+ * Adapter for output drivers with synchronous output only (version 3 drivers or newer drivers without submit_colors).
+ *
+ * Colors are passed to a worker thread by a single slot mailbox. The worker calls output_colors of the wrapped driver
+ * for the newest colors of the mailbox. Colors submitted while the worker is busy replace not yet send colors.
+ * Timed colors are queued and the worker calls output_colors when they are due.
+ */
+#define MAX_OUTPUT_CHANNELS     (NUM_AREAS * MAX_BORDER_CHANNELS)
+
+typedef struct {
+  output_driver_t output_driver;
+  output_driver_t *driver;          // Wrapped synchronous driver
+  thread_t worker_thread;
+  mutex_t lock;
+  cond_t cond;
+  int worker_running;
+  int num_channels;
+  int has_pending;                  // Mailbox contains not yet send colors
+  int pending_initial;              // Mailbox colors must be send without last colors
+  int busy;                         // Worker is calling output_colors of wrapped driver
+  int configuring;                  // Wrapped driver is reconfigured
+  int error;                        // Output of worker failed
+  char worker_errmsg[128];
+  uint32_t dropped_colors;
+  dfatmo_timed_queue_t queue;       // Timed colors
+  uint32_t changed[CHANNEL_MASK_WORDS(MAX_OUTPUT_CHANNELS)];
+  rgb_color_t pending_colors[MAX_OUTPUT_CHANNELS];
+  rgb_color_t send_colors[MAX_OUTPUT_CHANNELS];
+  rgb_color_t last_colors[MAX_OUTPUT_CHANNELS];
+} output_adapter_t;
+
+
+static int num_output_channels(atmo_parameters_t *p) {
+  return p->top + p->bottom + p->left + p->right + p->center + p->top_left + p->top_right + p->bottom_left + p->bottom_right;
+}
+
+
+static THREAD_PROC(output_adapter_worker, self_gen) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+
+  LOCK_MUTEX(&self->lock);
+  for (;;) {
+    int initial, rc, all;
+
+      // Wait for mailbox or until first timed colors are due. Timed colors are send at once when stopping
+    for (;;) {
+      int64_t wait_us = -1;
+      if (!self->configuring) {
+        if (self->has_pending)
+          break;
+        wait_us = dfatmo_timed_queue_wait_us(&self->queue, self->worker_running ? dfatmo_clock_us(): UINT64_MAX);
+        if (!wait_us || !self->worker_running)
+          break;
+      }
+      if (!self->worker_running)
+        break;
+      if (wait_us < 0)
+        WAIT_COND(&self->cond, &self->lock);
+      else {
+        deadline_t deadline;
+        SET_DEADLINE(deadline, (int)((wait_us + 999) / 1000));
+        (void) TIMED_WAIT_COND(&self->cond, &self->lock, deadline);
+      }
+    }
+
+    initial = self->pending_initial;
+    if (self->configuring)
+      break;
+    else if (self->has_pending) {
+      memcpy(self->send_colors, self->pending_colors, self->num_channels * sizeof(rgb_color_t));
+      self->has_pending = 0;
+    } else if (dfatmo_timed_queue_take(&self->queue, self->worker_running ? dfatmo_clock_us(): UINT64_MAX, self->send_colors, self->changed, &all))
+      initial |= all;
+    else
+      break;
+    self->pending_initial = 0;
+    self->busy = 1;
+    UNLOCK_MUTEX(&self->lock);
+
+    rc = self->driver->output_colors(self->driver, self->send_colors, initial ? NULL: self->last_colors);
+
+    LOCK_MUTEX(&self->lock);
+    if (rc) {
+      if (!self->error) {
+        self->error = 1;
+        strcpy(self->worker_errmsg, self->driver->errmsg);
+      }
+        // Device state is unknown so send next colors completely
+      self->pending_initial = 1;
+    }
+    else
+      memcpy(self->last_colors, self->send_colors, self->num_channels * sizeof(rgb_color_t));
+    self->busy = 0;
+    BROADCAST_COND(&self->cond);
   }
-  if (self->output_driver_lib) {
-    FREE_LIBRARY(self->output_driver_lib);
-    self->output_driver_lib = NULL;
-    DFATMO_LOG(DFLOG_INFO, "output driver unloaded");
+  UNLOCK_MUTEX(&self->lock);
+  THREAD_RETURN;
+}
+
+
+static int output_adapter_open(output_driver_t *self_gen, atmo_parameters_t *param) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  int rc = self->driver->open(self->driver, param);
+
+  if (rc) {
+    strcpy(self->output_driver.errmsg, self->driver->errmsg);
+    return rc;
   }
+
+  self->num_channels = MIN(num_output_channels(param), MAX_OUTPUT_CHANNELS);
+  self->has_pending = 0;
+  self->busy = 0;
+  self->configuring = 0;
+  self->error = 0;
+  self->dropped_colors = 0;
+  if (dfatmo_timed_queue_init(&self->queue, self->num_channels, sizeof(rgb_color_t))) {
+    strcpy(self->output_driver.errmsg, "allocating timed color queue failed");
+    self->driver->close(self->driver);
+    return -1;
+  }
+  self->worker_running = 1;
+  INIT_MUTEX(&self->lock);
+  INIT_COND(&self->cond);
+  if (CREATE_THREAD(&self->worker_thread, output_adapter_worker, self)) {
+    strcpy(self->output_driver.errmsg, "creating output worker thread failed");
+    DESTROY_COND(&self->cond);
+    DESTROY_MUTEX(&self->lock);
+    dfatmo_timed_queue_free(&self->queue);
+    self->worker_running = 0;
+    self->driver->close(self->driver);
+    return -1;
+  }
+  return 0;
 }
 
 
-static int load_output_driver(atmo_driver_t *self) {
+static int output_adapter_configure(output_driver_t *self_gen, atmo_parameters_t *param) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  int rc;
+
+    // Wrapped driver is not thread safe so stop worker while configuring
+  LOCK_MUTEX(&self->lock);
+  self->configuring = 1;
+  while (self->busy)
+    WAIT_COND(&self->cond, &self->lock);
+  UNLOCK_MUTEX(&self->lock);
+
+  rc = self->driver->configure(self->driver, param);
+  if (rc)
+    strcpy(self->output_driver.errmsg, self->driver->errmsg);
+
+  LOCK_MUTEX(&self->lock);
+  self->num_channels = MIN(num_output_channels(param), MAX_OUTPUT_CHANNELS);
+  self->has_pending = 0;
+  self->pending_initial = 1;
+  if (self->queue.num_channels != self->num_channels) {
+    self->dropped_colors += self->queue.replaced;
+    dfatmo_timed_queue_free(&self->queue);
+    if (dfatmo_timed_queue_init(&self->queue, self->num_channels, sizeof(rgb_color_t)) && !rc) {
+      strcpy(self->output_driver.errmsg, "allocating timed color queue failed");
+      rc = -1;
+    }
+  } else
+    dfatmo_timed_queue_clear(&self->queue);
+  self->configuring = 0;
+  BROADCAST_COND(&self->cond);
+  UNLOCK_MUTEX(&self->lock);
+  return rc;
+}
+
+
+static int output_adapter_close(output_driver_t *self_gen) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  int rc;
+
+  if (self->worker_running) {
+    LOCK_MUTEX(&self->lock);
+    self->worker_running = 0;
+    BROADCAST_COND(&self->cond);
+    UNLOCK_MUTEX(&self->lock);
+    JOIN_THREAD(self->worker_thread);
+    DESTROY_COND(&self->cond);
+    DESTROY_MUTEX(&self->lock);
+    self->dropped_colors += self->queue.replaced;
+    dfatmo_timed_queue_free(&self->queue);
+    if (self->dropped_colors)
+      DFATMO_LOG(DFLOG_INFO, "%u outdated color outputs dropped", self->dropped_colors);
+  }
+
+  rc = self->driver->close(self->driver);
+  if (rc)
+    strcpy(self->output_driver.errmsg, self->driver->errmsg);
+  return rc;
+}
+
+
+static void output_adapter_dispose(output_driver_t *self_gen) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  self->driver->dispose(self->driver);
+  free(self);
+}
+
+
+static int output_adapter_output_colors(output_driver_t *self_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  int rc;
+
+  LOCK_MUTEX(&self->lock);
+  while (self->busy)
+    WAIT_COND(&self->cond, &self->lock);
+  rc = self->driver->output_colors(self->driver, colors, last_colors);
+  if (rc)
+    strcpy(self->output_driver.errmsg, self->driver->errmsg);
+  else
+    memcpy(self->last_colors, colors, self->num_channels * sizeof(rgb_color_t));
+  UNLOCK_MUTEX(&self->lock);
+  return rc;
+}
+
+
+static int output_adapter_submit_colors(output_driver_t *self_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  int rc = 0;
+
+  LOCK_MUTEX(&self->lock);
+  if (self->error) {
+      // Report error of worker once
+    strcpy(self->output_driver.errmsg, self->worker_errmsg);
+    self->error = 0;
+    rc = -1;
+  }
+  if (self->has_pending)
+    ++self->dropped_colors;
+  if (!last_colors)
+    self->pending_initial = 1;
+  memcpy(self->pending_colors, colors, self->num_channels * sizeof(rgb_color_t));
+  self->has_pending = 1;
+    // Colors without presentation time replace all timed colors
+  self->dropped_colors += self->queue.count;
+  dfatmo_timed_queue_clear(&self->queue);
+  SIGNAL_COND(&self->cond);
+  UNLOCK_MUTEX(&self->lock);
+  return rc;
+}
+
+
+static int output_adapter_submit_timed_colors(output_driver_t *self_gen, rgb_color_t *colors, const uint32_t *changed, uint64_t present_us) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  int rc = 0;
+
+  LOCK_MUTEX(&self->lock);
+  if (self->error) {
+    strcpy(self->output_driver.errmsg, self->worker_errmsg);
+    self->error = 0;
+    rc = -1;
+  }
+  dfatmo_timed_queue_push(&self->queue, colors, changed, present_us);
+  SIGNAL_COND(&self->cond);
+  UNLOCK_MUTEX(&self->lock);
+  return rc;
+}
+
+
+static int output_adapter_poll_colors(output_driver_t *self_gen, int timeout_ms) {
+  output_adapter_t *self = (output_adapter_t *) self_gen;
+  deadline_t deadline;
+  int rc;
+
+  SET_DEADLINE(deadline, timeout_ms);
+  LOCK_MUTEX(&self->lock);
+  while ((self->has_pending || self->busy || self->queue.count) && !self->error) {
+    if (!TIMED_WAIT_COND(&self->cond, &self->lock, deadline))
+      break;
+  }
+  if (self->error) {
+    strcpy(self->output_driver.errmsg, self->worker_errmsg);
+    self->error = 0;
+    rc = -1;
+  }
+  else
+    rc = (self->has_pending || self->busy || self->queue.count);
+  UNLOCK_MUTEX(&self->lock);
+  return rc;
+}
+
+
+static output_driver_t *new_output_adapter(output_driver_t *driver) {
+  output_adapter_t *self = (output_adapter_t *) calloc(1, sizeof(output_adapter_t));
+  if (self == NULL)
+    return NULL;
+
+  self->driver = driver;
+  self->pending_initial = 1;
+  self->output_driver.version = DFATMO_OUTPUT_DRIVER_VERSION;
+  self->output_driver.open = output_adapter_open;
+  self->output_driver.configure = output_adapter_configure;
+  self->output_driver.close = output_adapter_close;
+  self->output_driver.dispose = output_adapter_dispose;
+  self->output_driver.output_colors = output_adapter_output_colors;
+  self->output_driver.submit_colors = output_adapter_submit_colors;
+  self->output_driver.poll_colors = output_adapter_poll_colors;
+  self->output_driver.submit_timed_colors = output_adapter_submit_timed_colors;
+  return &self->output_driver;
+}
+
+
+static output_driver_t *new_null_output_driver(void) {
+  output_driver_t *driver = (output_driver_t *) calloc(1, sizeof(output_driver_t));
+  if (driver == NULL)
+    return NULL;
+
+  driver->version = DFATMO_OUTPUT_DRIVER_VERSION;
+  driver->open = null_driver_open;
+  driver->configure = null_driver_configure;
+  driver->close = null_driver_close;
+  driver->dispose = null_driver_dispose;
+  driver->output_colors = null_driver_output_colors;
+  driver->submit_colors = null_driver_output_colors;
+  driver->poll_colors = null_driver_poll_colors;
+  return driver;
+}
+
+
+  // Create instance of output driver 'name' from its library found in search path. Synchronous drivers are wrapped by the output adapter.
+static output_driver_t *new_output_driver(const char *name, const char *driver_path, lib_handle_t *lib_ret) {
   char filename[256];
   int found;
-  char *p;
+  const char *p;
   dfatmo_new_output_driver_t new_output_driver;
   lib_handle_t lib;
   lib_error_t err;
   output_driver_t *ot;
 
-  if (!strlen(self->parm.driver))
-    strcpy(self->parm.driver, "null");
-
-  if (!strcmp(self->parm.driver, "null")) {
-    self->output_driver = (output_driver_t *) calloc(1, sizeof(output_driver_t));
-    if (!self->output_driver) {
+  *lib_ret = NULL;
+  if (!strcmp(name, "null")) {
+    ot = new_null_output_driver();
+    if (ot == NULL)
       DFATMO_LOG(DFLOG_ERROR, "creating null output driver instance failed");
-      return 1;
-    }
-    self->output_driver->version = DFATMO_OUTPUT_DRIVER_VERSION;
-    self->output_driver->open = null_driver_open;
-    self->output_driver->configure = null_driver_configure;
-    self->output_driver->close = null_driver_close;
-    self->output_driver->dispose = null_driver_dispose;
-    self->output_driver->output_colors = null_driver_output_colors;
-    DFATMO_LOG(DFLOG_INFO, "output driver %s loaded", self->parm.driver);
-    return 0;
+    return ot;
   }
 
-  if (strlen(self->parm.driver_path) == 0) {
+  if (strlen(driver_path) == 0) {
     DFATMO_LOG(DFLOG_ERROR, "output driver search path missing");
-    return 1;
+    return NULL;
   }
 
   found = 0;
-  p = self->parm.driver_path;
+  p = driver_path;
   while (p != NULL) {
-    char *e = strchr(p, LIB_SEARCH_PATH_SEP);
+    const char *e = strchr(p, LIB_SEARCH_PATH_SEP);
     if (e == NULL) {
-      snprintf(filename, sizeof(filename), LIB_NAME_TEMPLATE, (int)strlen(p), p, self->parm.driver);
+      snprintf(filename, sizeof(filename), LIB_NAME_TEMPLATE, (int)strlen(p), p, name);
       p = e;
     } else {
-      snprintf(filename, sizeof(filename), LIB_NAME_TEMPLATE, (int)(e - p), p, self->parm.driver);
+      snprintf(filename, sizeof(filename), LIB_NAME_TEMPLATE, (int)(e - p), p, name);
       p = e + 1;
     }
     DFATMO_LOG(DFLOG_DEBUG, "search output driver '%s'", filename);
@@ -1015,8 +1794,8 @@ static int load_output_driver(atmo_driver_t *self) {
     }
   }
   if (!found) {
-    DFATMO_LOG(DFLOG_ERROR, "output driver 'dfatmo-%s' not found", self->parm.driver);
-    return 1;
+    DFATMO_LOG(DFLOG_ERROR, "output driver 'dfatmo-%s' not found", name);
+    return NULL;
   }
 
   new_output_driver = NULL;
@@ -1031,25 +1810,512 @@ static int load_output_driver(atmo_driver_t *self) {
     DFATMO_LOG(DFLOG_ERROR, "loading output driver failed: %s", buf);
     if (lib != NULL)
       FREE_LIBRARY(lib);
-    return 1;
+    return NULL;
   }
 
   ot = (*new_output_driver)(dfatmo_log_level, dfatmo_log);
   if (ot == NULL) {
     DFATMO_LOG(DFLOG_ERROR, "creating output driver instance of '%s' failed", filename);
     FREE_LIBRARY(lib);
-    return 1;
+    return NULL;
   }
 
-  if (ot->version != DFATMO_OUTPUT_DRIVER_VERSION) {
-    DFATMO_LOG(DFLOG_ERROR, "wrong version %d of output driver '%s'. Expected version %d", ot->version, filename, DFATMO_OUTPUT_DRIVER_VERSION);
+  if (ot->version < 3 || ot->version > DFATMO_OUTPUT_DRIVER_VERSION) {
+    DFATMO_LOG(DFLOG_ERROR, "wrong version %d of output driver '%s'. Expected version 3 ... %d", ot->version, filename, DFATMO_OUTPUT_DRIVER_VERSION);
     ot->dispose(ot);
     FREE_LIBRARY(lib);
-    return 1;
+    return NULL;
+  }
+
+    // Version 3 drivers don't have the asynchronous output functions at all
+  if (ot->version == 3 || ot->submit_colors == NULL || ot->poll_colors == NULL) {
+    output_driver_t *adapter = new_output_adapter(ot);
+    if (adapter == NULL) {
+      DFATMO_LOG(DFLOG_ERROR, "creating output adapter for '%s' failed", filename);
+      ot->dispose(ot);
+      FREE_LIBRARY(lib);
+      return NULL;
+    }
+    DFATMO_LOG(DFLOG_INFO, "output driver %s uses synchronous output", name);
+    ot = adapter;
+  }
+
+  *lib_ret = lib;
+  return ot;
+}
+
+
+/*
+ * Multiplexer for output to several drivers ("multi" driver).
+ *
+ * The driver parameter is a list of drivers separated by ';', each with an optional list of areas and
+ * an optional driver parameter: name[area+area...](driver_param). Without area list all areas are routed
+ * to the driver. Every driver gets its own channel layout. Because output drivers could define their layout
+ * when opened (e.g. DF10CH), the layout of the engine is the maximum number of channels per area of all
+ * drivers. Channels of a driver with less channels in an area are sampled from the engine channels.
+ *
+ * Colors of a frame are submitted to all drivers before any driver is polled. Asynchronous drivers and the
+ * worker threads of the output adapter do the output of all drivers concurrently. Errors of a driver are
+ * logged and do not stop output to the other drivers. Next colors of a failed driver are send completely.
+ */
+#define MAX_MULTI_OUTPUTS       8
+
+typedef struct {
+  char name[SIZE_DRIVER_NAME];
+  char driver_param[SIZE_DRIVER_PARAM];
+  int areas;                        // Bit mask of routed areas
+  lib_handle_t lib;
+  output_driver_t *driver;
+  atmo_parameters_t parm;           // Channel layout and parameter of driver
+  int opened;
+  int initial;                      // Next colors must be send without last colors
+  int failed;                       // Last output failed
+  uint32_t errors;
+  int num_channels;
+  uint16_t channel_map[MAX_OUTPUT_CHANNELS];    // Engine channel of driver channel
+  rgb_color_t colors[MAX_OUTPUT_CHANNELS];
+  rgb_color_t last_colors[MAX_OUTPUT_CHANNELS];
+  uint32_t changed[CHANNEL_MASK_WORDS(MAX_OUTPUT_CHANNELS)];
+} multi_output_t;
+
+typedef struct {
+  output_driver_t output_driver;
+  int num_outputs;
+  multi_output_t outputs[MAX_MULTI_OUTPUTS];
+} output_multiplexer_t;
+
+static const char *area_names[NUM_AREAS] = { "top", "bottom", "left", "right", "center", "top_left", "top_right", "bottom_left", "bottom_right" };
+
+
+static void get_area_channels(atmo_parameters_t *p, int *n) {
+  n[0] = p->top;
+  n[1] = p->bottom;
+  n[2] = p->left;
+  n[3] = p->right;
+  n[4] = p->center;
+  n[5] = p->top_left;
+  n[6] = p->top_right;
+  n[7] = p->bottom_left;
+  n[8] = p->bottom_right;
+}
+
+
+static void set_area_channels(atmo_parameters_t *p, const int *n) {
+  p->top = n[0];
+  p->bottom = n[1];
+  p->left = n[2];
+  p->right = n[3];
+  p->center = n[4];
+  p->top_left = n[5];
+  p->top_right = n[6];
+  p->bottom_left = n[7];
+  p->bottom_right = n[8];
+}
+
+
+static int parse_multi_param(output_multiplexer_t *self, const char *s) {
+  char *errmsg = self->output_driver.errmsg;
+  const int size = sizeof(self->output_driver.errmsg);
+
+  while (*s) {
+    multi_output_t *o;
+    size_t n;
+
+    if (*s == ';' || isspace((unsigned char)*s)) {
+      ++s;
+      continue;
+    }
+    if (self->num_outputs == MAX_MULTI_OUTPUTS) {
+      snprintf(errmsg, size, "more than %d output drivers", MAX_MULTI_OUTPUTS);
+      return -1;
+    }
+    o = &self->outputs[self->num_outputs];
+
+    n = strcspn(s, "[(; ");
+    if (!n || n >= sizeof(o->name) || (n == 5 && !strncmp(s, "multi", 5))) {
+      snprintf(errmsg, size, "illegal output driver '%.*s'", (int)MIN(n, 32), s);
+      return -1;
+    }
+    memcpy(o->name, s, n);
+    o->name[n] = 0;
+    s += n;
+
+    o->areas = (1 << NUM_AREAS) - 1;
+    if (*s == '[') {
+      o->areas = 0;
+      do {
+        int a;
+        ++s;
+        n = strcspn(s, "+,]");
+        for (a = 0; a < NUM_AREAS; ++a) {
+          if (strlen(area_names[a]) == n && !strncmp(s, area_names[a], n))
+            break;
+        }
+        if (a == NUM_AREAS) {
+          snprintf(errmsg, size, "unknown area '%.*s' for output driver '%s'", (int)MIN(n, 32), s, o->name);
+          return -1;
+        }
+        o->areas |= 1 << a;
+        s += n;
+      } while (*s == '+' || *s == ',');
+      if (*s != ']') {
+        snprintf(errmsg, size, "missing ']' for output driver '%s'", o->name);
+        return -1;
+      }
+      ++s;
+    }
+
+    if (*s == '(') {
+      const char *b = ++s;
+      int depth = 1;
+      while (*s) {
+        if (*s == '(')
+          ++depth;
+        else if (*s == ')' && !--depth)
+          break;
+        ++s;
+      }
+      if (depth || (size_t)(s - b) >= sizeof(o->driver_param)) {
+        snprintf(errmsg, size, "illegal driver parameter for output driver '%s'", o->name);
+        return -1;
+      }
+      memcpy(o->driver_param, b, s - b);
+      o->driver_param[s - b] = 0;
+      ++s;
+    }
+
+    if (*s && *s != ';') {
+      snprintf(errmsg, size, "syntax error at '%.32s'", s);
+      return -1;
+    }
+    ++self->num_outputs;
+  }
+
+  if (!self->num_outputs) {
+    snprintf(errmsg, size, "no output drivers specified");
+    return -1;
+  }
+  return 0;
+}
+
+
+  // Layout of engine is maximum of all drivers, channel maps of drivers are build for this layout
+static void update_multi_layout(output_multiplexer_t *self, atmo_parameters_t *param) {
+  int eng[NUM_AREAS], n[NUM_AREAS], offset[NUM_AREAS];
+  int a, i, k, c;
+
+  memset(eng, 0, sizeof(eng));
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    if (o->opened) {
+      get_area_channels(&o->parm, n);
+      for (a = 0; a < NUM_AREAS; ++a)
+        eng[a] = MAX(eng[a], n[a]);
+    }
   }
+  set_area_channels(param, eng);
 
-  self->output_driver = ot;
-  self->output_driver_lib = lib;
+  c = 0;
+  for (a = 0; a < NUM_AREAS; ++a) {
+    offset[a] = c;
+    c += eng[a];
+  }
+
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    if (o->opened) {
+      get_area_channels(&o->parm, n);
+      c = 0;
+      for (a = 0; a < NUM_AREAS; ++a) {
+        for (i = 0; i < n[a]; ++i)
+          o->channel_map[c++] = offset[a] + (2 * i + 1) * eng[a] / (2 * n[a]);
+      }
+      o->num_channels = c;
+      o->initial = 1;
+      DFATMO_LOG(DFLOG_DEBUG, "output driver %s: %d channels", o->name, c);
+    }
+  }
+}
+
+
+  // Parameter of a driver are the engine parameter restricted to its areas
+static void set_multi_output_param(multi_output_t *o, atmo_parameters_t *param) {
+  int n[NUM_AREAS], a;
+
+  o->parm = *param;
+  strcpy(o->parm.driver, o->name);
+  strcpy(o->parm.driver_param, o->driver_param);
+  get_area_channels(param, n);
+  for (a = 0; a < NUM_AREAS; ++a) {
+    if (!(o->areas & (1 << a)))
+      n[a] = 0;
+  }
+  set_area_channels(&o->parm, n);
+}
+
+
+static void multi_output_error(multi_output_t *o) {
+  ++o->errors;
+  if (!o->failed) {
+    o->failed = 1;
+    DFATMO_LOG(DFLOG_ERROR, "output driver %s error: %s", o->name, o->driver->errmsg);
+  }
+    // Device state is unknown so send next colors completely
+  o->initial = 1;
+}
+
+
+static int output_multiplexer_open(output_driver_t *self_gen, atmo_parameters_t *param) {
+  output_multiplexer_t *self = (output_multiplexer_t *) self_gen;
+  int k, opened = 0;
+
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    set_multi_output_param(o, param);
+    o->failed = 0;
+    o->errors = 0;
+    if (o->driver->open(o->driver, &o->parm))
+      DFATMO_LOG(DFLOG_ERROR, "opening output driver %s failed: %s", o->name, o->driver->errmsg);
+    else {
+      o->opened = 1;
+      ++opened;
+    }
+  }
+
+  if (!opened) {
+    strcpy(self->output_driver.errmsg, "opening of all output drivers failed");
+    return -1;
+  }
+  update_multi_layout(self, param);
+  DFATMO_LOG(DFLOG_INFO, "%d of %d output drivers opened", opened, self->num_outputs);
+  return 0;
+}
+
+
+static int output_multiplexer_configure(output_driver_t *self_gen, atmo_parameters_t *param) {
+  output_multiplexer_t *self = (output_multiplexer_t *) self_gen;
+  int k, rc = -1;
+
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    if (o->opened) {
+      set_multi_output_param(o, param);
+      if (o->driver->configure(o->driver, &o->parm))
+        multi_output_error(o);
+      else
+        rc = 0;
+    }
+  }
+
+  if (rc)
+    strcpy(self->output_driver.errmsg, "configuring of all output drivers failed");
+  else
+    update_multi_layout(self, param);
+  return rc;
+}
+
+
+static int output_multiplexer_close(output_driver_t *self_gen) {
+  output_multiplexer_t *self = (output_multiplexer_t *) self_gen;
+  int k, rc = 0;
+
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    if (o->opened) {
+      o->opened = 0;
+      if (o->driver->close(o->driver)) {
+        DFATMO_LOG(DFLOG_ERROR, "closing output driver %s failed: %s", o->name, o->driver->errmsg);
+        strcpy(self->output_driver.errmsg, "closing of output driver failed");
+        rc = -1;
+      }
+      if (o->errors)
+        DFATMO_LOG(DFLOG_INFO, "output driver %s: %u errors", o->name, o->errors);
+    }
+  }
+  return rc;
+}
+
+
+static void output_multiplexer_dispose(output_driver_t *self_gen) {
+  output_multiplexer_t *self = (output_multiplexer_t *) self_gen;
+  int k;
+
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    if (o->driver)
+      o->driver->dispose(o->driver);
+    if (o->lib)
+      FREE_LIBRARY(o->lib);
+  }
+  free(self);
+}
+
+
+  /*
+   * Submit colors to all drivers without waiting, drivers with unchanged channels are only polled.
+   * Drivers without timed output get timed colors at once.
+   */
+static int output_multiplexer_submit(output_multiplexer_t *self, rgb_color_t *colors, int all_changed, uint64_t present_us) {
+  int k, i, ok = 0;
+
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    int changed, rc;
+
+    if (!o->opened)
+      continue;
+
+    changed = o->initial || all_changed;
+    memset(o->changed, 0, CHANNEL_MASK_WORDS(o->num_channels) * sizeof(uint32_t));
+    for (i = 0; i < o->num_channels; ++i) {
+      const rgb_color_t *c = &colors[o->channel_map[i]];
+      rgb_color_t *d = &o->colors[i];
+      if (d->r != c->r || d->g != c->g || d->b != c->b) {
+        *d = *c;
+        o->changed[i / 32] |= 1U << (i % 32);
+        changed = 1;
+      }
+    }
+
+    if (changed) {
+      const int all = (o->initial || all_changed);
+      if (present_us && HAS_SUBMIT_TIMED(o->driver))
+        rc = o->driver->submit_timed_colors(o->driver, o->colors, all ? NULL: o->changed, present_us);
+      else if (HAS_SUBMIT_CHANGED(o->driver))
+        rc = o->driver->submit_changed_colors(o->driver, o->colors, all ? NULL: o->changed);
+      else
+        rc = o->driver->submit_colors(o->driver, o->colors, all ? NULL: o->last_colors);
+      if (!rc) {
+        memcpy(o->last_colors, o->colors, o->num_channels * sizeof(rgb_color_t));
+        o->initial = 0;
+      }
+    } else
+      rc = (o->driver->poll_colors(o->driver, 0) < 0);
+
+    if (rc)
+      multi_output_error(o);
+    else {
+      if (o->failed) {
+        o->failed = 0;
+        DFATMO_LOG(DFLOG_INFO, "output driver %s recovered", o->name);
+      }
+      ++ok;
+    }
+  }
+
+  if (!ok) {
+    strcpy(self->output_driver.errmsg, "output of all output drivers failed");
+    return -1;
+  }
+  return 0;
+}
+
+
+static int output_multiplexer_submit_colors(output_driver_t *self_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  return output_multiplexer_submit((output_multiplexer_t *) self_gen, colors, !last_colors, 0);
+}
+
+
+static int output_multiplexer_submit_timed_colors(output_driver_t *self_gen, rgb_color_t *colors, const uint32_t *changed, uint64_t present_us) {
+  return output_multiplexer_submit((output_multiplexer_t *) self_gen, colors, !changed, present_us);
+}
+
+
+static int output_multiplexer_output_colors(output_driver_t *self_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  int rc = output_multiplexer_submit_colors(self_gen, colors, last_colors);
+  if (!rc)
+    rc = (self_gen->poll_colors(self_gen, OUTPUT_DRAIN_TIMEOUT) < 0);
+  return rc;
+}
+
+
+static int output_multiplexer_poll_colors(output_driver_t *self_gen, int timeout_ms) {
+  output_multiplexer_t *self = (output_multiplexer_t *) self_gen;
+  deadline_t deadline;
+  int k, rc, busy = 0, ok = 0;
+
+  SET_DEADLINE(deadline, timeout_ms);
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    if (o->opened) {
+      rc = o->driver->poll_colors(o->driver, timeout_ms ? REMAINING_MS(deadline): 0);
+      if (rc < 0)
+        multi_output_error(o);
+      else {
+        busy |= rc;
+        ++ok;
+      }
+    }
+  }
+
+  if (!ok) {
+    strcpy(self->output_driver.errmsg, "output of all output drivers failed");
+    return -1;
+  }
+  return busy;
+}
+
+
+static output_driver_t *new_output_multiplexer(const char *driver_param, const char *driver_path) {
+  output_multiplexer_t *self = (output_multiplexer_t *) calloc(1, sizeof(output_multiplexer_t));
+  int k;
+
+  if (self == NULL) {
+    DFATMO_LOG(DFLOG_ERROR, "creating multi output driver instance failed");
+    return NULL;
+  }
+  if (parse_multi_param(self, driver_param)) {
+    DFATMO_LOG(DFLOG_ERROR, "multi output driver: %s", self->output_driver.errmsg);
+    free(self);
+    return NULL;
+  }
+
+  for (k = 0; k < self->num_outputs; ++k) {
+    multi_output_t *o = &self->outputs[k];
+    o->driver = new_output_driver(o->name, driver_path, &o->lib);
+    if (o->driver == NULL) {
+      output_multiplexer_dispose(&self->output_driver);
+      return NULL;
+    }
+    DFATMO_LOG(DFLOG_INFO, "output driver %s loaded", o->name);
+  }
+
+  self->output_driver.version = DFATMO_OUTPUT_DRIVER_VERSION;
+  self->output_driver.open = output_multiplexer_open;
+  self->output_driver.configure = output_multiplexer_configure;
+  self->output_driver.close = output_multiplexer_close;
+  self->output_driver.dispose = output_multiplexer_dispose;
+  self->output_driver.output_colors = output_multiplexer_output_colors;
+  self->output_driver.submit_colors = output_multiplexer_submit_colors;
+  self->output_driver.poll_colors = output_multiplexer_poll_colors;
+  self->output_driver.submit_timed_colors = output_multiplexer_submit_timed_colors;
+  return &self->output_driver;
+}
+
+
+static void unload_output_driver(atmo_driver_t *self) {
+  if (self->output_driver) {
+    self->output_driver->dispose(self->output_driver);
+    self->output_driver = NULL;
+  }
+  if (self->output_driver_lib) {
+    FREE_LIBRARY(self->output_driver_lib);
+    self->output_driver_lib = NULL;
+    DFATMO_LOG(DFLOG_INFO, "output driver unloaded");
+  }
+}
+
+
+static int load_output_driver(atmo_driver_t *self) {
+  if (!strlen(self->parm.driver))
+    strcpy(self->parm.driver, "null");
+
+  if (!strcmp(self->parm.driver, "multi"))
+    self->output_driver = new_output_multiplexer(self->parm.driver_param, self->parm.driver_path);
+  else
+    self->output_driver = new_output_driver(self->parm.driver, self->parm.driver_path, &self->output_driver_lib);
+  if (self->output_driver == NULL)
+    return 1;
 
   DFATMO_LOG(DFLOG_INFO, "output driver %s loaded", self->parm.driver);
 
@@ -1070,6 +2336,7 @@ static int open_output_driver (atmo_driver_t *self) {
         DFATMO_LOG(DFLOG_ERROR, "output driver error: %s", self->output_driver->errmsg);
       else {
         self->driver_opened = 1;
+        self->present_time = 0;
         DFATMO_LOG(DFLOG_INFO, "output driver opened");
       }
     }
@@ -1089,6 +2356,20 @@ static int close_output_driver (atmo_driver_t *self) {
 
   if (self->driver_opened) {
     turn_lights_off(self);
+
+      // Wait until lights off colors are send
+    rc = self->output_driver->poll_colors(self->output_driver, OUTPUT_DRAIN_TIMEOUT);
+    if (rc < 0)
+      DFATMO_LOG(DFLOG_ERROR, "output driver error: %s", self->output_driver->errmsg);
+    else if (rc)
+      DFATMO_LOG(DFLOG_ERROR, "output driver still busy after %d ms", OUTPUT_DRAIN_TIMEOUT);
+
+    if (self->suppressed_outputs)
+      DFATMO_LOG(DFLOG_INFO, "%u color outputs send, %u suppressed by dead-band, %u unchanged", self->sent_outputs, self->suppressed_outputs, self->unchanged_outputs);
+    self->sent_outputs = 0;
+    self->suppressed_outputs = 0;
+    self->unchanged_outputs = 0;
+
     self->driver_opened = 0;
     rc = self->output_driver->close(self->output_driver);
     if (rc)
@@ -1100,7 +2381,7 @@ static int close_output_driver (atmo_driver_t *self) {
 }
 
 
-static void instant_configure (atmo_driver_t *self) {
+static inline void instant_configure (atmo_driver_t *self) {
   self->active_parm.overscan = self->parm.overscan;
   self->active_parm.darkness_limit = self->parm.darkness_limit;
   self->active_parm.edge_weighting = self->parm.edge_weighting;
@@ -1120,7 +2401,14 @@ static void instant_configure (atmo_driver_t *self) {
   self->active_parm.wc_blue = self->parm.wc_blue;
   self->active_parm.gamma = self->parm.gamma;
   self->active_parm.output_rate = self->parm.output_rate;
+  self->active_parm.output_keepalive = self->parm.output_keepalive;
+  self->active_parm.output_deadband = self->parm.output_deadband;
+  self->active_parm.output_deadband_mode = self->parm.output_deadband_mode;
+  self->active_parm.output_lead = self->parm.output_lead;
+  self->active_parm.output_dither = self->parm.output_dither;
+  self->active_parm.fine_colors = self->parm.fine_colors;
   self->active_parm.analyze_size = self->parm.analyze_size;
+  strcpy(self->active_parm.record_file, self->parm.record_file);
 }
 
 
@@ -1148,6 +2436,7 @@ static void init_configuration (atmo_driver_t *self)
   self->parm.wc_green = 255;
   self->parm.wc_blue = 255;
   self->parm.output_rate = 20;
+  self->parm.output_keepalive = 500;
   self->parm.gamma = 10;
   self->parm.analyze_rate = 35;
   self->parm.analyze_size = 1;
@@ -1162,8 +2451,10 @@ static void init_configuration (atmo_driver_t *self)
 int *dfatmo_driver_log_level;
 
 
-static const char *filter_enum[NUM_FILTERS] = { trNOOP("off"), trNOOP("percentage"), trNOOP("combined") };
-static const char *analyze_size_enum[4] = { "64", "128", "192", "256" };
+  /* Enumerations are only used by front ends that display parameters */
+static const char *filter_enum[NUM_FILTERS] UNUSED_SYM = { trNOOP("off"), trNOOP("percentage"), trNOOP("combined") };
+static const char *analyze_size_enum[4] UNUSED_SYM = { "64", "128", "192", "256" };
+static const char *deadband_mode_enum[NUM_DEADBAND_MODES] UNUSED_SYM = { trNOOP("linear"), trNOOP("perceptual") };
 
 #define PARM_DESC_LIST \
 PARM_DESC_BOOL(enabled, NULL, 0, 1, 0, trNOOP("Launch on startup")) \
@@ -1190,14 +2481,21 @@ PARM_DESC_INT(sat_win_size, NULL, 0, 5, 0, trNOOP("Saturation windowing size"))
 PARM_DESC_INT(hue_threshold, NULL, 0, 100, 0, trNOOP("Hue threshold [%]")) \
 PARM_DESC_INT(brightness, NULL, 50, 300, 0, trNOOP("Brightness [%]")) \
 PARM_DESC_INT(uniform_brightness, NULL, 0, 255, 0, trNOOP("Uniform brightness limit factor")) \
+PARM_DESC_BOOL(fine_colors, NULL, 0, 1, 0, trNOOP("Calculate colors with 16 bit")) \
 PARM_DESC_INT(filter, filter_enum, 0, (NUM_FILTERS-1), 0, trNOOP("Filter mode")) \
 PARM_DESC_INT(filter_smoothness, NULL, 1, 100, 0, trNOOP("Filter smoothness [%]")) \
 PARM_DESC_INT(filter_length, NULL, 300, 5000, 0, trNOOP("Filter length [ms]")) \
 PARM_DESC_INT(filter_threshold, NULL, 1, 100, 0, trNOOP("Filter threshold [%]")) \
 PARM_DESC_INT(filter_delay, NULL, 0, 1000, 0, trNOOP("Output delay [ms]")) \
 PARM_DESC_INT(output_rate, NULL, 10, 500, 0, trNOOP("Output rate [ms]")) \
+PARM_DESC_INT(output_keepalive, NULL, 0, 10000, 0, trNOOP("Output keep alive interval [ms]")) \
+PARM_DESC_INT(output_deadband, NULL, 0, 64, 0, trNOOP("Output dead-band")) \
+PARM_DESC_INT(output_deadband_mode, deadband_mode_enum, 0, (NUM_DEADBAND_MODES-1), 0, trNOOP("Output dead-band mode")) \
+PARM_DESC_INT(output_lead, NULL, 0, 500, 0, trNOOP("Output presentation lead [ms]")) \
+PARM_DESC_INT(output_dither, NULL, 0, 16, 0, trNOOP("Output dither cycles")) \
 PARM_DESC_INT(start_delay, NULL, 0, 5000, 0, trNOOP("Delay after stream start [ms]")) \
 PARM_DESC_INT(wc_red, NULL, 0, 255, 0, trNOOP("Red white calibration")) \
 PARM_DESC_INT(wc_green, NULL, 0, 255, 0, trNOOP("Green white calibration")) \
 PARM_DESC_INT(wc_blue, NULL, 0, 255, 0, trNOOP("Blue white calibration")) \
-PARM_DESC_INT(gamma, NULL, 0, 30, 0, trNOOP("Gamma correction"))
+PARM_DESC_INT(gamma, NULL, 0, 30, 0, trNOOP("Gamma correction")) \
+PARM_DESC_CHAR(record_file, NULL, 0, 0, 0, trNOOP("Record grabbed frames to file"))
@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the check of the multi output driver. Frames are send through the multi driver to two shm
+ * output drivers with different areas, the synchronous file output driver and a serial output driver
+ * that fails to open. After every frame the latest slot of both shared memory segments must contain
+ * exactly the channels of the routed areas.
+ *
+ * Every channel color of a frame encodes its channel number and the frame number:
+ * red = channel & 0xFF, green = frame number & 0xFF, blue = channel >> 8
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+#include "dfatmo_shm.h"
+
+#define DEFAULT_LAYOUT          "top=32 bottom=32 left=18 right=18 center=1 top_left=1 top_right=1 bottom_left=1 bottom_right=1"
+#define DEFAULT_FRAMES          10000
+#define BORDER_AREAS            "top+bottom"
+#define OTHER_AREAS             "left+right+center+top_left+top_right+bottom_left+bottom_right"
+
+typedef struct {
+  char name[64];
+  dfatmo_shm_header_t *hdr;
+  size_t size;
+  int first, num_channels;      // Routed engine channels
+} segment_t;
+
+
+static int map_segment(segment_t *s) {
+  int fd = shm_open(s->name, O_RDONLY, 0);
+  dfatmo_shm_header_t *hdr = (fd < 0) ? (dfatmo_shm_header_t *) MAP_FAILED: (dfatmo_shm_header_t *) mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0);
+
+  if (hdr == MAP_FAILED || hdr->magic != DFATMO_SHM_MAGIC || hdr->num_channels != (uint32_t) s->num_channels) {
+    printf("shared memory segment '%s' is not valid\n", s->name);
+    if (fd >= 0)
+      close(fd);
+    return -1;
+  }
+  s->size = hdr->header_size + hdr->num_slots * hdr->slot_size;
+  munmap(hdr, sizeof(*hdr));
+  s->hdr = (dfatmo_shm_header_t *) mmap(NULL, s->size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  return (s->hdr == MAP_FAILED) ? -1: 0;
+}
+
+
+  /* Latest frame of segment must be the routed channels of engine frame */
+static int check_segment(segment_t *s, int frame) {
+  const dfatmo_shm_slot_t *slot = dfatmo_shm_latest_slot(s->hdr);
+  int i;
+
+  if (slot->num_channels != (uint32_t) s->num_channels)
+    return -1;
+  for (i = 0; i < s->num_channels; ++i) {
+    const uint8_t *c = slot->colors[i];
+    const int ch = s->first + i;
+    if (c[0] != (ch & 0xFF) || c[1] != (frame & 0xFF) || c[2] != (ch >> 8))
+      return -1;
+  }
+  return 0;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] [parameter=value ...]\n"
+                  "  -d <path>     path of output drivers (default: .)\n"
+                  "  -n <frames>   number of frames (default: %d)\n"
+                  "  -v <level>    log level 0 ... 3\n"
+                  "Parameters override the default layout: %s\n", prog, DEFAULT_FRAMES, DEFAULT_LAYOUT);
+}
+
+
+int main(int argc, char *argv[]) {
+  static atmo_driver_t atmo_driver;
+  atmo_driver_t *ad = &atmo_driver;
+  const char *driver_path = ".";
+  char layout[1024], parms[SIZE_DRIVER_PATH + 512];
+  segment_t segs[2];
+  uint64_t start, elapsed, sum = 0, worst = 0;
+  int frames = DEFAULT_FRAMES, errors = 0, frame, c, i;
+
+  while ((c = getopt(argc, argv, "d:n:v:h")) != -1) {
+    switch (c) {
+    case 'd':
+      driver_path = optarg;
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (frames < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  strcpy(layout, DEFAULT_LAYOUT);
+  for (; optind < argc; ++optind) {
+    if (strlen(layout) + strlen(argv[optind]) + 2 > sizeof(layout)) {
+      usage(argv[0]);
+      return 1;
+    }
+    strcat(layout, " ");
+    strcat(layout, argv[optind]);
+  }
+
+  memset(segs, 0, sizeof(segs));
+  snprintf(segs[0].name, sizeof(segs[0].name), "/dfatmo-multi-%d-a", (int) getpid());
+  snprintf(segs[1].name, sizeof(segs[1].name), "/dfatmo-multi-%d-b", (int) getpid());
+
+  init_configuration(ad);
+  snprintf(parms, sizeof(parms), "driver=multi driver_path=%s driver_param=shm[" BORDER_AREAS "](%s);shm[" OTHER_AREAS "](%s&slots:2);file(/dev/null);serial(/dev/dfatmo-none)",
+          driver_path, segs[0].name, segs[1].name);
+  if (set_parm_list(&ad->parm, layout) || set_parm_list(&ad->parm, parms) || config_channels(ad))
+    return 1;
+  if (open_output_driver(ad)) {
+    free_channels(ad);
+    return 1;
+  }
+  ad->active_parm = ad->parm;
+
+  segs[0].first = 0;
+  segs[0].num_channels = ad->parm.top + ad->parm.bottom;
+  segs[1].first = segs[0].num_channels;
+  segs[1].num_channels = ad->sum_channels - segs[0].num_channels;
+  if (map_segment(&segs[0]) || map_segment(&segs[1])) {
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    shm_unlink(segs[0].name);
+    shm_unlink(segs[1].name);
+    free_channels(ad);
+    return 1;
+  }
+
+  turn_lights_off(ad);
+  start = now_ns();
+  for (frame = 1; frame <= frames; ++frame) {
+    uint64_t t;
+    for (i = 0; i < ad->sum_channels; ++i) {
+      ad->output_colors[i].r = i & 0xFF;
+      ad->output_colors[i].g = frame & 0xFF;
+      ad->output_colors[i].b = i >> 8;
+    }
+    t = now_ns();
+    if (send_output_colors(ad, ad->output_colors, 0))
+      break;
+    t = now_ns() - t;
+    sum += t;
+    if (t > worst)
+      worst = t;
+    for (i = 0; i < 2; ++i) {
+      if (check_segment(&segs[i], frame)) {
+        printf("segment %s: wrong colors at frame %d\n", segs[i].name, frame);
+        ++errors;
+      }
+    }
+    if (errors)
+      break;
+  }
+  elapsed = now_ns() - start;
+  if (frame <= frames && !errors) {
+    printf("output failed at frame %d\n", frame);
+    ++errors;
+  }
+
+  close_output_driver(ad);
+  unload_output_driver(ad);
+
+  printf("%d channels to %d + %d channels, %d frames in %.3f s, average submit %.2f us, worst %.1f us: %s\n",
+          ad->sum_channels, segs[0].num_channels, segs[1].num_channels, frames, elapsed / 1000000000.0,
+          sum / 1000.0 / frames, worst / 1000.0, errors ? "FAILED": "PASSED");
+  for (i = 0; i < 2; ++i) {
+    munmap(segs[i].hdr, segs[i].size);
+    shm_unlink(segs[i].name);
+  }
+  free_channels(ad);
+  return (errors != 0);
+}
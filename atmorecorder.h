@@ -0,0 +1,290 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This module contains the grab frame recorder of the DFAtmo engine.
+ *
+ * Grabbed frames are copied into a preallocated ring of slots by the grab thread and
+ * written to the record file by a dedicated writer thread. If the writer could not keep up
+ * frames are dropped instead of blocking the grab thread.
+ *
+ * Layout of a record file (all values in host byte order):
+ *
+ *   rec_file_header_t
+ *   chunk:  rec_chunk_header_t, payload, padding to multiple of 8 bytes
+ *   chunk:  ...
+ *
+ * Payload of a REC_CHUNK_FRAME chunk is a rec_frame_header_t followed by the pixel rows of the
+ * grabbed image without any padding between rows. The crop rectangle describes the analyze
+ * window within the image. Recording continues at the end of an existing record file.
+ */
+
+#include <time.h>
+
+#define REC_FILE_MAGIC          "DFATMREC"
+#define REC_FILE_VERSION        1
+#define REC_CHUNK_ALIGN         8
+#define REC_RING_SIZE           16      /* Number of frame slots between grab and writer thread */
+
+enum { REC_CHUNK_FRAME = 1 };
+
+  /* pixel formats of recorded frames */
+enum { REC_FMT_RGB24 = 0, REC_FMT_RGBA32, REC_FMT_BGRA32, REC_FMT_XRGB32, REC_FMT_RGB48, REC_FMT_XRGB2101010, NUM_REC_FMTS };
+  /* REC_FMT_XRGB32 is a native uint32_t per pixel with red in bits 16-23 */
+  /* REC_FMT_RGB48 are three native uint16_t per pixel */
+  /* REC_FMT_XRGB2101010 is a native uint32_t per pixel with 10 bit red in bits 20-29 */
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_size;
+} rec_file_header_t;
+
+typedef struct {
+  uint32_t type;
+  uint32_t size;                /* size of payload without padding */
+} rec_chunk_header_t;
+
+typedef struct {
+  uint64_t timestamp;           /* monotonic time of grab [us] */
+  uint16_t width, height;       /* size of grabbed image */
+  uint16_t format;
+  uint16_t reserved;
+  uint16_t crop_left, crop_top, crop_width, crop_height;
+} rec_frame_header_t;
+
+#define REC_PADDED_SIZE(s)      (((s) + (REC_CHUNK_ALIGN - 1)) & ~(REC_CHUNK_ALIGN - 1))
+
+static const int rec_pixel_len[NUM_REC_FMTS] = { 3, 4, 4, 4, 6, 4 };
+
+
+#ifndef WIN32
+#include <pthread.h>
+
+typedef struct {
+  int size, alloc_size;
+  uint8_t *data;
+} rec_slot_t;
+
+typedef struct {
+  char filename[SIZE_DRIVER_PATH];
+  FILE *fd;
+  int writer_running;
+  pthread_t writer_thread;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  rec_slot_t slots[REC_RING_SIZE];
+  int head, tail, count;
+  int write_error;
+  uint32_t recorded_frames, dropped_frames;
+} frame_recorder_t;
+
+
+static void *recorder_write_loop(void *rec_gen) {
+  frame_recorder_t *rec = (frame_recorder_t *) rec_gen;
+
+  pthread_mutex_lock(&rec->lock);
+  for (;;) {
+    while (!rec->count && rec->writer_running)
+      pthread_cond_wait(&rec->cond, &rec->lock);
+    if (!rec->count)
+      break;
+
+    {
+      rec_slot_t *slot = &rec->slots[rec->tail];
+      pthread_mutex_unlock(&rec->lock);
+      if (!rec->write_error && fwrite(slot->data, slot->size, 1, rec->fd) != 1)
+        rec->write_error = 1;
+      pthread_mutex_lock(&rec->lock);
+    }
+
+    rec->tail = (rec->tail + 1) % REC_RING_SIZE;
+    --rec->count;
+  }
+  pthread_mutex_unlock(&rec->lock);
+  return NULL;
+}
+
+
+static void close_recorder(frame_recorder_t *rec) {
+  int i;
+
+  if (rec->fd) {
+    pthread_mutex_lock(&rec->lock);
+    rec->writer_running = 0;
+    pthread_cond_signal(&rec->cond);
+    pthread_mutex_unlock(&rec->lock);
+    pthread_join(rec->writer_thread, NULL);
+    pthread_cond_destroy(&rec->cond);
+    pthread_mutex_destroy(&rec->lock);
+
+    if (fclose(rec->fd))
+      rec->write_error = 1;
+    rec->fd = NULL;
+    if (rec->write_error)
+      DFATMO_LOG(DFLOG_ERROR, "writing record file '%s' failed", rec->filename);
+    DFATMO_LOG(DFLOG_INFO, "recording to '%s' stopped: %u frames recorded, %u frames dropped", rec->filename, rec->recorded_frames, rec->dropped_frames);
+  }
+
+  for (i = 0; i < REC_RING_SIZE; ++i) {
+    free(rec->slots[i].data);
+    rec->slots[i].data = NULL;
+    rec->slots[i].alloc_size = 0;
+  }
+  rec->filename[0] = 0;
+}
+
+
+static int open_recorder(frame_recorder_t *rec, const char *filename) {
+  rec_file_header_t fh;
+
+  strcpy(rec->filename, filename);
+  rec->fd = fopen(filename, "ab");
+  if (rec->fd == NULL) {
+    DFATMO_LOG(DFLOG_ERROR, "open record file '%s' failed", filename);
+    return 1;
+  }
+
+    /* Write file header only for new files */
+  if (ftell(rec->fd) == 0) {
+    memset(&fh, 0, sizeof(fh));
+    memcpy(fh.magic, REC_FILE_MAGIC, sizeof(fh.magic));
+    fh.version = REC_FILE_VERSION;
+    fh.header_size = sizeof(fh);
+    if (fwrite(&fh, sizeof(fh), 1, rec->fd) != 1) {
+      DFATMO_LOG(DFLOG_ERROR, "writing record file '%s' failed", filename);
+      fclose(rec->fd);
+      rec->fd = NULL;
+      return 1;
+    }
+  }
+
+  rec->head = rec->tail = rec->count = 0;
+  rec->write_error = 0;
+  rec->recorded_frames = rec->dropped_frames = 0;
+  rec->writer_running = 1;
+  pthread_mutex_init(&rec->lock, NULL);
+  pthread_cond_init(&rec->cond, NULL);
+  if (pthread_create(&rec->writer_thread, NULL, recorder_write_loop, rec)) {
+    DFATMO_LOG(DFLOG_ERROR, "creating record writer thread failed");
+    pthread_cond_destroy(&rec->cond);
+    pthread_mutex_destroy(&rec->lock);
+    fclose(rec->fd);
+    rec->fd = NULL;
+    return 1;
+  }
+
+  DFATMO_LOG(DFLOG_INFO, "recording grabbed frames to '%s'", filename);
+  return 0;
+}
+
+
+/*
+ * Record a grabbed frame. Called by the grab thread only.
+ * Recording is started, switched or stopped when the record file parameter changes.
+ * The name of a file that fails to open is kept, so opening is retried only after the parameter changes.
+ */
+static inline void record_frame(frame_recorder_t *rec, const char *filename, int format, const uint8_t *img, int width, int height, int pitch,
+                                 int crop_left, int crop_top, int crop_width, int crop_height) {
+  rec_slot_t *slot;
+  rec_chunk_header_t *ch;
+  rec_frame_header_t *fh;
+  struct timespec ts;
+  int row_size, payload_size, size;
+  uint8_t *p;
+
+  if (strcmp(filename, rec->filename)) {
+    close_recorder(rec);
+    if (filename[0])
+      open_recorder(rec, filename);
+  }
+  if (!rec->fd)
+    return;
+
+  pthread_mutex_lock(&rec->lock);
+  if (rec->count == REC_RING_SIZE) {
+    ++rec->dropped_frames;
+    pthread_mutex_unlock(&rec->lock);
+    return;
+  }
+  slot = &rec->slots[rec->head];
+  pthread_mutex_unlock(&rec->lock);
+
+  row_size = width * rec_pixel_len[format];
+  payload_size = sizeof(rec_frame_header_t) + row_size * height;
+  size = sizeof(rec_chunk_header_t) + REC_PADDED_SIZE(payload_size);
+
+    /* Slot memory is only reallocated if frame size grows */
+  if (size > slot->alloc_size) {
+    free(slot->data);
+    slot->data = (uint8_t *) malloc(size);
+    if (slot->data == NULL) {
+      slot->alloc_size = 0;
+      ++rec->dropped_frames;
+      return;
+    }
+    slot->alloc_size = size;
+  }
+  slot->size = size;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ch = (rec_chunk_header_t *) slot->data;
+  ch->type = REC_CHUNK_FRAME;
+  ch->size = payload_size;
+  fh = (rec_frame_header_t *) (ch + 1);
+  fh->timestamp = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  fh->width = width;
+  fh->height = height;
+  fh->format = format;
+  fh->reserved = 0;
+  fh->crop_left = crop_left;
+  fh->crop_top = crop_top;
+  fh->crop_width = crop_width;
+  fh->crop_height = crop_height;
+
+  p = (uint8_t *) (fh + 1);
+  if (pitch == row_size)
+    memcpy(p, img, row_size * height);
+  else {
+    while (height--) {
+      memcpy(p, img, row_size);
+      p += row_size;
+      img += pitch;
+    }
+  }
+  memset(slot->data + sizeof(rec_chunk_header_t) + payload_size, 0, REC_PADDED_SIZE(payload_size) - payload_size);
+
+  pthread_mutex_lock(&rec->lock);
+  rec->head = (rec->head + 1) % REC_RING_SIZE;
+  ++rec->count;
+  ++rec->recorded_frames;
+  pthread_cond_signal(&rec->cond);
+  pthread_mutex_unlock(&rec->lock);
+}
+
+#else
+
+  /* Recording is not supported on windows */
+typedef struct {
+  int dummy;
+} frame_recorder_t;
+
+#define record_frame(rec, filename, format, img, width, height, pitch, crop_left, crop_top, crop_width, crop_height)
+#define close_recorder(rec)
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the replay tool for record files written by the grab frame recorder.
+ * Recorded frames are feed into the DFAtmo engine and the resulting colors are send to the configured
+ * output driver. Output is done with the configured output rate in the time base of the recording.
+ * Replay runs at full speed or in real time.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+#include "atmoreplay.h"
+
+#define MAX_FRAME_GAP   1000000   /* Gaps in recording longer than this are skipped [us] */
+
+
+static uint64_t now_us(void) {
+  return now_ns() / 1000;
+}
+
+
+static void sleep_us(uint64_t us) {
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000;
+  nanosleep(&ts, NULL);
+}
+
+
+static int send_output(atmo_driver_t *ad, uint64_t replay_time) {
+  apply_filters(ad);
+  if (replay_time >= (uint64_t)ad->active_parm.start_delay * 1000) {
+    if (apply_delay_filter(ad))
+      return 1;
+    apply_gamma_correction(ad);
+    apply_white_calibration(ad);
+    if (send_output_colors(ad, ad->filtered_output_colors, 0))
+      return 1;
+  }
+  return 0;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] file.rec [parameter=value ...]\n"
+                  "  -t            replay in real time (default: full speed)\n"
+                  "  -n <loops>    number of replay loops (default: 1)\n"
+                  "  -v <level>    log level 0 ... 3\n", prog);
+}
+
+
+int main(int argc, char *argv[]) {
+  static atmo_driver_t atmo_driver;
+  atmo_driver_t *ad = &atmo_driver;
+  rec_reader_t reader;
+  const rec_frame_header_t *fh;
+  int real_time = 0, loops = 1, loop, c;
+  uint64_t replay_time, next_output, last_timestamp, start, analyze_time = 0;
+  uint32_t frames = 0, outputs = 0;
+  int rc = 0;
+
+  while ((c = getopt(argc, argv, "tn:v:h")) != -1) {
+    switch (c) {
+    case 't':
+      real_time = 1;
+      break;
+    case 'n':
+      loops = atoi(optarg);
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (optind >= argc || loops < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  init_configuration(ad);
+  ad->parm.top = ad->parm.bottom = ad->parm.left = ad->parm.right = 1;
+  ad->parm.center = 1;
+  if (open_recording(&reader, argv[optind]))
+    return 1;
+  for (++optind; optind < argc; ++optind) {
+    if (set_parm(&ad->parm, argv[optind], strlen(argv[optind])))
+      return 1;
+  }
+
+    /* Recording while replaying makes no sense */
+  ad->parm.record_file[0] = 0;
+
+  if (config_channels(ad))
+    return 1;
+  ad->active_parm = ad->parm;
+  reset_filters(ad);
+  if (open_output_driver(ad) || turn_lights_off(ad))
+    return 1;
+
+  start = now_us();
+  replay_time = 0;
+  next_output = 0;
+  for (loop = 0; loop < loops && !rc; ++loop) {
+    rewind_recording(&reader);
+    last_timestamp = 0;
+    while ((fh = next_recorded_frame(&reader)) != NULL) {
+      uint64_t t0, gap = (last_timestamp && fh->timestamp > last_timestamp) ? fh->timestamp - last_timestamp: 0;
+      if (gap > MAX_FRAME_GAP)
+        gap = 0;
+      last_timestamp = fh->timestamp;
+
+        /* Do all color outputs that are due before this frame */
+      while (next_output <= replay_time + gap) {
+        if (real_time) {
+          uint64_t t = now_us() - start;
+          if (next_output > t)
+            sleep_us(next_output - t);
+        }
+        if ((rc = send_output(ad, next_output)))
+          break;
+        ++outputs;
+        next_output += ad->active_parm.output_rate * 1000;
+      }
+      if (rc)
+        break;
+
+      replay_time += gap;
+      if (real_time) {
+        uint64_t t = now_us() - start;
+        if (replay_time > t)
+          sleep_us(replay_time - t);
+      }
+
+      t0 = now_us();
+      if ((rc = analyze_recorded_frame(ad, fh)))
+        break;
+      analyze_time += now_us() - t0;
+      ++frames;
+    }
+  }
+
+  {
+    double elapsed = (now_us() - start) / 1000000.0;
+    printf("%u frames analyzed, %u color outputs, %.3f s recording time, %.3f s elapsed\n", frames, outputs, replay_time / 1000000.0, elapsed);
+    if (frames)
+      printf("average analyze time %.1f us, %.1f frames/s\n", (double)analyze_time / frames, (elapsed > 0.0) ? frames / elapsed: 0.0);
+  }
+
+  close_output_driver(ad);
+  unload_output_driver(ad);
+  free_channels(ad);
+  free_analyze_images(ad);
+  close_recording(&reader);
+  return rc;
+}
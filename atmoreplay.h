@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This module contains the replay source for record files written by the grab frame recorder.
+ * It must be included after "atmodriver.h" and "atmotools.h".
+ */
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+typedef struct {
+  int fd;
+  uint8_t *map;
+  size_t size, pos;
+} rec_reader_t;
+
+
+static void close_recording(rec_reader_t *r) {
+  if (r->map != NULL)
+    munmap(r->map, r->size);
+  if (r->fd >= 0)
+    close(r->fd);
+  r->map = NULL;
+  r->fd = -1;
+}
+
+
+static int open_recording(rec_reader_t *r, const char *filename) {
+  const rec_file_header_t *fh;
+  struct stat st;
+
+  memset(r, 0, sizeof(*r));
+  r->fd = open(filename, O_RDONLY);
+  if (r->fd < 0 || fstat(r->fd, &st)) {
+    DFATMO_LOG(DFLOG_ERROR, "open record file '%s' failed", filename);
+    close_recording(r);
+    return 1;
+  }
+
+  r->size = st.st_size;
+  if (r->size < sizeof(rec_file_header_t)) {
+    DFATMO_LOG(DFLOG_ERROR, "'%s' is not a record file", filename);
+    close_recording(r);
+    return 1;
+  }
+
+  r->map = (uint8_t *) mmap(NULL, r->size, PROT_READ, MAP_PRIVATE, r->fd, 0);
+  if (r->map == MAP_FAILED) {
+    r->map = NULL;
+    DFATMO_LOG(DFLOG_ERROR, "mapping record file '%s' failed", filename);
+    close_recording(r);
+    return 1;
+  }
+
+  fh = (const rec_file_header_t *) r->map;
+  if (memcmp(fh->magic, REC_FILE_MAGIC, sizeof(fh->magic)) || fh->header_size < sizeof(rec_file_header_t) || fh->header_size > r->size) {
+    DFATMO_LOG(DFLOG_ERROR, "'%s' is not a record file", filename);
+    close_recording(r);
+    return 1;
+  }
+  if (fh->version != REC_FILE_VERSION) {
+    DFATMO_LOG(DFLOG_ERROR, "record file '%s' has unsupported version %d", filename, fh->version);
+    close_recording(r);
+    return 1;
+  }
+
+  r->pos = REC_PADDED_SIZE(fh->header_size);
+  return 0;
+}
+
+
+static inline void rewind_recording(rec_reader_t *r) {
+  r->pos = REC_PADDED_SIZE(((const rec_file_header_t *) r->map)->header_size);
+}
+
+
+/*
+ * Return next valid frame of recording or NULL at end of file.
+ * Unknown chunks and frames with inconsistent header are skipped.
+ */
+static const rec_frame_header_t *next_recorded_frame(rec_reader_t *r) {
+  while (r->pos + sizeof(rec_chunk_header_t) <= r->size) {
+    const rec_chunk_header_t *ch = (const rec_chunk_header_t *) (r->map + r->pos);
+    const rec_frame_header_t *fh = (const rec_frame_header_t *) (ch + 1);
+    size_t payload_pos = r->pos + sizeof(rec_chunk_header_t);
+
+    if (payload_pos + ch->size > r->size)
+      break;
+    r->pos = payload_pos + REC_PADDED_SIZE(ch->size);
+
+    if (ch->type == REC_CHUNK_FRAME && ch->size >= sizeof(rec_frame_header_t) && fh->format < NUM_REC_FMTS &&
+          ch->size >= sizeof(rec_frame_header_t) + (size_t)fh->width * fh->height * rec_pixel_len[fh->format] &&
+          fh->crop_width >= 8 && fh->crop_height >= 8 &&
+          (fh->crop_left + fh->crop_width) <= fh->width && (fh->crop_top + fh->crop_height) <= fh->height)
+      return fh;
+  }
+  return NULL;
+}
+
+
+  /* Convert crop window of recorded frame to hsv image and analyze it */
+static inline int analyze_recorded_frame(atmo_driver_t *ad, const rec_frame_header_t *fh) {
+  const int pixel_len = rec_pixel_len[fh->format];
+  const int pitch = fh->width * pixel_len;
+  const uint8_t *img = (const uint8_t *) (fh + 1) + fh->crop_top * pitch + fh->crop_left * pixel_len;
+  hsv_color_t *hsv;
+  uint16_t *fine_v;
+  int h;
+
+  if (configure_analyze_size(ad, fh->crop_width, fh->crop_height))
+    return 1;
+
+  hsv = ad->hsv_img;
+  fine_v = ad->fine_v_img;
+  ad->fine_img = (fh->format == REC_FMT_RGB48 || fh->format == REC_FMT_XRGB2101010);
+  for (h = fh->crop_height; h--; img += pitch) {
+    const uint8_t *i = img;
+    int w = fh->crop_width;
+    switch (fh->format) {
+    case REC_FMT_RGB24:
+      for (; w--; i += 3)
+        rgb_to_hsv(hsv++, i[0], i[1], i[2]);
+      break;
+    case REC_FMT_RGBA32:
+      for (; w--; i += 4)
+        rgb_to_hsv(hsv++, i[0], i[1], i[2]);
+      break;
+    case REC_FMT_BGRA32:
+      for (; w--; i += 4)
+        rgb_to_hsv(hsv++, i[2], i[1], i[0]);
+      break;
+    case REC_FMT_XRGB32:
+      for (; w--; i += 4) {
+        uint32_t color = *((const uint32_t *) i);
+        rgb_to_hsv(hsv++, ((color >> 16) & 0x0FF), ((color >> 8) & 0x0FF), (color & 0x0FF));
+      }
+      break;
+    case REC_FMT_RGB48:
+      for (; w--; i += 6) {
+        const uint16_t *c = (const uint16_t *) i;
+        rgb16_to_hsv(hsv++, fine_v++, c[0], c[1], c[2]);
+      }
+      break;
+    case REC_FMT_XRGB2101010:
+      for (; w--; i += 4) {
+        uint32_t color = *((const uint32_t *) i);
+        rgb16_to_hsv(hsv++, fine_v++, RGB10_TO_16((color >> 20) & 0x3FF), RGB10_TO_16((color >> 10) & 0x3FF), RGB10_TO_16(color & 0x3FF));
+      }
+      break;
+    }
+  }
+
+  run_analysis(ad);
+  return 0;
+}
@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the check of the LED strip protocols of the serial output driver.
+ * The serial driver writes to a pseudo terminal. Frames for a full LED strip are streamed with the
+ * configured output rate and all telegrams received on the master side of the pseudo terminal are
+ * checked for correct header, checksum and LED order. The strip could be sharded to several
+ * pseudo terminals, each driving an equal part of the LEDs.
+ *
+ * Every LED color of a frame encodes its channel number and the frame number:
+ * red = channel & 0xFF, green = frame number, blue = channel >> 8
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <poll.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+
+#define DEFAULT_LAYOUT          "top=128 bottom=128 left=64 right=64 top_left=1 top_right=1 bottom_left=1 bottom_right=1"
+#define DEFAULT_FRAMES          200
+#define MAX_FRAMES              250     /* Frame number must fit into green value */
+#define RX_BUFFER_SIZE          (4 * 1024 * 1024)
+#define MAX_PORTS               8
+
+static const char *strip_protos[] = { "adalight", "awa", NULL };
+
+typedef struct {
+  int fd;
+  int first, num_leds;          // Part of the strip driven by this port
+  uint8_t *rx_buf;
+  int rx_len;
+} port_t;
+
+
+static void receive(port_t *ports, int num_ports, int timeout_ms) {
+  struct pollfd pfd[MAX_PORTS];
+  int i, n;
+
+  for (i = 0; i < num_ports; ++i) {
+    pfd[i].fd = ports[i].fd;
+    pfd[i].events = POLLIN;
+  }
+  while (poll(pfd, num_ports, timeout_ms) > 0) {
+    int received = 0;
+    for (i = 0; i < num_ports; ++i) {
+      port_t *port = &ports[i];
+      if ((pfd[i].revents & POLLIN) && port->rx_len < RX_BUFFER_SIZE) {
+        n = read(port->fd, port->rx_buf + port->rx_len, RX_BUFFER_SIZE - port->rx_len);
+        if (n > 0) {
+          port->rx_len += n;
+          received = 1;
+        }
+      }
+    }
+    if (!received)
+      break;
+    timeout_ms = 0;
+  }
+}
+
+
+  /* Build channel numbers of LEDs in strip order: clockwise starting at the bottom left corner */
+static int strip_channels(const atmo_parameters_t *p, int *ch) {
+  const int bottom = p->top, left = bottom + p->bottom, right = left + p->left, center = right + p->right;
+  const int tl = center + p->center, tr = tl + p->top_left, bl = tr + p->top_right, br = bl + p->bottom_left;
+  int n = 0, i;
+
+  if (p->bottom_left)
+    ch[n++] = bl;
+  for (i = p->left; i--;)
+    ch[n++] = left + i;
+  if (p->top_left)
+    ch[n++] = tl;
+  for (i = 0; i < p->top; ++i)
+    ch[n++] = i;
+  if (p->top_right)
+    ch[n++] = tr;
+  for (i = 0; i < p->right; ++i)
+    ch[n++] = right + i;
+  if (p->bottom_right)
+    ch[n++] = br;
+  for (i = p->bottom; i--;)
+    ch[n++] = bottom + i;
+  return n;
+}
+
+
+static int check_awa_checksum(const uint8_t *led, int len) {
+  uint16_t f1 = 0, f2 = 0, fext = 0;
+  uint8_t position = 0;
+  int i;
+
+  for (i = 0; i < len; ++i) {
+    fext = (fext + (led[i] ^ position++)) % 255;
+    f1 = (f1 + led[i]) % 255;
+    f2 = (f2 + f1) % 255;
+  }
+  if (fext == 0x41)
+    fext = 0xAA;
+  return (led[len] == f1 && led[len + 1] == f2 && led[len + 2] == fext);
+}
+
+
+/*
+ * Check all received telegrams. Telegrams may be dropped by the driver but received frame numbers
+ * must be increasing. Black telegrams are send when lights are turned on and off.
+ */
+static int check_telegrams(const char *proto, const uint8_t *rx_buf, int rx_len, const int *ch, int num_leds, int *num_frames, int *num_black) {
+  const int awa = !strcmp(proto, "awa");
+  const int size = 6 + num_leds * 3 + (awa ? 3: 0);
+  const int hi = ((num_leds - 1) >> 8) & 0xFF, lo = (num_leds - 1) & 0xFF;
+  int pos = 0, last_frame = 0, errors = 0;
+
+  *num_frames = *num_black = 0;
+  while (pos < rx_len && errors < 10) {
+    const uint8_t *t = rx_buf + pos;
+    int black = 1, frame, i;
+
+    if ((rx_len - pos) < size) {
+      printf("%s: incomplete telegram at offset %d\n", proto, pos);
+      ++errors;
+      break;
+    }
+    if (t[0] != 'A' || t[1] != (awa ? 'w': 'd') || t[2] != 'a' || t[3] != hi || t[4] != lo || t[5] != (hi ^ lo ^ 0x55)) {
+      printf("%s: bad header at offset %d\n", proto, pos);
+      ++errors;
+      break;
+    }
+    pos += size;
+    t += 6;
+    if (awa && !check_awa_checksum(t, num_leds * 3)) {
+      printf("%s: bad checksum of telegram at offset %d\n", proto, pos - size);
+      ++errors;
+      continue;
+    }
+    for (i = 0; i < num_leds * 3; ++i) {
+      if (t[i]) {
+        black = 0;
+        break;
+      }
+    }
+    if (black) {
+      ++*num_black;
+      continue;
+    }
+
+    frame = t[1];
+    for (i = 0; i < num_leds; ++i, t += 3) {
+      if (t[0] != (ch[i] & 0xFF) || t[1] != frame || t[2] != (ch[i] >> 8)) {
+        printf("%s: LED %d of telegram at offset %d is %d,%d,%d expected %d,%d,%d\n", proto, i, pos - size,
+                t[0], t[1], t[2], ch[i] & 0xFF, frame, ch[i] >> 8);
+        ++errors;
+        break;
+      }
+    }
+    if (frame <= last_frame) {
+      printf("%s: frame %d received after frame %d\n", proto, frame, last_frame);
+      ++errors;
+    }
+    last_frame = frame;
+    ++*num_frames;
+  }
+  return errors;
+}
+
+
+static int run_check(const char *proto, const char *driver_path, const char *speed, const char *layout, int frames, int num_ports) {
+  static atmo_driver_t atmo_driver;
+  atmo_driver_t *ad = &atmo_driver;
+  port_t ports[MAX_PORTS];
+  int ch[MAX_OUTPUT_CHANNELS];
+  char parms[SIZE_DRIVER_PARAM + 512], driver_param[SIZE_DRIVER_PARAM];
+  uint64_t start, next, worst = 0, elapsed;
+  int num_leds, num_frames = 0, num_black = 0, errors = 0, frame, i, n;
+
+  memset(ad, 0, sizeof(*ad));
+  init_configuration(ad);
+  if (set_parm_list(&ad->parm, layout) || config_channels(ad))
+    return 1;
+  num_leds = strip_channels(&ad->parm, ch);
+  if (num_leds < num_ports) {
+    printf("%s: less LEDs than ports\n", proto);
+    return 1;
+  }
+
+    /* Every port drives an equal part of the strip */
+  memset(ports, 0, sizeof(ports));
+  driver_param[0] = 0;
+  for (i = 0; i < num_ports; ++i) {
+    port_t *port = &ports[i];
+    port->first = num_leds * i / num_ports;
+    port->num_leds = num_leds * (i + 1) / num_ports - port->first;
+    port->fd = posix_openpt(O_RDWR | O_NOCTTY);
+    port->rx_buf = (uint8_t *) malloc(RX_BUFFER_SIZE);
+    if (port->fd < 0 || grantpt(port->fd) || unlockpt(port->fd) || port->rx_buf == NULL) {
+      printf("%s: opening pseudo terminal failed\n", proto);
+      ++errors;
+      break;
+    }
+    n = strlen(driver_param);
+    snprintf(driver_param + n, sizeof(driver_param) - n, "%s%s&proto:%s&speed:%s&range:%d-%d", i ? ",": "",
+              ptsname(port->fd), proto, speed, port->first + 1, port->first + port->num_leds);
+  }
+
+  snprintf(parms, sizeof(parms), "driver=serial driver_path=%s driver_param=%s", driver_path, driver_param);
+  if (errors || set_parm_list(&ad->parm, parms) || open_output_driver(ad)) {
+    ++errors;
+    goto cleanup;
+  }
+  ad->active_parm = ad->parm;
+  if (turn_lights_off(ad)) {
+    ++errors;
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    goto cleanup;
+  }
+
+  start = now_ns();
+  next = start;
+  for (frame = 1; frame <= frames; ++frame) {
+    uint64_t t;
+    for (i = 0; i < ad->sum_channels; ++i) {
+      ad->output_colors[i].r = i & 0xFF;
+      ad->output_colors[i].g = frame;
+      ad->output_colors[i].b = i >> 8;
+    }
+    t = now_ns();
+    if (send_output_colors(ad, ad->output_colors, 0))
+      break;
+    t = now_ns() - t;
+    if (t > worst)
+      worst = t;
+
+      /* Receive until next output is due */
+    next += (uint64_t)ad->active_parm.output_rate * 1000000;
+    while ((t = now_ns()) < next)
+      receive(ports, num_ports, (next - t) / 1000000);
+  }
+  elapsed = now_ns() - start;
+  close_output_driver(ad);
+  unload_output_driver(ad);
+  receive(ports, num_ports, 200);
+  if (frame <= frames) {
+    printf("%s: output failed at frame %d\n", proto, frame);
+    ++errors;
+  }
+
+  for (i = 0; i < num_ports; ++i) {
+    port_t *port = &ports[i];
+    int f, b;
+    errors += check_telegrams(proto, port->rx_buf, port->rx_len, ch + port->first, port->num_leds, &f, &b);
+    if (!f) {
+      printf("%s: no frames received on port %d\n", proto, i + 1);
+      ++errors;
+    }
+    if (!i || f < num_frames)
+      num_frames = f;
+    num_black += b;
+  }
+  printf("%s: %d LEDs on %d port(s), %d of %d frames received, %.1f frames/s, worst submit %.1f us: %s\n", proto, num_leds, num_ports,
+          num_frames, frames, num_frames * 1000000000.0 / elapsed, worst / 1000.0, errors ? "FAILED": "PASSED");
+
+cleanup:
+  for (i = 0; i < num_ports; ++i) {
+    if (ports[i].fd > 0)
+      close(ports[i].fd);
+    free(ports[i].rx_buf);
+  }
+  free_channels(ad);
+  return errors != 0;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] [parameter=value ...]\n"
+                  "  -d <path>     path of serial output driver (default: .)\n"
+                  "  -p <proto>    check only protocol 'adalight' or 'awa'\n"
+                  "  -s <speed>    baud rate (default: 500000)\n"
+                  "  -n <frames>   number of frames (default: %d, maximum: %d)\n"
+                  "  -P <ports>    number of serial ports the strip is sharded to (default: 1, maximum: %d)\n"
+                  "  -v <level>    log level 0 ... 3\n"
+                  "Parameters override the default layout: %s\n", prog, DEFAULT_FRAMES, MAX_FRAMES, MAX_PORTS, DEFAULT_LAYOUT);
+}
+
+
+int main(int argc, char *argv[]) {
+  const char *driver_path = ".", *proto = NULL, *speed = "500000";
+  char layout[1024];
+  int frames = DEFAULT_FRAMES, num_ports = 1, rc = 0, c, i;
+
+  while ((c = getopt(argc, argv, "d:p:s:n:P:v:h")) != -1) {
+    switch (c) {
+    case 'd':
+      driver_path = optarg;
+      break;
+    case 'p':
+      proto = optarg;
+      break;
+    case 's':
+      speed = optarg;
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 'P':
+      num_ports = atoi(optarg);
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (frames < 1 || frames > MAX_FRAMES || num_ports < 1 || num_ports > MAX_PORTS) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  strcpy(layout, DEFAULT_LAYOUT);
+  for (; optind < argc; ++optind) {
+    if (strlen(layout) + strlen(argv[optind]) + 2 > sizeof(layout)) {
+      usage(argv[0]);
+      return 1;
+    }
+    strcat(layout, " ");
+    strcat(layout, argv[optind]);
+  }
+
+  for (i = 0; strip_protos[i]; ++i) {
+    if (proto == NULL || !strcmp(proto, strip_protos[i]))
+      rc |= run_check(strip_protos[i], driver_path, speed, layout, frames, num_ports);
+  }
+  return rc;
+}
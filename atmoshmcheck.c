@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the check of the shared memory output driver. Frames are published as fast as possible
+ * while reader threads consume the latest frame in place through their own read only mapping of
+ * the segment. Readers check every frame they accept for torn data and increasing frame numbers.
+ * One reader could be slowed down inside its read section, the writer must not be affected.
+ *
+ * Every channel color of a frame encodes its channel number and the frame number:
+ * red = channel & 0xFF, green = frame number & 0xFF, blue = channel >> 8
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+#include "dfatmo_shm.h"
+
+#define DEFAULT_LAYOUT          "top=64 bottom=64 left=36 right=36 center=1 top_left=1 top_right=1 bottom_left=1 bottom_right=1"
+#define DEFAULT_FRAMES          100000
+#define DEFAULT_READERS         2
+#define MAX_READERS             16
+
+typedef struct {
+  const dfatmo_shm_header_t *hdr;
+  int slow_us;                  // Time spend inside read section
+  volatile int *stop;
+  uint64_t reads, retries, torn, reordered;
+} reader_t;
+
+
+static void *reader_thread(void *arg) {
+  reader_t *r = (reader_t *) arg;
+  const dfatmo_shm_header_t *hdr = r->hdr;
+  uint64_t last_frame = 0;
+
+  while (!*r->stop) {
+    const dfatmo_shm_slot_t *slot = dfatmo_shm_latest_slot(hdr);
+    const uint32_t seq = dfatmo_shm_read_begin(&slot->seq);
+    const uint64_t frame = slot->frame;
+    const int n = (slot->num_channels <= DFATMO_SHM_MAX_CHANNELS) ? slot->num_channels: 0;
+    const int green = slot->colors[0][1];
+    int black = 1, torn = 0, i;
+
+      /* Frame must be black or every channel must match its encoding */
+    for (i = 0; i < n; ++i) {
+      const uint8_t *c = slot->colors[i];
+      if (c[0] || c[1] || c[2])
+        black = 0;
+      if (c[0] != (i & 0xFF) || c[1] != green || c[2] != (i >> 8))
+        torn = 1;
+    }
+    if (r->slow_us) {
+      struct timespec ts = { 0, r->slow_us * 1000 };
+      nanosleep(&ts, NULL);
+    }
+    if (!dfatmo_shm_read_end(&slot->seq, seq)) {
+      ++r->retries;
+      continue;
+    }
+    if (torn && !black)
+      ++r->torn;
+    if (frame < last_frame)
+      ++r->reordered;
+    if (frame != last_frame)
+      ++r->reads;
+    last_frame = frame;
+  }
+  return NULL;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] [parameter=value ...]\n"
+                  "  -d <path>     path of shared memory output driver (default: .)\n"
+                  "  -n <frames>   number of frames (default: %d)\n"
+                  "  -R <readers>  number of reader threads (default: %d, maximum: %d)\n"
+                  "  -s <us>       first reader spends this time inside its read section (default: 0)\n"
+                  "  -S <slots>    number of slots of ring (default: 4)\n"
+                  "  -v <level>    log level 0 ... 3\n"
+                  "Parameters override the default layout: %s\n", prog, DEFAULT_FRAMES, DEFAULT_READERS, MAX_READERS, DEFAULT_LAYOUT);
+}
+
+
+int main(int argc, char *argv[]) {
+  static atmo_driver_t atmo_driver;
+  atmo_driver_t *ad = &atmo_driver;
+  const char *driver_path = ".";
+  char layout[1024], parms[SIZE_DRIVER_PATH + 256], name[64];
+  reader_t readers[MAX_READERS];
+  pthread_t threads[MAX_READERS];
+  volatile int stop = 0;
+  dfatmo_shm_header_t *hdr;
+  const dfatmo_shm_slot_t *slot;
+  uint64_t start, elapsed, sum = 0, worst = 0, reads = 0, retries = 0;
+  int frames = DEFAULT_FRAMES, num_readers = DEFAULT_READERS, slow_us = 0, num_slots = 4, errors = 0, fd, frame, c, i;
+  size_t size;
+
+  while ((c = getopt(argc, argv, "d:n:R:s:S:v:h")) != -1) {
+    switch (c) {
+    case 'd':
+      driver_path = optarg;
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 'R':
+      num_readers = atoi(optarg);
+      break;
+    case 's':
+      slow_us = atoi(optarg);
+      break;
+    case 'S':
+      num_slots = atoi(optarg);
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (frames < 1 || num_readers < 0 || num_readers > MAX_READERS || slow_us < 0 || slow_us > 999999) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  strcpy(layout, DEFAULT_LAYOUT);
+  for (; optind < argc; ++optind) {
+    if (strlen(layout) + strlen(argv[optind]) + 2 > sizeof(layout)) {
+      usage(argv[0]);
+      return 1;
+    }
+    strcat(layout, " ");
+    strcat(layout, argv[optind]);
+  }
+
+  init_configuration(ad);
+  snprintf(name, sizeof(name), "/dfatmo-check-%d", (int) getpid());
+  snprintf(parms, sizeof(parms), "driver=shm driver_path=%s driver_param=%s&slots:%d", driver_path, name, num_slots);
+  if (set_parm_list(&ad->parm, layout) || set_parm_list(&ad->parm, parms) || config_channels(ad))
+    return 1;
+  if (open_output_driver(ad)) {
+    free_channels(ad);
+    return 1;
+  }
+  ad->active_parm = ad->parm;
+
+    /* Readers use their own read only mapping like external processes */
+  fd = shm_open(name, O_RDONLY, 0);
+  hdr = (fd < 0) ? MAP_FAILED: (dfatmo_shm_header_t *) mmap(NULL, sizeof(*hdr), PROT_READ, MAP_SHARED, fd, 0);
+  if (hdr == MAP_FAILED || hdr->magic != DFATMO_SHM_MAGIC || hdr->num_channels != (uint32_t) ad->sum_channels) {
+    printf("shared memory segment '%s' is not valid\n", name);
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    shm_unlink(name);
+    free_channels(ad);
+    return 1;
+  }
+  size = hdr->header_size + hdr->num_slots * hdr->slot_size;
+  munmap(hdr, sizeof(*hdr));
+  hdr = (dfatmo_shm_header_t *) mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+
+  memset(readers, 0, sizeof(readers));
+  for (i = 0; i < num_readers; ++i) {
+    readers[i].hdr = hdr;
+    readers[i].stop = &stop;
+    readers[i].slow_us = i ? 0: slow_us;
+    pthread_create(&threads[i], NULL, reader_thread, &readers[i]);
+  }
+
+  turn_lights_off(ad);
+  start = now_ns();
+  for (frame = 1; frame <= frames; ++frame) {
+    uint64_t t;
+    for (i = 0; i < ad->sum_channels; ++i) {
+      ad->output_colors[i].r = i & 0xFF;
+      ad->output_colors[i].g = frame & 0xFF;
+      ad->output_colors[i].b = i >> 8;
+    }
+    t = now_ns();
+    if (send_output_colors(ad, ad->output_colors, 0))
+      break;
+    t = now_ns() - t;
+    sum += t;
+    if (t > worst)
+      worst = t;
+  }
+  elapsed = now_ns() - start;
+
+  stop = 1;
+  for (i = 0; i < num_readers; ++i) {
+    reader_t *r = &readers[i];
+    pthread_join(threads[i], NULL);
+    if (r->torn || r->reordered) {
+      printf("reader %d: %llu torn and %llu reordered frames\n", i + 1, (unsigned long long) r->torn, (unsigned long long) r->reordered);
+      ++errors;
+    }
+    reads += r->reads;
+    retries += r->retries;
+  }
+  if (frame <= frames) {
+    printf("output failed at frame %d\n", frame);
+    ++errors;
+  }
+
+    /* Lights off at close is the last published frame */
+  close_output_driver(ad);
+  unload_output_driver(ad);
+  slot = dfatmo_shm_latest_slot(hdr);
+  if (hdr->active || hdr->frames <= (uint64_t)frames || slot->frame != hdr->frames || slot->colors[1][0] || slot->colors[1][1] || slot->colors[1][2]) {
+    printf("segment after close: active %u, %llu frames, latest slot frame %llu\n", hdr->active,
+            (unsigned long long) hdr->frames, (unsigned long long) slot->frame);
+    ++errors;
+  }
+
+  printf("%d channels, %d frames in %.3f s, %.0f frames/s, average publish %.2f us, worst %.1f us, %d readers with %llu frames read, %llu retries: %s\n",
+          ad->sum_channels, frames, elapsed / 1000000000.0, frames * 1000000000.0 / elapsed, sum / 1000.0 / frames, worst / 1000.0, num_readers,
+          (unsigned long long) reads, (unsigned long long) retries, errors ? "FAILED": "PASSED");
+  munmap(hdr, size);
+  shm_unlink(name);
+  free_channels(ad);
+  return (errors != 0);
+}
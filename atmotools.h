@@ -0,0 +1,226 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This module contains common functions of the standalone DFAtmo tools (benchmark, replay and check).
+ * It must be included after "atmodriver.h".
+ */
+
+#include <stdarg.h>
+#include <time.h>
+
+
+static int act_log_level = DFLOG_ERROR;
+dfatmo_log_level_t dfatmo_log_level = &act_log_level;
+
+static void driver_log(int level, const char *fmt, ...) {
+  va_list ap;
+  va_start(ap, fmt);
+  fprintf(stderr, "DFAtmo: ");
+  vfprintf(stderr, fmt, ap);
+  fprintf(stderr, "\n");
+  va_end(ap);
+}
+dfatmo_log_t dfatmo_log = &driver_log;
+
+
+/*
+ * Setting of engine parameters from "name=value" strings
+ */
+typedef enum { PARM_TYPE_LAST, PARM_TYPE_INT, PARM_TYPE_BOOL, PARM_TYPE_CHAR } parm_type_t;
+
+typedef struct {
+  parm_type_t type;
+  const char *name;
+  size_t size;
+  int offset;
+  int range_min;
+  int range_max;
+} parm_desc_t;
+
+static atmo_parameters_t tmp_parm;
+
+#define PARM_DESC_BOOL( var, enumv, min, max, readonly, descr ) \
+{ PARM_TYPE_BOOL, #var, sizeof(tmp_parm.var), (char*)&tmp_parm.var-(char*)&tmp_parm, min, max },
+
+#define PARM_DESC_INT( var, enumv, min, max, readonly, descr ) \
+{ PARM_TYPE_INT, #var, sizeof(tmp_parm.var), (char*)&tmp_parm.var-(char*)&tmp_parm, min, max },
+
+#define PARM_DESC_CHAR( var, enumv, min, max, readonly, descr ) \
+{ PARM_TYPE_CHAR, #var, sizeof(tmp_parm.var), (char*)&tmp_parm.var-(char*)&tmp_parm, min, max },
+
+static parm_desc_t parm_desc[] = {
+PARM_DESC_LIST
+{ PARM_TYPE_LAST, NULL, 0, 0, 0, 0 }
+};
+
+
+static int set_parm(atmo_parameters_t *parm, const char *arg, int len) {
+  const char *value = memchr(arg, '=', len);
+  parm_desc_t *pd;
+
+  if (value != NULL) {
+    int name_len = value - arg;
+    int value_len = len - name_len - 1;
+    ++value;
+    for (pd = parm_desc; pd->type != PARM_TYPE_LAST; ++pd) {
+      char *p = (char *) parm + pd->offset;
+      if (strncmp(pd->name, arg, name_len) || pd->name[name_len])
+        continue;
+      if (pd->type == PARM_TYPE_CHAR) {
+        if (value_len < (int)pd->size) {
+          memcpy(p, value, value_len);
+          p[value_len] = 0;
+          return 0;
+        }
+      } else {
+        int v = atoi(value);
+        if (v >= pd->range_min && v <= pd->range_max) {
+          *((int *) p) = v;
+          return 0;
+        }
+      }
+      break;
+    }
+  }
+
+  fprintf(stderr, "illegal parameter '%.*s'\n", len, arg);
+  return 1;
+}
+
+
+  /* Set a white space separated list of parameters */
+static inline int set_parm_list(atmo_parameters_t *parm, const char *list) {
+  while (*list) {
+    int len;
+    while (isspace(*list))
+      ++list;
+    for (len = 0; list[len] && !isspace(list[len]); ++len)
+      ;
+    if (len && set_parm(parm, list, len))
+      return 1;
+    list += len;
+  }
+  return 0;
+}
+
+
+static inline uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+static uint32_t lcg_next(uint32_t *seed) {
+  *seed = *seed * 1664525U + 1013904223U;
+  return *seed >> 8;
+}
+
+
+/*
+ * Synthetic frame generators. All frames are packed RGB24 and depend only on size and variant.
+ */
+
+static void gen_gradient(uint8_t *p, int w, int h, int variant) {
+  int x, y;
+  for (y = 0; y < h; ++y) {
+    for (x = 0; x < w; ++x) {
+      p[0] = (uint8_t)((x * 255 / (w - 1) + variant * 37) & 0xFF);
+      p[1] = (uint8_t)((y * 255 / (h - 1) + variant * 11) & 0xFF);
+      p[2] = (uint8_t)(255 - p[0]);
+      p += 3;
+    }
+  }
+}
+
+static void gen_bars(uint8_t *p, int w, int h, int variant) {
+  static const uint8_t bars[8][3] = { {192,192,192}, {192,192,0}, {0,192,192}, {0,192,0}, {192,0,192}, {192,0,0}, {0,0,192}, {16,16,16} };
+  const int letterbox = h / 8;
+  int x, y;
+  for (y = 0; y < h; ++y) {
+    for (x = 0; x < w; ++x) {
+      if (y < letterbox || y >= (h - letterbox)) {
+        p[0] = p[1] = p[2] = 0;
+      } else {
+        const uint8_t *c = bars[((x * 8) / w + variant) & 7];
+        p[0] = c[0];
+        p[1] = c[1];
+        p[2] = c[2];
+      }
+      p += 3;
+    }
+  }
+}
+
+static void gen_noise(uint8_t *p, int w, int h, int variant) {
+  uint32_t seed = 4711 + variant;
+  int n = w * h * 3;
+  while (n--)
+    *p++ = (uint8_t)lcg_next(&seed);
+}
+
+static void gen_dark(uint8_t *p, int w, int h, int variant) {
+  uint32_t seed = 815 + variant;
+  int n = w * h;
+  while (n--) {
+    uint32_t r = lcg_next(&seed);
+    if ((r & 0x3F) == 0) {
+      p[0] = (uint8_t)(r >> 8);
+      p[1] = (uint8_t)(r >> 12);
+      p[2] = (uint8_t)(r >> 4);
+    } else
+      p[0] = p[1] = p[2] = (uint8_t)(r & 0x03);
+    p += 3;
+  }
+}
+
+static const struct { const char *name; void (*gen)(uint8_t *p, int w, int h, int variant); } generators[] = {
+  { "gradient", gen_gradient },
+  { "bars", gen_bars },
+  { "noise", gen_noise },
+  { "dark", gen_dark },
+  { NULL, NULL }
+};
+
+
+static inline void calc_hsv_image_from_rgb(hsv_color_t *hsv, const uint8_t *img, int img_size) {
+  while (img_size--) {
+    rgb_to_hsv(hsv, img[0], img[1], img[2]);
+    ++hsv;
+    img += 3;
+  }
+}
+
+
+  /* Analyze sequence of the grab threads */
+static inline void run_analysis(atmo_driver_t *ad) {
+  calc_hue_hist(ad);
+  if (ad->active_parm.hue_win_size)
+    calc_windowed_hue_hist(ad);
+  calc_most_used_hue(ad);
+  calc_sat_hist(ad);
+  if (ad->active_parm.sat_win_size)
+    calc_windowed_sat_hist(ad);
+  calc_most_used_sat(ad);
+  if (ad->active_parm.uniform_brightness)
+    calc_uniform_average_brightness(ad);
+  else
+    calc_average_brightness(ad);
+  calc_rgb_values(ad);
+}
@@ -0,0 +1,335 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the check and benchmark of the E1.31 and Art-Net protocols of the UDP output driver.
+ * The UDP driver sends to a receiver socket on localhost. Frames spanning several universes are
+ * submitted as fast as possible or with the configured output rate and all received packets are
+ * checked for correct header, universe and DMX data. At most 1% of the packets may be lost.
+ *
+ * Every LED color of a frame encodes its channel number and the frame number:
+ * red = channel & 0xFF, green = frame number & 0xFF, blue = channel >> 8
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "atmodriver.h"
+#include "atmotools.h"
+
+#define DEFAULT_LAYOUT          "top=128 bottom=128 left=128 right=128 center=1 top_left=1 top_right=1 bottom_left=1 bottom_right=1"
+#define DEFAULT_FRAMES          5000
+#define DEFAULT_SLOTS           510
+#define RX_BUFFER_SIZE          (8 * 1024 * 1024)
+#define MAX_PACKET_SIZE         1024
+#define MAX_LOSS_PERCENT        1       /* Tolerated packet loss on loopback, e.g. by a full socket buffer */
+
+static const char *udp_protos[] = { "e131", "artnet", NULL };
+
+typedef struct {
+  const char *proto;
+  int num_bytes;                // Color bytes of a frame
+  int slots;
+  int first_universe;
+  int num_universes;
+  uint32_t packets, black, errors;
+  uint8_t last_seq[64];
+  uint32_t seen[64];
+} receiver_t;
+
+
+static int get16(const uint8_t *p) {
+  return (p[0] << 8) | p[1];
+}
+
+
+  /* Check header of a received packet and return universe, sequence number and DMX data */
+static int check_header(receiver_t *r, const uint8_t *p, int len, int *universe, int *seq, const uint8_t **data, int *slots) {
+  if (!strcmp(r->proto, "e131")) {
+    if (len < 126 || get16(p) != 0x0010 || memcmp(p + 4, "ASC-E1.17", 10) || get16(p + 16) != (0x7000 | (len - 16)) ||
+        get16(p + 38) != (0x7000 | (len - 38)) || get16(p + 115) != (0x7000 | (len - 115)) || p[117] != 0x02 || p[118] != 0xA1 ||
+        get16(p + 123) != (len - 125) || p[125] != 0)
+      return -1;
+    *seq = p[111];
+    *universe = get16(p + 113);
+    *data = p + 126;
+    *slots = len - 126;
+  } else {
+    if (len < 18 || memcmp(p, "Art-Net", 8) || p[8] != 0x00 || p[9] != 0x50 || p[11] != 14 || get16(p + 16) != (len - 18) || (len & 1))
+      return -1;
+    *seq = p[12];
+    *universe = p[14] | (p[15] << 8);
+    *data = p + 18;
+    *slots = len - 18;
+  }
+  return 0;
+}
+
+
+static void check_packet(receiver_t *r, const uint8_t *p, int len) {
+  const uint8_t *data;
+  int universe, seq, slots, expected, black = 1, green = -1, u, i;
+
+  ++r->packets;
+  if (check_header(r, p, len, &universe, &seq, &data, &slots)) {
+    if (r->errors++ < 10)
+      printf("%s: bad header of packet %u\n", r->proto, r->packets);
+    return;
+  }
+  u = universe - r->first_universe;
+  if (u < 0 || u >= r->num_universes) {
+    if (r->errors++ < 10)
+      printf("%s: unexpected universe %d\n", r->proto, universe);
+    return;
+  }
+  expected = r->num_bytes - u * r->slots;
+  if (expected > r->slots)
+    expected = r->slots;
+  if (slots != (!strcmp(r->proto, "e131") ? expected: ((expected + 1) & ~1))) {
+    if (r->errors++ < 10)
+      printf("%s: universe %d has %d slots expected %d\n", r->proto, universe, slots, expected);
+    return;
+  }
+  if (r->seen[u] && seq == r->last_seq[u]) {
+    if (r->errors++ < 10)
+      printf("%s: universe %d repeated sequence number %d\n", r->proto, universe, seq);
+  }
+  r->seen[u]++;
+  r->last_seq[u] = seq;
+
+  for (i = 0; i < expected; ++i) {
+    if (data[i]) {
+      black = 0;
+      break;
+    }
+  }
+  if (black) {
+    ++r->black;
+    return;
+  }
+
+  for (i = 0; i < expected; ++i) {
+    const int off = u * r->slots + i, ch = off / 3;
+    int v;
+    if (off % 3 == 0)
+      v = ch & 0xFF;
+    else if (off % 3 == 2)
+      v = ch >> 8;
+    else {
+        /* All LEDs of a packet have the same frame number */
+      if (green < 0)
+        green = data[i];
+      v = green;
+    }
+    if (data[i] != v) {
+      if (r->errors++ < 10)
+        printf("%s: slot %d of universe %d is %d expected %d\n", r->proto, i + 1, universe, data[i], v);
+      return;
+    }
+  }
+}
+
+
+static void receive(receiver_t *r, int sock, int timeout_ms) {
+  uint8_t buf[MAX_PACKET_SIZE];
+  struct pollfd pfd;
+  int n;
+
+  pfd.fd = sock;
+  pfd.events = POLLIN;
+  while (poll(&pfd, 1, timeout_ms) > 0) {
+    while ((n = recv(sock, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+      check_packet(r, buf, n);
+    timeout_ms = 0;
+  }
+}
+
+
+static int run_check(const char *proto, const char *driver_path, const char *layout, int frames, int rate, int slots) {
+  static atmo_driver_t atmo_driver;
+  atmo_driver_t *ad = &atmo_driver;
+  receiver_t r;
+  struct sockaddr_in addr;
+  socklen_t addr_len = sizeof(addr);
+  char parms[SIZE_DRIVER_PARAM + 512];
+  uint64_t start, next, worst = 0, elapsed;
+  int sock, size = RX_BUFFER_SIZE, errors = 0, frame, i;
+  uint32_t sent;
+
+  memset(ad, 0, sizeof(*ad));
+  init_configuration(ad);
+  if (set_parm_list(&ad->parm, layout) || config_channels(ad))
+    return 1;
+
+  memset(&r, 0, sizeof(r));
+  r.proto = proto;
+  r.num_bytes = ad->sum_channels * 3;
+  r.slots = slots;
+  r.first_universe = !strcmp(proto, "e131") ? 1: 0;
+  r.num_universes = (r.num_bytes + slots - 1) / slots;
+
+    /* Receiver on localhost with ephemeral port */
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  if (sock < 0 || setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size)) ||
+      bind(sock, (struct sockaddr *) &addr, sizeof(addr)) || getsockname(sock, (struct sockaddr *) &addr, &addr_len)) {
+    printf("%s: opening receiver socket failed\n", proto);
+    if (sock >= 0)
+      close(sock);
+    free_channels(ad);
+    return 1;
+  }
+
+  snprintf(parms, sizeof(parms), "driver=udp driver_path=%s output_rate=%d driver_param=127.0.0.1:%d&proto:%s&slots:%d",
+            driver_path, rate ? rate: 20, ntohs(addr.sin_port), proto, slots);
+  if (set_parm_list(&ad->parm, parms) || open_output_driver(ad)) {
+    ++errors;
+    goto cleanup;
+  }
+  ad->active_parm = ad->parm;
+  if (turn_lights_off(ad)) {
+    ++errors;
+    close_output_driver(ad);
+    unload_output_driver(ad);
+    goto cleanup;
+  }
+
+  start = now_ns();
+  next = start;
+  for (frame = 1; frame <= frames; ++frame) {
+    uint64_t t;
+    for (i = 0; i < ad->sum_channels; ++i) {
+      ad->output_colors[i].r = i & 0xFF;
+      ad->output_colors[i].g = frame & 0xFF;
+      ad->output_colors[i].b = i >> 8;
+    }
+    t = now_ns();
+    if (send_output_colors(ad, ad->output_colors, 0))
+      break;
+    t = now_ns() - t;
+    if (t > worst)
+      worst = t;
+
+    if (rate) {
+        /* Receive until next output is due */
+      next += (uint64_t)rate * 1000000;
+      while ((t = now_ns()) < next)
+        receive(&r, sock, (next - t) / 1000000);
+    } else
+      receive(&r, sock, 0);
+  }
+  elapsed = now_ns() - start;
+  close_output_driver(ad);
+  unload_output_driver(ad);
+  receive(&r, sock, 200);
+  if (frame <= frames) {
+    printf("%s: output failed at frame %d\n", proto, frame);
+    ++errors;
+  }
+
+    /* Initial lights off frame is send complete too */
+  sent = frame * r.num_universes;
+  errors += r.errors;
+  if (r.packets > sent || (uint64_t)(sent - r.packets) * 100 > (uint64_t)sent * MAX_LOSS_PERCENT) {
+    printf("%s: %u of %u packets received\n", proto, r.packets, sent);
+    ++errors;
+  }
+  printf("%s: %d channels in %d universes, %u of %u packets received, %.0f packets/s, %.1f frames/s, worst submit %.1f us: %s\n",
+          proto, ad->sum_channels, r.num_universes, r.packets, sent, (frame - 1) * r.num_universes * 1000000000.0 / elapsed,
+          (frame - 1) * 1000000000.0 / elapsed, worst / 1000.0, errors ? "FAILED": "PASSED");
+
+cleanup:
+  close(sock);
+  free_channels(ad);
+  return errors != 0;
+}
+
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [options] [parameter=value ...]\n"
+                  "  -d <path>     path of UDP output driver (default: .)\n"
+                  "  -p <proto>    check only protocol 'e131' or 'artnet'\n"
+                  "  -s <slots>    used DMX slots per universe (default: %d)\n"
+                  "  -n <frames>   number of frames (default: %d)\n"
+                  "  -r <ms>       output rate, 0 is as fast as possible (default: 0)\n"
+                  "  -v <level>    log level 0 ... 3\n"
+                  "Parameters override the default layout: %s\n", prog, DEFAULT_SLOTS, DEFAULT_FRAMES, DEFAULT_LAYOUT);
+}
+
+
+int main(int argc, char *argv[]) {
+  const char *driver_path = ".", *proto = NULL;
+  char layout[1024];
+  int frames = DEFAULT_FRAMES, rate = 0, slots = DEFAULT_SLOTS, rc = 0, c, i;
+
+  while ((c = getopt(argc, argv, "d:p:s:n:r:v:h")) != -1) {
+    switch (c) {
+    case 'd':
+      driver_path = optarg;
+      break;
+    case 'p':
+      proto = optarg;
+      break;
+    case 's':
+      slots = atoi(optarg);
+      break;
+    case 'n':
+      frames = atoi(optarg);
+      break;
+    case 'r':
+      rate = atoi(optarg);
+      break;
+    case 'v':
+      act_log_level = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+      return 1;
+    }
+  }
+  if (frames < 1 || rate < 0 || slots < 3 || slots > 512) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  strcpy(layout, DEFAULT_LAYOUT);
+  for (; optind < argc; ++optind) {
+    if (strlen(layout) + strlen(argv[optind]) + 2 > sizeof(layout)) {
+      usage(argv[0]);
+      return 1;
+    }
+    strcat(layout, " ");
+    strcat(layout, argv[optind]);
+  }
+
+  for (i = 0; udp_protos[i]; ++i) {
+    if (proto == NULL || !strcmp(proto, udp_protos[i]))
+      rc |= run_check(udp_protos[i], driver_path, layout, frames, rate, slots);
+  }
+  return rc;
+}
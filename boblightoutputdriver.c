@@ -0,0 +1,626 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the DFAtmo native output driver for boblight servers (boblightd, Hyperion).
+ *
+ * The lights of the server are mapped to the DFAtmo channel that is nearest to the center of the
+ * scanned screen region of the light. All light values of a frame are formatted into one buffer
+ * that is written to the non blocking TCP socket, replies of the server are not waited for.
+ * If the connection is lost the driver reconnects in the background while colors are still submitted.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "dfatmo.h"
+
+#define DEFAULT_HOST            "localhost"
+#define DEFAULT_PORT            19333
+#define DEFAULT_PRIORITY        128
+#define MAX_LIGHTS              1024
+#define MAX_LIGHT_NAME          32
+#define CONNECT_TIMEOUT         3000    /* [ms] Timeout of connection and negotiation at open */
+#define RECONNECT_INTERVAL      1000    /* [ms] */
+#define RX_BUFFER_SIZE          (64 * 1024)
+#define VALUE_SIZE              6       /* Formatted color value " 0.000" */
+
+enum { ST_DISCONNECTED, ST_CONNECTING, ST_NEGOTIATING, ST_CONNECTED };
+
+typedef struct {
+  char name[MAX_LIGHT_NAME];
+  float vscan[2], hscan[2];     // Scanned region of screen in percent
+  int channel;                  // Mapped DFAtmo channel
+} boblight_light_t;
+
+typedef struct {
+  output_driver_t output_driver;
+  atmo_parameters_t param;
+  char host[128];
+  int port;
+  struct sockaddr_storage addr; // Server address resolved at open, used for reconnects
+  socklen_t addr_len;
+  int priority;
+  int sock;
+  int state;
+  uint64_t connect_time;
+  int num_lights, lights_expected;
+  boblight_light_t *lights;
+  char rx_buf[RX_BUFFER_SIZE];
+  int rx_len;
+  char *tx_buf;                 // Formatted frame
+  int tx_size, tx_len, tx_pos;
+  int pending;                  // Colors waiting for output of previous frame
+  rgb_color_t *pending_colors;
+  int num_channels;
+  char values[256][VALUE_SIZE + 1];
+  uint32_t frames, coalesced, reconnects, bytes;
+} boblight_output_driver_t;
+
+
+static uint64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+static void disconnect(boblight_output_driver_t *this) {
+  if (this->sock >= 0) {
+    close(this->sock);
+    this->sock = -1;
+  }
+  this->state = ST_DISCONNECTED;
+  this->rx_len = 0;
+  this->tx_len = this->tx_pos = 0;
+}
+
+
+  /* Resolve server address, done only at open because resolving could block for a long time */
+static int resolve_host(boblight_output_driver_t *this) {
+  struct addrinfo hints, *res;
+  char port[16];
+  int rc;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  snprintf(port, sizeof(port), "%d", this->port);
+  rc = getaddrinfo(this->host, port, &hints, &res);
+  if (rc) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "resolving host '%.64s' failed: %s", this->host, gai_strerror(rc));
+    return -1;
+  }
+  memcpy(&this->addr, res->ai_addr, res->ai_addrlen);
+  this->addr_len = res->ai_addrlen;
+  freeaddrinfo(res);
+  return 0;
+}
+
+
+  /* Start non blocking connect to resolved server address */
+static int start_connect(boblight_output_driver_t *this) {
+  int rc, on = 1;
+
+  this->connect_time = now_ms();
+  this->sock = socket(this->addr.ss_family, SOCK_STREAM, 0);
+  if (this->sock < 0) {
+    strerror_r(errno, this->output_driver.errmsg, sizeof(this->output_driver.errmsg));
+    return -1;
+  }
+  fcntl(this->sock, F_SETFL, fcntl(this->sock, F_GETFL) | O_NONBLOCK);
+  setsockopt(this->sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+  rc = connect(this->sock, (struct sockaddr *) &this->addr, this->addr_len);
+  if (rc < 0 && errno != EINPROGRESS) {
+    strerror_r(errno, this->output_driver.errmsg, sizeof(this->output_driver.errmsg));
+    disconnect(this);
+    return -1;
+  }
+  this->state = ST_CONNECTING;
+  this->num_lights = this->lights_expected = 0;
+  return 0;
+}
+
+
+enum { EDGE_TOP, EDGE_BOTTOM, EDGE_LEFT, EDGE_RIGHT };
+
+typedef struct {
+  float h0, h1, v0, v1;         // Rectangle in percent of screen
+  int edge;
+} channel_area_t;
+
+
+  /* Integral of (1 - x)^w over [a, b] of the interval [0, 100] */
+static float edge_weight(float a, float b, int w) {
+  float pa = 1.0f, pb = 1.0f;
+  int i;
+
+  if (b <= a)
+    return 0.0f;
+  for (i = 0; i <= w; ++i) {
+    pa *= 1.0f - a / 100.0f;
+    pb *= 1.0f - b / 100.0f;
+  }
+  return (pa - pb) / (w + 1);
+}
+
+
+  /* Overlap of scanned region of light and channel area weighted like the analyze engine towards the edge of the area */
+static float weighted_overlap(const boblight_light_t *l, const channel_area_t *a, int w) {
+  const float h0 = (l->hscan[0] > a->h0) ? l->hscan[0]: a->h0, h1 = (l->hscan[1] < a->h1) ? l->hscan[1]: a->h1;
+  const float v0 = (l->vscan[0] > a->v0) ? l->vscan[0]: a->v0, v1 = (l->vscan[1] < a->v1) ? l->vscan[1]: a->v1;
+
+  if (h1 <= h0 || v1 <= v0)
+    return 0.0f;
+  switch (a->edge) {
+  case EDGE_TOP:
+    return (h1 - h0) * edge_weight(v0, v1, w);
+  case EDGE_BOTTOM:
+    return (h1 - h0) * edge_weight(100.0f - v1, 100.0f - v0, w);
+  case EDGE_LEFT:
+    return (v1 - v0) * edge_weight(h0, h1, w);
+  default:
+    return (v1 - v0) * edge_weight(100.0f - h1, 100.0f - h0, w);
+  }
+}
+
+
+  /*
+   * Map every light to the DFAtmo channel whose area has the largest weighted overlap with the scanned region
+   * of the light. Areas follow the layout of the analyze engine: border channels cover half of the screen in
+   * depth and the corner channels take the first and last segment of both borders. The center channel is
+   * used for lights whose region contains the center of the screen.
+   */
+static void map_lights(boblight_output_driver_t *this) {
+  const atmo_parameters_t *p = &this->param;
+  const float st = 100.0f / (p->top + p->top_left + p->top_right), sb = 100.0f / (p->bottom + p->bottom_left + p->bottom_right);
+  const float sl = 100.0f / (p->left + p->top_left + p->bottom_left), sr = 100.0f / (p->right + p->top_right + p->bottom_right);
+  const int w = (p->edge_weighting > 10) ? (p->edge_weighting + 5) / 10: 1;
+  channel_area_t area[NUM_AREAS * MAX_BORDER_CHANNELS][2];      // Corner channels have two areas
+  int n = 0, center = -1, i, k;
+
+#define SET_AREA(j, e, h0_, h1_, v0_, v1_) do { channel_area_t *a = &area[n][j]; a->h0 = (h0_); a->h1 = (h1_); a->v0 = (v0_); a->v1 = (v1_); a->edge = (e); } while (0)
+  memset(area, 0, sizeof(area));
+  for (i = 0; i < p->top; ++i, ++n)
+    SET_AREA(0, EDGE_TOP, (i + p->top_left) * st, (i + p->top_left + 1) * st, 0.0f, 50.0f);
+  for (i = 0; i < p->bottom; ++i, ++n)
+    SET_AREA(0, EDGE_BOTTOM, (i + p->bottom_left) * sb, (i + p->bottom_left + 1) * sb, 50.0f, 100.0f);
+  for (i = 0; i < p->left; ++i, ++n)
+    SET_AREA(0, EDGE_LEFT, 0.0f, 50.0f, (i + p->top_left) * sl, (i + p->top_left + 1) * sl);
+  for (i = 0; i < p->right; ++i, ++n)
+    SET_AREA(0, EDGE_RIGHT, 50.0f, 100.0f, (i + p->top_right) * sr, (i + p->top_right + 1) * sr);
+  if (p->center)
+    center = n++;
+  if (p->top_left) {
+    SET_AREA(0, EDGE_TOP, 0.0f, st, 0.0f, 50.0f);
+    SET_AREA(1, EDGE_LEFT, 0.0f, 50.0f, 0.0f, sl);
+    ++n;
+  }
+  if (p->top_right) {
+    SET_AREA(0, EDGE_TOP, 100.0f - st, 100.0f, 0.0f, 50.0f);
+    SET_AREA(1, EDGE_RIGHT, 50.0f, 100.0f, 0.0f, sr);
+    ++n;
+  }
+  if (p->bottom_left) {
+    SET_AREA(0, EDGE_BOTTOM, 0.0f, sb, 50.0f, 100.0f);
+    SET_AREA(1, EDGE_LEFT, 0.0f, 50.0f, 100.0f - sl, 100.0f);
+    ++n;
+  }
+  if (p->bottom_right) {
+    SET_AREA(0, EDGE_BOTTOM, 100.0f - sb, 100.0f, 50.0f, 100.0f);
+    SET_AREA(1, EDGE_RIGHT, 50.0f, 100.0f, 100.0f - sr, 100.0f);
+    ++n;
+  }
+#undef SET_AREA
+  this->num_channels = n;
+
+  for (k = 0; k < this->num_lights; ++k) {
+    boblight_light_t *l = &this->lights[k];
+    float best = 0.0f;
+
+    l->channel = 0;
+    if (center >= 0 && l->hscan[0] <= 50.0f && l->hscan[1] >= 50.0f && l->vscan[0] <= 50.0f && l->vscan[1] >= 50.0f)
+      l->channel = center;
+    else {
+      for (i = 0; i < n; ++i) {
+        const float a = weighted_overlap(l, &area[i][0], w), b = weighted_overlap(l, &area[i][1], w);
+        if (a > best || b > best) {
+          best = (a > b) ? a: b;
+          l->channel = i;
+        }
+      }
+    }
+    DFATMO_LOG(DFLOG_DEBUG, "light '%s' mapped to channel %d", l->name, l->channel + 1);
+  }
+}
+
+
+  /* Parse one line received from server. Returns -1 for protocol errors */
+static int parse_line(boblight_output_driver_t *this, char *line) {
+  if (this->state != ST_NEGOTIATING)
+    return 0;   /* Replies to pings or error messages are ignored */
+
+  if (!strncmp(line, "lights ", 7)) {
+    this->lights_expected = atoi(line + 7);
+    if (this->lights_expected < 1 || this->lights_expected > MAX_LIGHTS) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "server reports %d lights", this->lights_expected);
+      return -1;
+    }
+    this->num_lights = 0;
+  } else if (!strncmp(line, "light ", 6) && this->num_lights < this->lights_expected) {
+    boblight_light_t *l = &this->lights[this->num_lights];
+    char fmt[64];
+    snprintf(fmt, sizeof(fmt), "light %%%ds scan %%f %%f %%f %%f", MAX_LIGHT_NAME - 1);
+    if (sscanf(line, fmt, l->name, &l->vscan[0], &l->vscan[1], &l->hscan[0], &l->hscan[1]) != 5) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "bad light description '%.80s'", line);
+      return -1;
+    }
+    if (++this->num_lights == this->lights_expected) {
+      char cmd[64];
+      map_lights(this);
+      snprintf(cmd, sizeof(cmd), "set priority %d\n", this->priority);
+      if (send(this->sock, cmd, strlen(cmd), MSG_NOSIGNAL) < 0) {
+        strerror_r(errno, this->output_driver.errmsg, sizeof(this->output_driver.errmsg));
+        return -1;
+      }
+      this->state = ST_CONNECTED;
+      DFATMO_LOG(DFLOG_INFO, "connected to boblight server %s:%d with %d lights", this->host, this->port, this->num_lights);
+    }
+  }
+  return 0;
+}
+
+
+  /* Progress connection state without blocking longer than timeout. Returns -1 if connection failed */
+static int process_connection(boblight_output_driver_t *this, int timeout_ms) {
+  struct pollfd pfd;
+  int n;
+
+  if (this->state == ST_DISCONNECTED)
+    return 0;
+
+  pfd.fd = this->sock;
+  pfd.events = POLLIN;
+  if (this->state == ST_CONNECTING || this->tx_pos < this->tx_len)
+    pfd.events |= POLLOUT;
+  if (poll(&pfd, 1, timeout_ms) <= 0)
+    return 0;
+
+  if (this->state == ST_CONNECTING && (pfd.revents & (POLLOUT | POLLERR | POLLHUP))) {
+    static const char hello[] = "hello\nget version\nget lights\n";
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(this->sock, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err) {
+      strerror_r(err, this->output_driver.errmsg, sizeof(this->output_driver.errmsg));
+      return -1;
+    }
+    if (send(this->sock, hello, sizeof(hello) - 1, MSG_NOSIGNAL) < 0) {
+      strerror_r(errno, this->output_driver.errmsg, sizeof(this->output_driver.errmsg));
+      return -1;
+    }
+    this->state = ST_NEGOTIATING;
+    return 0;
+  }
+
+  if (pfd.revents & (POLLIN | POLLHUP | POLLERR)) {
+    char *line, *end;
+    n = recv(this->sock, this->rx_buf + this->rx_len, sizeof(this->rx_buf) - 1 - this->rx_len, MSG_DONTWAIT);
+    if (n == 0) {
+      strcpy(this->output_driver.errmsg, "connection closed by server");
+      return -1;
+    }
+    if (n < 0) {
+      if (errno == EAGAIN || errno == EINTR)
+        return 0;
+      strerror_r(errno, this->output_driver.errmsg, sizeof(this->output_driver.errmsg));
+      return -1;
+    }
+    this->rx_len += n;
+    this->rx_buf[this->rx_len] = 0;
+    line = this->rx_buf;
+    while ((end = strchr(line, '\n')) != NULL) {
+      *end = 0;
+      if (parse_line(this, line))
+        return -1;
+      line = end + 1;
+    }
+    this->rx_len -= line - this->rx_buf;
+    if (this->rx_len == sizeof(this->rx_buf) - 1)
+      this->rx_len = 0;   /* Drop overlong line */
+    memmove(this->rx_buf, line, this->rx_len);
+  }
+  return 0;
+}
+
+
+  /* Write rest of formatted frame without blocking. Returns 1 if output is still busy */
+static int flush_frame(boblight_output_driver_t *this) {
+  while (this->tx_pos < this->tx_len) {
+    int n = send(this->sock, this->tx_buf + this->tx_pos, this->tx_len - this->tx_pos, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
+        return 1;
+      strerror_r(errno, this->output_driver.errmsg, sizeof(this->output_driver.errmsg));
+      return -1;
+    }
+    this->tx_pos += n;
+    this->bytes += n;
+  }
+  return 0;
+}
+
+
+  /* Format values of all lights that changed (by last colors or changed mask) into one buffer terminated with a sync command */
+static void format_frame(boblight_output_driver_t *this, rgb_color_t *colors, rgb_color_t *last_colors, const uint32_t *changed) {
+  char *p = this->tx_buf;
+  int k;
+
+  for (k = 0; k < this->num_lights; ++k) {
+    const boblight_light_t *l = &this->lights[k];
+    const rgb_color_t *c = &colors[l->channel];
+    const int len = strlen(l->name);
+    if (last_colors != NULL && !memcmp(c, &last_colors[l->channel], sizeof(*c)))
+      continue;
+    if (changed != NULL && !IS_CHANNEL_CHANGED(changed, l->channel))
+      continue;
+    memcpy(p, "set light ", 10);
+    memcpy(p + 10, l->name, len);
+    p += 10 + len;
+    memcpy(p, " rgb", 4);
+    memcpy(p + 4, this->values[c->r], VALUE_SIZE);
+    memcpy(p + 4 + VALUE_SIZE, this->values[c->g], VALUE_SIZE);
+    memcpy(p + 4 + 2 * VALUE_SIZE, this->values[c->b], VALUE_SIZE);
+    p += 4 + 3 * VALUE_SIZE;
+    *p++ = '\n';
+  }
+  if (p != this->tx_buf) {
+    memcpy(p, "sync\n", 5);
+    p += 5;
+  }
+  this->tx_len = p - this->tx_buf;
+  this->tx_pos = 0;
+}
+
+
+  /* Reset connection after an error and try again later */
+static void connection_lost(boblight_output_driver_t *this) {
+  DFATMO_LOG((this->state == ST_CONNECTED) ? DFLOG_ERROR: DFLOG_DEBUG, "boblight server %s:%d: %s", this->host, this->port, this->output_driver.errmsg);
+  disconnect(this);
+  this->pending = 1;    /* Send all colors after reconnect */
+}
+
+
+static int boblight_driver_poll_colors(output_driver_t *this_gen, int timeout_ms) {
+  boblight_output_driver_t *this = (boblight_output_driver_t *) this_gen;
+  uint64_t end = now_ms() + timeout_ms;
+  int rc;
+
+  for (;;) {
+    if (this->state == ST_DISCONNECTED) {
+      if ((now_ms() - this->connect_time) < RECONNECT_INTERVAL)
+        return this->pending;
+      ++this->reconnects;
+      if (start_connect(this)) {
+        connection_lost(this);
+        return this->pending;
+      }
+    }
+
+    if (this->state == ST_CONNECTED) {
+      rc = flush_frame(this);
+      if (rc < 0) {
+        connection_lost(this);
+        continue;
+      }
+      if (!rc && this->pending) {
+        format_frame(this, this->pending_colors, NULL, NULL);
+        this->pending = 0;
+        ++this->frames;
+        continue;
+      }
+      if (!rc)
+        return 0;
+    }
+
+    if (process_connection(this, (int)(end > now_ms() ? end - now_ms(): 0))) {
+      connection_lost(this);
+      continue;
+    }
+    if (now_ms() >= end)
+      return (this->pending || this->tx_pos < this->tx_len);
+  }
+}
+
+
+static int submit_frame(boblight_output_driver_t *this, rgb_color_t *colors, rgb_color_t *last_colors, const uint32_t *changed) {
+  if (this->state == ST_CONNECTED && this->tx_pos == this->tx_len && !this->pending) {
+    format_frame(this, colors, last_colors, changed);
+    ++this->frames;
+  } else {
+      /* Previous frame still in output or not connected: newest colors win */
+    memcpy(this->pending_colors, colors, this->num_channels * sizeof(rgb_color_t));
+    if (this->pending)
+      ++this->coalesced;
+    this->pending = 1;
+  }
+  boblight_driver_poll_colors(&this->output_driver, 0);
+  return 0;
+}
+
+
+static int boblight_driver_submit_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  return submit_frame((boblight_output_driver_t *) this_gen, colors, last_colors, NULL);
+}
+
+
+  /* Only lights of changed channels are send */
+static int boblight_driver_submit_changed_colors(output_driver_t *this_gen, rgb_color_t *colors, const uint32_t *changed) {
+  return submit_frame((boblight_output_driver_t *) this_gen, colors, NULL, changed);
+}
+
+
+static int boblight_driver_output_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  boblight_output_driver_t *this = (boblight_output_driver_t *) this_gen;
+
+  boblight_driver_submit_colors(this_gen, colors, last_colors);
+
+    // wait until frame is written
+  if (boblight_driver_poll_colors(this_gen, CONNECT_TIMEOUT)) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "boblight server %.64s:%d not ready", this->host, this->port);
+    return -1;
+  }
+  return 0;
+}
+
+
+static int boblight_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
+  boblight_output_driver_t *this = (boblight_output_driver_t *) this_gen;
+  char driver_param[SIZE_DRIVER_PARAM];
+  char *t, *tp;
+  uint64_t end;
+
+  this->param = *p;
+  strcpy(this->host, DEFAULT_HOST);
+  this->port = DEFAULT_PORT;
+  this->priority = DEFAULT_PRIORITY;
+  this->pending = 0;
+  this->frames = this->coalesced = this->reconnects = this->bytes = 0;
+
+  /* parse driver parameter */
+  strcpy(driver_param, p->driver_param);
+  t = strtok_r(driver_param, ";&", &tp);
+  while (t != NULL) {
+    if (!strncmp(t, "priority:", 9))
+      this->priority = atoi(t + 9);
+    else {
+        /* Server host with optional port */
+      char *port = strrchr(t, ':');
+      if (port != NULL) {
+        *port++ = 0;
+        this->port = atoi(port);
+      }
+      if (*t)
+        snprintf(this->host, sizeof(this->host), "%s", t);
+    }
+    t = strtok_r(NULL, ";&", &tp);
+  }
+
+    /* Light list is negotiated at open, later reconnects to the same address are done in the background */
+  if (resolve_host(this) || start_connect(this))
+    return -1;
+  end = now_ms() + CONNECT_TIMEOUT;
+  while (this->state != ST_CONNECTED) {
+    const uint64_t t = now_ms();
+    if (t >= end) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "no answer from boblight server %.64s:%d", this->host, this->port);
+      disconnect(this);
+      return -1;
+    }
+    if (process_connection(this, (int)(end - t))) {
+      disconnect(this);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+static int boblight_driver_configure(output_driver_t *this_gen, atmo_parameters_t *p) {
+  boblight_output_driver_t *this = (boblight_output_driver_t *) this_gen;
+
+  this->param = *p;
+  map_lights(this);
+  this->pending = 0;
+  return 0;
+}
+
+
+static int boblight_driver_close(output_driver_t *this_gen) {
+  boblight_output_driver_t *this = (boblight_output_driver_t *) this_gen;
+
+  disconnect(this);
+  DFATMO_LOG(DFLOG_INFO, "%u frames, %u coalesced, %u reconnects, %.1f bytes per frame", this->frames, this->coalesced, this->reconnects,
+               this->frames ? (double)this->bytes / this->frames: 0.0);
+  return 0;
+}
+
+
+static void boblight_driver_dispose(output_driver_t *this_gen) {
+  boblight_output_driver_t *this = (boblight_output_driver_t *) this_gen;
+
+  free(this->lights);
+  free(this->tx_buf);
+  free(this->pending_colors);
+  free(this);
+}
+
+
+dfatmo_log_level_t dfatmo_log_level;
+dfatmo_log_t dfatmo_log;
+
+output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_log_t log_fn) {
+  boblight_output_driver_t *d;
+  int i;
+
+  if (dfatmo_log_level == NULL) {
+    dfatmo_log_level = log_level;
+    dfatmo_log = log_fn;
+  }
+
+  d = (boblight_output_driver_t *) calloc(1, sizeof(boblight_output_driver_t));
+  if (d == NULL)
+    return NULL;
+
+    /* Buffers for largest light list, so a frame is formatted without allocation */
+  d->tx_size = MAX_LIGHTS * (10 + MAX_LIGHT_NAME + 4 + 3 * VALUE_SIZE + 1) + 5;
+  d->tx_buf = (char *) malloc(d->tx_size);
+  d->lights = (boblight_light_t *) calloc(MAX_LIGHTS, sizeof(boblight_light_t));
+  d->pending_colors = (rgb_color_t *) calloc(NUM_AREAS * MAX_BORDER_CHANNELS, sizeof(rgb_color_t));
+  if (d->tx_buf == NULL || d->lights == NULL || d->pending_colors == NULL) {
+    boblight_driver_dispose(&d->output_driver);
+    return NULL;
+  }
+  for (i = 0; i < 256; ++i)
+    snprintf(d->values[i], sizeof(d->values[i]), " %.3f", i / 255.0);
+
+  d->sock = -1;
+  d->output_driver.version = DFATMO_OUTPUT_DRIVER_VERSION;
+  d->output_driver.open = boblight_driver_open;
+  d->output_driver.configure = boblight_driver_configure;
+  d->output_driver.close = boblight_driver_close;
+  d->output_driver.dispose = boblight_driver_dispose;
+  d->output_driver.output_colors = boblight_driver_output_colors;
+  d->output_driver.submit_colors = boblight_driver_submit_colors;
+  d->output_driver.poll_colors = boblight_driver_poll_colors;
+  d->output_driver.submit_changed_colors = boblight_driver_submit_changed_colors;
+  return &d->output_driver;
+}
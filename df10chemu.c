@@ -0,0 +1,637 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is a software emulation of DF10CH controllers for testing the DF10CH output driver without hardware.
+ * It implements the part of the libusb-1.0 API that is used by the driver and is linked instead of the
+ * libusb library. The API is declared by usbemu/libusb.h, so neither libusb nor its headers are required.
+ * The emulated controllers answer the enumeration strings, eeprom configuration, version, max PWM, brightness,
+ * echo and error status requests. Requests of a controller are processed one after the other, each one takes
+ * the configured latency. This includes string descriptor requests and setting the configuration.
+ *
+ * Controller k is connected to port k % 8 + 1 of a hub at root port k / 8 + 1 of bus 1. The check tool could
+ * re-enumerate the controllers, this unconfigures them and assigns new device addresses like a bus reset.
+ *
+ * The emulation is configured by the environment variable DF10CH_EMU with options separated by ampersand:
+ *   controllers:<n>    number of emulated controllers (default 1, maximum 48)
+ *   latency:<us>       duration of a request (default 1000)
+ *   jitter:<us>        maximum random extension of a request (default 0)
+ *   errors:<n>         every n-th brightness request fails (default 0: no errors)
+ *
+ * Every controller drives 10 RGB LEDs (30 channels). Controllers are assigned round robin to the top, bottom,
+ * left and right area, so 48 controllers drive 128 LEDs per area.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <libusb.h>
+
+#include "df10ch_usb_proto.h"
+#include "dfatmo.h"
+
+#define EMU_VENDOR_ID           0x16c0
+#define EMU_PRODUCT_ID          0x05dc
+#define EMU_VENDOR_NAME         "yak54@gmx.net"
+#define EMU_PRODUCT             "DF10CH"
+#define EMU_SERIAL              "AP"
+#define EMU_MAX_CTRLS           48
+#define EMU_LEDS                (NCHANNELS / 3)     // RGB LEDs of a controller
+#define EMU_EEPROM_SIZE         512
+#define EMU_CONFIG_ADDR         1                   // Eeprom address of configuration data
+#define EMU_PWM_RES             4095
+#define EMU_MAX_PENDING         (EMU_MAX_CTRLS * 4)
+
+enum { EMU_STR_MANUFACTURER = 1, EMU_STR_PRODUCT, EMU_STR_SERIAL };
+enum { EMU_AREA_TOP, EMU_AREA_BOTTOM, EMU_AREA_LEFT, EMU_AREA_RIGHT };
+
+struct libusb_context {
+  int dummy;
+};
+
+struct libusb_device {
+  int idx;
+};
+
+struct libusb_device_handle {
+  int idx;
+};
+
+typedef struct {
+  struct libusb_device dev;
+  struct libusb_device_handle hdl;
+  int address;                  // USB device address
+  int configuration;            // Active configuration, 0 is unconfigured
+  uint8_t eeprom[EMU_EEPROM_SIZE];
+  uint16_t brightness[NCHANNELS];
+  uint8_t reply_err;            // COMM_ERR_... flags of USB controller
+  uint8_t request_err;          // COMM_ERR_... flags of PWM controller
+  uint64_t busy_until;          // End of last accepted request [us]
+  uint32_t requests;
+  uint32_t brightness_requests;
+  uint32_t brightness_bytes;
+  uint32_t injected_errors;
+  uint64_t last_apply;          // Time of last applied brightness request [us]
+  uint32_t intervals;           // Statistics of time between applied brightness requests
+  double interval_sum, interval_sq_sum;
+  uint64_t mean_last, mean_time;  // Time weighted sum of brightness values since last query
+  double brightness_sum[NCHANNELS];
+} emu_ctrl_t;
+
+typedef struct {
+  struct libusb_transfer *transfer;
+  uint64_t due;                 // Completion time [us]
+  int cancelled;
+} emu_pending_t;
+
+static struct libusb_context emu_context;
+static emu_ctrl_t emu_ctrls[EMU_MAX_CTRLS];
+static int emu_num_ctrls = 0;
+static int emu_latency, emu_jitter, emu_errors;
+static emu_pending_t emu_pending[EMU_MAX_PENDING];
+static int emu_num_pending;
+static uint32_t emu_seed = 4711;
+static pthread_mutex_t emu_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t emu_cond = PTHREAD_COND_INITIALIZER;
+
+
+static uint64_t emu_now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+  // Add brightness values weighted by the time they were applied. Called with locked emulator
+static void emu_sum_brightness(emu_ctrl_t *c, uint64_t now) {
+  int i;
+
+  if (c->mean_last) {
+    const double d = (double)(now - c->mean_last);
+    for (i = 0; i < NCHANNELS; ++i)
+      c->brightness_sum[i] += c->brightness[i] * d;
+    c->mean_time += now - c->mean_last;
+  }
+  c->mean_last = now;
+}
+
+
+  // Configuration data of controller 'k': 10 RGB LEDs with linear gamma and full white calibration
+static void emu_setup_eeprom(emu_ctrl_t *c, int k) {
+  uint8_t *ee = c->eeprom + EMU_CONFIG_ADDR;
+  const int area = k % 4, first = (k / 4) * EMU_LEDS;
+  int i;
+
+  memset(c->eeprom, 0xFF, sizeof(c->eeprom));
+  memset(ee, 0, 14);
+  ee[0] = 0xA1;     // Valid id
+  ee[1] = 0xA0;
+  ee[2] = 3;        // Configuration version
+  ee[3] = 0;
+  ee[4 + area] = first + EMU_LEDS;
+  ee[13] = NCHANNELS;
+  for (i = 0; i < NCHANNELS; ++i) {
+    uint8_t *cc = ee + 14 + i * 6;
+    cc[0] = i;
+    cc[1] = (area << 2) | (i % 3);
+    cc[2] = first + i / 3;
+    cc[3] = 10;
+    cc[4] = EMU_PWM_RES & 0xFF;
+    cc[5] = EMU_PWM_RES >> 8;
+  }
+  ee += 14 + NCHANNELS * 6;
+  ee[0] = 0;        // overscan
+  ee[1] = 1;        // analyze_size
+  ee[2] = 60;       // edge_weighting
+  ee[3] = 12;       // weight_limit
+}
+
+
+static void emu_setup(void) {
+  const char *cfg = getenv("DF10CH_EMU");
+  int i;
+
+  emu_num_ctrls = 1;
+  emu_latency = 1000;
+  emu_jitter = 0;
+  emu_errors = 0;
+  while (cfg != NULL && *cfg) {
+    const char *v = strchr(cfg, ':');
+    if (v != NULL) {
+      int n = atoi(v + 1);
+      if (!strncmp(cfg, "controllers:", v - cfg + 1))
+        emu_num_ctrls = (n < 1) ? 1: ((n > EMU_MAX_CTRLS) ? EMU_MAX_CTRLS: n);
+      else if (!strncmp(cfg, "latency:", v - cfg + 1))
+        emu_latency = n;
+      else if (!strncmp(cfg, "jitter:", v - cfg + 1))
+        emu_jitter = n;
+      else if (!strncmp(cfg, "errors:", v - cfg + 1))
+        emu_errors = n;
+    }
+    cfg = strchr(cfg, '&');
+    if (cfg != NULL)
+      ++cfg;
+  }
+
+  memset(emu_ctrls, 0, sizeof(emu_ctrls));
+  for (i = 0; i < emu_num_ctrls; ++i) {
+    emu_ctrls[i].dev.idx = i;
+    emu_ctrls[i].hdl.idx = i;
+    emu_ctrls[i].address = i + 2;
+    emu_setup_eeprom(&emu_ctrls[i], i);
+  }
+  emu_num_pending = 0;
+}
+
+
+  // Accept a request of controller and return its completion time. Called with locked emulation
+static uint64_t emu_schedule(emu_ctrl_t *c) {
+  uint64_t start = emu_now_us();
+
+  if (c->busy_until > start)
+    start = c->busy_until;
+  c->busy_until = start + emu_latency;
+  if (emu_jitter > 0) {
+    emu_seed = emu_seed * 1664525U + 1013904223U;
+    c->busy_until += (emu_seed >> 8) % (emu_jitter + 1);
+  }
+  return c->busy_until;
+}
+
+
+  // Wait until a synchronous request of controller is processed
+static void emu_wait(emu_ctrl_t *c) {
+  uint64_t due, now;
+
+  pthread_mutex_lock(&emu_lock);
+  due = emu_schedule(c);
+  pthread_mutex_unlock(&emu_lock);
+
+  now = emu_now_us();
+  if (due > now)
+    usleep(due - now);
+}
+
+
+  // Execute request at controller. Returns number of transferred data bytes or libusb error. Called with locked emulation
+static int emu_request(emu_ctrl_t *c, uint8_t req, uint16_t val, uint16_t idx, uint8_t *data, uint16_t len) {
+  int i;
+
+  ++c->requests;
+  switch (req) {
+  case REQ_READ_EE_DATA:
+    if (idx + len > EMU_EEPROM_SIZE)
+      return LIBUSB_ERROR_PIPE;
+    memcpy(data, c->eeprom + idx, len);
+    return len;
+  case REQ_GET_REPLY_ERR_STATUS:
+    if (len < 1)
+      return LIBUSB_ERROR_OVERFLOW;
+    data[0] = c->reply_err;
+    c->reply_err = 0;
+    return 1;
+  case PWM_REQ_GET_REQUEST_ERR_STATUS:
+    if (len < 1)
+      return LIBUSB_ERROR_OVERFLOW;
+    data[0] = c->request_err;
+    c->request_err = 0;
+    return 1;
+  case PWM_REQ_GET_VERSION:
+    if (len < 2)
+      return LIBUSB_ERROR_OVERFLOW;
+    data[0] = PWM_VERS_APPL;
+    data[1] = 0;
+    return 2;
+  case PWM_REQ_GET_MAX_PWM:
+    if (len < 2)
+      return LIBUSB_ERROR_OVERFLOW;
+    data[0] = EMU_PWM_RES & 0xFF;
+    data[1] = EMU_PWM_RES >> 8;
+    return 2;
+  case PWM_REQ_ECHO_TEST:
+    if (len < 8)
+      return LIBUSB_ERROR_OVERFLOW;
+    data[0] = LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE;
+    data[1] = req;
+    data[2] = val & 0xFF;
+    data[3] = val >> 8;
+    data[4] = idx & 0xFF;
+    data[5] = idx >> 8;
+    data[6] = len & 0xFF;
+    data[7] = len >> 8;
+    return 8;
+  case PWM_REQ_SET_BRIGHTNESS:
+  case PWM_REQ_SET_BRIGHTNESS_SYNCED:
+    if (emu_errors > 0 && ((c->brightness_requests + c->injected_errors + 1) % emu_errors) == 0) {
+      ++c->injected_errors;
+      c->reply_err |= (1 << COMM_ERR_CRC);
+      c->request_err |= (1 << COMM_ERR_TIMEOUT);
+      return LIBUSB_ERROR_TIMEOUT;
+    }
+    if ((len & 1) || idx + len / 2 > NCHANNELS) {
+      c->request_err |= (1 << COMM_ERR_OVERFLOW);
+      return LIBUSB_ERROR_PIPE;
+    }
+    {
+      const uint64_t now = emu_now_us();
+      emu_sum_brightness(c, now);
+      for (i = 0; i < len / 2; ++i)
+        c->brightness[idx + i] = data[i * 2] | (data[i * 2 + 1] << 8);
+      if (c->last_apply) {
+        const double d = (double)(now - c->last_apply);
+        ++c->intervals;
+        c->interval_sum += d;
+        c->interval_sq_sum += d * d;
+      }
+      c->last_apply = now;
+    }
+    ++c->brightness_requests;
+    c->brightness_bytes += len;
+    return len;
+  }
+  return LIBUSB_ERROR_PIPE;
+}
+
+
+int libusb_init(libusb_context **ctx) {
+  pthread_mutex_lock(&emu_lock);
+  emu_setup();
+  pthread_mutex_unlock(&emu_lock);
+  *ctx = &emu_context;
+  return 0;
+}
+
+
+void libusb_exit(libusb_context *ctx) {
+  int i;
+
+  for (i = 0; i < emu_num_ctrls; ++i) {
+    emu_ctrl_t *c = &emu_ctrls[i];
+    DFATMO_LOG(DFLOG_INFO, "DF10CH emulator %d: %u requests, %u brightness requests with %u bytes, %u injected errors",
+                 i, c->requests, c->brightness_requests, c->brightness_bytes, c->injected_errors);
+  }
+}
+
+
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list) {
+  libusb_device **l = (libusb_device **) calloc(emu_num_ctrls + 1, sizeof(libusb_device *));
+  int i;
+
+  if (l == NULL)
+    return LIBUSB_ERROR_NO_MEM;
+  for (i = 0; i < emu_num_ctrls; ++i)
+    l[i] = &emu_ctrls[i].dev;
+  *list = l;
+  return emu_num_ctrls;
+}
+
+
+void libusb_free_device_list(libusb_device **list, int unref_devices) {
+  free(list);
+}
+
+
+uint8_t libusb_get_bus_number(libusb_device *dev) {
+  return 1;
+}
+
+
+uint8_t libusb_get_device_address(libusb_device *dev) {
+  return emu_ctrls[dev->idx].address;
+}
+
+
+int libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers, int port_numbers_len) {
+  if (port_numbers_len < 2)
+    return LIBUSB_ERROR_OVERFLOW;
+  port_numbers[0] = dev->idx / 8 + 1;
+  port_numbers[1] = dev->idx % 8 + 1;
+  return 2;
+}
+
+
+int libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc) {
+  memset(desc, 0, sizeof(*desc));
+  desc->idVendor = EMU_VENDOR_ID;
+  desc->idProduct = EMU_PRODUCT_ID;
+  desc->iManufacturer = EMU_STR_MANUFACTURER;
+  desc->iProduct = EMU_STR_PRODUCT;
+  desc->iSerialNumber = EMU_STR_SERIAL;
+  return 0;
+}
+
+
+int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle) {
+  *dev_handle = &emu_ctrls[dev->idx].hdl;
+  return 0;
+}
+
+
+void libusb_close(libusb_device_handle *dev_handle) {
+}
+
+
+int libusb_get_string_descriptor_ascii(libusb_device_handle *dev_handle, uint8_t desc_index, unsigned char *data, int length) {
+  const char *s;
+  int n;
+
+  switch (desc_index) {
+  case EMU_STR_MANUFACTURER:
+    s = EMU_VENDOR_NAME;
+    break;
+  case EMU_STR_PRODUCT:
+    s = EMU_PRODUCT;
+    break;
+  case EMU_STR_SERIAL:
+    s = EMU_SERIAL;
+    break;
+  default:
+    return LIBUSB_ERROR_PIPE;
+  }
+  emu_wait(&emu_ctrls[dev_handle->idx]);
+  n = strlen(s);
+  if (n > length)
+    n = length;
+  memcpy(data, s, n);
+  return n;
+}
+
+
+int libusb_get_configuration(libusb_device_handle *dev_handle, int *config) {
+  pthread_mutex_lock(&emu_lock);
+  *config = emu_ctrls[dev_handle->idx].configuration;
+  pthread_mutex_unlock(&emu_lock);
+  return 0;
+}
+
+
+int libusb_set_configuration(libusb_device_handle *dev_handle, int configuration) {
+  emu_wait(&emu_ctrls[dev_handle->idx]);
+  pthread_mutex_lock(&emu_lock);
+  emu_ctrls[dev_handle->idx].configuration = configuration;
+  pthread_mutex_unlock(&emu_lock);
+  return 0;
+}
+
+
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number) {
+  return 0;
+}
+
+
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number) {
+  return 0;
+}
+
+
+int libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                              unsigned char *data, uint16_t wLength, unsigned int timeout) {
+  emu_ctrl_t *c = &emu_ctrls[dev_handle->idx];
+  int rc;
+
+  emu_wait(c);
+  pthread_mutex_lock(&emu_lock);
+  rc = emu_request(c, bRequest, wValue, wIndex, data, wLength);
+  pthread_mutex_unlock(&emu_lock);
+  return rc;
+}
+
+
+struct libusb_transfer *libusb_alloc_transfer(int iso_packets) {
+  if (iso_packets)
+    return NULL;
+  return (struct libusb_transfer *) calloc(1, sizeof(struct libusb_transfer));
+}
+
+
+void libusb_free_transfer(struct libusb_transfer *transfer) {
+  free(transfer);
+}
+
+
+int libusb_submit_transfer(struct libusb_transfer *transfer) {
+  int i;
+
+  pthread_mutex_lock(&emu_lock);
+  for (i = 0; i < emu_num_pending; ++i) {
+    if (emu_pending[i].transfer == transfer) {
+      pthread_mutex_unlock(&emu_lock);
+      return LIBUSB_ERROR_BUSY;
+    }
+  }
+  if (emu_num_pending == EMU_MAX_PENDING) {
+    pthread_mutex_unlock(&emu_lock);
+    return LIBUSB_ERROR_NO_MEM;
+  }
+  emu_pending[emu_num_pending].transfer = transfer;
+  emu_pending[emu_num_pending].due = emu_schedule(&emu_ctrls[transfer->dev_handle->idx]);
+  emu_pending[emu_num_pending].cancelled = 0;
+  ++emu_num_pending;
+  pthread_cond_broadcast(&emu_cond);
+  pthread_mutex_unlock(&emu_lock);
+  return 0;
+}
+
+
+int libusb_cancel_transfer(struct libusb_transfer *transfer) {
+  int i, rc = LIBUSB_ERROR_NOT_FOUND;
+
+  pthread_mutex_lock(&emu_lock);
+  for (i = 0; i < emu_num_pending; ++i) {
+    if (emu_pending[i].transfer == transfer) {
+      emu_pending[i].cancelled = 1;
+      emu_pending[i].due = 0;
+      pthread_cond_broadcast(&emu_cond);
+      rc = 0;
+    }
+  }
+  pthread_mutex_unlock(&emu_lock);
+  return rc;
+}
+
+
+  // Complete the first due transfer or wait until one is due or the timeout expired
+int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv) {
+  const uint64_t deadline = emu_now_us() + (uint64_t)tv->tv_sec * 1000000 + tv->tv_usec;
+  struct libusb_transfer *transfer = NULL;
+
+  pthread_mutex_lock(&emu_lock);
+  for (;;) {
+    uint64_t now = emu_now_us(), wakeup = deadline;
+    int i, first = -1;
+
+    for (i = 0; i < emu_num_pending; ++i) {
+      if (first < 0 || emu_pending[i].due < emu_pending[first].due)
+        first = i;
+    }
+    if (first >= 0 && emu_pending[first].due <= now) {
+      emu_pending_t p = emu_pending[first];
+      const uint8_t *setup = p.transfer->buffer;
+      emu_pending[first] = emu_pending[--emu_num_pending];
+      transfer = p.transfer;
+      if (p.cancelled) {
+        transfer->status = LIBUSB_TRANSFER_CANCELLED;
+        transfer->actual_length = 0;
+      } else {
+        int rc = emu_request(&emu_ctrls[transfer->dev_handle->idx], setup[1], setup[2] | (setup[3] << 8), setup[4] | (setup[5] << 8),
+                               transfer->buffer + LIBUSB_CONTROL_SETUP_SIZE, setup[6] | (setup[7] << 8));
+        transfer->status = (rc < 0) ? LIBUSB_TRANSFER_ERROR: LIBUSB_TRANSFER_COMPLETED;
+        transfer->actual_length = (rc < 0) ? 0: rc;
+      }
+      break;
+    }
+    if (now >= deadline)
+      break;
+
+    if (first >= 0 && emu_pending[first].due < wakeup)
+      wakeup = emu_pending[first].due;
+    {
+      struct timespec ts;
+      uint64_t wait_ns = (wakeup - now) * 1000;
+      clock_gettime(CLOCK_REALTIME, &ts);
+      ts.tv_sec += (ts.tv_nsec + wait_ns) / 1000000000;
+      ts.tv_nsec = (ts.tv_nsec + wait_ns) % 1000000000;
+      pthread_cond_timedwait(&emu_cond, &emu_lock, &ts);
+    }
+  }
+  pthread_mutex_unlock(&emu_lock);
+
+  if (transfer != NULL)
+    transfer->callback(transfer);
+  return 0;
+}
+
+
+  // Access to state of emulated controllers for the check tool
+int df10chemu_controllers(void) {
+  return emu_num_ctrls;
+}
+
+
+  // Re-enumerate all controllers with new device addresses, the ports stay the same
+void df10chemu_reenumerate(void) {
+  int i;
+  pthread_mutex_lock(&emu_lock);
+  for (i = 0; i < emu_num_ctrls; ++i) {
+    emu_ctrls[i].address = (emu_ctrls[i].address + emu_num_ctrls - 1) % 126 + 2;
+    emu_ctrls[i].configuration = 0;
+  }
+  pthread_mutex_unlock(&emu_lock);
+}
+
+
+int df10chemu_brightness(int ctrl, int channel) {
+  int v;
+  pthread_mutex_lock(&emu_lock);
+  v = emu_ctrls[ctrl].brightness[channel];
+  pthread_mutex_unlock(&emu_lock);
+  return v;
+}
+
+
+uint32_t df10chemu_brightness_requests(int ctrl) {
+  uint32_t n;
+  pthread_mutex_lock(&emu_lock);
+  n = emu_ctrls[ctrl].brightness_requests;
+  pthread_mutex_unlock(&emu_lock);
+  return n;
+}
+
+
+  // Mean and standard deviation of time between applied brightness requests [us], returns number of intervals
+uint32_t df10chemu_apply_interval(int ctrl, double *mean, double *deviation) {
+  emu_ctrl_t *c = &emu_ctrls[ctrl];
+  uint32_t n;
+  double v;
+
+  pthread_mutex_lock(&emu_lock);
+  n = c->intervals;
+  *mean = n ? c->interval_sum / n: 0.0;
+  v = n ? c->interval_sq_sum / n - *mean * *mean: 0.0;
+  *deviation = (v > 0.0) ? sqrt(v): 0.0;
+  c->intervals = 0;
+  c->interval_sum = 0.0;
+  c->interval_sq_sum = 0.0;
+  pthread_mutex_unlock(&emu_lock);
+  return n;
+}
+
+
+  // Time weighted mean of brightness values of all channels since last call, returns the measured time [us]
+uint64_t df10chemu_mean_brightness(int ctrl, double *mean) {
+  emu_ctrl_t *c = &emu_ctrls[ctrl];
+  uint64_t t;
+  int i;
+
+  pthread_mutex_lock(&emu_lock);
+  emu_sum_brightness(c, emu_now_us());
+  t = c->mean_time;
+  for (i = 0; i < NCHANNELS; ++i) {
+    mean[i] = t ? c->brightness_sum[i] / t: c->brightness[i];
+    c->brightness_sum[i] = 0.0;
+  }
+  c->mean_time = 0;
+  pthread_mutex_unlock(&emu_lock);
+  return t;
+}
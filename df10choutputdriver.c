@@ -33,6 +33,7 @@
 #ifdef WIN32
 #include <windows.h>
 #define snprintf _snprintf
+#define strtok_r strtok_s
 #else
 #include <unistd.h>
 #include <sys/time.h>
@@ -44,6 +45,8 @@
 
 #include "df10ch_usb_proto.h"
 #include "dfatmo.h"
+#include "dfatmo_thread.h"
+#include "dfatmo_timed.h"
 
 #define DF10CH_USB_CFG_VENDOR_ID     0x16c0
 #define DF10CH_USB_CFG_PRODUCT_ID    0x05dc
@@ -51,9 +54,14 @@
 #define DF10CH_USB_CFG_PRODUCT       "DF10CH"
 #define DF10CH_USB_CFG_SERIAL        "AP"
 #define DF10CH_USB_DEFAULT_TIMEOUT   100
+#define DF10CH_EVENT_TIMEOUT         50     // Maximum time the event thread needs to notice that it should stop [ms]
+#define DF10CH_LATENCY_SLOT          50     // Width of a latency histogram slot [us]
+#define DF10CH_LATENCY_SLOTS         400    // Number of latency histogram slots, last slot counts all longer latencies
 
 #define DF10CH_MAX_CHANNELS     30
 #define DF10CH_SIZE_CONFIG      (18 + DF10CH_MAX_CHANNELS * 6)
+#define DF10CH_MAX_PORTS        7       // Maximum depth of USB port path
+#define DF10CH_SIZE_SERIAL      32
 #define DF10CH_CONFIG_VALID_ID  0xA0A1
 
 enum { DF10CH_AREA_TOP, DF10CH_AREA_BOTTOM, DF10CH_AREA_LEFT, DF10CH_AREA_RIGHT, DF10CH_AREA_CENTER, DF10CH_AREA_TOP_LEFT, DF10CH_AREA_TOP_RIGHT, DF10CH_AREA_BOTTOM_LEFT, DF10CH_AREA_BOTTOM_RIGHT };
@@ -62,6 +70,7 @@ typedef struct df10ch_gamma_tab_s {
   struct df10ch_gamma_tab_s *next;
   uint8_t gamma;
   uint16_t white_cal;
+  uint16_t pwm_res;
   uint16_t tab[256];
 } df10ch_gamma_tab_t;
 
@@ -73,22 +82,58 @@ typedef struct {
   df10ch_gamma_tab_t *gamma_tab;  // Corresponding gamma table
 } df10ch_channel_config_t;
 
+  // Result of previous opens for a USB device, keyed by bus and port path and serial number. The device address
+  // changes with every re-enumeration, e.g. after a controller reset, but the port path stays the same.
+typedef struct df10ch_cache_s {
+  struct df10ch_cache_s *next;
+  int busnum;                   // USB bus of device
+  int num_ports;                // Length of port path
+  uint8_t ports[DF10CH_MAX_PORTS];  // Port numbers from root hub to device
+  int devnum;                   // Device address at last enumeration
+  char serial[DF10CH_SIZE_SERIAL];  // Serial number string, tells the firmware mode of a controller
+  int is_df10ch;                // Is false for other devices using the same free USB IDs
+  int seen;                     // Is true if device was found by last enumeration
+  int config_valid;             // Is true if configuration data and PWM resolution are valid
+  uint16_t pwm_res;             // PWM resolution
+  uint8_t eedata[DF10CH_SIZE_CONFIG];   // Eeprom configuration data
+} df10ch_cache_t;
+
+  // Histogram of USB round trip latencies
+typedef struct {
+  uint32_t slot[DF10CH_LATENCY_SLOTS];
+  uint32_t cnt;
+  uint32_t max;
+  uint64_t sum;
+} df10ch_latency_hist_t;
+
 typedef struct df10ch_output_driver_s df10ch_output_driver_t;
 
 typedef struct df10ch_ctrl_s {
   struct df10ch_ctrl_s *next;
   df10ch_output_driver_t *driver;
   libusb_device_handle *dev;
-  int idx_serial_number;        // USB string index of serial number
+  df10ch_cache_t *cache;        // Cached data of controller
+  char serial[DF10CH_SIZE_SERIAL];  // USB serial number string
   uint16_t config_version;      // Version number of configuration data
   uint16_t pwm_res;             // PWM resolution
   int num_req_channels;         // Number of channels in request
   df10ch_channel_config_t *channel_config;      // List of channel configurations
   char id[32];                  // ID of Controller
-  struct libusb_transfer *transfer; // Prepared set brightness request for asynchrony submitting
-  uint8_t *transfer_data;       // Data of set brightness request
-  int pending_submit;           // Is true if a asynchrony transfer is pending
-  int transfer_error;
+  struct libusb_transfer *transfer[2]; // Prepared set brightness requests, one is filled while the other is in flight
+  uint8_t *transfer_data[2];    // Data of set brightness requests
+  int inflight;                 // Index of transfer in flight or -1
+  int ready;                    // Index of transfer with newest brightness values waiting for end of transfer in flight or -1
+  int xfer_first[2], xfer_last[2];  // Range of channels send by transfers
+  uint8_t *brightness;          // Newest brightness values of all channels
+  uint32_t *target;             // Brightness of all channels with fraction (24.8 fixed point)
+  uint8_t *residue;             // Fraction of brightness not yet send by dithering
+  int num_dithered;             // Number of channels with fractional brightness
+  int dirty_first, dirty_last;  // Range of channels changed since last prepared transfer
+  int transfer_error;           // Is true if a transfer failed and error is not reported yet
+  int submit_error;             // libusb error of submit done by event thread or 0
+  int force_submit;             // Is true if brightness values should be send even if they are unchanged
+  uint32_t submit_time;         // Time stamp of last submit [us]
+  df10ch_latency_hist_t latency;  // Round trip latencies of brightness transfers
 } df10ch_ctrl_t;
 
 struct df10ch_output_driver_s {
@@ -96,11 +141,29 @@ struct df10ch_output_driver_s {
   libusb_context *ctx;
   atmo_parameters_t param;          // Global channel layout
   df10ch_ctrl_t *ctrls;             // List of found controllers
-  df10ch_gamma_tab_t *gamma_tabs;   // List of calculated gamma tables
+  df10ch_gamma_tab_t *gamma_tabs;   // List of calculated gamma tables, kept over reopen
+  df10ch_cache_t *cache;            // Cached data of found devices, kept over reopen
   uint16_t config_version;          // (Maximum) Version number of configuration data
-  int max_transmit_latency;
-  int avg_transmit_latency;
   int transfer_err_cnt;             // Number of transfer errors
+  uint32_t dropped_cnt;             // Number of submitted colors that are replaced by newer ones before sending
+  uint32_t output_cnt;              // Number of submitted colors
+  uint32_t bus_transfer_cnt;        // Number of submitted USB transfers
+  uint64_t bus_bytes;               // Bytes of submitted USB transfers (setup and payload)
+  thread_t event_thread;            // Handles USB events and submits waiting transfers on completion
+  int event_thread_running;
+  int event_error;                  // libusb error of event thread or 0
+  mutex_t lock;                     // Protects transfer state of controllers and statistics
+  cond_t transfer_done;             // Signaled by event thread if a transfer is completed
+  thread_t present_thread;          // Submits timed colors when they are due
+  int present_thread_running;
+  cond_t present_wakeup;            // Signaled if timed colors are queued
+  dfatmo_timed_queue_t queue;       // Timed colors
+  rgb16_color_t *timed_colors;      // Due timed colors
+  uint32_t *timed_changed;          // Changed channels of due timed colors
+  uint32_t timed_cnt;               // Number of submitted timed colors
+  rgb16_color_t *fine_colors;       // Submitted 8 bit colors converted to fine colors
+  uint32_t dither_period;           // Time between dither cycles [us] or 0 if dithering is disabled
+  uint32_t dither_cnt;              // Number of dither cycles
 };
 
 #ifndef HAVE_LIBUSB_STRERROR
@@ -160,27 +223,69 @@ static const char * df10ch_usb_transfer_errmsg(int s) {
 }
 
 
+  // Names of COMM_ERR_... flags
+static const char *df10ch_comm_err_names[8] = { "OVERRUN", "FRAME", "TIMEOUT", "START", "OVERFLOW", "CRC", "DUPLICATE", "DEBUG" };
+
 static void df10ch_comm_errmsg(int stat, char *rc) {
+  int i;
+
   if (stat == 0)
     strcpy(rc, "OK");
   else
     *rc = 0;
-  if (stat & (1<<COMM_ERR_OVERRUN))
-      strcat(rc, " OVERRUN");
-  if (stat & (1<<COMM_ERR_FRAME))
-      strcat(rc, " FRAME");
-  if (stat & (1<<COMM_ERR_TIMEOUT))
-      strcat(rc, " TIMEOUT");
-  if (stat & (1<<COMM_ERR_START))
-      strcat(rc, " START");
-  if (stat & (1<<COMM_ERR_OVERFLOW))
-      strcat(rc, " OVERFLOW");
-  if (stat & (1<<COMM_ERR_CRC))
-      strcat(rc, " CRC");
-  if (stat & (1<<COMM_ERR_DUPLICATE))
-      strcat(rc, " DUPLICATE");
-  if (stat & (1<<COMM_ERR_DEBUG))
-      strcat(rc, " DEBUG");
+  for (i = 0; i < 8; ++i) {
+    if (stat & (1<<i)) {
+      strcat(rc, " ");
+      strcat(rc, df10ch_comm_err_names[i]);
+    }
+  }
+}
+
+
+static uint32_t df10ch_time_us(void) {
+#ifdef WIN32
+  FILETIME t;
+  GetSystemTimeAsFileTime(&t);
+  return (uint32_t)((((uint64_t)t.dwHighDateTime << 32) | t.dwLowDateTime) / 10);
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+
+static void df10ch_add_latency(df10ch_latency_hist_t *h, uint32_t latency) {
+  uint32_t i = latency / DF10CH_LATENCY_SLOT;
+
+  ++h->slot[(i < DF10CH_LATENCY_SLOTS) ? i: DF10CH_LATENCY_SLOTS - 1];
+  ++h->cnt;
+  h->sum += latency;
+  if (latency > h->max)
+    h->max = latency;
+}
+
+
+  // Return upper bound of slot that contains the 'pct' percentile
+static uint32_t df10ch_latency_percentile(df10ch_latency_hist_t *h, int pct) {
+  uint64_t n = ((uint64_t)h->cnt * pct + 99) / 100;
+  uint64_t sum = 0;
+  int i;
+
+  for (i = 0; i < DF10CH_LATENCY_SLOTS - 1; ++i) {
+    sum += h->slot[i];
+    if (sum >= n)
+      return (i + 1) * DF10CH_LATENCY_SLOT;
+  }
+  return h->max;
+}
+
+
+static void df10ch_log_latency(const char *id, const char *what, df10ch_latency_hist_t *h) {
+  if (h->cnt)
+    DFATMO_LOG(DFLOG_INFO, "%s: %s latency p50/p95/p99/max: %u/%u/%u/%u [us], average %u [us] of %u transfers", id, what,
+                 df10ch_latency_percentile(h, 50), df10ch_latency_percentile(h, 95), df10ch_latency_percentile(h, 99), h->max,
+                 (uint32_t)(h->sum / h->cnt), h->cnt);
 }
 
 
@@ -226,59 +331,126 @@ static int df10ch_control_in_transfer(df10ch_ctrl_t *ctrl, uint8_t req, uint16_t
 
 static void df10ch_dispose(df10ch_output_driver_t *this) {
   df10ch_ctrl_t *ctrl = this->ctrls;
-  df10ch_gamma_tab_t *gt = this->gamma_tabs;
 
   while (ctrl) {
     df10ch_ctrl_t *next;
 
-	libusb_free_transfer(ctrl->transfer);
+    libusb_free_transfer(ctrl->transfer[0]);
+    libusb_free_transfer(ctrl->transfer[1]);
     libusb_release_interface(ctrl->dev, 0);
     libusb_close(ctrl->dev);
 
     next = ctrl->next;
-    free(ctrl->transfer_data);
+    free(ctrl->transfer_data[0]);
+    free(ctrl->transfer_data[1]);
+    free(ctrl->brightness);
+    free(ctrl->target);
+    free(ctrl->residue);
     free(ctrl->channel_config);
     free(ctrl);
     ctrl = next;
   }
 
-  if (this->ctx)
-    libusb_exit(this->ctx);
+  this->ctrls = NULL;
+  FREE_AND_SET_NULL(this->timed_colors);
+  FREE_AND_SET_NULL(this->timed_changed);
+  FREE_AND_SET_NULL(this->fine_colors);
+  dfatmo_timed_queue_free(&this->queue);
+}
 
-  while (gt) {
-    df10ch_gamma_tab_t *next = gt->next;
-    free(gt);
-    gt = next;
-  }
 
-  this->ctrls = NULL;
-  this->ctx = NULL;
-  this->gamma_tabs = NULL;
+  // Dither cycles per output period are set by parameter 'output_dither'
+static uint32_t df10ch_dither_period(atmo_parameters_t *param) {
+  return param->output_dither ? param->output_rate * 1000 / param->output_dither: 0;
 }
 
 
-static int df10ch_wait_for_replys(df10ch_output_driver_t *this) {
-  df10ch_ctrl_t *ctrl = this->ctrls;
-  struct timeval timeout;
+  // Lookup cached data of USB device at port path or create a new entry for it
+static df10ch_cache_t *df10ch_lookup_cache(df10ch_output_driver_t *this, int busnum, const uint8_t *ports, int num_ports) {
+  df10ch_cache_t *ce = this->cache;
+
+  while (ce && (ce->busnum != busnum || ce->num_ports != num_ports || memcmp(ce->ports, ports, num_ports)))
+    ce = ce->next;
+  if (!ce) {
+    ce = (df10ch_cache_t *) calloc(1, sizeof(df10ch_cache_t));
+    if (ce) {
+      ce->next = this->cache;
+      this->cache = ce;
+      ce->busnum = busnum;
+      ce->num_ports = num_ports;
+      memcpy(ce->ports, ports, num_ports);
+      ce->is_df10ch = -1;
+    }
+  }
+  if (ce)
+    ce->seen = 1;
+  return ce;
+}
 
-	// wait for end of all pending transfers
-  timeout.tv_sec = 0;
-  timeout.tv_usec = (DF10CH_USB_DEFAULT_TIMEOUT + 50) * 1000;
-  while (ctrl) {
-    if (ctrl->pending_submit) {
-      int rc = libusb_handle_events_timeout(this->ctx, &timeout);
-      if (rc && rc != LIBUSB_ERROR_INTERRUPTED) {
-        snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: handling USB events failed: %s", ctrl->id, libusb_strerror(rc));
-        return -1;
-      }
+
+  // Remove cached data of devices that are not found anymore
+static void df10ch_purge_cache(df10ch_output_driver_t *this) {
+  df10ch_cache_t **pce = &this->cache;
+
+  while (*pce) {
+    df10ch_cache_t *ce = *pce;
+    if (ce->seen) {
+      ce->seen = 0;
+      pce = &ce->next;
+    } else {
+      *pce = ce->next;
+      free(ce);
     }
-    else
-      ctrl = ctrl->next;
   }
+}
+
+
+  // Check USB manufacturer and product string of device. Returns 1 for DF10CH controller, 0 for other device, -1 on failure
+static int df10ch_check_device_strings(libusb_device_handle *hdl, struct libusb_device_descriptor *desc, int busnum, int devnum) {
+  unsigned char buf[256];
+  int rc;
+
+  rc = libusb_get_string_descriptor_ascii(hdl, desc->iManufacturer, buf, sizeof(buf));
+  if (rc < 0) {
+    DFATMO_LOG(DFLOG_ERROR, "USB[%d,%d]: getting USB manufacturer string failed: %s", busnum, devnum, libusb_strerror(rc));
+    return -1;
+  }
+  if (rc != sizeof(DF10CH_USB_CFG_VENDOR_NAME) - 1 || memcmp(buf, DF10CH_USB_CFG_VENDOR_NAME, rc))
+    return 0;
+
+  rc = libusb_get_string_descriptor_ascii(hdl, desc->iProduct, buf, sizeof(buf));
+  if (rc < 0) {
+    DFATMO_LOG(DFLOG_ERROR, "USB[%d,%d]: getting USB product string failed: %s", busnum, devnum, libusb_strerror(rc));
+    return -1;
+  }
+  return (rc == sizeof(DF10CH_USB_CFG_PRODUCT) - 1 && !memcmp(buf, DF10CH_USB_CFG_PRODUCT, rc));
+}
+
+
+  // Read USB serial number string of device. Returns -1 on failure
+static int df10ch_read_serial(libusb_device_handle *hdl, struct libusb_device_descriptor *desc, char *serial, int busnum, int devnum) {
+  int rc = libusb_get_string_descriptor_ascii(hdl, desc->iSerialNumber, (unsigned char *) serial, DF10CH_SIZE_SERIAL - 1);
+  if (rc < 0) {
+    DFATMO_LOG(DFLOG_ERROR, "USB[%d,%d]: getting USB serial number string failed: %s", busnum, devnum, libusb_strerror(rc));
+    return -1;
+  }
+  serial[rc] = 0;
+  return 0;
+}
+
+
+  // Report errors of failed transfers. Called by output thread only for controllers without transfer in flight
+static void df10ch_report_errors(df10ch_output_driver_t *this) {
+  df10ch_ctrl_t *ctrl = this->ctrls;
 
-  ctrl = this->ctrls;
   while (ctrl) {
-    if (ctrl->transfer_error) {
+    int report;
+    LOCK_MUTEX(&this->lock);
+    report = (ctrl->transfer_error && ctrl->inflight < 0);
+    ctrl->transfer_error = 0;
+    UNLOCK_MUTEX(&this->lock);
+
+    if (report) {
       char reply_errmsg[128], request_errmsg[128];
       uint8_t data[1];
       if (df10ch_control_in_transfer(ctrl, REQ_GET_REPLY_ERR_STATUS, 0, 0, DF10CH_USB_DEFAULT_TIMEOUT, data, 1))
@@ -290,25 +462,210 @@ static int df10ch_wait_for_replys(df10ch_output_driver_t *this) {
       else
         df10ch_comm_errmsg(data[0], request_errmsg);
       DFATMO_LOG(DFLOG_ERROR, "%s: comm error USB: %s, PWM: %s", ctrl->id, reply_errmsg, request_errmsg);
+
+        // Controller state is unknown so send next brightness values in any case
+      LOCK_MUTEX(&this->lock);
+      ctrl->force_submit = 1;
+      UNLOCK_MUTEX(&this->lock);
     }
     ctrl = ctrl->next;
   }
+}
 
+
+  // Check for errors of submits done by the event thread. Called with locked driver
+static int df10ch_check_async_errors(df10ch_output_driver_t *this) {
+  df10ch_ctrl_t *ctrl = this->ctrls;
+
+  if (this->event_error) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "handling USB events failed: %s", libusb_strerror(this->event_error));
+    return -1;
+  }
+  while (ctrl) {
+    if (ctrl->submit_error) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%.31s: submitting USB transfer message failed: %.48s", ctrl->id, libusb_strerror(ctrl->submit_error));
+      ctrl->submit_error = 0;
+      return -1;
+    }
+    ctrl = ctrl->next;
+  }
+  return 0;
+}
+
+
+  // Is true if a transfer is in flight or waiting. Called with locked driver
+static int df10ch_is_busy(df10ch_output_driver_t *this) {
+  df10ch_ctrl_t *ctrl = this->ctrls;
+  while (ctrl) {
+    if (ctrl->inflight >= 0 || ctrl->ready >= 0)
+      return 1;
+    ctrl = ctrl->next;
+  }
+  return 0;
+}
+
+
+  // Submit prepared transfer. Called with locked driver
+static int df10ch_submit_transfer(df10ch_ctrl_t *ctrl, int idx) {
+  int rc;
+
+  ctrl->submit_time = df10ch_time_us();
+  rc = libusb_submit_transfer(ctrl->transfer[idx]);
+  if (rc) {
+    ctrl->force_submit = 1;
+    return rc;
+  }
+  ctrl->inflight = idx;
+  ++ctrl->driver->bus_transfer_cnt;
+  ctrl->driver->bus_bytes += ctrl->transfer[idx]->length;
   return 0;
 }
 
 
+  // Called by event thread on completion of a transfer. Waiting transfer is submitted at once
 static void LIBUSB_CALL df10ch_reply_cb(struct libusb_transfer *transfer) {
   df10ch_ctrl_t *ctrl = (df10ch_ctrl_t *) transfer->user_data;
-  ctrl->pending_submit = 0;
+  df10ch_output_driver_t *this = ctrl->driver;
+
+  LOCK_MUTEX(&this->lock);
+  ctrl->inflight = -1;
   if (transfer->status != LIBUSB_TRANSFER_COMPLETED && transfer->status != LIBUSB_TRANSFER_CANCELLED) {
-    ++ctrl->driver->transfer_err_cnt;
+    ++this->transfer_err_cnt;
     ctrl->transfer_error = 1;
     DFATMO_LOG(DFLOG_ERROR, "%s: submitting USB control transfer message failed: %s\n", ctrl->id, df10ch_usb_transfer_errmsg(transfer->status));
   }
+
+  if (transfer->status == LIBUSB_TRANSFER_COMPLETED) {
+    uint32_t latency = df10ch_time_us() - ctrl->submit_time;
+    if (latency > ctrl->latency.max && ctrl->latency.cnt)
+      DFATMO_LOG(DFLOG_INFO, "%s: new max transmit latency: %u [us]", ctrl->id, latency);
+    df10ch_add_latency(&ctrl->latency, latency);
+  }
+
+  if (ctrl->ready >= 0 && transfer->status != LIBUSB_TRANSFER_CANCELLED) {
+    int rc = df10ch_submit_transfer(ctrl, ctrl->ready);
+    if (rc)
+      ctrl->submit_error = rc;
+  }
+  ctrl->ready = -1;
+  BROADCAST_COND(&this->transfer_done);
+  UNLOCK_MUTEX(&this->lock);
+}
+
+
+  // Read communication error status of USB and PWM controller and count set flags
+static void df10ch_count_comm_errors(df10ch_ctrl_t *ctrl, uint32_t *usb_errs, uint32_t *pwm_errs) {
+  uint8_t data[1];
+  int i;
+
+  if (!df10ch_control_in_transfer(ctrl, REQ_GET_REPLY_ERR_STATUS, 0, 0, DF10CH_USB_DEFAULT_TIMEOUT, data, 1)) {
+    for (i = 0; i < 8; ++i)
+      usb_errs[i] += (data[0] >> i) & 1;
+  }
+  if (!df10ch_control_in_transfer(ctrl, PWM_REQ_GET_REQUEST_ERR_STATUS, 0, 0, DF10CH_USB_DEFAULT_TIMEOUT, data, 1)) {
+    for (i = 0; i < 8; ++i)
+      pwm_errs[i] += (data[0] >> i) & 1;
+  }
+}
+
+
+/*
+ * Latency test: Measure round trip latency of 'n' echo requests and 'n' synchronous brightness
+ * requests for every controller and log the distributions, the communication errors and the
+ * sustainable update rate.
+ */
+static void df10ch_latency_test(df10ch_output_driver_t *this, int n) {
+  df10ch_latency_hist_t *h = (df10ch_latency_hist_t *) malloc(sizeof(df10ch_latency_hist_t));
+  int transfer_err_cnt = this->transfer_err_cnt;
+  df10ch_ctrl_t *ctrl;
+
+  if (h == NULL)
+    return;
+
+  for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next) {
+    uint32_t usb_errs[8], pwm_errs[8], start, elapsed;
+    int failed = 0, i, rc;
+    char buf[256];
+    uint8_t data[8];
+
+    memset(usb_errs, 0, sizeof(usb_errs));
+    memset(pwm_errs, 0, sizeof(pwm_errs));
+
+    memset(h, 0, sizeof(*h));
+    for (i = 0; i < n; ++i) {
+      uint32_t t = df10ch_time_us();
+      rc = libusb_control_transfer(ctrl->dev, LIBUSB_ENDPOINT_IN | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE, PWM_REQ_ECHO_TEST, 0, 0, data, sizeof(data), DF10CH_USB_DEFAULT_TIMEOUT);
+      if (rc == sizeof(data))
+        df10ch_add_latency(h, df10ch_time_us() - t);
+      else {
+        ++failed;
+        df10ch_count_comm_errors(ctrl, usb_errs, pwm_errs);
+      }
+    }
+    df10ch_log_latency(ctrl->id, "echo test", h);
+
+      // Brightness values are still zero
+    memset(h, 0, sizeof(*h));
+    start = df10ch_time_us();
+    for (i = 0; i < n; ++i) {
+      uint32_t t = df10ch_time_us();
+      rc = libusb_control_transfer(ctrl->dev, LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE, PWM_REQ_SET_BRIGHTNESS, 0, 0, ctrl->brightness, ctrl->num_req_channels * 2, DF10CH_USB_DEFAULT_TIMEOUT);
+      if (rc == ctrl->num_req_channels * 2)
+        df10ch_add_latency(h, df10ch_time_us() - t);
+      else {
+        ++failed;
+        df10ch_count_comm_errors(ctrl, usb_errs, pwm_errs);
+      }
+    }
+    elapsed = df10ch_time_us() - start;
+    df10ch_log_latency(ctrl->id, "brightness", h);
+    DFATMO_LOG(DFLOG_INFO, "%s: %d failed requests, sustainable update rate %.1f updates/s", ctrl->id, failed, elapsed ? n * 1000000.0 / elapsed: 0.0);
+
+    df10ch_count_comm_errors(ctrl, usb_errs, pwm_errs);
+    buf[0] = 0;
+    for (i = 0; i < 8; ++i) {
+      if (usb_errs[i] || pwm_errs[i])
+        snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " %s %u/%u", df10ch_comm_err_names[i], usb_errs[i], pwm_errs[i]);
+    }
+    DFATMO_LOG(DFLOG_INFO, "%s: comm errors USB/PWM:%s", ctrl->id, buf[0] ? buf: " none");
+  }
+
+    // Failures of the test are no driver errors
+  this->transfer_err_cnt = transfer_err_cnt;
+  free(h);
+}
+
+
+static THREAD_PROC(df10ch_event_loop, this_gen) {
+  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
+
+  for (;;) {
+    struct timeval timeout;
+    int rc;
+
+    LOCK_MUTEX(&this->lock);
+    rc = this->event_thread_running;
+    UNLOCK_MUTEX(&this->lock);
+    if (!rc)
+      break;
+
+    timeout.tv_sec = 0;
+    timeout.tv_usec = DF10CH_EVENT_TIMEOUT * 1000;
+    rc = libusb_handle_events_timeout(this->ctx, &timeout);
+    if (rc && rc != LIBUSB_ERROR_INTERRUPTED) {
+      LOCK_MUTEX(&this->lock);
+      this->event_error = rc;
+      BROADCAST_COND(&this->transfer_done);
+      UNLOCK_MUTEX(&this->lock);
+      break;
+    }
+  }
+  THREAD_RETURN;
 }
 
 
+static THREAD_PROC(df10ch_present_loop, this_gen);
+
 static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *param) {
   df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
   libusb_device **list = NULL;
@@ -316,13 +673,29 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
   int rc;
   size_t i;
   df10ch_ctrl_t *ctrl;
+  char driver_param[SIZE_DRIVER_PARAM];
+  char *t, *tp;
+  int latency_test = 0, n;
+
+    // parse driver parameter
+  strcpy(driver_param, param->driver_param);
+  t = strtok_r(driver_param, ";&", &tp);
+  while (t != NULL) {
+    char *v = strchr(t, ':');
+    if (v != NULL)
+      *v++ = 0;
+    if (v != NULL && !strcmp(t, "latencytest"))
+      latency_test = atoi(v);
+    else if (strspn(t, " ") != strlen(t))
+      DFATMO_LOG(DFLOG_ERROR, "driver parameter '%s' ignored", t);
+    t = strtok_r(NULL, ";&", &tp);
+  }
 
   this->config_version = 0;
-  this->max_transmit_latency = 0;
-  this->avg_transmit_latency = 0;
   this->transfer_err_cnt = 0;
 
-  if (libusb_init(&this->ctx) < 0) {
+  if (!this->ctx && libusb_init(&this->ctx) < 0) {
+    this->ctx = NULL;
     strcpy(this->output_driver.errmsg, "can't initialize USB library");
     return -1;
   }
@@ -348,45 +721,64 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
       DFATMO_LOG(DFLOG_ERROR, "USB[%d,%d]: getting USB device descriptor failed: %s", busnum, devnum, libusb_strerror(rc));
     }
     else if (desc.idVendor == DF10CH_USB_CFG_VENDOR_ID && desc.idProduct == DF10CH_USB_CFG_PRODUCT_ID) {
+      uint8_t ports[DF10CH_MAX_PORTS];
+      int num_ports = libusb_get_port_numbers(d, ports, sizeof(ports));
+      df10ch_cache_t *ce = (num_ports > 0) ? df10ch_lookup_cache(this, busnum, ports, num_ports): NULL;
       libusb_device_handle *hdl = NULL;
+
+        // Don't open devices again that are known to be no controllers. A re-enumerated device could be another one plugged into the same port
+      if (ce && !ce->is_df10ch && ce->devnum == devnum)
+        continue;
+
       rc = libusb_open(d, &hdl);
       if (rc < 0) {
         DFATMO_LOG(DFLOG_ERROR, "USB[%d,%d]: open of USB device failed: %s", busnum, devnum, libusb_strerror(rc));
       }
       else {
-        unsigned char buf[256];
-        rc = libusb_get_string_descriptor_ascii(hdl, desc.iManufacturer, buf, sizeof(buf));
-        if (rc < 0) {
-          DFATMO_LOG(DFLOG_ERROR, "USB[%d,%d]: getting USB manufacturer string failed: %s", busnum, devnum, libusb_strerror(rc));
+        char serial[DF10CH_SIZE_SERIAL];
+        int is_df10ch = (ce && ce->is_df10ch > 0) ? 1: df10ch_check_device_strings(hdl, &desc, busnum, devnum);
+        if (is_df10ch > 0 && df10ch_read_serial(hdl, &desc, serial, busnum, devnum))
+          is_df10ch = -1;
+
+          // A different serial number at the same port is another device or firmware, cached data is not valid for it
+        if (is_df10ch > 0 && ce && ce->is_df10ch > 0 && strcmp(ce->serial, serial)) {
+          ce->config_valid = 0;
+          is_df10ch = df10ch_check_device_strings(hdl, &desc, busnum, devnum);
         }
-        else if (rc == sizeof(DF10CH_USB_CFG_VENDOR_NAME) - 1 && !memcmp(buf, DF10CH_USB_CFG_VENDOR_NAME, rc)) {
-          rc = libusb_get_string_descriptor_ascii(hdl, desc.iProduct, buf, sizeof(buf));
+        if (ce && is_df10ch >= 0) {
+          ce->is_df10ch = is_df10ch;
+          ce->devnum = devnum;
+          if (is_df10ch)
+            strcpy(ce->serial, serial);
+        }
+        if (is_df10ch > 0) {
+          char id[32];
+          int config = 0;
+          snprintf(id, sizeof(id), "DF10CH[%d,%d]", busnum, devnum);
+
+            // Setting the configuration resets the device, skip it if the device is still configured
+          rc = libusb_get_configuration(hdl, &config);
+          if (rc >= 0 && config != 1)
+            rc = libusb_set_configuration(hdl, 1);
           if (rc < 0) {
-            DFATMO_LOG(DFLOG_ERROR, "USB[%d,%d]: getting USB product string failed: %s", busnum, devnum, libusb_strerror(rc));
+            DFATMO_LOG(DFLOG_ERROR, "%s: setting USB configuration failed: %s", id, libusb_strerror(rc));
           }
-          else if (rc == sizeof(DF10CH_USB_CFG_PRODUCT) - 1 && !memcmp(buf, DF10CH_USB_CFG_PRODUCT, rc)) {
-            char id[32];
-            snprintf(id, sizeof(id), "DF10CH[%d,%d]", busnum, devnum);
-            rc = libusb_set_configuration(hdl, 1);
+          else {
+            rc = libusb_claim_interface(hdl, 0);
             if (rc < 0) {
-              DFATMO_LOG(DFLOG_ERROR, "%s: setting USB configuration failed: %s", id, libusb_strerror(rc));
+              DFATMO_LOG(DFLOG_ERROR, "%s: claiming USB interface failed: %s", id, libusb_strerror(rc));
             }
             else {
-              rc = libusb_claim_interface(hdl, 0);
-              if (rc < 0) {
-                DFATMO_LOG(DFLOG_ERROR, "%s: claiming USB interface failed: %s", id, libusb_strerror(rc));
-              }
-              else {
-                df10ch_ctrl_t *ctrl = (df10ch_ctrl_t *) calloc(1, sizeof(df10ch_ctrl_t));
-                ctrl->next = this->ctrls;
-                this->ctrls = ctrl;
-                ctrl->driver = this;
-                ctrl->dev = hdl;
-                ctrl->idx_serial_number = desc.iSerialNumber;
-                strcpy(ctrl->id, id);
-                DFATMO_LOG(DFLOG_INFO, "%s: device opened", id);
-                continue;
-              }
+              df10ch_ctrl_t *ctrl = (df10ch_ctrl_t *) calloc(1, sizeof(df10ch_ctrl_t));
+              ctrl->next = this->ctrls;
+              this->ctrls = ctrl;
+              ctrl->driver = this;
+              ctrl->dev = hdl;
+              ctrl->cache = ce;
+              strcpy(ctrl->serial, serial);
+              strcpy(ctrl->id, id);
+              DFATMO_LOG(DFLOG_INFO, "%s: device opened", id);
+              continue;
             }
           }
         }
@@ -396,6 +788,7 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
   }
 
   libusb_free_device_list(list, 1);
+  df10ch_purge_cache(this);
 
   if (!this->ctrls) {
     strcpy(this->output_driver.errmsg, "USB: no DF10CH devices found!");
@@ -426,15 +819,8 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
     int eei;
 
       // Check that USB controller is running application firmware and not bootloader
-    rc = libusb_get_string_descriptor_ascii(ctrl->dev, ctrl->idx_serial_number, data, sizeof(data) - 1);
-    if (rc < 0) {
-      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: getting USB serial number string failed: %s", ctrl->id, libusb_strerror(rc));
-      df10ch_dispose(this);
-      return -1;
-    }
-    if (rc != sizeof(DF10CH_USB_CFG_SERIAL) - 1 || memcmp(data, DF10CH_USB_CFG_SERIAL, rc)) {
-      data[rc] = 0;
-      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: application firmware of USB controller is not running! Current mode is: %s", ctrl->id, data);
+    if (strcmp(ctrl->serial, DF10CH_USB_CFG_SERIAL)) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: application firmware of USB controller is not running! Current mode is: %.16s", ctrl->id, ctrl->serial);
       df10ch_dispose(this);
       return -1;
     }
@@ -466,6 +852,24 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
       return -1;
     }
 
+      // Read PWM resolution only if configuration has changed since last open
+    if (ctrl->cache && ctrl->cache->config_valid && !memcmp(ctrl->cache->eedata, eedata, sizeof(eedata))) {
+      ctrl->pwm_res = ctrl->cache->pwm_res;
+      DFATMO_LOG(DFLOG_DEBUG, "%s: configuration unchanged", ctrl->id);
+    } else {
+      if (df10ch_control_in_transfer(ctrl, PWM_REQ_GET_MAX_PWM, 0, 0, DF10CH_USB_DEFAULT_TIMEOUT, data, 2)) {
+        snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: reading PWM resolution data fails!", ctrl->id);
+        df10ch_dispose(this);
+        return -1;
+      }
+      ctrl->pwm_res = data[0] + (data[1] << 8);
+      if (ctrl->cache) {
+        memcpy(ctrl->cache->eedata, eedata, sizeof(eedata));
+        ctrl->cache->pwm_res = ctrl->pwm_res;
+        ctrl->cache->config_valid = 1;
+      }
+    }
+
     ctrl->config_version = eedata[2] + (eedata[3] << 8);
     if (ctrl->config_version > this->config_version)
       this->config_version = ctrl->config_version;
@@ -512,14 +916,6 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
         param->weight_limit = eedata[eei + 3];
     }
 
-      // Read PWM resolution
-    if (df10ch_control_in_transfer(ctrl, PWM_REQ_GET_MAX_PWM, 0, 0, DF10CH_USB_DEFAULT_TIMEOUT, data, 2)) {
-      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: reading PWM resolution data fails!", ctrl->id);
-      df10ch_dispose(this);
-      return -1;
-    }
-    ctrl->pwm_res = data[0] + (data[1] << 8);
-
       // Build channel configuration list
     nch = ctrl->num_req_channels;
     ccfg = (df10ch_channel_config_t *) calloc(nch, sizeof(df10ch_channel_config_t));
@@ -541,7 +937,7 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
 
         // Lookup gamma table for gamma and white calibration value
       gt = this->gamma_tabs;
-      while (gt && gamma != gt->gamma && white_cal != gt->white_cal)
+      while (gt && (gamma != gt->gamma || white_cal != gt->white_cal || ctrl->pwm_res != gt->pwm_res))
         gt = gt->next;
       if (!gt) {
 		// Calculate new gamma table
@@ -550,6 +946,7 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
         this->gamma_tabs = gt;
         gt->gamma = gamma;
         gt->white_cal = white_cal;
+        gt->pwm_res = ctrl->pwm_res;
 		{
 			const double dgamma = gamma / 10.0;
 			const double dwhite_cal = white_cal;
@@ -568,17 +965,89 @@ static int df10ch_driver_open(output_driver_t *this_gen, atmo_parameters_t *para
       --nch;
     }
 
-      // Prepare USB request for sending brightness values
-    ctrl->transfer_data = calloc(1, (LIBUSB_CONTROL_SETUP_SIZE + ctrl->num_req_channels * 2));
-    libusb_fill_control_setup(ctrl->transfer_data, LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE, PWM_REQ_SET_BRIGHTNESS, 0, 0, ctrl->num_req_channels * 2);
-    ctrl->transfer = libusb_alloc_transfer(0);
-    libusb_fill_control_transfer(ctrl->transfer, ctrl->dev, ctrl->transfer_data, df10ch_reply_cb, ctrl, DF10CH_USB_DEFAULT_TIMEOUT);
-    ctrl->pending_submit = 0;
+      // Prepare two USB requests for sending brightness values
+    ctrl->brightness = calloc(1, ctrl->num_req_channels * 2);
+    ctrl->target = calloc(ctrl->num_req_channels, sizeof(uint32_t));
+    ctrl->residue = malloc(ctrl->num_req_channels);
+    if (ctrl->brightness == NULL || ctrl->target == NULL || ctrl->residue == NULL) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: allocating USB transfer failed", ctrl->id);
+      df10ch_dispose(this);
+      return -1;
+    }
+    for (i = 0; i < 2; ++i) {
+      ctrl->transfer_data[i] = calloc(1, (LIBUSB_CONTROL_SETUP_SIZE + ctrl->num_req_channels * 2));
+      ctrl->transfer[i] = libusb_alloc_transfer(0);
+      if (ctrl->transfer_data[i] == NULL || ctrl->transfer[i] == NULL) {
+        snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: allocating USB transfer failed", ctrl->id);
+        df10ch_dispose(this);
+        return -1;
+      }
+      libusb_fill_control_setup(ctrl->transfer_data[i], LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE, PWM_REQ_SET_BRIGHTNESS, 0, 0, ctrl->num_req_channels * 2);
+      libusb_fill_control_transfer(ctrl->transfer[i], ctrl->dev, ctrl->transfer_data[i], df10ch_reply_cb, ctrl, DF10CH_USB_DEFAULT_TIMEOUT);
+    }
+    ctrl->inflight = -1;
+    ctrl->ready = -1;
+    ctrl->dirty_first = ctrl->num_req_channels;
+    ctrl->dirty_last = -1;
+    ctrl->submit_error = 0;
+    ctrl->force_submit = 1;
+    memset(ctrl->residue, 128, ctrl->num_req_channels);   // Rounding without dithering
+    ctrl->num_dithered = 0;
 
     ctrl = ctrl->next;
   }
 
+  if (latency_test > 0)
+    df10ch_latency_test(this, latency_test);
+
   this->param = *param;
+  this->dropped_cnt = 0;
+  this->output_cnt = 0;
+  this->timed_cnt = 0;
+  this->dither_cnt = 0;
+  this->dither_period = df10ch_dither_period(param);
+  this->bus_transfer_cnt = 0;
+  this->bus_bytes = 0;
+  this->event_error = 0;
+
+  n = param->top + param->bottom + param->left + param->right + param->center + param->top_left + param->top_right + param->bottom_left + param->bottom_right;
+  this->timed_colors = (rgb16_color_t *) calloc(n + 1, sizeof(rgb16_color_t));
+  this->timed_changed = (uint32_t *) calloc(CHANNEL_MASK_WORDS(n) + 1, sizeof(uint32_t));
+  this->fine_colors = (rgb16_color_t *) calloc(n + 1, sizeof(rgb16_color_t));
+  if (this->timed_colors == NULL || this->timed_changed == NULL || this->fine_colors == NULL || dfatmo_timed_queue_init(&this->queue, n, sizeof(rgb16_color_t))) {
+    strcpy(this->output_driver.errmsg, "memory allocation failed");
+    df10ch_dispose(this);
+    return -1;
+  }
+
+    // Start thread that handles completion of transfers
+  INIT_MUTEX(&this->lock);
+  INIT_COND(&this->transfer_done);
+  INIT_COND(&this->present_wakeup);
+  this->event_thread_running = 1;
+  if (CREATE_THREAD(&this->event_thread, df10ch_event_loop, this)) {
+    strcpy(this->output_driver.errmsg, "creating USB event thread failed");
+    DESTROY_COND(&this->present_wakeup);
+    DESTROY_COND(&this->transfer_done);
+    DESTROY_MUTEX(&this->lock);
+    df10ch_dispose(this);
+    return -1;
+  }
+
+    // Start thread that submits timed colors
+  this->present_thread_running = 1;
+  if (CREATE_THREAD(&this->present_thread, df10ch_present_loop, this)) {
+    strcpy(this->output_driver.errmsg, "creating present thread failed");
+    LOCK_MUTEX(&this->lock);
+    this->event_thread_running = 0;
+    UNLOCK_MUTEX(&this->lock);
+    JOIN_THREAD(this->event_thread);
+    DESTROY_COND(&this->present_wakeup);
+    DESTROY_COND(&this->transfer_done);
+    DESTROY_MUTEX(&this->lock);
+    df10ch_dispose(this);
+    return -1;
+  }
   return 0;
 }
 
@@ -605,7 +1074,17 @@ static int df10ch_driver_configure(output_driver_t *this_gen, atmo_parameters_t
       param->weight_limit = this->param.weight_limit;
   }
 
+    // Parameters are read by the present thread
+  LOCK_MUTEX(&this->lock);
   this->param = *param;
+  this->dither_period = df10ch_dither_period(param);
+  if (!this->dither_period) {
+    df10ch_ctrl_t *ctrl;
+    for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next)
+      memset(ctrl->residue, 128, ctrl->num_req_channels);
+  }
+  BROADCAST_COND(&this->present_wakeup);
+  UNLOCK_MUTEX(&this->lock);
   return 0;
 }
 
@@ -613,18 +1092,52 @@ static int df10ch_driver_configure(output_driver_t *this_gen, atmo_parameters_t
 static int df10ch_driver_close(output_driver_t *this_gen) {
   df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
   df10ch_ctrl_t *ctrl = this->ctrls;
+  deadline_t deadline;
+
+    // Stop submitting of timed colors
+  LOCK_MUTEX(&this->lock);
+  this->present_thread_running = 0;
+  BROADCAST_COND(&this->present_wakeup);
+  UNLOCK_MUTEX(&this->lock);
+  JOIN_THREAD(this->present_thread);
 
     // Cancel all pending requests
+  LOCK_MUTEX(&this->lock);
+  dfatmo_timed_queue_clear(&this->queue);
   while (ctrl) {
-    if (ctrl->pending_submit)
-      libusb_cancel_transfer(ctrl->transfer);
+    ctrl->ready = -1;
+    if (ctrl->inflight >= 0)
+      libusb_cancel_transfer(ctrl->transfer[ctrl->inflight]);
     ctrl = ctrl->next;
   }
 
-  df10ch_wait_for_replys(this);
+    // wait for end of all canceled transfers
+  SET_DEADLINE(deadline, DF10CH_USB_DEFAULT_TIMEOUT + 50);
+  while (df10ch_is_busy(this) && !this->event_error) {
+    if (!TIMED_WAIT_COND(&this->transfer_done, &this->lock, deadline))
+      break;
+  }
+  this->event_thread_running = 0;
+  UNLOCK_MUTEX(&this->lock);
+
+  JOIN_THREAD(this->event_thread);
+  DESTROY_COND(&this->present_wakeup);
+  DESTROY_COND(&this->transfer_done);
+  DESTROY_MUTEX(&this->lock);
+
+  for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next)
+    df10ch_log_latency(ctrl->id, "transmit", &ctrl->latency);
   df10ch_dispose(this);
 
-  DFATMO_LOG(DFLOG_INFO, "average transmit latency: %d [us]", this->avg_transmit_latency);
+  this->dropped_cnt += this->queue.replaced;
+  if (this->dropped_cnt)
+    DFATMO_LOG(DFLOG_INFO, "%u outdated color outputs dropped", this->dropped_cnt);
+  if (this->timed_cnt)
+    DFATMO_LOG(DFLOG_INFO, "%u color outputs submitted at presentation time", this->timed_cnt);
+  if (this->dither_cnt)
+    DFATMO_LOG(DFLOG_INFO, "%u dither cycles", this->dither_cnt);
+  if (this->output_cnt)
+    DFATMO_LOG(DFLOG_INFO, "%u color outputs, %u USB transfers, %.1f bus bytes per color output", this->output_cnt, this->bus_transfer_cnt, (double)this->bus_bytes / this->output_cnt);
 
   if (this->transfer_err_cnt) {
     snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%d transfer errors happen", this->transfer_err_cnt);
@@ -634,123 +1147,401 @@ static int df10ch_driver_close(output_driver_t *this_gen) {
 }
 
 static void df10ch_driver_dispose(output_driver_t *this_gen) {
-  free(this_gen);
-}
+  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
+  df10ch_gamma_tab_t *gt = this->gamma_tabs;
+  df10ch_cache_t *ce = this->cache;
 
+  df10ch_dispose(this);
+  if (this->ctx)
+    libusb_exit(this->ctx);
 
-static int df10ch_driver_output_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
-  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
-  rgb_color_t *area_map[9];
-  rgb_color_t *c = colors;
-  df10ch_ctrl_t *ctrl = this->ctrls;
+  while (gt) {
+    df10ch_gamma_tab_t *next = gt->next;
+    free(gt);
+    gt = next;
+  }
 
-#ifdef WIN32
-  FILETIME act_time, start_time;
-  if (IS_LOG_LEVEL(DFLOG_INFO))
-    GetSystemTimeAsFileTime (&start_time);
-#else
-  struct timeval act_time, start_time, latency_time;
-  if (IS_LOG_LEVEL(DFLOG_INFO))
-    gettimeofday(&start_time, NULL);
-#endif
+  while (ce) {
+    df10ch_cache_t *next = ce->next;
+    free(ce);
+    ce = next;
+  }
 
-    // Build area mapping table
-  area_map[DF10CH_AREA_TOP] = c;
-  c += this->param.top;
-  area_map[DF10CH_AREA_BOTTOM] = c;
-  c += this->param.bottom;
-  area_map[DF10CH_AREA_LEFT] = c;
-  c += this->param.left;
-  area_map[DF10CH_AREA_RIGHT] = c;
-  c += this->param.right;
-  area_map[DF10CH_AREA_CENTER] = c;
-  c += this->param.center;
-  area_map[DF10CH_AREA_TOP_LEFT] = c;
-  c += this->param.top_left;
-  area_map[DF10CH_AREA_TOP_RIGHT] = c;
-  c += this->param.top_right;
-  area_map[DF10CH_AREA_BOTTOM_LEFT] = c;
-  c += this->param.bottom_left;
-  area_map[DF10CH_AREA_BOTTOM_RIGHT] = c;
-
-    // Generate transfer messages and send it to controllers
-  while (ctrl) {
-      // Generate payload data (brightness values)
-    int do_submit = 0;
-    uint8_t *payload = ctrl->transfer_data + LIBUSB_CONTROL_SETUP_SIZE;
-    df10ch_channel_config_t *cfg = ctrl->channel_config;
-    int nch = ctrl->num_req_channels;
-
-	while (nch) {
-      rgb_color_t *lc;
-      int v = 0;
-      uint16_t bv;
-
-	  c = area_map[cfg->area] + cfg->area_num;
-      lc = last_colors ? last_colors + (c - colors): NULL;
-      switch (cfg->color) {
-      case 0: // Red
-        v = c->r;
-        if (!lc || v != lc->r)
-          do_submit = 1;
-        break;
-      case 1: // Green
-        v = c->g;
-        if (!lc || v != lc->g)
-          do_submit = 1;
-        break;
-      case 2: // Blue
-        v = c->b;
-        if (!lc || v != lc->b)
-          do_submit = 1;
-      }
+  free(this);
+}
 
-        // gamma and white calibration correction
-      bv = cfg->gamma_tab->tab[v];
-      payload[cfg->req_channel * 2] = (uint8_t)bv;
-      payload[cfg->req_channel * 2 + 1] = (uint8_t)(bv >> 8);
 
-      ++cfg;
-      --nch;
+/*
+ * Set brightness value of request channel from its target and extend range of changed channels. With dithering the
+ * fraction of the target is accumulated in the residue and the brightness is one higher whenever the residue overflows
+ * (first order sigma delta), so the mean brightness over some dither cycles is the target. Without dithering the target is rounded.
+ */
+static void df10ch_set_brightness(df10ch_ctrl_t *ctrl, int ch) {
+  const uint32_t s = ctrl->target[ch] + ctrl->residue[ch];
+  const uint16_t bv = (uint16_t)(s >> 8);
+  uint8_t *p = ctrl->brightness + ch * 2;
+
+  if (ctrl->driver->dither_period)
+    ctrl->residue[ch] = (uint8_t)s;
+  if (p[0] != (uint8_t)bv || p[1] != (uint8_t)(bv >> 8)) {
+    p[0] = (uint8_t)bv;
+    p[1] = (uint8_t)(bv >> 8);
+    if (ch < ctrl->dirty_first)
+      ctrl->dirty_first = ch;
+    if (ch > ctrl->dirty_last)
+      ctrl->dirty_last = ch;
+  }
+}
+
+
+  // Generate brightness values of controller. Only channels set in 'changed' mask are generated if given.
+static void df10ch_update_brightness(df10ch_ctrl_t *ctrl, rgb16_color_t **area_map, const int *area_offset, const uint32_t *changed) {
+  df10ch_channel_config_t *cfg = ctrl->channel_config;
+  int nch = ctrl->num_req_channels;
+
+  for (; nch; ++cfg, --nch) {
+    int v = 0, i, f;
+    uint32_t t;
+    const uint16_t *tab = cfg->gamma_tab->tab;
+    rgb16_color_t *c = area_map[cfg->area] + cfg->area_num;
+
+    if (changed != NULL && !IS_CHANNEL_CHANGED(changed, area_offset[cfg->area] + cfg->area_num))
+      continue;
+
+    switch (cfg->color) {
+    case 0: // Red
+      v = c->r;
+      break;
+    case 1: // Green
+      v = c->g;
+      break;
+    case 2: // Blue
+      v = c->b;
     }
 
-      // initiate asynchron data transfer to controller
-    if (do_submit) {
-      int rc;
-      ctrl->transfer_error = 0;
-      rc = libusb_submit_transfer(ctrl->transfer);
+      // gamma and white calibration correction, fraction is interpolated between table entries
+    i = v >> 8;
+    f = v & 0xFF;
+    t = (uint32_t)tab[i] << 8;
+    if (f && i < 255 && tab[i + 1] > tab[i])
+      t += (tab[i + 1] - tab[i]) * f;
+    if ((ctrl->target[cfg->req_channel] & 0xFF) != 0)
+      --ctrl->num_dithered;
+    if ((t & 0xFF) != 0)
+      ++ctrl->num_dithered;
+    ctrl->target[cfg->req_channel] = t;
+    df10ch_set_brightness(ctrl, cfg->req_channel);
+  }
+}
+
+
+  // Brightness of channels with fractional target changes between dither cycles. Called with locked driver
+static void df10ch_dither_brightness(df10ch_ctrl_t *ctrl) {
+  int ch;
+
+  for (ch = 0; ch < ctrl->num_req_channels; ++ch) {
+    if (ctrl->target[ch] & 0xFF)
+      df10ch_set_brightness(ctrl, ch);
+  }
+}
+
+
+  // Is true if a channel of any controller has a fractional brightness. Called with locked driver
+static int df10ch_is_dithering(df10ch_output_driver_t *this) {
+  df10ch_ctrl_t *ctrl;
+
+  for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next) {
+    if (ctrl->num_dithered)
+      return 1;
+  }
+  return 0;
+}
+
+
+/*
+ * Prepare transfer 'idx' with brightness values of changed channels only. If the transfer is
+ * still waiting for submit its channels are send too. Channels of all controllers
+ * are switched together when more than one controller is connected.
+ */
+static void df10ch_prepare_transfer(df10ch_ctrl_t *ctrl, int idx) {
+  uint8_t *data = ctrl->transfer_data[idx];
+  int first = ctrl->dirty_first, last = ctrl->dirty_last, len;
+
+  if (idx == ctrl->ready) {
+    if (ctrl->xfer_first[idx] < first)
+      first = ctrl->xfer_first[idx];
+    if (ctrl->xfer_last[idx] > last)
+      last = ctrl->xfer_last[idx];
+  }
+  len = (last - first + 1) * 2;
+  memcpy(data + LIBUSB_CONTROL_SETUP_SIZE, ctrl->brightness + first * 2, len);
+  libusb_fill_control_setup(data, LIBUSB_ENDPOINT_OUT | LIBUSB_REQUEST_TYPE_VENDOR | LIBUSB_RECIPIENT_DEVICE,
+                              (ctrl->driver->ctrls->next != NULL) ? PWM_REQ_SET_BRIGHTNESS_SYNCED: PWM_REQ_SET_BRIGHTNESS, 0, first, len);
+  ctrl->transfer[idx]->length = LIBUSB_CONTROL_SETUP_SIZE + len;
+  ctrl->xfer_first[idx] = first;
+  ctrl->xfer_last[idx] = last;
+  ctrl->dirty_first = ctrl->num_req_channels;
+  ctrl->dirty_last = -1;
+}
+
+
+/*
+ * Submit changed brightness values of all controllers. Caller never waits for the USB transfer:
+ * If the previous transfer of a controller is still in flight the values are prepared in the
+ * second transfer that is submitted by the event thread on completion.
+ * Called with locked driver, a failed submit is reported by df10ch_check_async_errors().
+ */
+static int df10ch_send_brightness(df10ch_output_driver_t *this) {
+  df10ch_ctrl_t *ctrl;
+  int rc = 0;
+
+  for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next) {
+    int idx = (ctrl->inflight >= 0) ? 1 - ctrl->inflight: 0;
+
+    if (ctrl->force_submit) {
+      ctrl->dirty_first = 0;
+      ctrl->dirty_last = ctrl->num_req_channels - 1;
+      ctrl->force_submit = 0;
+    }
+    if (ctrl->dirty_last < 0)
+      continue;
+    df10ch_prepare_transfer(ctrl, idx);
+
+    if (ctrl->inflight >= 0) {
+        // Newest values replace values that are still waiting for the busy controller
+      if (ctrl->ready >= 0)
+        ++this->dropped_cnt;
+      ctrl->ready = idx;
+    } else {
+      rc = df10ch_submit_transfer(ctrl, idx);
       if (rc) {
-        snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%s: submitting USB transfer message failed: %s", ctrl->id, libusb_strerror(rc));
-        return -1;
+        ctrl->submit_error = rc;
+        rc = -1;
+        break;
       }
-      ctrl->pending_submit = 1;
     }
+  }
+  return rc;
+}
 
-    ctrl = ctrl->next;
+
+  // Generate brightness values for all controllers and submit changed ones. With a 'changed' mask only brightness values of changed channels are generated.
+static int df10ch_update(df10ch_output_driver_t *this, rgb16_color_t *colors, int initial, const uint32_t *changed) {
+  rgb16_color_t *area_map[9];
+  int area_offset[9];
+  df10ch_ctrl_t *ctrl;
+  int a, n = 0;
+
+    // Build area mapping table
+  area_offset[DF10CH_AREA_TOP] = n;
+  n += this->param.top;
+  area_offset[DF10CH_AREA_BOTTOM] = n;
+  n += this->param.bottom;
+  area_offset[DF10CH_AREA_LEFT] = n;
+  n += this->param.left;
+  area_offset[DF10CH_AREA_RIGHT] = n;
+  n += this->param.right;
+  area_offset[DF10CH_AREA_CENTER] = n;
+  n += this->param.center;
+  area_offset[DF10CH_AREA_TOP_LEFT] = n;
+  n += this->param.top_left;
+  area_offset[DF10CH_AREA_TOP_RIGHT] = n;
+  n += this->param.top_right;
+  area_offset[DF10CH_AREA_BOTTOM_LEFT] = n;
+  n += this->param.bottom_left;
+  area_offset[DF10CH_AREA_BOTTOM_RIGHT] = n;
+  for (a = 0; a < 9; ++a)
+    area_map[a] = colors + area_offset[a];
+
+  ++this->output_cnt;
+  for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next) {
+    if (initial)
+      ctrl->force_submit = 1;
+    df10ch_update_brightness(ctrl, area_map, area_offset, initial ? NULL: changed);
   }
+  return df10ch_send_brightness(this);
+}
 
-    // wait for end of all pending transfers
-  if (df10ch_wait_for_replys(this))
+
+  // Dither cycle between outputs. Called with locked driver
+static int df10ch_dither(df10ch_output_driver_t *this) {
+  df10ch_ctrl_t *ctrl;
+
+  ++this->dither_cnt;
+  for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next) {
+    if (ctrl->num_dithered)
+      df10ch_dither_brightness(ctrl);
+  }
+  return df10ch_send_brightness(this);
+}
+
+
+  // Time until brightness values are applied by the slowest controller: Mean round trip latency [us]. Called with locked driver
+static uint32_t df10ch_transmit_time(df10ch_output_driver_t *this) {
+  df10ch_ctrl_t *ctrl;
+  uint32_t t = 0;
+
+  for (ctrl = this->ctrls; ctrl; ctrl = ctrl->next) {
+    if (ctrl->latency.cnt && ctrl->latency.sum / ctrl->latency.cnt > t)
+      t = (uint32_t)(ctrl->latency.sum / ctrl->latency.cnt);
+  }
+  return t;
+}
+
+
+  // Submit all timed colors that are due at 'now'. Called with locked driver
+static int df10ch_update_timed(df10ch_output_driver_t *this, uint64_t now) {
+  int all;
+
+  if (!dfatmo_timed_queue_take(&this->queue, now, this->timed_colors, this->timed_changed, &all))
+    return 0;
+  ++this->timed_cnt;
+  BROADCAST_COND(&this->transfer_done);
+  return df10ch_update(this, this->timed_colors, all, all ? NULL: this->timed_changed);
+}
+
+
+  // Submits timed colors when they are due and runs the dither cycles while channels have a fractional brightness
+static THREAD_PROC(df10ch_present_loop, this_gen) {
+  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
+  uint64_t next_dither = 0;
+
+  LOCK_MUTEX(&this->lock);
+  while (this->present_thread_running) {
+    const uint64_t clock = dfatmo_clock_us(), now = clock + df10ch_transmit_time(this);
+    int64_t wait_us = dfatmo_timed_queue_wait_us(&this->queue, now);
+
+    if (this->dither_period && df10ch_is_dithering(this)) {
+        // Dither cycles follow a fixed grid, which is set again if the thread was stalled
+      if (!next_dither || clock >= next_dither + this->dither_period)
+        next_dither = clock + this->dither_period;
+      else if (clock >= next_dither) {
+        df10ch_dither(this);
+        next_dither += this->dither_period;
+        continue;
+      }
+      if (wait_us < 0 || (int64_t)(next_dither - clock) < wait_us)
+        wait_us = (int64_t)(next_dither - clock);
+    } else
+      next_dither = 0;
+
+    if (!wait_us)
+      df10ch_update_timed(this, now);
+    else if (wait_us < 0)
+      WAIT_COND(&this->present_wakeup, &this->lock);
+    else {
+      deadline_t deadline;
+      SET_DEADLINE_US(deadline, wait_us);
+      (void) TIMED_WAIT_COND(&this->present_wakeup, &this->lock, deadline);
+    }
+  }
+  UNLOCK_MUTEX(&this->lock);
+  THREAD_RETURN;
+}
+
+
+  // Called by output thread, present_us is 0 for colors without presentation time
+static int df10ch_submit(df10ch_output_driver_t *this, rgb16_color_t *colors, int initial, const uint32_t *changed, uint64_t present_us) {
+  int rc;
+
+  df10ch_report_errors(this);
+
+  LOCK_MUTEX(&this->lock);
+  if (df10ch_check_async_errors(this)) {
+    UNLOCK_MUTEX(&this->lock);
     return -1;
+  }
 
-  if (IS_LOG_LEVEL(DFLOG_INFO)) {
-    int latency;
-#ifdef WIN32
-    GetSystemTimeAsFileTime (&act_time);
-    latency = (act_time.dwLowDateTime - start_time.dwLowDateTime) / 10;
-#else
-    gettimeofday(&act_time, NULL);
-    timersub(&act_time, &start_time, &latency_time);
-    latency = latency_time.tv_usec;
-#endif
-    this->avg_transmit_latency = (this->avg_transmit_latency + latency) / 2;
-    if (latency > this->max_transmit_latency) {
-      this->max_transmit_latency = latency;
-      DFATMO_LOG(DFLOG_INFO, "max/avg transmit latency: %d/%d [us]", this->max_transmit_latency, this->avg_transmit_latency);
+  if (present_us || this->queue.count) {
+      // Colors without presentation time replace all timed colors
+    const uint64_t now = dfatmo_clock_us() + df10ch_transmit_time(this);
+    dfatmo_timed_queue_push(&this->queue, colors, initial ? NULL: changed, present_us ? present_us: now);
+    rc = df10ch_update_timed(this, now);
+    BROADCAST_COND(&this->present_wakeup);
+  } else {
+    rc = df10ch_update(this, colors, initial, changed);
+    if (this->dither_period)
+      BROADCAST_COND(&this->present_wakeup);
+  }
+  if (rc)
+    df10ch_check_async_errors(this);
+  UNLOCK_MUTEX(&this->lock);
+  return rc;
+}
+
+
+  // 8 bit colors have no fraction
+static rgb16_color_t *df10ch_fine_colors(df10ch_output_driver_t *this, const rgb_color_t *colors) {
+  rgb16_color_t *fine = this->fine_colors;
+  int n = this->queue.num_channels;
+
+  while (n--) {
+    fine->r = colors->r << 8;
+    fine->g = colors->g << 8;
+    fine->b = colors->b << 8;
+    ++fine;
+    ++colors;
+  }
+  return this->fine_colors;
+}
+
+
+static int df10ch_driver_submit_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
+  return df10ch_submit(this, df10ch_fine_colors(this, colors), (last_colors == NULL), NULL, 0);
+}
+
+
+static int df10ch_driver_submit_changed_colors(output_driver_t *this_gen, rgb_color_t *colors, const uint32_t *changed) {
+  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
+  return df10ch_submit(this, df10ch_fine_colors(this, colors), (changed == NULL), changed, 0);
+}
+
+
+static int df10ch_driver_submit_timed_colors(output_driver_t *this_gen, rgb_color_t *colors, const uint32_t *changed, uint64_t present_us) {
+  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
+  return df10ch_submit(this, df10ch_fine_colors(this, colors), (changed == NULL), changed, present_us);
+}
+
+
+static int df10ch_driver_submit_fine_colors(output_driver_t *this_gen, rgb16_color_t *colors, const uint32_t *changed, uint64_t present_us) {
+  return df10ch_submit((df10ch_output_driver_t *) this_gen, colors, (changed == NULL), changed, present_us);
+}
+
+
+static int df10ch_driver_poll_colors(output_driver_t *this_gen, int timeout_ms) {
+  df10ch_output_driver_t *this = (df10ch_output_driver_t *) this_gen;
+  deadline_t deadline;
+  int rc;
+
+  df10ch_report_errors(this);
+
+  LOCK_MUTEX(&this->lock);
+  if (timeout_ms > 0) {
+    SET_DEADLINE(deadline, timeout_ms);
+    while ((df10ch_is_busy(this) || this->queue.count) && !this->event_error) {
+      if (!TIMED_WAIT_COND(&this->transfer_done, &this->lock, deadline))
+        break;
     }
   }
+  rc = df10ch_check_async_errors(this) ? -1: (df10ch_is_busy(this) || this->queue.count);
+  UNLOCK_MUTEX(&this->lock);
+  return rc;
+}
 
-  return 0;
+
+static int df10ch_driver_output_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  int rc = df10ch_driver_submit_colors(this_gen, colors, last_colors);
+
+    // wait for end of all pending transfers
+  if (!rc) {
+    rc = df10ch_driver_poll_colors(this_gen, 2 * (DF10CH_USB_DEFAULT_TIMEOUT + 50));
+    if (rc > 0) {
+      strcpy(this_gen->errmsg, "USB transfer timeout");
+      rc = -1;
+    }
+  }
+  return rc;
 }
 
 
@@ -775,6 +1566,11 @@ output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_l
   d->output_driver.close = df10ch_driver_close;
   d->output_driver.dispose = df10ch_driver_dispose;
   d->output_driver.output_colors = df10ch_driver_output_colors;
+  d->output_driver.submit_colors = df10ch_driver_submit_colors;
+  d->output_driver.poll_colors = df10ch_driver_poll_colors;
+  d->output_driver.submit_changed_colors = df10ch_driver_submit_changed_colors;
+  d->output_driver.submit_timed_colors = df10ch_driver_submit_timed_colors;
+  d->output_driver.submit_fine_colors = df10ch_driver_submit_fine_colors;
 
   return &d->output_driver;
 }
@@ -40,6 +40,7 @@ enum { DFLOG_NONE = 0, DFLOG_ERROR, DFLOG_INFO, DFLOG_DEBUG };
 #define SIZE_DRIVER_PARAM       2048    /* Maximum size of driver parameter string */
 
 typedef struct { uint8_t r, g, b; } rgb_color_t;
+typedef struct { uint16_t r, g, b; } rgb16_color_t;     /* 8.8 fixed point: High byte is the 8 bit value, low byte the fraction */
 
 typedef struct {
   char driver[SIZE_DRIVER_NAME];
@@ -77,12 +78,23 @@ typedef struct {
   int analyze_size;
   int start_delay;
   int enabled;
+  char record_file[SIZE_DRIVER_PATH];
+  int output_keepalive;
+  int output_deadband;
+  int output_deadband_mode;
+  int output_lead;
+  int output_dither;
+  int fine_colors;
 } atmo_parameters_t;
 
 /*
  * abstraction for output drivers
  */
-#define DFATMO_OUTPUT_DRIVER_VERSION    3
+#define DFATMO_OUTPUT_DRIVER_VERSION    7
+
+  /* bit mask of changed channels as used by submit_changed_colors */
+#define CHANNEL_MASK_WORDS(n)           (((n) + 31) / 32)
+#define IS_CHANNEL_CHANGED(mask, n)     ((mask)[(n) / 32] & (1U << ((n) % 32)))
 
 typedef struct output_driver_s output_driver_t;
 struct output_driver_s {
@@ -110,8 +122,79 @@ struct output_driver_s {
 
     /* provide detailed error message here if open of device fails */
   char errmsg[128];
+
+    /*
+     * Since version 4: asynchronous output
+     *
+     * Queue RGB color values for sending to device and return without waiting for the device.
+     * Arguments are the same as for output_colors. Buffers are reused by the caller so the colors have to be copied.
+     * If the device is still busy with a previous transfer only the newest queued colors are send later on
+     * ("newest frame wins"), older not yet send colors are dropped.
+     * Set to NULL if driver supports only synchronous output. In this case output_colors is called by a worker thread
+     * of the DFAtmo engine.
+     */
+  int (*submit_colors)(output_driver_t *self, rgb_color_t *new_colors, rgb_color_t *last_colors);
+
+    /*
+     * Process completion of submitted colors and wait up to timeout_ms milliseconds until all queued colors are send.
+     * Returns 0 if device is idle, 1 if device is still busy and -1 on error.
+     * Only used if submit_colors is not NULL.
+     */
+  int (*poll_colors)(output_driver_t *self, int timeout_ms);
+
+    /*
+     * Since version 5: output of changed channels
+     *
+     * Like submit_colors but instead of the last colors the engine passes a bit mask of the channels that changed
+     * since the previous submitted colors: Channel n changed if IS_CHANNEL_CHANGED(changed, n) is true.
+     * changed is NULL when all channels have to be send (first initial color packet or keep alive).
+     * Set to NULL if not supported, submit_colors is used in this case.
+     */
+  int (*submit_changed_colors)(output_driver_t *self, rgb_color_t *new_colors, const uint32_t *changed);
+
+    /*
+     * Since version 6: timed output
+     *
+     * Like submit_changed_colors but the colors have to be presented at time 'present_us' of the DFAtmo clock
+     * (see dfatmo_clock_us()). The driver queues the colors and sends them so they get visible at that time,
+     * colors with a presentation time in the past are send at once. Queued colors with a presentation time that is
+     * not before the one of new colors are replaced by the new colors.
+     * Set to NULL if not supported, the engine submits the colors without presentation time in this case.
+     */
+  int (*submit_timed_colors)(output_driver_t *self, rgb_color_t *new_colors, const uint32_t *changed, uint64_t present_us);
+
+    /*
+     * Since version 7: fine output
+     *
+     * Like submit_timed_colors but the colors keep the fraction calculated by analysis and filters (8.8 fixed point).
+     * A driver for devices with a higher resolution than 8 bit maps them to its native resolution and dithers the
+     * rest over time with 'output_dither' cycles per output period. present_us is 0 for colors without presentation time.
+     * Only used if parameter 'fine_colors' or 'output_dither' is set. Set to NULL if not supported.
+     */
+  int (*submit_fine_colors)(output_driver_t *self, rgb16_color_t *new_colors, const uint32_t *changed, uint64_t present_us);
 };
 
+  /* Monotonic clock of presentation times [us] */
+#ifdef WIN32
+#include <windows.h>
+
+static inline uint64_t dfatmo_clock_us(void) {
+  LARGE_INTEGER count, freq;
+  QueryPerformanceCounter(&count);
+  QueryPerformanceFrequency(&freq);
+    // Split to avoid overflow of count * 1000000
+  return (uint64_t)(count.QuadPart / freq.QuadPart) * 1000000 + (uint64_t)(count.QuadPart % freq.QuadPart) * 1000000 / freq.QuadPart;
+}
+#else
+#include <time.h>
+
+static inline uint64_t dfatmo_clock_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+#endif
+
 typedef int* dfatmo_log_level_t;
 typedef void (*dfatmo_log_t)(int level, const char *fmt, ...);
 typedef output_driver_t* (*dfatmo_new_output_driver_t)(dfatmo_log_level_t log_level, dfatmo_log_t log_fn);
@@ -157,6 +157,7 @@ dfatmoParmList = (
     ( 'i', 'sat_win_size' ),
     ( 'i', 'hue_threshold' ),
     ( 'i', 'uniform_brightness' ),
+    ( 'b', 'fine_colors' ),
     ( 'i', 'brightness' ),
     ( 'i', 'filter' ),
     ( 'i', 'filter_smoothness' ),
@@ -164,12 +165,18 @@ dfatmoParmList = (
     ( 'i', 'filter_threshold' ),
     ( 'i', 'filter_delay' ),
     ( 'i', 'output_rate' ),
+    ( 'i', 'output_keepalive' ),
+    ( 'i', 'output_deadband' ),
+    ( 'i', 'output_deadband_mode' ),
+    ( 'i', 'output_lead' ),
+    ( 'i', 'output_dither' ),
     ( 'i', 'wc_red' ),
     ( 'i', 'wc_green' ),
     ( 'i', 'wc_blue' ),
     ( 'i', 'gamma' ),
     ( 'i', 'analyze_rate' ),
     ( 'i', 'analyze_size' ),
+    ( 't', 'record_file' ),
     ( 'b', 'enabled' ))
 
 
@@ -242,6 +249,9 @@ class OutputThread(threading.Thread):
                         outputCount = 1
                     colors = ad.filterAnalyzedColors(colors)
                     colors = ad.filterOutputColors(colors)
+                    if od != ad:
+                        # script drivers get a copy, the returned views of driver colors change with every frame
+                        colors = bytearray(colors)
                     try:
                         od.outputColors(colors)
                         writeFailureRetry = False
@@ -426,6 +436,8 @@ class CaptureThread(threading.Thread):
         else:
             self.outputDriver = self.atmoDriver
             
+        # views of driver colors are invalid after configure
+        self.analyzedColors = None
         try:
             log(LOG_DEBUG, "before configure")
             self.atmoDriver.configure()
@@ -504,6 +516,7 @@ class CaptureThread(threading.Thread):
  
             pending = False
             if img:
+                # same view for every frame, its colors are replaced as a whole while the output thread waits for the GIL
                 self.analyzedColors = ad.analyzeImage(capture.getWidth(), capture.getHeight(), imgFmt, img)
                 captureCount = captureCount + 1
 
@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the layout of the POSIX shared memory segment published by the shm output driver.
+ *
+ * The segment starts with the header followed by a ring of slots, each holding one output frame.
+ * The writer never waits for readers: A slot and the channel layout in the header are protected
+ * by a sequence lock. The sequence number is odd while the writer updates the data, so a reader
+ * takes the data only if the sequence number is even and unchanged after reading:
+ *
+ *   const dfatmo_shm_slot_t *slot = dfatmo_shm_latest_slot(hdr);
+ *   uint32_t seq;
+ *   do {
+ *     seq = dfatmo_shm_read_begin(&slot->seq);
+ *     ... use slot->colors in place ...
+ *   } while (!dfatmo_shm_read_end(&slot->seq, seq));
+ *
+ * Colors are in DFAtmo output order: top 1,2,3..., bottom 1,2,3..., left 1,2,3..., right 1,2,3...,
+ * center, top left, top right, bottom left, bottom right
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#define DFATMO_SHM_MAGIC        0x53414644      /* "DFAS" */
+#define DFATMO_SHM_VERSION      1
+#define DFATMO_SHM_NAME         "/dfatmo"       /* Default name of segment */
+#define DFATMO_SHM_MAX_CHANNELS (9 * 128)
+
+enum { DFATMO_SHM_TOP, DFATMO_SHM_BOTTOM, DFATMO_SHM_LEFT, DFATMO_SHM_RIGHT, DFATMO_SHM_CENTER,
+       DFATMO_SHM_TOP_LEFT, DFATMO_SHM_TOP_RIGHT, DFATMO_SHM_BOTTOM_LEFT, DFATMO_SHM_BOTTOM_RIGHT, DFATMO_SHM_NUM_AREAS };
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t header_size;
+  uint32_t slot_size;                           // Size of a slot including colors
+  uint32_t num_slots;
+  uint32_t writer_pid;
+  volatile uint32_t active;                     // Writer has the output driver opened
+  volatile uint32_t layout_seq;                 // Sequence lock of channel layout
+  uint32_t num_channels;
+  uint32_t areas[DFATMO_SHM_NUM_AREAS];         // Number of channels per area
+  uint32_t output_rate;                         // [ms]
+  uint32_t reserved;
+  volatile uint64_t frames;                     // Number of published frames, latest is in slot (frames - 1) % num_slots
+} dfatmo_shm_header_t;
+
+typedef struct {
+  volatile uint32_t seq;                        // Sequence lock of slot
+  uint32_t num_channels;
+  uint64_t frame;                               // Frame number starting with 1
+  uint64_t monotonic_ns;                        // Publishing time CLOCK_MONOTONIC
+  uint64_t realtime_ns;                         // Publishing time CLOCK_REALTIME
+  uint8_t colors[DFATMO_SHM_MAX_CHANNELS][3];   // RGB
+} dfatmo_shm_slot_t;
+
+
+static inline dfatmo_shm_slot_t *dfatmo_shm_slot(const dfatmo_shm_header_t *hdr, uint64_t frame) {
+  return (dfatmo_shm_slot_t *) ((uint8_t *) hdr + hdr->header_size + ((frame - 1) % hdr->num_slots) * hdr->slot_size);
+}
+
+static inline dfatmo_shm_slot_t *dfatmo_shm_latest_slot(const dfatmo_shm_header_t *hdr) {
+  uint64_t frames = __atomic_load_n(&hdr->frames, __ATOMIC_ACQUIRE);
+  return dfatmo_shm_slot(hdr, frames ? frames: 1);
+}
+
+static inline uint32_t dfatmo_shm_read_begin(volatile const uint32_t *seq) {
+  return __atomic_load_n(seq, __ATOMIC_ACQUIRE);
+}
+
+  /* Returns 0 if the writer was updating the data while reading */
+static inline int dfatmo_shm_read_end(volatile const uint32_t *seq, uint32_t s) {
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  return (!(s & 1) && __atomic_load_n(seq, __ATOMIC_RELAXED) == s);
+}
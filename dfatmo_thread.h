@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * These are portable thread, mutex and condition variable primitives used by the engine and the output drivers.
+ */
+
+#pragma once
+
+#ifdef WIN32
+#include <windows.h>
+
+typedef HANDLE thread_t;
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+typedef DWORD deadline_t;
+
+#define THREAD_PROC(name, arg)  DWORD WINAPI name(LPVOID arg)
+#define THREAD_RETURN           return 0
+#define CREATE_THREAD(thr, proc, arg) ((*(thr) = CreateThread(NULL, 0, proc, arg, 0, NULL)) == NULL)
+#define JOIN_THREAD(thr)        { WaitForSingleObject(thr, INFINITE); CloseHandle(thr); }
+#define INIT_MUTEX(m)           InitializeCriticalSection(m)
+#define DESTROY_MUTEX(m)        DeleteCriticalSection(m)
+#define LOCK_MUTEX(m)           EnterCriticalSection(m)
+#define UNLOCK_MUTEX(m)         LeaveCriticalSection(m)
+#define INIT_COND(c)            InitializeConditionVariable(c)
+#define DESTROY_COND(c)
+#define SIGNAL_COND(c)          WakeConditionVariable(c)
+#define BROADCAST_COND(c)       WakeAllConditionVariable(c)
+#define WAIT_COND(c, m)         SleepConditionVariableCS(c, m, INFINITE)
+#define SET_DEADLINE(d, ms)     (d) = GetTickCount() + (ms)
+#define SET_DEADLINE_US(d, us)  (d) = GetTickCount() + ((us) + 999) / 1000
+#define TIMED_WAIT_COND(c, m, d) SleepConditionVariableCS(c, m, ((int)((d) - GetTickCount()) > 0) ? ((d) - GetTickCount()): 0)
+#define REMAINING_MS(d)         (((int)((d) - GetTickCount()) > 0) ? (int)((d) - GetTickCount()): 0)
+#else
+#include <pthread.h>
+#include <time.h>
+
+typedef pthread_t thread_t;
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+typedef struct timespec deadline_t;
+
+#define THREAD_PROC(name, arg)  void *name(void *arg)
+#define THREAD_RETURN           return NULL
+#define CREATE_THREAD(thr, proc, arg) (pthread_create(thr, NULL, proc, arg) != 0)
+#define JOIN_THREAD(thr)        pthread_join(thr, NULL)
+#define INIT_MUTEX(m)           pthread_mutex_init(m, NULL)
+#define DESTROY_MUTEX(m)        pthread_mutex_destroy(m)
+#define LOCK_MUTEX(m)           pthread_mutex_lock(m)
+#define UNLOCK_MUTEX(m)         pthread_mutex_unlock(m)
+#define INIT_COND(c)            pthread_cond_init(c, NULL)
+#define DESTROY_COND(c)         pthread_cond_destroy(c)
+#define SIGNAL_COND(c)          pthread_cond_signal(c)
+#define BROADCAST_COND(c)       pthread_cond_broadcast(c)
+#define WAIT_COND(c, m)         pthread_cond_wait(c, m)
+#define SET_DEADLINE(d, ms)     { clock_gettime(CLOCK_REALTIME, &(d)); (d).tv_sec += (ms) / 1000; (d).tv_nsec += ((ms) % 1000) * 1000000; \
+                                  if ((d).tv_nsec >= 1000000000) { (d).tv_nsec -= 1000000000; ++(d).tv_sec; } }
+#define SET_DEADLINE_US(d, us)  { clock_gettime(CLOCK_REALTIME, &(d)); (d).tv_sec += (us) / 1000000; (d).tv_nsec += ((us) % 1000000) * 1000; \
+                                  if ((d).tv_nsec >= 1000000000) { (d).tv_nsec -= 1000000000; ++(d).tv_sec; } }
+#define TIMED_WAIT_COND(c, m, d) (pthread_cond_timedwait(c, m, &(d)) == 0)
+#define REMAINING_MS(d)         remaining_ms(&(d))
+
+static inline int remaining_ms(const struct timespec *d) {
+  struct timespec now;
+  long ms;
+  clock_gettime(CLOCK_REALTIME, &now);
+  ms = (d->tv_sec - now.tv_sec) * 1000 + (d->tv_nsec - now.tv_nsec) / 1000000;
+  return (ms > 0) ? (int) ms: 0;
+}
+#endif
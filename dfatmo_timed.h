@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is a queue of colors with presentation time for output drivers that support timed output (submit_timed_colors).
+ *
+ * Frames are queued in order of their presentation time. A new frame replaces queued frames that are not presented
+ * before it and the oldest frame is merged into the next one if the queue is full. Taking frames merges all due
+ * frames into one: Colors of the newest due frame and the changed channels of all of them.
+ * The queue is not locked, this has to be done by the driver.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dfatmo.h"
+
+#define DFATMO_TIMED_QUEUE_SIZE         16
+
+typedef struct {
+  uint64_t present_us;          // Presentation time of DFAtmo clock
+  int all;                      // All channels have to be send
+  void *colors;                 // rgb_color_t or rgb16_color_t
+  uint32_t *changed;            // Channels changed since previous frame
+} dfatmo_timed_frame_t;
+
+typedef struct {
+  int num_channels;
+  size_t colors_size;           // Size of colors of a frame
+  int first, count;
+  uint32_t replaced;            // Number of frames replaced by newer ones before they got due
+  dfatmo_timed_frame_t frame[DFATMO_TIMED_QUEUE_SIZE];
+  void *buf;
+} dfatmo_timed_queue_t;
+
+
+static inline int dfatmo_timed_queue_init(dfatmo_timed_queue_t *q, int num_channels, size_t color_size) {
+  const size_t colors_size = (num_channels * color_size + 3) & ~3, mask_size = (CHANNEL_MASK_WORDS(num_channels) + 1) * sizeof(uint32_t);
+  uint8_t *p;
+  int i;
+
+  memset(q, 0, sizeof(*q));
+  q->num_channels = num_channels;
+  q->colors_size = num_channels * color_size;
+  q->buf = p = (uint8_t *) malloc(DFATMO_TIMED_QUEUE_SIZE * (mask_size + colors_size));
+  if (p == NULL)
+    return -1;
+  for (i = 0; i < DFATMO_TIMED_QUEUE_SIZE; ++i) {
+    q->frame[i].changed = (uint32_t *) p;
+    p += mask_size;
+    q->frame[i].colors = p;
+    p += colors_size;
+  }
+  return 0;
+}
+
+
+static inline void dfatmo_timed_queue_free(dfatmo_timed_queue_t *q) {
+  free(q->buf);
+  q->buf = NULL;
+  q->count = 0;
+}
+
+
+static inline void dfatmo_timed_queue_clear(dfatmo_timed_queue_t *q) {
+  q->first = 0;
+  q->count = 0;
+}
+
+
+static inline dfatmo_timed_frame_t *dfatmo_timed_queue_frame(dfatmo_timed_queue_t *q, int i) {
+  return &q->frame[(q->first + i) % DFATMO_TIMED_QUEUE_SIZE];
+}
+
+
+  // Merge changed channels of frame 'f' into frame 't'
+static inline void dfatmo_timed_queue_merge(dfatmo_timed_queue_t *q, dfatmo_timed_frame_t *t, const dfatmo_timed_frame_t *f) {
+  int i;
+
+  t->all |= f->all;
+  for (i = CHANNEL_MASK_WORDS(q->num_channels) - 1; i >= 0; --i)
+    t->changed[i] |= f->changed[i];
+}
+
+
+  // Queue colors, changed is NULL if all channels have to be send
+static inline void dfatmo_timed_queue_push(dfatmo_timed_queue_t *q, const void *colors, const uint32_t *changed, uint64_t present_us) {
+  const size_t mask_size = CHANNEL_MASK_WORDS(q->num_channels) * sizeof(uint32_t);
+  dfatmo_timed_frame_t *f, *l;
+
+  if (q->count == DFATMO_TIMED_QUEUE_SIZE) {
+    dfatmo_timed_queue_merge(q, dfatmo_timed_queue_frame(q, 1), dfatmo_timed_queue_frame(q, 0));
+    q->first = (q->first + 1) % DFATMO_TIMED_QUEUE_SIZE;
+    --q->count;
+    ++q->replaced;
+  }
+
+  f = dfatmo_timed_queue_frame(q, q->count);
+  f->present_us = present_us;
+  f->all = (changed == NULL);
+  if (changed)
+    memcpy(f->changed, changed, mask_size);
+  else
+    memset(f->changed, 0, mask_size);
+  memcpy(f->colors, colors, q->colors_size);
+
+    // New frame replaces queued frames that would be presented at the same time or later
+  while (q->count && (l = dfatmo_timed_queue_frame(q, q->count - 1))->present_us >= present_us) {
+    dfatmo_timed_queue_merge(q, l, f);
+    l->present_us = present_us;
+    memcpy(l->colors, colors, q->colors_size);
+    f = l;
+    --q->count;
+    ++q->replaced;
+  }
+  ++q->count;
+}
+
+
+  // Time until first frame is due [us], 0 if it is due and -1 if queue is empty
+static inline int64_t dfatmo_timed_queue_wait_us(dfatmo_timed_queue_t *q, uint64_t now_us) {
+  const dfatmo_timed_frame_t *f = dfatmo_timed_queue_frame(q, 0);
+
+  if (!q->count)
+    return -1;
+  return (f->present_us > now_us) ? (int64_t)(f->present_us - now_us): 0;
+}
+
+
+  // Take all frames that are due at 'now_us'. Returns 0 if no frame is due
+static inline int dfatmo_timed_queue_take(dfatmo_timed_queue_t *q, uint64_t now_us, void *colors, uint32_t *changed, int *all) {
+  int n = 0;
+
+  memset(changed, 0, CHANNEL_MASK_WORDS(q->num_channels) * sizeof(uint32_t));
+  *all = 0;
+  while (q->count && dfatmo_timed_queue_frame(q, 0)->present_us <= now_us) {
+    dfatmo_timed_frame_t *f = dfatmo_timed_queue_frame(q, 0);
+    int i;
+
+    *all |= f->all;
+    for (i = CHANNEL_MASK_WORDS(q->num_channels) - 1; i >= 0; --i)
+      changed[i] |= f->changed[i];
+    memcpy(colors, f->colors, q->colors_size);
+    q->first = (q->first + 1) % DFATMO_TIMED_QUEUE_SIZE;
+    --q->count;
+    ++n;
+  }
+  return n;
+}
@@ -170,5 +170,7 @@ output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_l
   d->output_driver.close = file_driver_close;
   d->output_driver.dispose = file_driver_dispose;
   d->output_driver.output_colors = file_driver_output_colors;
+  d->output_driver.submit_colors = NULL;   // Output is done by worker thread of DFAtmo engine
+  d->output_driver.poll_colors = NULL;
   return &d->output_driver;
 }
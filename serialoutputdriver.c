@@ -51,6 +51,9 @@ typedef DWORD dev_speed_t;
 #include <regex.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <sys/ioctl.h>
+#include <sys/time.h>
+#include <time.h>
 
 typedef int dev_handle_t;
 typedef ssize_t dev_size_t;
@@ -60,28 +63,99 @@ typedef speed_t dev_speed_t;
 #define DEFAULT_PORT            "/dev/ttyS0"
 #define SPEED_CONST(speed)      B ## speed
 #define GET_SYS_ERR_MSG(buf)    strerror_r(errno, buf, sizeof(buf))
-#define OPEN_DEVICE(name)       open(name, O_WRONLY|O_NOCTTY)
+#define OPEN_DEVICE(name)       open(name, O_WRONLY|O_NOCTTY|O_NONBLOCK)
 #define CLOSE_DEVICE(fd)        close(fd)
 #define WRITE_DATA(fd, buf, len, written) ((written = write(fd, buf, (size_t)len)) != (ssize_t)-1)
 #define FLUSH_BUFFER(fd)        (tcdrain(fd) != -1)
+#define ASYNC_OUTPUT            1
+
+#if defined(__linux__) && defined(TCSETS2)
+  /*
+   * Arbitrary baud rates are set with the termios2 interface of the linux kernel.
+   * Kernel header <asm/termbits.h> could not be included together with <termios.h> so
+   * the (asm-generic) kernel structure is declared here.
+   */
+#define CUSTOM_SPEED            1
+#ifndef BOTHER
+#define BOTHER                  0010000
+#endif
+struct termios2 {
+  tcflag_t c_iflag;
+  tcflag_t c_oflag;
+  tcflag_t c_cflag;
+  tcflag_t c_lflag;
+  cc_t c_line;
+  cc_t c_cc[19];
+  speed_t c_ispeed;
+  speed_t c_ospeed;
+};
+#endif
 #endif
 
 #include "dfatmo.h"
 
-/* Maximum size of a telegram send over the serial port */
-#define SIZE_TELEGRAM_BUF      1023
+/* Maximum size of a telegram send over the serial port, buffers are sized by the compiled protocol */
+#define MAX_TELEGRAM_SIZE      65535
+
+/* Maximum time waiting for a telegram in synchronous output mode [ms] */
+#define SYNC_OUTPUT_TIMEOUT    1000
+
+/* DMX512 timing: break and mark after break before every telegram [us], start code and 512 slots */
+#define DMX_SPEED              250000
+#define DMX_BREAK_DURATION     100
+#define DMX_MARK_DURATION      12
+#define DMX_MAX_TELEGRAM_SIZE  513
 
+enum { COLOR_RED, COLOR_GREEN, COLOR_BLUE };
+
+  /* Position of a color value within the compiled telegram template */
 typedef struct {
+  uint16_t pos;                 // Offset within template
+  int16_t channel;              // Index of color or -1 if outside of area
+  uint8_t color;
+} proto_slot_t;
+
+/* Maximum number of serial ports a channel layout could be sharded to */
+#define MAX_SERIAL_PORTS       8
+
+typedef struct serial_output_driver_s {
   output_driver_t output_driver;
   atmo_parameters_t param;
   const char *protocol;
+  int strip_proto;              // Protocol for addressable LED strips or STRIP_NONE
+  char strip_protocol[512];     // Protocol descriptor generated for LED strip
+  int strip_first, strip_last;  // Range of LEDs of strip driven by this port, 0 for last means end of strip
+  int fletcher_start;           // Start of bytes covered by AWA Fletcher checksum or -1
   const uint8_t *escapes;
-#ifdef WIN32
+  uint8_t escape_tab[256];      // Is true for color values that have to be escaped
+  uint8_t *tmpl;                // Compiled telegram with constant values
+  int tmpl_len;
+  proto_slot_t *slots;          // Compiled color value positions
+  int num_slots;
+  int crc_pos;                  // Offset of XOR checksum within template or -1
+  int baud;                     // Transmission speed [bit/s]
+  uint8_t tmpl_crc;             // XOR checksum of constant values of template
+  uint8_t *msg;                 // Telegram buffer, sized for worst case that all color values are escaped
+#ifdef ASYNC_OUTPUT
+  uint8_t *tx;                  // Telegram that is currently written to device
+  int tx_size, tx_len, tx_pos;
+  int pending_len;              // Length of telegram in 'msg' that waits for output or 0
+  uint32_t send_cnt;            // Number of telegrams send
+  uint32_t coalesced_cnt;       // Number of telegrams that are send later because device was busy
+  uint32_t dropped_cnt;         // Number of telegrams that are replaced by newer ones before sending
+#endif
   uint8_t dmx;
+#ifdef WIN32
   LARGE_INTEGER dmx_break_duration, dmx_mark_duration;
+#else
+  uint32_t dmx_frame_cnt;       // Statistics of achieved DMX timing [us]
+  uint32_t dmx_break_min, dmx_break_max, dmx_mark_min, dmx_mark_max;
+  uint64_t dmx_break_sum, dmx_mark_sum, dmx_first_frame, dmx_last_frame;
+  uint64_t dmx_idle_time;       // Estimated time when last stop bit of the telegram has left the line [us]
 #endif
   dev_handle_t devfd;
   char driver_param[SIZE_DRIVER_PARAM];
+  struct serial_output_driver_s *next_port;     // Driver instances of additional ports, only used by first instance
 } serial_output_driver_t;
 
 
@@ -92,9 +166,644 @@ static const char *karate_proto = "xAA|x12|CX|24|Gl|Bl|Rl|Gr|Br|Rr|Gt|Bt|Rt|Gb|B
 
 static const uint8_t amblone_escapes[] = { 0x99, 6, 0xF1, 0xF2, 0xF3, 0xF4, 0x33, 0x99 };
 
+enum { STRIP_NONE, STRIP_ADALIGHT, STRIP_AWA };
+
+#define STRIP_HEADER_SIZE       6       /* "Ada" or "Awa", LED count - 1 (high, low byte), header checksum */
+
+
+  /* Append sections k0 ... k0 + c - 1 of LED strip area with n sections in forward or reverse direction to protocol descriptor */
+static int append_strip_area(char *d, int size, const char *area, int n, int reverse, int k0, int c) {
+  int num = reverse ? n - k0: k0 + 1;
+  if (c < 1)
+    return 0;
+  if (strlen(area) == 2)
+    return snprintf(d, size, "|R%s|G%s|B%s", area, area, area);
+  if (c == 1)
+    return snprintf(d, size, "|R%s%d|G%s%d|B%s%d", area, num, area, num, area, num);
+  return snprintf(d, size, "|R%s%d|G%s%d|B%s%d|%c%d", area, num, area, num, area, num, reverse ? '-': '+', c - 1);
+}
+
+
+/*
+ * Generate protocol descriptor for Adalight or AWA LED strip.
+ * The strip runs clockwise around the screen starting at the bottom left corner:
+ * bottom left, left (bottom to top), top left, top (left to right), top right,
+ * right (top to bottom), bottom right, bottom (right to left). Center area is not used.
+ * If a LED range is given only this part of the strip is driven by the port.
+ */
+static int build_strip_protocol(serial_output_driver_t *this) {
+  const struct { const char *area; int n, reverse; } areas[] = {
+    { "bl", this->param.bottom_left, 0 }, { "l", this->param.left, 1 }, { "tl", this->param.top_left, 0 }, { "t", this->param.top, 0 },
+    { "tr", this->param.top_right, 0 }, { "r", this->param.right, 0 }, { "br", this->param.bottom_right, 0 }, { "b", this->param.bottom, 1 } };
+  char *d = this->strip_protocol;
+  int size = sizeof(this->strip_protocol);
+  int first, last, pos, n, hi, lo, i;
+
+  for (n = 0, i = 0; i < 8; ++i)
+    n += areas[i].n;
+  first = this->strip_first;
+  last = (this->strip_last && this->strip_last < n) ? this->strip_last: n;
+  if (first >= last) {
+    strcpy(this->output_driver.errmsg, "no LEDs for strip protocol configured");
+    return -1;
+  }
+  hi = ((last - first - 1) >> 8) & 0xFF;
+  lo = (last - first - 1) & 0xFF;
+
+  n = snprintf(d, size, "x41|x%s|x61|%d|%d|%d", (this->strip_proto == STRIP_AWA) ? "77": "64", hi, lo, hi ^ lo ^ 0x55);
+  for (pos = 0, i = 0; i < 8 && n < size; pos += areas[i++].n) {
+    int k0 = (first > pos) ? first - pos: 0;
+    int k1 = (last < pos + areas[i].n) ? last - pos: areas[i].n;
+    n += append_strip_area(d + n, size - n, areas[i].area, areas[i].n, areas[i].reverse, k0, k1 - k0);
+  }
+  if (this->strip_proto == STRIP_AWA && n < size)
+    n += snprintf(d + n, size - n, "|0|0|0");   // Placeholder for Fletcher checksum
+  if (n >= size) {
+    strcpy(this->output_driver.errmsg, "strip protocol descriptor to long");
+    return -1;
+  }
+
+  this->protocol = this->strip_protocol;
+  DFATMO_LOG(DFLOG_DEBUG, "strip protocol: %s", this->protocol);
+  return 0;
+}
+
+
+typedef struct { int i, color, max, min; } area_info_t;
+
+static void add_color_slot(serial_output_driver_t *this, area_info_t *g) {
+  proto_slot_t *slot = &this->slots[this->num_slots++];
+  slot->pos = this->tmpl_len;
+  slot->channel = (g->i >= g->min && g->i < g->max) ? g->i: -1;
+  slot->color = g->color;
+  this->tmpl[this->tmpl_len++] = 0;
+}
+
+
+/*
+ * Compile protocol descriptor into telegram template and list of color value positions.
+ * Has to be done again if channel layout changes.
+ */
+static int compile_protocol(serial_output_driver_t *this) {
+  const char *p;
+  int data = 0, area = 0, area_num = 0, color = 0;
+  enum { TOP_AREA, BOTTOM_AREA, LEFT_AREA, RIGHT_AREA, CENTER_AREA, TOP_LEFT_AREA, TOP_RIGHT_AREA, BOTTOM_LEFT_AREA, BOTTOM_RIGHT_AREA };
+  enum { START_STATE, DEC_CONST_STATE, HEX_CONST_STATE, AREA_STATE, AREA_NUM_STATE, CRC_STATE, BYTE_REPEAT_STATE, BYTE_FILLUP_STATE, GROUP_INC_STATE, GROUP_DEC_STATE };
+  enum { NO_ERR, SYNTAX_ERR, DATA_ERR, LENGTH_ERR, CRC_MODE_ERR };
+  enum { ERR_CRC_MODE, XOR_CRC_MODE };
+  int state = START_STATE;
+  int err = NO_ERR;
+  int crc_mode = ERR_CRC_MODE;
+  uint8_t *m;
+  area_info_t last_group[3];
+  int lg_i = 0;
+  int i;
+
+  if (this->strip_proto != STRIP_NONE && build_strip_protocol(this))
+    return -1;
+  this->fletcher_start = (this->strip_proto == STRIP_AWA) ? STRIP_HEADER_SIZE: -1;
+  p = this->protocol;
+
+  memset(last_group, 0, sizeof(last_group));
+  free(this->tmpl);
+  free(this->slots);
+  free(this->msg);
+  this->msg = NULL;
+  this->tmpl_len = 0;
+#ifdef ASYNC_OUTPUT
+  this->pending_len = 0;
+#endif
+
+    // Compile into buffers of maximum size which are shrunk afterwards
+  this->tmpl = (uint8_t *) calloc(1, MAX_TELEGRAM_SIZE + 1);
+  this->slots = (proto_slot_t *) malloc((MAX_TELEGRAM_SIZE + 1) * sizeof(proto_slot_t));
+  if (this->tmpl == NULL || this->slots == NULL) {
+    strcpy(this->output_driver.errmsg, "allocating protocol buffers failed");
+    FREE_AND_SET_NULL(this->tmpl);
+    FREE_AND_SET_NULL(this->slots);
+    return -1;
+  }
+  m = this->tmpl;
+  this->num_slots = 0;
+  this->crc_pos = -1;
+
+  /* parse protocol descriptor and build telegram template */
+  while (err == NO_ERR) {
+    int c = *p++;
+
+    switch (state) {
+    case START_STATE:
+      switch (c) {
+      case 0:
+        break;
+      case 'x':
+      case 'X':
+        data = 0;
+        state = HEX_CONST_STATE;
+        break;
+      case 'r':
+      case 'R':
+        color = COLOR_RED;
+        state = AREA_STATE;
+        break;
+      case 'g':
+      case 'G':
+        color = COLOR_GREEN;
+        state = AREA_STATE;
+        break;
+      case 'b':
+      case 'B':
+        color = COLOR_BLUE;
+        state = AREA_STATE;
+        break;
+      case 'c':
+      case 'C':
+        state = CRC_STATE;
+        break;
+      case '+':
+        data = 0;
+        state = GROUP_INC_STATE;
+        break;
+      case '-':
+        data = 0;
+        state = GROUP_DEC_STATE;
+        break;
+      default:
+        if (c >= '0' && c <= '9') {
+          data = c - '0';
+          state = DEC_CONST_STATE;
+        } else
+          err = SYNTAX_ERR;
+      }
+      break;
+
+    case GROUP_INC_STATE:
+    case GROUP_DEC_STATE:
+      if (c >= '0' && c <= '9') {
+        data = data * 10 + c - '0';
+      } else if (c == '|' || !c) {
+        while (data)
+        {
+          int i = 3;
+          while (i && this->tmpl_len < MAX_TELEGRAM_SIZE) {
+            area_info_t *g = &last_group[lg_i];
+            lg_i = (lg_i + 1) % 3;
+            if (state == GROUP_INC_STATE)
+              ++g->i;
+            else
+              --g->i;
+            add_color_slot(this, g);
+            --i;
+          }
+          --data;
+        }
+        m = this->tmpl + this->tmpl_len;
+        state = START_STATE;
+      } else
+        err = SYNTAX_ERR;
+      break;
+
+    case CRC_STATE:
+      switch (c)
+      {
+      case 'x':
+      case 'X':
+        crc_mode = XOR_CRC_MODE;
+        break;
+      case '|':
+      case 0:
+        if (crc_mode == ERR_CRC_MODE)
+          err = CRC_MODE_ERR;
+        else
+        {
+          this->crc_pos = m - this->tmpl;
+          ++m;
+          state = START_STATE;
+        }
+        break;
+      default:
+        err = SYNTAX_ERR;
+      }
+      break;
+
+	case DEC_CONST_STATE:
+      if (c >= '0' && c <= '9') {
+        data = data * 10 + c - '0';
+        if (data > 255)
+          err = DATA_ERR;
+      } else if (c == '*') {
+        *m = data;
+        data = 0;
+        state = BYTE_REPEAT_STATE;
+      } else if (c == '/') {
+        *m = data;
+        data = 0;
+        state = BYTE_FILLUP_STATE;
+      } else if (c == '|' || !c) {
+        *m++ = data;
+        state = START_STATE;
+      } else
+        err = SYNTAX_ERR;
+      break;
+
+    case HEX_CONST_STATE:
+      if (c >= '0' && c <= '9') {
+        data = data * 16 + c - '0';
+        if (data > 255)
+          err = DATA_ERR;
+      } else if (c >= 'a' && c <= 'f') {
+        data = data * 16 + c - 'a' + 10;
+        if (data > 255)
+          err = DATA_ERR;
+      } else if (c >= 'A' && c <= 'F') {
+        data = data * 16 + c - 'A' + 10;
+        if (data > 255)
+          err = DATA_ERR;
+      } else if (c == '*') {
+        *m = data;
+        data = 0;
+        state = BYTE_REPEAT_STATE;
+      } else if (c == '/') {
+        *m = data;
+        data = 0;
+        state = BYTE_FILLUP_STATE;
+      } else if (c == '|' || !c) {
+        *m++ = data;
+        state = START_STATE;
+      } else
+        err = SYNTAX_ERR;
+      break;
+
+    case BYTE_REPEAT_STATE:
+      if (c >= '0' && c <= '9') {
+        data = data * 10 + c - '0';
+        if (((m - this->tmpl) + data) > MAX_TELEGRAM_SIZE)
+          err = LENGTH_ERR;
+      } else if (c == '|' || !c) {
+        uint8_t lc = *m;
+        while (data--)
+          *m++ = lc;
+        state = START_STATE;
+      } else
+        err = SYNTAX_ERR;
+      break;
+
+    case BYTE_FILLUP_STATE:
+      if (c >= '0' && c <= '9') {
+        data = data * 10 + c - '0';
+        if (data > MAX_TELEGRAM_SIZE)
+          err = LENGTH_ERR;
+      } else if (c == '|' || !c) {
+        uint8_t lc = *m;
+        while ((m - this->tmpl) < data)
+          *m++ = lc;
+        state = START_STATE;
+      } else
+        err = SYNTAX_ERR;
+      break;
+
+    case AREA_STATE:
+      area_num = 0;
+      state = AREA_NUM_STATE;
+      switch (c) {
+      case 't':
+      case 'T':
+        area = TOP_AREA;
+        break;
+      case 'b':
+      case 'B':
+        area = BOTTOM_AREA;
+        break;
+      case 'l':
+      case 'L':
+        area = LEFT_AREA;
+        break;
+      case 'r':
+      case 'R':
+        area = RIGHT_AREA;
+        break;
+      case 'c':
+      case 'C':
+        area = CENTER_AREA;
+        break;
+      default:
+        err = SYNTAX_ERR;
+      }
+      break;
+
+    case AREA_NUM_STATE:
+      switch (c) {
+      case 'l':
+      case 'L':
+        switch (area) {
+        case TOP_AREA:
+          area = TOP_LEFT_AREA;
+          break;
+        case BOTTOM_AREA:
+          area = BOTTOM_LEFT_AREA;
+          break;
+        default:
+          err = SYNTAX_ERR;
+        }
+        break;
+
+      case 'r':
+      case 'R':
+        switch (area) {
+        case TOP_AREA:
+          area = TOP_RIGHT_AREA;
+          break;
+        case BOTTOM_AREA:
+          area = BOTTOM_RIGHT_AREA;
+          break;
+        default:
+          err = SYNTAX_ERR;
+        }
+        break;
+
+      default:
+        if (c >= '0' && c <= '9')
+          area_num = area_num * 10 + c - '0';
+        else if (c == '|' || !c) {
+          int n, i;
+          area_info_t *g = &last_group[lg_i];
+          switch (area) {
+          case TOP_AREA:
+            i = 0;
+            n = this->param.top;
+            break;
+          case BOTTOM_AREA:
+            i = this->param.top;
+            n = this->param.bottom;
+            break;
+          case LEFT_AREA:
+            i = this->param.top + this->param.bottom;
+            n = this->param.left;
+            break;
+          case RIGHT_AREA:
+            i = this->param.top + this->param.bottom + this->param.left;
+            n = this->param.right;
+            break;
+          case CENTER_AREA:
+            i = this->param.top + this->param.bottom + this->param.left + this->param.right;
+            n = this->param.center;
+            break;
+          case TOP_LEFT_AREA:
+            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center;
+            n = this->param.top_left;
+            break;
+          case TOP_RIGHT_AREA:
+            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center + this->param.top_left;
+            n = this->param.top_right;
+            break;
+          case BOTTOM_LEFT_AREA:
+            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center + this->param.top_left + this->param.top_right;
+            n = this->param.bottom_left;
+            break;
+          default:
+            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center + this->param.top_left + this->param.top_right + this->param.bottom_left;
+            n = this->param.bottom_right;
+          }
+          if (area_num)
+            --area_num;
+          g->min = i;
+          g->max = i + n;
+          i += area_num;
+          g->i = i;
+          g->color = color;
+          this->tmpl_len = m - this->tmpl;
+          add_color_slot(this, g);
+          m = this->tmpl + this->tmpl_len;
+          lg_i = (lg_i + 1) % 3;
+          state = START_STATE;
+        } else
+          err = SYNTAX_ERR;
+      }
+    }
+
+    this->tmpl_len = m - this->tmpl;
+
+    if (!c) {
+      if (state != START_STATE)
+        err = SYNTAX_ERR;
+      break;
+    }
+
+    if (this->tmpl_len > MAX_TELEGRAM_SIZE)
+      err = LENGTH_ERR;
+  }
+
+  if (err != NO_ERR) {
+    switch (err) {
+    case SYNTAX_ERR:
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "protocol syntax error at position: %d", (int)(p - this->protocol));
+      break;
+    case DATA_ERR:
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "bad data byte value: %d", data);
+      break;
+    case LENGTH_ERR:
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "message to long");
+      break;
+    case CRC_MODE_ERR:
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "missing crc mode");
+    }
+    FREE_AND_SET_NULL(this->tmpl);
+    FREE_AND_SET_NULL(this->slots);
+    this->tmpl_len = 0;
+    this->num_slots = 0;
+    return -1;
+  }
+
+  this->tmpl = (uint8_t *) realloc(this->tmpl, this->tmpl_len + 1);
+  this->slots = (proto_slot_t *) realloc(this->slots, (this->num_slots + 1) * sizeof(proto_slot_t));
+  this->msg = (uint8_t *) malloc(this->tmpl_len + (this->escapes ? this->num_slots: 0) + 1);
+  if (this->msg == NULL) {
+    strcpy(this->output_driver.errmsg, "allocating telegram buffer failed");
+    return -1;
+  }
+
+    // Checksum of constant part of telegram is calculated only once
+  this->tmpl_crc = 0;
+  for (i = 0; i < this->tmpl_len; ++i) {
+    if (i != this->crc_pos)
+      this->tmpl_crc ^= this->tmpl[i];
+  }
+
+  memset(this->escape_tab, 0, sizeof(this->escape_tab));
+  if (this->escapes) {
+    for (i = 0; i < this->escapes[1]; ++i)
+      this->escape_tab[this->escapes[2 + i]] = 1;
+  }
+
+    // Without escaping the telegram buffer keeps the constant values, only color values are written per frame
+  memcpy(this->msg, this->tmpl, this->tmpl_len);
+
+  DFATMO_LOG(DFLOG_INFO, "serial protocol compiled: %d bytes, %d color values", this->tmpl_len, this->num_slots);
+  return 0;
+}
+
+
+static inline uint8_t slot_color_value(const proto_slot_t *slot, const rgb_color_t *colors) {
+  const rgb_color_t *c;
+  if (slot->channel < 0)
+    return 0;
+  c = &colors[slot->channel];
+  return (slot->color == COLOR_RED) ? c->r: ((slot->color == COLOR_GREEN) ? c->g: c->b);
+}
+
+
+  /* Build telegram for colors in 'msg' and return length of telegram */
+static int build_telegram(serial_output_driver_t *this, rgb_color_t *colors) {
+  const proto_slot_t *slot = this->slots;
+  const proto_slot_t *slot_end = slot + this->num_slots;
+  uint8_t *msg = this->msg;
+  uint8_t crc = this->tmpl_crc;
+  int len;
+
+  if (!this->escapes) {
+      // Fast path: color values have fixed positions within telegram
+    while (slot < slot_end) {
+      uint8_t v = slot_color_value(slot, colors);
+      msg[slot->pos] = v;
+      crc ^= v;
+      ++slot;
+    }
+    if (this->crc_pos >= 0)
+      msg[this->crc_pos] = crc;
+    len = this->tmpl_len;
+  } else {
+      // Escaped color values shift the following bytes of telegram
+    uint8_t *m = msg;
+    int tpos = 0, crc_pos = -1;
+    while (slot < slot_end) {
+      uint8_t v = slot_color_value(slot, colors);
+      int n = slot->pos - tpos;
+      if (this->crc_pos >= tpos && this->crc_pos < slot->pos)
+        crc_pos = (m - msg) + (this->crc_pos - tpos);
+      memcpy(m, this->tmpl + tpos, n);
+      m += n;
+      if (this->escape_tab[v]) {
+        *m++ = this->escapes[0];
+        crc ^= this->escapes[0];
+      }
+      *m++ = v;
+      crc ^= v;
+      tpos = slot->pos + 1;
+      ++slot;
+    }
+    if (this->crc_pos >= tpos)
+      crc_pos = (m - msg) + (this->crc_pos - tpos);
+    memcpy(m, this->tmpl + tpos, this->tmpl_len - tpos);
+    m += this->tmpl_len - tpos;
+    if (crc_pos >= 0)
+      msg[crc_pos] = crc;
+    len = m - msg;
+  }
+
+  if (this->fletcher_start >= 0) {
+      // Fletcher checksum of AWA protocol over LED data with additional position dependent sum
+    uint16_t f1 = 0, f2 = 0, fext = 0;
+    uint8_t position = 0;
+    const uint8_t *d = msg + this->fletcher_start;
+    const uint8_t *e = msg + len - 3;
+    while (d < e) {
+      fext = (fext + (*d ^ position++)) % 255;
+      f1 = (f1 + *d++) % 255;
+      f2 = (f2 + f1) % 255;
+    }
+    msg[len - 3] = (uint8_t)f1;
+    msg[len - 2] = (uint8_t)f2;
+    msg[len - 1] = (uint8_t)((fext != 0x41) ? fext: 0xAA);
+  }
+  return len;
+}
+
+
+static uint32_t time_ms(void) {
+#ifdef WIN32
+  return GetTickCount();
+#else
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return (uint32_t)(tv.tv_sec * 1000 + tv.tv_usec / 1000);
+#endif
+}
+
+
+  /* Maximum number of telegrams per second the serial line could transmit (1 start, 8 data, 2 stop bits) */
+static double max_telegram_rate(serial_output_driver_t *this, int len) {
+  return (len > 0) ? (double)this->baud / (11.0 * len): 0.0;
+}
+
+
+/*
+ * Throughput self test: Send a number of black telegrams as fast as possible and
+ * report the achieved telegrams per second.
+ */
+static int serial_selftest(serial_output_driver_t *this, int n) {
+  rgb_color_t *black = (rgb_color_t *) calloc(NUM_AREAS * MAX_BORDER_CHANNELS, sizeof(rgb_color_t));
+  dev_size_t len, written;
+  uint32_t start, elapsed;
+  int i, ok = 1;
+#ifdef ASYNC_OUTPUT
+  int flags = fcntl(this->devfd, F_GETFL);
+  fcntl(this->devfd, F_SETFL, flags & ~O_NONBLOCK);
+#endif
+
+  if (black == NULL) {
+    strcpy(this->output_driver.errmsg, "allocating self test buffer failed");
+    return -1;
+  }
+
+  len = (dev_size_t)build_telegram(this, black);
+  start = time_ms();
+  for (i = 0; i < n && ok; ++i)
+    ok = WRITE_DATA(this->devfd, this->msg, len, written);
+  if (ok)
+    ok = FLUSH_BUFFER(this->devfd);
+  elapsed = time_ms() - start;
+
+#ifdef ASYNC_OUTPUT
+  fcntl(this->devfd, F_SETFL, flags);
+#endif
+  free(black);
+
+  if (!ok) {
+    char buf[128];
+    GET_SYS_ERR_MSG(buf);
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "self test writing data to serial port failed: %.60s", buf);
+    return -1;
+  }
+
+  DFATMO_LOG(DFLOG_INFO, "self test: %d telegrams of %d bytes in %u ms, %.1f telegrams/s (line maximum %.1f telegrams/s)",
+               n, (int)len, elapsed, elapsed ? n * 1000.0 / elapsed: 0.0, max_telegram_rate(this, (int)len));
+  return 0;
+}
+
+
+#ifdef CUSTOM_SPEED
+static int set_custom_speed(dev_handle_t fd, int speed) {
+  struct termios2 tio2;
+
+  if (ioctl(fd, TCGETS2, &tio2) == -1)
+    return -1;
+  tio2.c_cflag &= ~CBAUD;
+  tio2.c_cflag |= BOTHER;
+  tio2.c_ispeed = speed;
+  tio2.c_ospeed = speed;
+  if (ioctl(fd, TCSETS2, &tio2) == -1)
+    return -1;
+
+    // Device may round to nearest possible baud rate
+  if (ioctl(fd, TCGETS2, &tio2) == 0 && (int)tio2.c_ospeed != speed)
+    DFATMO_LOG(DFLOG_INFO, "serial port speed %d is set to %d by device", speed, (int)tio2.c_ospeed);
+  return 0;
+}
+#endif
+
 
-static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
-  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
+  /* Open one serial port, its options are already copied to 'driver_param' */
+static int open_port(serial_output_driver_t *this, atmo_parameters_t *p) {
   const char *devname = NULL;
   const char *usb = NULL;
   const char *speed = NULL;
@@ -103,13 +812,18 @@ static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
   dev_handle_t devfd;
   dev_speed_t bspeed;
   int ok;
+  int selftest = 0;
+#ifdef CUSTOM_SPEED
+  int custom_speed = 0;
+#endif
 
   this->param = *p;
   this->devfd = INVALID_DEV_HANDLE;
   this->protocol = classic_proto;
+  this->strip_proto = STRIP_NONE;
+  this->strip_first = this->strip_last = 0;
 
   /* parse driver parameter */
-  strncpy(this->driver_param, this->param.driver_param, sizeof(this->driver_param));
   t = strtok_r(this->driver_param, ";&", &tp);
   while (t != NULL) {
     char *v = strchr(t, ':');
@@ -128,14 +842,27 @@ static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
           this->protocol = amblone_proto;
         else if (!strcmp(v, "karatelight"))
           this->protocol = karate_proto;
+        else if (!strcmp(v, "adalight"))
+          this->strip_proto = STRIP_ADALIGHT;
+        else if (!strcmp(v, "awa"))
+          this->strip_proto = STRIP_AWA;
         else
           this->protocol = v;
       } else if (!strcmp(t, "amblone")) {
           this->escapes = amblone_escapes;
-#ifdef WIN32
-	  } else if (!strcmp(t, "dmx")) {
-		  this->dmx = TRUE;
-#else
+      } else if (!strcmp(t, "range")) {
+        char *e;
+        this->strip_first = strtol(v, &e, 10) - 1;
+        this->strip_last = (*e == '-') ? atoi(e + 1): 0;
+        if (this->strip_first < 0 || (this->strip_last && this->strip_last <= this->strip_first)) {
+          snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "illegal LED range '%s'", v);
+          return -1;
+        }
+      } else if (!strcmp(t, "selftest")) {
+        selftest = atoi(v);
+      } else if (!strcmp(t, "dmx")) {
+        this->dmx = 1;
+#ifndef WIN32
       } else if (!strcmp(t, "usb")) {
         usb = v;
 #endif
@@ -147,6 +874,13 @@ static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
     t = strtok_r(NULL, ";&", &tp);
   }
 
+  if (compile_protocol(this))
+    return -1;
+  if (this->dmx && this->tmpl_len > DMX_MAX_TELEGRAM_SIZE) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "DMX telegram to long: %d bytes (maximum %d)", this->tmpl_len, DMX_MAX_TELEGRAM_SIZE);
+    return -1;
+  }
+
   if (usb == NULL && (devname == NULL || strspn(devname, " ") == strlen(devname)))
     devname = DEFAULT_PORT;
 
@@ -202,6 +936,8 @@ static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
   }
 
     /* configure serial port */
+  if (speed == NULL && this->dmx)
+    speed = "250000";
   if (speed == NULL) {
     speed = "38400";
     bspeed = SPEED_CONST(38400);
@@ -285,17 +1021,25 @@ static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
         snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "serial port device speed '%s' unsupported", speed);
         return -1;
       }
+#ifdef CUSTOM_SPEED
+      custom_speed = bspeed;
+      bspeed = SPEED_CONST(38400);
+#elif !defined(WIN32)
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "serial port device speed '%s' unsupported", speed);
+      return -1;
+#endif
     }
   }
 
+  this->baud = atoi(speed);
   DFATMO_LOG(DFLOG_INFO, "serial port speed: %s", speed);
 
 #ifdef WIN32
   {
 	LARGE_INTEGER freq;
 	if (this->dmx && QueryPerformanceFrequency(&freq)) {
-		this->dmx_break_duration.QuadPart = 100 * freq.QuadPart / 1000000;	// 100us break duration
-		this->dmx_mark_duration.QuadPart = 10 * freq.QuadPart / 1000000;	// 10us mark after break duration
+		this->dmx_break_duration.QuadPart = DMX_BREAK_DURATION * freq.QuadPart / 1000000;
+		this->dmx_mark_duration.QuadPart = DMX_MARK_DURATION * freq.QuadPart / 1000000;
 	}
 
     DCB dcbSerialParams = {0};
@@ -316,6 +1060,10 @@ static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
   tio.c_cflag = (CS8 | CSTOPB | CLOCAL);
   cfsetospeed(&tio, bspeed);
   ok = (tcsetattr(devfd, TCSANOW, &tio) == 0);
+#ifdef CUSTOM_SPEED
+  if (ok && custom_speed)
+    ok = (set_custom_speed(devfd, custom_speed) == 0);
+#endif
   if (ok)
     tcflush(devfd, TCIOFLUSH);
 #endif
@@ -327,442 +1075,390 @@ static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
   }
 
   this->devfd = devfd;
-  return 0;
-}
-
-
-static int serial_driver_configure(output_driver_t *this_gen, atmo_parameters_t *p) {
-  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
-  this->param = *p;
-  return 0;
-}
-
-
-static int serial_driver_close(output_driver_t *this_gen) {
-  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
-
-  if (this->devfd != INVALID_DEV_HANDLE) {
-    CLOSE_DEVICE(this->devfd);
+  DFATMO_LOG(DFLOG_INFO, "telegram size: %d bytes, line maximum: %.1f telegrams/s", this->tmpl_len, max_telegram_rate(this, this->tmpl_len));
+  if (selftest > 0 && serial_selftest(this, selftest)) {
+    CLOSE_DEVICE(devfd);
     this->devfd = INVALID_DEV_HANDLE;
+    return -1;
   }
+#ifdef ASYNC_OUTPUT
+  this->tx_len = this->tx_pos = 0;
+  this->pending_len = 0;
+  this->send_cnt = this->coalesced_cnt = this->dropped_cnt = 0;
+  this->dmx_frame_cnt = 0;
+  this->dmx_idle_time = 0;
+#endif
   return 0;
 }
 
 
-static void serial_driver_dispose(output_driver_t *this_gen) {
-  free(this_gen);
-}
+static serial_output_driver_t *new_serial_driver(void);
+static int serial_driver_close(output_driver_t *this_gen);
+static void serial_driver_dispose(output_driver_t *this_gen);
 
 
-enum { COLOR_RED, COLOR_GREEN, COLOR_BLUE };
-typedef struct { int i, color, max, min; } area_info_t;
+  /* Copy error of additional port to driver */
+static void port_error(serial_output_driver_t *this, serial_output_driver_t *port, int port_num) {
+  char buf[sizeof(this->output_driver.errmsg)];
+  if (port != this) {
+    strcpy(buf, port->output_driver.errmsg);
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "port %d: %s", port_num, buf);
+  }
+}
 
-static uint8_t* insert_color_value(serial_output_driver_t *this, rgb_color_t *colors, area_info_t *g, uint8_t *m) {
-  uint8_t v = 0;
 
-  if (g->i >= g->min && g->i < g->max) {
-    switch (g->color) {
-    case COLOR_RED:
-      v = colors[g->i].r;
-      break;
-    case COLOR_GREEN:
-      v = colors[g->i].g;
-      break;
-    default:
-      v = colors[g->i].b;
+/*
+ * Open all serial ports. Driver parameter could contain several ports separated by ','
+ * each with its own options, protocol and LED range. Every additional port is handled
+ * by a chained driver instance. All ports are written in the same output cycle.
+ */
+static int serial_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
+  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
+  serial_output_driver_t *port = this, **next = &this->next_port;
+  const char *s = p->driver_param;
+  int port_num = 1;
+
+  for (;;) {
+    const char *e = strchr(s, ',');
+    int len = (e != NULL) ? e - s: (int)strlen(s);
+
+    memcpy(port->driver_param, s, len);
+    port->driver_param[len] = 0;
+    if (open_port(port, p)) {
+      port_error(this, port, port_num);
+      serial_driver_close(this_gen);
+      return -1;
     }
-  }
+    if (e == NULL)
+      break;
 
-  if (this->escapes) {
-    int n = this->escapes[1];
-    const uint8_t *p = &this->escapes[2];
-    while (n) {
-      if (v == *p) {
-        *m++ = this->escapes[0];
-        break;
-      }
-      ++p;
-      --n;
+    s = e + 1;
+    if (++port_num > MAX_SERIAL_PORTS) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "too many serial ports (maximum %d)", MAX_SERIAL_PORTS);
+      serial_driver_close(this_gen);
+      return -1;
     }
+    port = new_serial_driver();
+    if (port == NULL) {
+      strcpy(this->output_driver.errmsg, "allocating serial port failed");
+      serial_driver_close(this_gen);
+      return -1;
+    }
+    *next = port;
+    next = &port->next_port;
   }
 
-  *m++ = v;
-
-  return m;
+  if (port_num > 1)
+    DFATMO_LOG(DFLOG_INFO, "%d serial ports opened", port_num);
+  return 0;
 }
 
 
-static int serial_driver_output_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+static int serial_driver_configure(output_driver_t *this_gen, atmo_parameters_t *p) {
   serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
-  uint8_t msg[SIZE_TELEGRAM_BUF+1];
-  uint8_t *m = msg;
-  int data = 0, area = 0, area_num = 0, color = 0;
-  const char *p = this->protocol;
-  dev_size_t len, written;
-  enum { TOP_AREA, BOTTOM_AREA, LEFT_AREA, RIGHT_AREA, CENTER_AREA, TOP_LEFT_AREA, TOP_RIGHT_AREA, BOTTOM_LEFT_AREA, BOTTOM_RIGHT_AREA };
-  enum { START_STATE, DEC_CONST_STATE, HEX_CONST_STATE, AREA_STATE, AREA_NUM_STATE, CRC_STATE, BYTE_REPEAT_STATE, BYTE_FILLUP_STATE, GROUP_INC_STATE, GROUP_DEC_STATE };
-  enum { NO_ERR, SYNTAX_ERR, DATA_ERR, LENGTH_ERR, CRC_MODE_ERR };
-  enum { ERR_CRC_MODE, XOR_CRC_MODE };
-  int state = START_STATE;
-  int err = NO_ERR;
-  int crc_mode = ERR_CRC_MODE;
-  uint8_t *crc_pos = NULL;
-  area_info_t last_group[3];
-  int lg_i = 0;
+  serial_output_driver_t *port;
+  int port_num = 1;
 
-  if (this->devfd == INVALID_DEV_HANDLE)
-    return -1;
+  for (port = this; port != NULL; port = port->next_port, ++port_num) {
+    port->param = *p;
+    if (compile_protocol(port)) {
+      port_error(this, port, port_num);
+      return -1;
+    }
+  }
+  return 0;
+}
 
-  memset(last_group, 0, sizeof(last_group));
 
-  /* parse protocol descriptor and build data packet */
-  while (err == NO_ERR) {
-    int c = *p++;
+static void close_port(serial_output_driver_t *this) {
+  if (this->devfd != INVALID_DEV_HANDLE) {
+    CLOSE_DEVICE(this->devfd);
+    this->devfd = INVALID_DEV_HANDLE;
+#ifdef ASYNC_OUTPUT
+    DFATMO_LOG(DFLOG_INFO, "%u telegrams send, %u coalesced, %u dropped", this->send_cnt, this->coalesced_cnt, this->dropped_cnt);
+    if (this->dmx_frame_cnt) {
+      uint64_t t = this->dmx_last_frame - this->dmx_first_frame;
+      DFATMO_LOG(DFLOG_INFO, "DMX: %u frames, %.1f frames/s, break %u/%u/%u us, mark after break %u/%u/%u us (min/avg/max)", this->dmx_frame_cnt,
+                   (t && this->dmx_frame_cnt > 1) ? (this->dmx_frame_cnt - 1) * 1000000.0 / t: 0.0,
+                   this->dmx_break_min, (uint32_t)(this->dmx_break_sum / this->dmx_frame_cnt), this->dmx_break_max,
+                   this->dmx_mark_min, (uint32_t)(this->dmx_mark_sum / this->dmx_frame_cnt), this->dmx_mark_max);
+    }
+#endif
+  }
+}
 
-    switch (state) {
-    case START_STATE:
-      switch (c) {
-      case 0:
-        break;
-      case 'x':
-      case 'X':
-        data = 0;
-        state = HEX_CONST_STATE;
-        break;
-      case 'r':
-      case 'R':
-        color = COLOR_RED;
-        state = AREA_STATE;
-        break;
-      case 'g':
-      case 'G':
-        color = COLOR_GREEN;
-        state = AREA_STATE;
-        break;
-      case 'b':
-      case 'B':
-        color = COLOR_BLUE;
-        state = AREA_STATE;
-        break;
-      case 'c':
-      case 'C':
-        state = CRC_STATE;
-        break;
-      case '+':
-        data = 0;
-        state = GROUP_INC_STATE;
-        break;
-      case '-':
-        data = 0;
-        state = GROUP_DEC_STATE;
-        break;
-      default:
-        if (c >= '0' && c <= '9') {
-          data = c - '0';
-          state = DEC_CONST_STATE;
-        } else
-          err = SYNTAX_ERR;
-      }
-      break;
 
-    case GROUP_INC_STATE:
-      if (c >= '0' && c <= '9') {
-        data = data * 10 + c - '0';
-      } else if (c == '|' || !c) {
-        while (data)
-        {
-          int i = 3;
-          while (i && (m - msg) < SIZE_TELEGRAM_BUF) {
-            area_info_t *g = &last_group[lg_i];
-            lg_i = (lg_i + 1) % 3;
-            ++g->i;
-            m = insert_color_value(this, colors, g, m);
-            --i;
-          }
-          --data;
-        }
-        state = START_STATE;
-      } else
-        err = SYNTAX_ERR;
-      break;
+static int serial_driver_close(output_driver_t *this_gen) {
+  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
 
-    case GROUP_DEC_STATE:
-      if (c >= '0' && c <= '9') {
-        data = data * 10 + c - '0';
-      } else if (c == '|' || !c) {
-        while (data)
-        {
-          int i = 3;
-          while (i && (m - msg) < SIZE_TELEGRAM_BUF) {
-            area_info_t *g = &last_group[lg_i];
-            lg_i = (lg_i + 1) % 3;
-            --g->i;
-            m = insert_color_value(this, colors, g, m);
-            --i;
-          }
-          --data;
-        }
-        state = START_STATE;
-      } else
-        err = SYNTAX_ERR;
-      break;
+  close_port(this);
+  if (this->next_port != NULL) {
+    serial_driver_close(&this->next_port->output_driver);
+    serial_driver_dispose(&this->next_port->output_driver);
+    this->next_port = NULL;
+  }
+  return 0;
+}
 
-    case CRC_STATE:
-      switch (c)
-      {
-      case 'x':
-      case 'X':
-        crc_mode = XOR_CRC_MODE;
-        break;
-      case '|':
-      case 0:
-        if (crc_mode == ERR_CRC_MODE)
-          err = CRC_MODE_ERR;
-        else
-        {
-          crc_pos = m++;
-          state = START_STATE;
-        }
-        break;
-      default:
-        err = SYNTAX_ERR;
-      }
-      break;
 
-	case DEC_CONST_STATE:
-      if (c >= '0' && c <= '9') {
-        data = data * 10 + c - '0';
-        if (data > 255)
-          err = DATA_ERR;
-      } else if (c == '*') {
-        *m = data;
-        data = 0;
-        state = BYTE_REPEAT_STATE;
-      } else if (c == '/') {
-        *m = data;
-        data = 0;
-        state = BYTE_FILLUP_STATE;
-      } else if (c == '|' || !c) {
-        *m++ = data;
-        state = START_STATE;
-      } else
-        err = SYNTAX_ERR;
-      break;
+static void serial_driver_dispose(output_driver_t *this_gen) {
+  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
+  if (this->next_port != NULL)
+    serial_driver_dispose(&this->next_port->output_driver);
+  free(this->tmpl);
+  free(this->slots);
+  free(this->msg);
+#ifdef ASYNC_OUTPUT
+  free(this->tx);
+#endif
+  free(this);
+}
 
-    case HEX_CONST_STATE:
-      if (c >= '0' && c <= '9') {
-        data = data * 16 + c - '0';
-        if (data > 255)
-          err = DATA_ERR;
-      } else if (c >= 'a' && c <= 'f') {
-        data = data * 16 + c - 'a' + 10;
-        if (data > 255)
-          err = DATA_ERR;
-      } else if (c >= 'A' && c <= 'F') {
-        data = data * 16 + c - 'A' + 10;
-        if (data > 255)
-          err = DATA_ERR;
-      } else if (c == '*') {
-        *m = data;
-        data = 0;
-        state = BYTE_REPEAT_STATE;
-      } else if (c == '/') {
-        *m = data;
-        data = 0;
-        state = BYTE_FILLUP_STATE;
-      } else if (c == '|' || !c) {
-        *m++ = data;
-        state = START_STATE;
-      } else
-        err = SYNTAX_ERR;
-      break;
 
-    case BYTE_REPEAT_STATE:
-      if (c >= '0' && c <= '9') {
-        data = data * 10 + c - '0';
-        if (((m - msg) + data) > SIZE_TELEGRAM_BUF)
-          err = LENGTH_ERR;
-      } else if (c == '|' || !c) {
-        uint8_t lc = *m;
-        while (data--)
-          *m++ = lc;
-        state = START_STATE;
-      } else
-        err = SYNTAX_ERR;
-      break;
+#ifdef ASYNC_OUTPUT
+/*
+ * Asynchronous output: The device is opened in non blocking mode. A new telegram is only written
+ * if the previous one has left the output queue of the kernel. Otherwise the telegram waits for output
+ * and is replaced by newer telegrams ("newest frame wins"). So the output rate is never limited by the UART.
+ */
 
-    case BYTE_FILLUP_STATE:
-      if (c >= '0' && c <= '9') {
-        data = data * 10 + c - '0';
-        if (data > SIZE_TELEGRAM_BUF)
-          err = LENGTH_ERR;
-      } else if (c == '|' || !c) {
-        uint8_t lc = *m;
-        while ((m - msg) < data)
-          *m++ = lc;
-        state = START_STATE;
-      } else
-        err = SYNTAX_ERR;
-      break;
+static uint64_t time_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-    case AREA_STATE:
-      area_num = 0;
-      state = AREA_NUM_STATE;
-      switch (c) {
-      case 't':
-      case 'T':
-        area = TOP_AREA;
-        break;
-      case 'b':
-      case 'B':
-        area = BOTTOM_AREA;
-        break;
-      case 'l':
-      case 'L':
-        area = LEFT_AREA;
-        break;
-      case 'r':
-      case 'R':
-        area = RIGHT_AREA;
-        break;
-      case 'c':
-      case 'C':
-        area = CENTER_AREA;
-        break;
-      default:
-        err = SYNTAX_ERR;
-      }
-      break;
 
-    case AREA_NUM_STATE:
-      switch (c) {
-      case 'l':
-      case 'L':
-        switch (area) {
-        case TOP_AREA:
-          area = TOP_LEFT_AREA;
-          break;
-        case BOTTOM_AREA:
-          area = BOTTOM_LEFT_AREA;
-          break;
-        default:
-          err = SYNTAX_ERR;
-        }
+  /* Write rest of current telegram as far as possible without blocking */
+static int write_telegram(serial_output_driver_t *this) {
+  while (this->tx_pos < this->tx_len) {
+    ssize_t n = write(this->devfd, this->tx + this->tx_pos, this->tx_len - this->tx_pos);
+    if (n < 0) {
+      char buf[128];
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK)
         break;
+      GET_SYS_ERR_MSG(buf);
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "writing data to serial port failed: %.60s", buf);
+      return -1;
+    }
+    this->tx_pos += n;
+      // An empty output queue does not mean an idle line, the FIFO of the UART or USB adapter can hold the whole telegram
+    if (this->dmx && this->tx_pos == this->tx_len && this->baud > 0)
+      this->dmx_idle_time = time_us() + (uint64_t)this->tx_len * 11 * 1000000 / this->baud;
+  }
+  return 0;
+}
 
-      case 'r':
-      case 'R':
-        switch (area) {
-        case TOP_AREA:
-          area = TOP_RIGHT_AREA;
-          break;
-        case BOTTOM_AREA:
-          area = BOTTOM_RIGHT_AREA;
-          break;
-        default:
-          err = SYNTAX_ERR;
-        }
-        break;
 
-      default:
-        if (c >= '0' && c <= '9')
-          area_num = area_num * 10 + c - '0';
-        else if (c == '|' || !c) {
-          int n, i;
-          area_info_t *g = &last_group[lg_i];
-          switch (area) {
-          case TOP_AREA:
-            i = 0;
-            n = this->param.top;
-            break;
-          case BOTTOM_AREA:
-            i = this->param.top;
-            n = this->param.bottom;
-            break;
-          case LEFT_AREA:
-            i = this->param.top + this->param.bottom;
-            n = this->param.left;
-            break;
-          case RIGHT_AREA:
-            i = this->param.top + this->param.bottom + this->param.left;
-            n = this->param.right;
-            break;
-          case CENTER_AREA:
-            i = this->param.top + this->param.bottom + this->param.left + this->param.right;
-            n = this->param.center;
-            break;
-          case TOP_LEFT_AREA:
-            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center;
-            n = this->param.top_left;
-            break;
-          case TOP_RIGHT_AREA:
-            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center + this->param.top_left;
-            n = this->param.top_right;
-            break;
-          case BOTTOM_LEFT_AREA:
-            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center + this->param.top_left + this->param.top_right;
-            n = this->param.bottom_left;
-            break;
-          default:
-            i = this->param.top + this->param.bottom + this->param.left + this->param.right + this->param.center + this->param.top_left + this->param.top_right + this->param.bottom_left;
-            n = this->param.bottom_right;
-          }
-          if (area_num)
-            --area_num;
-          g->min = i;
-          g->max = i + n;
-          i += area_num;
-          g->i = i;
-          g->color = color;
-          m = insert_color_value(this, colors, g, m);
-          lg_i = (lg_i + 1) % 3;
-          state = START_STATE;
-        } else
-          err = SYNTAX_ERR;
-      }
-    }
+static void sleep_us(uint32_t us) {
+  struct timespec ts;
+  ts.tv_sec = us / 1000000;
+  ts.tv_nsec = (us % 1000000) * 1000;
+  while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+    ;
+}
 
-    if (!c) {
-      if (state != START_STATE)
-        err = SYNTAX_ERR;
-      break;
-    }
 
-    if ((m - msg) > SIZE_TELEGRAM_BUF)
-      err = LENGTH_ERR;
+/*
+ * Generate DMX break and mark after break. The line is held in break state by the UART
+ * while the thread sleeps, so no CPU time is burned in busy waits. Sleeping could only
+ * lengthen break and mark which is allowed by DMX512. Achieved timing is measured.
+ */
+static int dmx_break(serial_output_driver_t *this) {
+  uint64_t t0, t1, t2;
+  uint32_t brk, mark;
+
+    // Break would cut off last slots of previous telegram
+  t0 = time_us();
+  if (t0 < this->dmx_idle_time) {
+    sleep_us((uint32_t)(this->dmx_idle_time - t0));
+    t0 = time_us();
+  }
+  if (ioctl(this->devfd, TIOCSBRK, 0) == -1) {
+    char buf[128];
+    GET_SYS_ERR_MSG(buf);
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "setting comm break failed: %.60s", buf);
+    return -1;
+  }
+  sleep_us(DMX_BREAK_DURATION);
+  if (ioctl(this->devfd, TIOCCBRK, 0) == -1) {
+    char buf[128];
+    GET_SYS_ERR_MSG(buf);
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "clearing comm break failed: %.60s", buf);
+    return -1;
+  }
+  t1 = time_us();
+  sleep_us(DMX_MARK_DURATION);
+  t2 = time_us();
+
+  brk = (uint32_t)(t1 - t0);
+  mark = (uint32_t)(t2 - t1);
+  if (!this->dmx_frame_cnt) {
+    this->dmx_break_min = this->dmx_break_max = brk;
+    this->dmx_mark_min = this->dmx_mark_max = mark;
+    this->dmx_break_sum = this->dmx_mark_sum = 0;
+    this->dmx_first_frame = t0;
   }
+  if (brk < this->dmx_break_min)
+    this->dmx_break_min = brk;
+  if (brk > this->dmx_break_max)
+    this->dmx_break_max = brk;
+  if (mark < this->dmx_mark_min)
+    this->dmx_mark_min = mark;
+  if (mark > this->dmx_mark_max)
+    this->dmx_mark_max = mark;
+  this->dmx_break_sum += brk;
+  this->dmx_mark_sum += mark;
+  this->dmx_last_frame = t0;
+  ++this->dmx_frame_cnt;
+  return 0;
+}
 
-  if (err != NO_ERR) {
-    switch (err) {
-    case SYNTAX_ERR:
-      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "protocol syntax error at position: %d", (int)(p - this->protocol));
-      break;
-    case DATA_ERR:
-      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "bad data byte value: %d", data);
-      break;
-    case LENGTH_ERR:
-      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "message to long");
-      break;
-    case CRC_MODE_ERR:
-      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "missing crc mode");
+
+static int start_telegram(serial_output_driver_t *this, int len) {
+  if (this->dmx && dmx_break(this))
+    return -1;
+  if (len > this->tx_size) {
+    uint8_t *tx = (uint8_t *) realloc(this->tx, len);
+    if (tx == NULL) {
+      strcpy(this->output_driver.errmsg, "allocating telegram buffer failed");
+      return -1;
     }
+    this->tx = tx;
+    this->tx_size = len;
+  }
+  memcpy(this->tx, this->msg, len);
+  this->tx_len = len;
+  this->tx_pos = 0;
+  this->pending_len = 0;
+  ++this->send_cnt;
+  return write_telegram(this);
+}
+
+
+  /*
+   * Device is busy as long as the current telegram is not completely in the output queue or the queue is not empty.
+   * DMX break must not start before the last stop bit has left the line, most USB serial drivers do not
+   * support TIOCSERGETLSR so the transmission time of the telegram is waited at least.
+   */
+static int device_busy(serial_output_driver_t *this) {
+  int queued = 0;
+  if (this->tx_pos < this->tx_len)
+    return 1;
+  if (this->dmx && time_us() < this->dmx_idle_time)
+    return 1;
+  if (ioctl(this->devfd, TIOCOUTQ, &queued) == -1)
+    return 0;
+  if (queued > 0)
+    return 1;
+#ifdef TIOCSERGETLSR
+  if (this->dmx) {
+    unsigned int lsr = 0;
+    if (ioctl(this->devfd, TIOCSERGETLSR, &lsr) == 0 && !(lsr & TIOCSER_TEMT))
+      return 1;
+  }
+#endif
+  return 0;
+}
+
+
+static int submit_port(serial_output_driver_t *this, rgb_color_t *colors) {
+  int len;
+
+  if (this->devfd == INVALID_DEV_HANDLE)
+    return -1;
+
+  if (write_telegram(this))
     return -1;
+
+  len = build_telegram(this, colors);
+  if (device_busy(this)) {
+    if (this->pending_len)
+      ++this->dropped_cnt;
+    this->pending_len = len;
+    return 0;
   }
+  return start_telegram(this, len);
+}
 
-  if (crc_pos != NULL)
-  {
-    uint8_t *v = msg;
-    uint8_t crc = 0;
-    while (v < m)
-    {
-      if (v != crc_pos)
-        crc ^= *v;
-      ++v;
+
+  /* Continue output of port without blocking, returns 1 if port is still busy */
+static int pump_port(serial_output_driver_t *this) {
+  if (this->devfd == INVALID_DEV_HANDLE)
+    return -1;
+
+  for (;;) {
+    if (write_telegram(this))
+      return -1;
+    if (device_busy(this))
+      return 1;
+    if (!this->pending_len)
+      return 0;
+    ++this->coalesced_cnt;
+    if (start_telegram(this, this->pending_len))
+      return -1;
+  }
+}
+
+
+  /* New colors are submitted to all ports in the same output cycle */
+static int serial_driver_submit_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
+  serial_output_driver_t *port;
+  int port_num = 1;
+
+  for (port = this; port != NULL; port = port->next_port, ++port_num) {
+    if (submit_port(port, colors)) {
+      port_error(this, port, port_num);
+      return -1;
     }
-    *crc_pos = crc;
   }
+  return 0;
+}
+
+
+static int serial_driver_poll_colors(output_driver_t *this_gen, int timeout_ms) {
+  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
+  serial_output_driver_t *port;
+  struct timeval start, now, elapsed;
+
+  gettimeofday(&start, NULL);
+  for (;;) {
+    int remaining, busy = 0, port_num = 1;
+
+    for (port = this; port != NULL; port = port->next_port, ++port_num) {
+      int rc = pump_port(port);
+      if (rc < 0) {
+        port_error(this, port, port_num);
+        return -1;
+      }
+      busy |= rc;
+    }
+    if (!busy)
+      return 0;
+
+    gettimeofday(&now, NULL);
+    timersub(&now, &start, &elapsed);
+    remaining = timeout_ms - (int)(elapsed.tv_sec * 1000 + elapsed.tv_usec / 1000);
+    if (remaining <= 0)
+      return 1;
+    usleep((remaining > 1) ? 1000: remaining * 1000);
+  }
+}
+#endif
+
+
+#ifndef ASYNC_OUTPUT
+static int output_port(serial_output_driver_t *this, rgb_color_t *colors) {
+  dev_size_t len, written;
+
+  if (this->devfd == INVALID_DEV_HANDLE)
+    return -1;
+
+  len = (dev_size_t)build_telegram(this, colors);
 
-#ifdef WIN32
   if (this->dmx) {
 	  if (!SetCommBreak(this->devfd)) {
 		char buf[128];
@@ -785,10 +1481,8 @@ static int serial_driver_output_colors(output_driver_t *this_gen, rgb_color_t *c
 	  if (QueryPerformanceCounter(&start_time))
 		  while (QueryPerformanceCounter(&time) && (time.QuadPart - start_time.QuadPart) < this->dmx_mark_duration.QuadPart);
   }
-#endif
 
-  len = (dev_size_t)(m - msg);
-  if (!WRITE_DATA(this->devfd, msg, len, written) || !FLUSH_BUFFER(this->devfd)) {
+  if (!WRITE_DATA(this->devfd, this->msg, len, written) || !FLUSH_BUFFER(this->devfd)) {
     char buf[128];
     GET_SYS_ERR_MSG(buf);
     snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "writing data to serial port failed: %s", buf);
@@ -797,20 +1491,38 @@ static int serial_driver_output_colors(output_driver_t *this_gen, rgb_color_t *c
 
   return 0;
 }
+#endif
 
 
-dfatmo_log_level_t dfatmo_log_level;
-dfatmo_log_t dfatmo_log;
-
-output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_log_t log_fn) {
-  serial_output_driver_t *d;
+static int serial_driver_output_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  serial_output_driver_t *this = (serial_output_driver_t *) this_gen;
+#ifdef ASYNC_OUTPUT
+  int rc = serial_driver_submit_colors(this_gen, colors, last_colors);
+  if (!rc) {
+    rc = serial_driver_poll_colors(this_gen, SYNC_OUTPUT_TIMEOUT);
+    if (rc > 0) {
+      strcpy(this->output_driver.errmsg, "writing data to serial port timed out");
+      rc = -1;
+    }
+  }
+  return rc;
+#else
+  serial_output_driver_t *port;
+  int port_num = 1;
 
-  if (dfatmo_log_level == NULL) {
-    dfatmo_log_level = log_level;
-    dfatmo_log = log_fn;
+  for (port = this; port != NULL; port = port->next_port, ++port_num) {
+    if (output_port(port, colors)) {
+      port_error(this, port, port_num);
+      return -1;
+    }
   }
+  return 0;
+#endif
+}
 
-  d = (serial_output_driver_t *) calloc(1, sizeof(serial_output_driver_t));
+
+static serial_output_driver_t *new_serial_driver(void) {
+  serial_output_driver_t *d = (serial_output_driver_t *) calloc(1, sizeof(serial_output_driver_t));
   if (d == NULL)
     return NULL;
 
@@ -820,7 +1532,31 @@ output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_l
   d->output_driver.close = serial_driver_close;
   d->output_driver.dispose = serial_driver_dispose;
   d->output_driver.output_colors = serial_driver_output_colors;
+#ifdef ASYNC_OUTPUT
+  d->output_driver.submit_colors = serial_driver_submit_colors;
+  d->output_driver.poll_colors = serial_driver_poll_colors;
+#else
+  d->output_driver.submit_colors = NULL;   // Output is done by worker thread of DFAtmo engine
+  d->output_driver.poll_colors = NULL;
+#endif
   d->devfd = INVALID_DEV_HANDLE;
+  return d;
+}
+
+
+dfatmo_log_level_t dfatmo_log_level;
+dfatmo_log_t dfatmo_log;
+
+output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_log_t log_fn) {
+  serial_output_driver_t *d;
+
+  if (dfatmo_log_level == NULL) {
+    dfatmo_log_level = log_level;
+    dfatmo_log = log_fn;
+  }
 
+  d = new_serial_driver();
+  if (d == NULL)
+    return NULL;
   return &d->output_driver;
 }
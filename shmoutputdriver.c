@@ -0,0 +1,249 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the DFAtmo native output driver that publishes the output colors into a POSIX shared memory segment.
+ *
+ * The layout of the segment is defined in "dfatmo_shm.h". Every output is written into the next slot of a
+ * ring protected by a sequence lock, so any number of readers could consume the colors in place while the
+ * writer never waits for them. Publishing a frame needs no system call.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "dfatmo.h"
+#include "dfatmo_shm.h"
+
+#define DEFAULT_SLOTS           4
+#define MAX_SLOTS               64
+#define ALIGN_SIZE(s)           (((s) + 63) & ~63)      /* Cache line alignment */
+
+typedef struct {
+  output_driver_t output_driver;
+  atmo_parameters_t param;
+  char name[128];
+  int num_slots;
+  size_t size;
+  dfatmo_shm_header_t *hdr;
+  int num_channels;
+} shm_output_driver_t;
+
+
+static uint64_t clock_ns(clockid_t id) {
+  struct timespec ts;
+  clock_gettime(id, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+
+  /* Writer side of sequence lock: Sequence number is odd while data is updated */
+static void write_begin(volatile uint32_t *seq) {
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+
+static void write_end(volatile uint32_t *seq) {
+  __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+
+static void publish_layout(shm_output_driver_t *this) {
+  dfatmo_shm_header_t *hdr = this->hdr;
+  const atmo_parameters_t *p = &this->param;
+
+  write_begin(&hdr->layout_seq);
+  hdr->areas[DFATMO_SHM_TOP] = p->top;
+  hdr->areas[DFATMO_SHM_BOTTOM] = p->bottom;
+  hdr->areas[DFATMO_SHM_LEFT] = p->left;
+  hdr->areas[DFATMO_SHM_RIGHT] = p->right;
+  hdr->areas[DFATMO_SHM_CENTER] = p->center;
+  hdr->areas[DFATMO_SHM_TOP_LEFT] = p->top_left;
+  hdr->areas[DFATMO_SHM_TOP_RIGHT] = p->top_right;
+  hdr->areas[DFATMO_SHM_BOTTOM_LEFT] = p->bottom_left;
+  hdr->areas[DFATMO_SHM_BOTTOM_RIGHT] = p->bottom_right;
+  hdr->num_channels = this->num_channels;
+  hdr->output_rate = p->output_rate;
+  write_end(&hdr->layout_seq);
+}
+
+
+static int num_channels(atmo_parameters_t *p) {
+  return p->top + p->bottom + p->left + p->right + p->center + p->top_left + p->top_right + p->bottom_left + p->bottom_right;
+}
+
+
+static int shm_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
+  shm_output_driver_t *this = (shm_output_driver_t *) this_gen;
+  char driver_param[SIZE_DRIVER_PARAM];
+  const size_t header_size = ALIGN_SIZE(sizeof(dfatmo_shm_header_t)), slot_size = ALIGN_SIZE(sizeof(dfatmo_shm_slot_t));
+  dfatmo_shm_header_t *hdr;
+  char *t, *tp;
+  int fd;
+
+  this->param = *p;
+  this->num_channels = num_channels(p);
+  strcpy(this->name, DFATMO_SHM_NAME);
+  this->num_slots = DEFAULT_SLOTS;
+
+  /* parse driver parameter */
+  strcpy(driver_param, p->driver_param);
+  t = strtok_r(driver_param, ";&", &tp);
+  while (t != NULL) {
+    if (!strncmp(t, "slots:", 6)) {
+      this->num_slots = atoi(t + 6);
+      if (this->num_slots < 2 || this->num_slots > MAX_SLOTS) {
+        snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "illegal number of slots '%s'", t + 6);
+        return -1;
+      }
+    } else
+      snprintf(this->name, sizeof(this->name), "%s%s", (*t == '/') ? "": "/", t);
+    t = strtok_r(NULL, ";&", &tp);
+  }
+
+  fd = shm_open(this->name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "opening shared memory '%.64s' failed: %s", this->name, strerror(errno));
+    return -1;
+  }
+  this->size = header_size + this->num_slots * slot_size;
+  if (ftruncate(fd, this->size)) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "resizing shared memory '%.64s' failed: %s", this->name, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  hdr = (dfatmo_shm_header_t *) mmap(NULL, this->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (hdr == MAP_FAILED) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "mapping shared memory '%.64s' failed: %s", this->name, strerror(errno));
+    return -1;
+  }
+
+    /* Readers of a previous session see a new ring, frames stay counting up */
+  this->hdr = hdr;
+  if (hdr->magic != DFATMO_SHM_MAGIC || hdr->version != DFATMO_SHM_VERSION || hdr->num_slots != (uint32_t)this->num_slots) {
+    memset(hdr, 0, this->size);
+    hdr->version = DFATMO_SHM_VERSION;
+    hdr->header_size = header_size;
+    hdr->slot_size = slot_size;
+    hdr->num_slots = this->num_slots;
+    __atomic_store_n(&hdr->magic, DFATMO_SHM_MAGIC, __ATOMIC_RELEASE);
+  }
+  hdr->writer_pid = getpid();
+  publish_layout(this);
+  __atomic_store_n(&hdr->active, 1, __ATOMIC_RELEASE);
+
+  DFATMO_LOG(DFLOG_INFO, "publishing %d channels to shared memory '%s' with %d slots", this->num_channels, this->name, this->num_slots);
+  return 0;
+}
+
+
+static int shm_driver_configure(output_driver_t *this_gen, atmo_parameters_t *p) {
+  shm_output_driver_t *this = (shm_output_driver_t *) this_gen;
+
+  this->param = *p;
+  this->num_channels = num_channels(p);
+  if (this->hdr != NULL)
+    publish_layout(this);
+  return 0;
+}
+
+
+static int shm_driver_close(output_driver_t *this_gen) {
+  shm_output_driver_t *this = (shm_output_driver_t *) this_gen;
+
+  if (this->hdr != NULL) {
+      /* Segment is kept so readers stay attached over a reopen */
+    __atomic_store_n(&this->hdr->active, 0, __ATOMIC_RELEASE);
+    munmap(this->hdr, this->size);
+    this->hdr = NULL;
+  }
+  return 0;
+}
+
+
+static void shm_driver_dispose(output_driver_t *this_gen) {
+  free(this_gen);
+}
+
+
+  /* Write colors into next slot of ring, readers are never waited for */
+static int shm_driver_output_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  shm_output_driver_t *this = (shm_output_driver_t *) this_gen;
+  dfatmo_shm_header_t *hdr = this->hdr;
+  uint64_t frame;
+  dfatmo_shm_slot_t *slot;
+
+  if (hdr == NULL)
+    return -1;
+
+  frame = hdr->frames + 1;
+  slot = dfatmo_shm_slot(hdr, frame);
+
+  write_begin(&slot->seq);
+  slot->num_channels = this->num_channels;
+  slot->frame = frame;
+  slot->monotonic_ns = clock_ns(CLOCK_MONOTONIC);
+  slot->realtime_ns = clock_ns(CLOCK_REALTIME);
+  memcpy(slot->colors, colors, this->num_channels * sizeof(rgb_color_t));
+  write_end(&slot->seq);
+  __atomic_store_n(&hdr->frames, frame, __ATOMIC_RELEASE);
+  return 0;
+}
+
+
+  /* Publishing is done when submitted */
+static int shm_driver_poll_colors(output_driver_t *this_gen, int timeout_ms) {
+  return 0;
+}
+
+
+dfatmo_log_level_t dfatmo_log_level;
+dfatmo_log_t dfatmo_log;
+
+output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_log_t log_fn) {
+  shm_output_driver_t *d;
+
+  if (dfatmo_log_level == NULL) {
+    dfatmo_log_level = log_level;
+    dfatmo_log = log_fn;
+  }
+
+  d = (shm_output_driver_t *) calloc(1, sizeof(shm_output_driver_t));
+  if (d == NULL)
+    return NULL;
+
+  d->output_driver.version = DFATMO_OUTPUT_DRIVER_VERSION;
+  d->output_driver.open = shm_driver_open;
+  d->output_driver.configure = shm_driver_configure;
+  d->output_driver.close = shm_driver_close;
+  d->output_driver.dispose = shm_driver_dispose;
+  d->output_driver.output_colors = shm_driver_output_colors;
+  d->output_driver.submit_colors = shm_driver_output_colors;
+  d->output_driver.poll_colors = shm_driver_poll_colors;
+  return &d->output_driver;
+}
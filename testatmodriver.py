@@ -68,7 +68,8 @@ outputColors = ad.filterAnalyzedColors(analyzedColors)
 
 filteredOutputColors = ad.filterOutputColors(outputColors)
 
-od.outputColors(filteredOutputColors)
+# returned views are overwritten by the next call, script drivers keep the colors and get a copy
+od.outputColors(filteredOutputColors if od == ad else bytearray(filteredOutputColors))
 
 ad.gamma = 25
 if ad != od:
@@ -76,7 +77,7 @@ if ad != od:
 ad.instantConfigure()
 
 filteredOutputColors = ad.filterOutputColors(outputColors)
-od.outputColors(filteredOutputColors)
+od.outputColors(filteredOutputColors if od == ad else bytearray(filteredOutputColors))
 
 od.turnLightsOff()
 od.closeOutputDriver()
@@ -0,0 +1,462 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * This is the DFAtmo native UDP output driver for network pixel controllers (E1.31 sACN and Art-Net).
+ *
+ * The RGB values of all channels in DFAtmo output order are mapped to consecutive DMX universes.
+ * Packets of all universes are prebuilt when the driver is opened or configured, for a frame only
+ * the DMX data and the sequence number are written and all packets are send with one system call.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <netdb.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "dfatmo.h"
+
+#define MAX_UNIVERSES           32
+#define MAX_SLOTS               512       /* DMX slots of an universe */
+#define DEFAULT_SLOTS           510       /* Default used slots of an universe: 170 RGB LEDs */
+
+#define E131_PORT               5568
+#define E131_HEADER_SIZE        126
+#define E131_DEFAULT_PRIORITY   100
+#define E131_MAX_PRIORITY       200
+
+#define ARTNET_PORT             6454
+#define ARTNET_HEADER_SIZE      18
+
+  /* sendmmsg() requires _GNU_SOURCE that selects the GNU variant of strerror_r() */
+#define GET_SYS_ERR_MSG(buf)    snprintf(buf, sizeof(buf), "%s", strerror(errno))
+
+enum { PROTO_E131, PROTO_ARTNET };
+
+typedef struct {
+  output_driver_t output_driver;
+  atmo_parameters_t param;
+  int proto;
+  int sock;
+  char host[128];               // Destination host or empty for E1.31 multicast and Art-Net broadcast
+  int port;
+  int first_universe;
+  int slots;                    // Used slots per universe
+  int priority;
+  uint8_t cid[16];              // E1.31 component identifier
+  int num_bytes;                // Number of color bytes of a frame
+  int num_universes;
+  int header_size;
+  int packet_size;              // Size of a packet buffer
+  uint8_t *packets;             // Prebuilt packets of all universes
+  struct sockaddr_in dest[MAX_UNIVERSES];
+  struct mmsghdr msgs[MAX_UNIVERSES];
+  struct mmsghdr send_msgs[MAX_UNIVERSES];      // Messages of universes send with current frame
+  struct iovec iov[MAX_UNIVERSES];
+  uint8_t sequence;
+  int resend;                   // Packets were dropped, send next frame complete
+  uint32_t frames;              // Statistics
+  uint32_t packets_send;
+  uint32_t packets_dropped;
+  uint32_t packets_skipped;
+} udp_output_driver_t;
+
+
+static void put16(uint8_t *p, int v) {
+  p[0] = (v >> 8) & 0xFF;
+  p[1] = v & 0xFF;
+}
+
+
+static void put32(uint8_t *p, uint32_t v) {
+  p[0] = v >> 24;
+  p[1] = (v >> 16) & 0xFF;
+  p[2] = (v >> 8) & 0xFF;
+  p[3] = v & 0xFF;
+}
+
+
+  /* Prebuild E1.31 data packet with root, framing and DMP layer, 'slots' DMX slots follow the header */
+static void build_e131_header(udp_output_driver_t *this, uint8_t *p, int universe, int slots) {
+  const int len = E131_HEADER_SIZE + slots;
+
+  memset(p, 0, E131_HEADER_SIZE);
+    /* Root layer */
+  put16(p, 0x0010);
+  memcpy(p + 4, "ASC-E1.17\0\0\0", 12);
+  put16(p + 16, 0x7000 | (len - 16));
+  put32(p + 18, 0x00000004);
+  memcpy(p + 22, this->cid, 16);
+    /* Framing layer */
+  put16(p + 38, 0x7000 | (len - 38));
+  put32(p + 40, 0x00000002);
+  strcpy((char *) p + 44, "DFAtmo");
+  p[108] = this->priority;
+  put16(p + 113, universe);
+    /* DMP layer */
+  put16(p + 115, 0x7000 | (len - 115));
+  p[117] = 0x02;
+  p[118] = 0xA1;
+  put16(p + 121, 0x0001);
+  put16(p + 123, slots + 1);
+}
+
+
+  /* Prebuild Art-Net ArtDmx packet, length of DMX data must be even */
+static void build_artnet_header(uint8_t *p, int universe, int slots) {
+  memset(p, 0, ARTNET_HEADER_SIZE);
+  memcpy(p, "Art-Net", 8);
+  p[8] = 0x00;      /* OpDmx, little endian */
+  p[9] = 0x50;
+  p[11] = 14;       /* Protocol version */
+  p[14] = universe & 0xFF;
+  p[15] = (universe >> 8) & 0x7F;
+  put16(p + 16, (slots + 1) & ~1);
+}
+
+
+static int num_channels(atmo_parameters_t *p) {
+  return p->top + p->bottom + p->left + p->right + p->center + p->top_left + p->top_right + p->bottom_left + p->bottom_right;
+}
+
+
+  /* Lookup destination address of universe */
+static int resolve_destination(udp_output_driver_t *this, struct sockaddr_in *addr, int universe) {
+  memset(addr, 0, sizeof(*addr));
+  addr->sin_family = AF_INET;
+  addr->sin_port = htons(this->port);
+  if (this->host[0]) {
+    struct addrinfo hints, *res;
+    int rc;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    rc = getaddrinfo(this->host, NULL, &hints, &res);
+    if (rc) {
+      snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "resolving host '%.64s' failed: %s", this->host, gai_strerror(rc));
+      return -1;
+    }
+    addr->sin_addr = ((struct sockaddr_in *) res->ai_addr)->sin_addr;
+    freeaddrinfo(res);
+  } else if (this->proto == PROTO_E131) {
+      /* Multicast address of universe */
+    addr->sin_addr.s_addr = htonl(0xEFFF0000 | (universe & 0xFFFF));
+  } else
+    addr->sin_addr.s_addr = htonl(INADDR_BROADCAST);
+  return 0;
+}
+
+
+  /* Prebuild packets and messages of all universes for actual channel layout */
+static int build_packets(udp_output_driver_t *this) {
+  int u;
+
+  this->num_bytes = num_channels(&this->param) * 3;
+  this->num_universes = (this->num_bytes + this->slots - 1) / this->slots;
+  if (this->num_universes > MAX_UNIVERSES) {
+    snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "%d channels need more than %d universes", this->num_bytes / 3, MAX_UNIVERSES);
+    return -1;
+  }
+
+  this->header_size = (this->proto == PROTO_E131) ? E131_HEADER_SIZE: ARTNET_HEADER_SIZE;
+  this->packet_size = this->header_size + MAX_SLOTS;
+  free(this->packets);
+  this->packets = (uint8_t *) calloc(MAX_UNIVERSES, this->packet_size);
+  if (this->packets == NULL) {
+    strcpy(this->output_driver.errmsg, "allocating packet buffers failed");
+    return -1;
+  }
+
+  memset(this->msgs, 0, sizeof(this->msgs));
+  for (u = 0; u < this->num_universes; ++u) {
+    const int universe = this->first_universe + u;
+    int slots = this->num_bytes - u * this->slots;
+    uint8_t *p = this->packets + u * this->packet_size;
+    if (slots > this->slots)
+      slots = this->slots;
+
+    if (u && this->host[0])
+      this->dest[u] = this->dest[0];
+    else if (resolve_destination(this, &this->dest[u], universe))
+      return -1;
+    if (this->proto == PROTO_E131) {
+      build_e131_header(this, p, universe, slots);
+      this->iov[u].iov_len = E131_HEADER_SIZE + slots;
+    } else {
+      build_artnet_header(p, universe, slots);
+      this->iov[u].iov_len = ARTNET_HEADER_SIZE + ((slots + 1) & ~1);
+    }
+    this->iov[u].iov_base = p;
+    this->msgs[u].msg_hdr.msg_name = &this->dest[u];
+    this->msgs[u].msg_hdr.msg_namelen = sizeof(this->dest[u]);
+    this->msgs[u].msg_hdr.msg_iov = &this->iov[u];
+    this->msgs[u].msg_hdr.msg_iovlen = 1;
+  }
+  return 0;
+}
+
+
+static int udp_driver_open(output_driver_t *this_gen, atmo_parameters_t *p) {
+  udp_output_driver_t *this = (udp_output_driver_t *) this_gen;
+  char driver_param[SIZE_DRIVER_PARAM];
+  char *t, *tp;
+  int universe = -1, on = 1, i, first = 1;
+  uint32_t seed;
+
+  this->param = *p;
+  this->proto = PROTO_E131;
+  this->host[0] = 0;
+  this->port = 0;
+  this->slots = DEFAULT_SLOTS;
+  this->priority = E131_DEFAULT_PRIORITY;
+  this->sequence = 0;
+  this->frames = this->packets_send = this->packets_dropped = this->packets_skipped = 0;
+  this->resend = 0;
+
+  /* parse driver parameter */
+  strcpy(driver_param, p->driver_param);
+  t = strtok_r(driver_param, ";&", &tp);
+  while (t != NULL) {
+    char *v = NULL;
+    if (!strncmp(t, "proto:", 6) || !strncmp(t, "universe:", 9) || !strncmp(t, "slots:", 6) || !strncmp(t, "priority:", 9))
+      v = strchr(t, ':');
+    if (v == NULL && (first || strchr(t, ':') == NULL)) {
+        /* Destination host, with port only as first option */
+      char *port = strchr(t, ':');
+      if (port != NULL) {
+        *port++ = 0;
+        this->port = atoi(port);
+        if (this->port < 1 || this->port > 65535 || strspn(port, "0123456789") != strlen(port)) {
+          snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "illegal port '%.32s'", port);
+          return -1;
+        }
+      }
+      snprintf(this->host, sizeof(this->host), "%s", t);
+    } else if (v == NULL) {
+      DFATMO_LOG(DFLOG_ERROR, "driver parameter '%s' ignored", t);
+    } else {
+      *v++ = 0;
+      if (!strcmp(t, "proto")) {
+        if (!strcmp(v, "e131"))
+          this->proto = PROTO_E131;
+        else if (!strcmp(v, "artnet"))
+          this->proto = PROTO_ARTNET;
+        else {
+          snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "protocol '%s' unknown", v);
+          return -1;
+        }
+      } else if (!strcmp(t, "universe")) {
+        universe = atoi(v);
+      } else if (!strcmp(t, "slots")) {
+        this->slots = atoi(v);
+        if (this->slots < 3 || this->slots > MAX_SLOTS) {
+          snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "illegal number of slots '%s'", v);
+          return -1;
+        }
+      } else if (!strcmp(t, "priority")) {
+        this->priority = atoi(v);
+        if (this->priority < 0 || this->priority > E131_MAX_PRIORITY) {
+          snprintf(this->output_driver.errmsg, sizeof(this->output_driver.errmsg), "illegal priority '%s'", v);
+          return -1;
+        }
+      }
+    }
+    first = 0;
+    t = strtok_r(NULL, ";&", &tp);
+  }
+
+  if (this->proto == PROTO_E131) {
+    this->first_universe = (universe < 0) ? 1: universe;
+    if (!this->port)
+      this->port = E131_PORT;
+  } else {
+    this->first_universe = (universe < 0) ? 0: universe;
+    if (!this->port)
+      this->port = ARTNET_PORT;
+  }
+
+    /* Component identifier should be unique for every source */
+  seed = (uint32_t)time(NULL) ^ ((uint32_t)getpid() << 16);
+  for (i = 0; i < 16; ++i) {
+    seed = seed * 1664525U + 1013904223U;
+    this->cid[i] = seed >> 24;
+  }
+
+  this->sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (this->sock < 0) {
+    GET_SYS_ERR_MSG(this->output_driver.errmsg);
+    return -1;
+  }
+  if (this->proto == PROTO_ARTNET && !this->host[0])
+    setsockopt(this->sock, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+
+  if (build_packets(this)) {
+    close(this->sock);
+    this->sock = -1;
+    return -1;
+  }
+  DFATMO_LOG(DFLOG_INFO, "%s output of %d channels to %d universes starting at %d", (this->proto == PROTO_E131) ? "E1.31": "Art-Net",
+               this->num_bytes / 3, this->num_universes, this->first_universe);
+  return 0;
+}
+
+
+static int udp_driver_configure(output_driver_t *this_gen, atmo_parameters_t *p) {
+  udp_output_driver_t *this = (udp_output_driver_t *) this_gen;
+
+  this->param = *p;
+  return build_packets(this);
+}
+
+
+static int udp_driver_close(output_driver_t *this_gen) {
+  udp_output_driver_t *this = (udp_output_driver_t *) this_gen;
+
+  if (this->sock >= 0) {
+    close(this->sock);
+    this->sock = -1;
+  }
+  DFATMO_LOG(DFLOG_INFO, "%u frames, %u packets send, %u packets dropped, %u unchanged packets skipped", this->frames, this->packets_send, this->packets_dropped, this->packets_skipped);
+  return 0;
+}
+
+
+static void udp_driver_dispose(output_driver_t *this_gen) {
+  udp_output_driver_t *this = (udp_output_driver_t *) this_gen;
+
+  free(this->packets);
+  free(this);
+}
+
+
+  /* Universe contains a changed channel */
+static int universe_changed(udp_output_driver_t *this, int u, const uint32_t *changed) {
+  int n = (u + 1) * this->slots, c;
+
+  if (n > this->num_bytes)
+    n = this->num_bytes;
+  for (c = u * this->slots / 3; c <= (n - 1) / 3; ++c) {
+    if (IS_CHANNEL_CHANGED(changed, c))
+      return 1;
+  }
+  return 0;
+}
+
+
+  /*
+   * Write colors and sequence number into the prebuilt packets and send all universes at once.
+   * With a changed mask only universes with changed channels are send.
+   */
+static int send_frame(udp_output_driver_t *this, rgb_color_t *colors, const uint32_t *changed) {
+  const uint8_t *src = (const uint8_t *) colors;
+  int u, num_msgs = 0, sent = 0;
+
+  if (this->sock < 0)
+    return -1;
+
+  if (this->resend)
+    changed = NULL;
+  this->resend = 0;
+  ++this->sequence;
+  for (u = 0; u < this->num_universes; ++u) {
+    uint8_t *p = this->packets + u * this->packet_size;
+    int n = this->num_bytes - u * this->slots;
+    if (changed != NULL && !universe_changed(this, u, changed))
+      continue;
+    if (n > this->slots)
+      n = this->slots;
+    memcpy(p + this->header_size, src + u * this->slots, n);
+    p[(this->proto == PROTO_E131) ? 111: 12] = this->sequence;
+    this->send_msgs[num_msgs++] = this->msgs[u];
+  }
+  this->packets_skipped += this->num_universes - num_msgs;
+
+  while (sent < num_msgs) {
+    int n = sendmmsg(this->sock, this->send_msgs + sent, num_msgs - sent, MSG_DONTWAIT);
+    if (n < 0) {
+      if (errno == EINTR)
+        continue;
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+          /* Socket buffer is full: drop rest of frame, next frame is send complete */
+        this->packets_dropped += num_msgs - sent;
+        this->resend = 1;
+        break;
+      }
+      GET_SYS_ERR_MSG(this->output_driver.errmsg);
+      return -1;
+    }
+    sent += n;
+  }
+  this->packets_send += sent;
+  ++this->frames;
+  return 0;
+}
+
+
+static int udp_driver_output_colors(output_driver_t *this_gen, rgb_color_t *colors, rgb_color_t *last_colors) {
+  return send_frame((udp_output_driver_t *) this_gen, colors, NULL);
+}
+
+
+static int udp_driver_submit_changed_colors(output_driver_t *this_gen, rgb_color_t *colors, const uint32_t *changed) {
+  return send_frame((udp_output_driver_t *) this_gen, colors, changed);
+}
+
+
+  /* Sending never blocks so there are no deferred colors */
+static int udp_driver_poll_colors(output_driver_t *this_gen, int timeout_ms) {
+  return 0;
+}
+
+
+dfatmo_log_level_t dfatmo_log_level;
+dfatmo_log_t dfatmo_log;
+
+output_driver_t* dfatmo_new_output_driver(dfatmo_log_level_t log_level, dfatmo_log_t log_fn) {
+  udp_output_driver_t *d;
+
+  if (dfatmo_log_level == NULL) {
+    dfatmo_log_level = log_level;
+    dfatmo_log = log_fn;
+  }
+
+  d = (udp_output_driver_t *) calloc(1, sizeof(udp_output_driver_t));
+  if (d == NULL)
+    return NULL;
+
+  d->sock = -1;
+  d->output_driver.version = DFATMO_OUTPUT_DRIVER_VERSION;
+  d->output_driver.open = udp_driver_open;
+  d->output_driver.configure = udp_driver_configure;
+  d->output_driver.close = udp_driver_close;
+  d->output_driver.dispose = udp_driver_dispose;
+  d->output_driver.output_colors = udp_driver_output_colors;
+  d->output_driver.submit_colors = udp_driver_output_colors;
+  d->output_driver.poll_colors = udp_driver_poll_colors;
+  d->output_driver.submit_changed_colors = udp_driver_submit_changed_colors;
+  return &d->output_driver;
+}
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2013 Andreas Auras <yak54@inkennet.de>
+ *
+ * This file is part of DFAtmo the driver for 'Atmolight' controllers for VDR, XBMC and xinelib based video players.
+ *
+ * DFAtmo is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * DFAtmo is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110, USA
+ *
+ * These are the declarations of the libusb-1.0 API subset that is implemented by the DF10CH controller emulation
+ * (df10chemu.c). The emulator driver is compiled against this header instead of the libusb headers, so it builds
+ * on any system without libusb.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/time.h>
+
+#define LIBUSB_CALL
+
+#define LIBUSB_ENDPOINT_IN              0x80
+#define LIBUSB_ENDPOINT_OUT             0x00
+#define LIBUSB_REQUEST_TYPE_VENDOR      (0x02 << 5)
+#define LIBUSB_RECIPIENT_DEVICE         0x00
+#define LIBUSB_CONTROL_SETUP_SIZE       8
+#define LIBUSB_TRANSFER_TYPE_CONTROL    0
+
+enum libusb_error {
+  LIBUSB_SUCCESS = 0,
+  LIBUSB_ERROR_IO = -1,
+  LIBUSB_ERROR_INVALID_PARAM = -2,
+  LIBUSB_ERROR_ACCESS = -3,
+  LIBUSB_ERROR_NO_DEVICE = -4,
+  LIBUSB_ERROR_NOT_FOUND = -5,
+  LIBUSB_ERROR_BUSY = -6,
+  LIBUSB_ERROR_TIMEOUT = -7,
+  LIBUSB_ERROR_OVERFLOW = -8,
+  LIBUSB_ERROR_PIPE = -9,
+  LIBUSB_ERROR_INTERRUPTED = -10,
+  LIBUSB_ERROR_NO_MEM = -11,
+  LIBUSB_ERROR_NOT_SUPPORTED = -12,
+  LIBUSB_ERROR_OTHER = -99
+};
+
+enum libusb_transfer_status {
+  LIBUSB_TRANSFER_COMPLETED,
+  LIBUSB_TRANSFER_ERROR,
+  LIBUSB_TRANSFER_TIMED_OUT,
+  LIBUSB_TRANSFER_CANCELLED,
+  LIBUSB_TRANSFER_STALL,
+  LIBUSB_TRANSFER_NO_DEVICE,
+  LIBUSB_TRANSFER_OVERFLOW
+};
+
+typedef struct libusb_context libusb_context;
+typedef struct libusb_device libusb_device;
+typedef struct libusb_device_handle libusb_device_handle;
+
+struct libusb_device_descriptor {
+  uint16_t idVendor;
+  uint16_t idProduct;
+  uint8_t iManufacturer;
+  uint8_t iProduct;
+  uint8_t iSerialNumber;
+};
+
+struct libusb_transfer;
+typedef void (*libusb_transfer_cb_fn)(struct libusb_transfer *transfer);
+
+struct libusb_transfer {
+  libusb_device_handle *dev_handle;
+  uint8_t flags;
+  unsigned char endpoint;
+  unsigned char type;
+  unsigned int timeout;
+  enum libusb_transfer_status status;
+  int length;
+  int actual_length;
+  libusb_transfer_cb_fn callback;
+  void *user_data;
+  unsigned char *buffer;
+};
+
+int libusb_init(libusb_context **ctx);
+void libusb_exit(libusb_context *ctx);
+ssize_t libusb_get_device_list(libusb_context *ctx, libusb_device ***list);
+void libusb_free_device_list(libusb_device **list, int unref_devices);
+uint8_t libusb_get_bus_number(libusb_device *dev);
+uint8_t libusb_get_device_address(libusb_device *dev);
+int libusb_get_port_numbers(libusb_device *dev, uint8_t *port_numbers, int port_numbers_len);
+int libusb_get_device_descriptor(libusb_device *dev, struct libusb_device_descriptor *desc);
+int libusb_open(libusb_device *dev, libusb_device_handle **dev_handle);
+void libusb_close(libusb_device_handle *dev_handle);
+int libusb_get_string_descriptor_ascii(libusb_device_handle *dev_handle, uint8_t desc_index, unsigned char *data, int length);
+int libusb_get_configuration(libusb_device_handle *dev_handle, int *config);
+int libusb_set_configuration(libusb_device_handle *dev_handle, int configuration);
+int libusb_claim_interface(libusb_device_handle *dev_handle, int interface_number);
+int libusb_release_interface(libusb_device_handle *dev_handle, int interface_number);
+int libusb_control_transfer(libusb_device_handle *dev_handle, uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex,
+                            unsigned char *data, uint16_t wLength, unsigned int timeout);
+struct libusb_transfer *libusb_alloc_transfer(int iso_packets);
+void libusb_free_transfer(struct libusb_transfer *transfer);
+int libusb_submit_transfer(struct libusb_transfer *transfer);
+int libusb_cancel_transfer(struct libusb_transfer *transfer);
+int libusb_handle_events_timeout(libusb_context *ctx, struct timeval *tv);
+
+
+static inline void libusb_fill_control_setup(unsigned char *buffer, uint8_t request_type, uint8_t bRequest, uint16_t wValue, uint16_t wIndex, uint16_t wLength) {
+  buffer[0] = request_type;
+  buffer[1] = bRequest;
+  buffer[2] = wValue & 0xFF;
+  buffer[3] = wValue >> 8;
+  buffer[4] = wIndex & 0xFF;
+  buffer[5] = wIndex >> 8;
+  buffer[6] = wLength & 0xFF;
+  buffer[7] = wLength >> 8;
+}
+
+
+static inline void libusb_fill_control_transfer(struct libusb_transfer *transfer, libusb_device_handle *dev_handle, unsigned char *buffer,
+                                                libusb_transfer_cb_fn callback, void *user_data, unsigned int timeout) {
+  transfer->dev_handle = dev_handle;
+  transfer->endpoint = 0;
+  transfer->type = LIBUSB_TRANSFER_TYPE_CONTROL;
+  transfer->timeout = timeout;
+  transfer->buffer = buffer;
+  if (buffer)
+    transfer->length = LIBUSB_CONTROL_SETUP_SIZE + (buffer[6] | (buffer[7] << 8));
+  transfer->user_data = user_data;
+  transfer->callback = callback;
+}
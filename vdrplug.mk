@@ -93,7 +93,7 @@ clean:
 libvdr-$(PLUGIN).so: $(OBJS)
 	$(CXX) $(CXXFLAGS) $(LDFLAGS) -shared $(OBJS) -o $@ -ldl -lm
 
-$(OBJS): dfatmo.h atmodriver.h
+$(OBJS): dfatmo.h dfatmo_thread.h dfatmo_timed.h atmodriver.h atmorecorder.h
 
 %.o: %.cpp
 	$(CXX) $(CXXFLAGS) -O3 -c $(DEFINES) $(INCLUDES) $<
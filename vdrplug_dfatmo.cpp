@@ -277,6 +277,9 @@ void cDFAtmoGrabThread::Action(void)
         break;
       }
 
+      record_frame(&ad->recorder, ad->active_parm.record_file, REC_FMT_XRGB32, (uint8_t *) req.img, req.width, req.height, (req.width * 4),
+                    0, 0, req.width, req.height);
+
       if (configure_analyze_size(ad, req.width, req.height))
       {
         free(req.img);
@@ -343,12 +346,12 @@ void cDFAtmoGrabThread::Action(void)
         /* calculate size of analyze (sub) window */
       int overscan = ad->active_parm.overscan;
       int analyzeWidth, analyzeHeight;
+      int cropWidth = 0, cropHeight = 0;
       if (overscan) {
-        int cropWidth = (grabWidth * overscan + 500) / 1000;
-        int cropHeight = (grabHeight * overscan + 500) / 1000;
+        cropWidth = (grabWidth * overscan + 500) / 1000;
+        cropHeight = (grabHeight * overscan + 500) / 1000;
         analyzeWidth = grabWidth - 2 * cropWidth;
         analyzeHeight = grabHeight - 2 * cropHeight;
-        img += (cropHeight * grabWidth + cropWidth) * 3;
       } else {
         analyzeWidth = grabWidth;
         analyzeHeight = grabHeight;
@@ -360,12 +363,17 @@ void cDFAtmoGrabThread::Action(void)
         break;
       }
 
+      record_frame(&ad->recorder, ad->active_parm.record_file, REC_FMT_RGB24, img, grabWidth, grabHeight, (grabWidth * 3),
+                    cropWidth, cropHeight, analyzeWidth, analyzeHeight);
+
       if (configure_analyze_size(ad, analyzeWidth, analyzeHeight))
       {
         free(grabImg);
         break;
       }
 
+      img += (cropHeight * grabWidth + cropWidth) * 3;
+
         // calculate HSV image
       hsv_color_t *hsv = ad->hsv_img;
       int pitch = grabWidth * 3;
@@ -405,6 +413,8 @@ void cDFAtmoGrabThread::Action(void)
     ++n;
   }
 
+  close_recorder(&ad->recorder);
+
   if (suspended)
     DFATMO_LOG(DFLOG_INFO, "grab thread terminated.");
   else
@@ -716,6 +726,7 @@ void cDFAtmoSetupMenu::SetAnalysisMenu(void)
   SetSubMenuSection(tr("Analysis"));
 
   AddParm("uniform_brightness");
+  AddParm("fine_colors");
   AddParm("analyze_size");
   AddParm("overscan");
   AddParm("edge_weighting");
@@ -744,6 +755,12 @@ void cDFAtmoSetupMenu::SetFiltersMenu(void)
   AddParm("start_delay");
   AddParm("filter_delay");
   AddParm("output_rate");
+  AddParm("output_keepalive");
+  AddParm("output_deadband");
+  if (plugin->SetupParm.output_deadband)
+    AddParm("output_deadband_mode");
+  AddParm("output_lead");
+  AddParm("output_dither");
 }
 
 void cDFAtmoSetupMenu::SetCalibrationMenu(void)
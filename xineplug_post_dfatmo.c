@@ -377,6 +377,9 @@ static void *atmo_grab_loop (void *this_gen) {
       frame->flags = XINE_GRAB_VIDEO_FRAME_FLAGS_CONTINUOUS | XINE_GRAB_VIDEO_FRAME_FLAGS_WAIT_NEXT;
       if (!(rc = frame->grab(frame))) {
         if (frame->width == analyze_width && frame->height == analyze_height) {
+          record_frame(&ad->recorder, ad->active_parm.record_file, REC_FMT_RGB24, frame->img, analyze_width, analyze_height, (analyze_width * 3),
+                        0, 0, analyze_width, analyze_height);
+
           if (configure_analyze_size(ad, analyze_width, analyze_height)) {
             pthread_mutex_lock(&this->lock);
             break;
@@ -442,6 +445,8 @@ static void *atmo_grab_loop (void *this_gen) {
   pthread_cond_broadcast(&this->thread_state_change);
   pthread_mutex_unlock(&this->lock);
 
+  close_recorder(&ad->recorder);
+
   if (port)
     _x_post_dec_usage(port);
 